@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <filesystem>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+#include "webgpu/webgpu_cpp.h"
+#include "dawn/platform/DawnPlatform.h"
+
+#include "core.hh"
+
+//
+// PipelineBlobCache:
+//
+
+namespace broccoli {
+  /// PipelineBlobCache is the Dawn platform through which Dawn persists compiled shaders and pipelines across runs, so
+  /// that warm starts skip Tint and backend compilation.
+  /// Blobs are stored one per file under 'cache/v<version>/<adapter>/', where the adapter directory is a hash of the
+  /// adapter's identity (see 'setAdapter'). Dawn's own keys already cover the shader source and pipeline state, and each
+  /// file repeats its key so that hash collisions read as misses.
+  /// Dawn may load and store from any thread.
+  class PipelineBlobCache final: public dawn::platform::Platform, private dawn::platform::CachingInterface {
+  public:
+    static constexpr uint32_t VERSION = 1;
+  private:
+    std::filesystem::path m_root_directory;
+    std::filesystem::path m_adapter_directory;
+    std::string m_isolation_key;
+    std::mutex m_store_mutex;
+    std::atomic<uint64_t> m_hit_count;
+    std::atomic<uint64_t> m_miss_count;
+    std::atomic<uint64_t> m_store_count;
+  public:
+    explicit PipelineBlobCache(std::filesystem::path root_directory);
+    PipelineBlobCache(PipelineBlobCache const &other) = delete;
+    ~PipelineBlobCache() override = default;
+  public:
+    void setAdapter(wgpu::Adapter const &adapter);
+    std::string const &isolationKey() const;
+  public:
+    uint64_t hitCount() const;
+    uint64_t missCount() const;
+    uint64_t storeCount() const;
+  public:
+    dawn::platform::CachingInterface *GetCachingInterface() override;
+  private:
+    size_t LoadData(const void *key, size_t key_size, void *value_out, size_t value_size) override;
+    void StoreData(const void *key, size_t key_size, const void *value, size_t value_size) override;
+  private:
+    std::filesystem::path blobPath(const void *key, size_t key_size) const;
+  };
+}
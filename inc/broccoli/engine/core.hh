@@ -101,14 +101,6 @@ namespace broccoli {
   }
 }
 
-//
-// String replacement:
-//
-
-namespace broccoli {
-  std::string replaceAll(const std::string &s, std::unordered_map<std::string, std::string> const &rw_map);
-}
-
 //
 // Hashing:
 //
@@ -5,12 +5,17 @@
 #include <utility>
 #include <functional>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "webgpu/webgpu_cpp.h"
 #include "GLFW/glfw3.h"
 
 #include "core.hh"
 #include "render.hh"
+#include "blob_cache.hh"
+#include "timeline.hh"
 
 struct GLFWwindow;
 
@@ -18,9 +23,13 @@ namespace broccoli {
   class Engine;
   class Glfw;
   class Activity;
+  struct RenderFramePacket;
+  class RenderSubmissionThread;
 }
 
 namespace broccoli {
+  /// Activities are updated on the main thread while the render thread still submits the previous frame (see
+  /// RenderSubmissionThread), so every resource a frame draws (such as a Geometry) must outlive the next call to 'draw'.
   class Activity {
   public:
     enum class StackAction { Push, Pop, Swap };
@@ -58,10 +67,52 @@ namespace broccoli {
   };
 }
 
+namespace broccoli {
+  /// A frame recorded by the main thread, with the swapchain view it draws into, handed off to the render thread. The
+  /// frame refers to the view, so packets are only ever handed off by pointer.
+  struct RenderFramePacket {
+    wgpu::TextureView target_texture_view = nullptr;
+    std::unique_ptr<RenderFrame> frame;
+  };
+}
+
+namespace broccoli {
+  /// RenderSubmissionThread encodes, submits and presents the frames recorded on the main thread, so that submitting
+  /// one frame overlaps with dispatching events and updating activities for the next.
+  /// Frames are handed off one at a time: the main thread waits for the previous frame to be submitted before it
+  /// records the next one, so the main thread runs at most one frame ahead of the render thread. The render thread
+  /// holds the RenderManager's submission lock while it submits and runs device callbacks, so activities that create
+  /// resources or change settings while updating wait for it (see RenderManager).
+  class RenderSubmissionThread {
+  private:
+    wgpu::Instance &m_wgpu_instance;
+    wgpu::SwapChain &m_wgpu_swapchain;
+    RenderManager &m_renderer;
+    std::mutex m_mutex;
+    std::condition_variable m_packet_cv;
+    std::condition_variable m_idle_cv;
+    std::unique_ptr<RenderFramePacket> m_packet;
+    bool m_is_submitting;
+    bool m_is_stopping;
+    std::thread m_thread;
+  public:
+    RenderSubmissionThread(wgpu::Instance &instance, wgpu::SwapChain &swapchain, RenderManager &renderer);
+    RenderSubmissionThread(RenderSubmissionThread const &other) = delete;
+    ~RenderSubmissionThread();
+  public:
+    void submit(std::unique_ptr<RenderFramePacket> packet);
+    void waitUntilIdle();
+  private:
+    void threadMain();
+  };
+}
+
 namespace broccoli {
 	class Engine {
 	private:
+    StartupTimeline m_startup_timeline;
 		Glfw m_glfw;
+    std::unique_ptr<PipelineBlobCache> m_pipeline_blob_cache;
     wgpu::Instance m_wgpu_instance;
     wgpu::Surface m_wgpu_surface;
     wgpu::Adapter m_wgpu_adapter;
@@ -76,6 +127,7 @@ namespace broccoli {
     double m_fixed_update_accum_time;
     double m_fixed_update_delta_sec;
     std::unique_ptr<RenderManager> m_renderer;
+    std::unique_ptr<RenderSubmissionThread> m_render_thread;
     bool m_is_running;
 	public:
     Engine(glm::ivec2 size, const char *caption, bool fullscreen = false, double fixed_update_hz = 120.0);
@@ -95,6 +147,7 @@ namespace broccoli {
   private:
     void beginFrame();
     void endFrame();
+    void reportStagingBelt();
     void dispatchEvents();
     void draw();
     void update();
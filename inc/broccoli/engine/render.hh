@@ -2,19 +2,30 @@
 
 #include <span>
 #include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <variant>
+#include <chrono>
 #include <cstdint>
 #include <cstddef>
 
 #include "webgpu/webgpu_cpp.h"
 #include "glm/vec3.hpp"
 #include "glm/vec4.hpp"
+#include "glm/mat3x3.hpp"
 #include "glm/mat4x4.hpp"
 #include "robin_hood.h"
 
 #include "core.hh"
 #include "bitmap.hh"
+#include "shader.hh"
+#include "timeline.hh"
+#include "render_graph.hh"
+#include "staging_belt.hh"
+#include "software_occlusion.hh"
 
 namespace broccoli {
   class Engine;
@@ -24,10 +35,22 @@ namespace broccoli {
   class RenderCamera;
   class RenderTexture;
   class RenderTextureView;
+  class RenderTextureAtlas;
+  class RenderTextureStreamer;
   class RenderManager;
+  struct RenderManagerSources;
   class RenderFrame;
   class OverlayRenderer;
   class Renderer;
+  class RenderShadowMaps;
+  class RenderVirtualShadowMap;
+  class RenderOcclusionCuller;
+}
+namespace broccoli {
+  template <uint32_t bind_group_count, uint32_t bind_group_prefix_count>
+  struct RenderPipeline;
+  template <uint32_t bind_group_count>
+  struct ComputePipeline;
 }
 namespace broccoli {
   class GeometryBuilder;
@@ -51,6 +74,9 @@ namespace broccoli {
 namespace broccoli {
   struct MaterialUniform;
   struct ShadowUniform;
+  struct VirtualShadowMapUniform;
+  struct OcclusionCullUniform;
+  struct OcclusionCullChunk;
 }
 
 //
@@ -61,6 +87,39 @@ namespace broccoli {
   struct ShadowUniform {
     glm::mat4x4 proj_view_matrix;
   };
+  struct VirtualShadowMapUniform {
+    glm::mat4x4 proj_view_matrix;
+    uint32_t page_table_size;
+    uint32_t page_size;
+    float depth_bias;
+    uint32_t is_enabled;
+  };
+  struct OcclusionCullUniform {
+    glm::mat4x4 view_matrix;
+    float camera_cot_half_fovy;
+    float camera_aspect_inv;
+    float camera_zmin;
+    float camera_zmax;
+    float camera_logarithmic_z_scale;
+    uint32_t hiz_mip_count;
+    glm::u32vec2 depth_size;
+    uint32_t is_hiz_valid;
+    uint32_t chunk_count;
+    uint32_t rsv00 = 0;
+    uint32_t rsv01 = 0;
+  };
+  struct OcclusionCullChunk {
+    glm::vec3 bounds_min;
+    uint32_t instance_offset;
+    glm::vec3 bounds_max;
+    uint32_t instance_count;
+    uint32_t index_count;
+    uint32_t rsv00 = 0;
+    uint32_t rsv01 = 0;
+    uint32_t rsv02 = 0;
+  };
+  static_assert(sizeof(OcclusionCullUniform) == 112, "expected sizeof(OcclusionCullUniform) == 112B");
+  static_assert(sizeof(OcclusionCullChunk) == 48, "expected sizeof(OcclusionCullChunk) == 48B");
 }
 
 //
@@ -74,6 +133,114 @@ namespace broccoli {
     Metadata_Count,
   };
 }
+namespace broccoli {
+  /// MaterialParameterSource selects where a material's parameters come from: constants stored in its uniform, or
+  /// textures. Each source specializes its own render pipeline so constant materials perform no texture fetches.
+  enum class MaterialParameterSource: uint32_t {
+    Constant,
+    Texture,
+    Metadata_Count,
+  };
+}
+namespace broccoli {
+  enum class ShadowTechnique: uint32_t {
+    CascadedShadowMap = 1,
+    VirtualShadowMap = 2,
+  };
+}
+namespace broccoli {
+  enum class ShadowMapRepresentation: uint32_t {
+    Depth = 1,
+    Moments = 2,
+  };
+}
+namespace broccoli {
+  enum class ShadowDepthFormat: uint32_t {
+    Depth32Float = 1,
+    Depth16Unorm = 2,
+  };
+}
+namespace broccoli {
+  /// ShadowSettings selects shadow quality at runtime: see RenderManager::setShadowSettings.
+  /// Light and cascade counts are limited by the capacities the shaders are compiled with; lights past the shadowed 
+  /// light count are lit without shadows. Only the first `1 << dir_light_cascade_count_lg2` cascade distances are used.
+  /// Depth16Unorm halves the memory of depth shadow maps, the virtual shadow map atlas, and the depth scratch buffer 
+  /// used to render moments, at the cost of depth precision (so more acne and peter-panning).
+  struct ShadowSettings {
+    static constexpr int32_t dir_light_cascade_capacity_lg2 = 2;
+    ShadowTechnique dir_light_technique = ShadowTechnique::VirtualShadowMap;
+    ShadowMapRepresentation dir_light_representation = ShadowMapRepresentation::Moments;
+    ShadowDepthFormat depth_format = ShadowDepthFormat::Depth32Float;
+    int32_t dir_light_shadow_count_lg2 = 2;
+    int32_t dir_light_cascade_count_lg2 = 2;
+    int32_t dir_light_cascade_map_resolution_lg2 = 9;
+    std::array<double, 1 << dir_light_cascade_capacity_lg2> dir_light_cascade_max_distances = {2.0, 16.0, 128.0, 1024.0};
+    double dir_light_shadow_radius = 1024.0;
+    int32_t point_light_shadow_count_lg2 = 4;
+    int32_t point_light_cascade_count_lg2 = 2;
+    int32_t point_light_cascade_map_resolution_lg2 = 10;
+    int32_t vsm_page_table_size_lg2 = 7;
+    int32_t vsm_page_size_lg2 = 7;
+    int32_t vsm_physical_page_count = 256;
+    double vsm_world_size = 1024.0;
+  };
+}
+namespace broccoli {
+  /// How edges in the scene are anti-aliased: see RenderManager::setAntiAliasingMode.
+  /// - 'Msaa4x' multisamples the scene's color and depth attachments, and resolves them before tonemapping.
+  /// - 'Fxaa' draws the scene at one sample per pixel, then smooths edges found in the tonemapped image with a single
+  ///   fullscreen pass, which is far cheaper in memory and bandwidth but softer and prone to crawling in motion.
+  /// - 'None' draws the scene at one sample per pixel and leaves it as it is.
+  enum class AntiAliasingMode {
+    None,
+    Msaa4x,
+    Fxaa,
+  };
+}
+namespace broccoli {
+  /// How the scene's lights are applied to its meshes: see RenderManager::setShadingPath.
+  /// - 'Forward' shades every fragment of every mesh as it is drawn, so overlapping meshes pay for lighting once each.
+  /// - 'Deferred' draws every mesh into a thin G-buffer holding only the material parameters lighting reads, then
+  ///   shades each covered pixel exactly once in a fullscreen pass, which pays off in scenes with many point lights
+  ///   and much overdraw. The scene is drawn at one sample per pixel: MSAA is not applied, but FXAA still is.
+  enum class ShadingPath {
+    Forward,
+    Deferred,
+  };
+}
+namespace broccoli {
+  enum class TonemapOperator: uint32_t {
+    NaughtyDog = 0,
+    Reinhard = 1,
+  };
+}
+namespace broccoli {
+  /// ToneMappingSettings control how the HDR scene is mapped to the display: see RenderManager::setToneMappingSettings.
+  /// Auto-exposure meters the log2 luminance of every covered pixel into a histogram whose range is given here, and 
+  /// eases towards its average at 'auto_exposure_adaptation_speed' (per second). The camera's exposure bias applies on
+  /// top of it either way.
+  struct ToneMappingSettings {
+    TonemapOperator tonemap_operator = TonemapOperator::NaughtyDog;
+    bool is_auto_exposure_enabled = true;
+    float auto_exposure_min_log2_luminance = -8.0f;
+    float auto_exposure_max_log2_luminance = 8.0f;
+    float auto_exposure_adaptation_speed = 1.5f;
+  };
+}
+namespace broccoli {
+  /// DynamicResolutionSettings control the fraction of the target's resolution the scene is drawn at: see 
+  /// RenderManager::setDynamicResolutionSettings.
+  /// While enabled, the render scale is adjusted between 'min_render_scale' and 'max_render_scale' so that the time the
+  /// GPU takes to draw each frame stays under 'frame_time_budget_ms'. While disabled, the scene is always drawn at 
+  /// 'max_render_scale'.
+  /// NOTE: GPU time is measured with timestamp queries. On devices without them, the scene stays at 'max_render_scale'.
+  struct DynamicResolutionSettings {
+    bool is_enabled = false;
+    double frame_time_budget_ms = 1000.0 / 60.0;
+    double min_render_scale = 0.5;
+    double max_render_scale = 1.0;
+  };
+}
 
 //
 // RenderManager, RenderFrame, Renderer
@@ -81,6 +248,42 @@ namespace broccoli {
 
 namespace broccoli {
   struct RenderTarget { wgpu::TextureView &texture_view; glm::ivec2 size; };
+  /// The views a frame's passes render into, as bound by the frame's RenderGraph: an HDR color attachment (resolved 
+  /// into the frame's HDR scene texture when multisampled), and a matching depth attachment, which is also bound to 
+  /// build the occlusion culling pyramid.
+  /// When deferred shading, meshes are drawn into the G-buffer textures instead, which are then shaded into the color
+  /// attachment.
+  struct RenderAttachments {
+    wgpu::TextureView color_texture_view;
+    wgpu::TextureView resolve_texture_view;
+    wgpu::TextureView depth_stencil_texture_view;
+    uint32_t sample_count;
+    ShadingPath shading_path;
+    std::array<wgpu::TextureView, 4> gbuffer_texture_views;
+  };
+  /// The copies of the uniforms rewritten by every frame, one per frame that may be in flight at once, so that the CPU
+  /// can prepare a frame while the GPU still reads the previous ones: see RenderManager::setMaxFramesInFlight.
+  /// Shadow map UBOs (see RenderShadowMaps and RenderVirtualShadowMap) are not part of a slot: each is only read by the
+  /// shadow passes recorded right after it is written, in the same submit, and those passes draw into shadow maps that
+  /// every frame shares anyway. Since the queue runs submits in order, a frame's write cannot overtake the previous
+  /// frame's shadow passes, and ringing the UBOs without also ringing the maps would only cost memory.
+  /// The other buffers rewritten by every frame are shared for the same reason: each is written on the queue (by
+  /// 'Queue::WriteBuffer', a staged copy or a compute pass), never through a mapping, and is read only by passes of the
+  /// same frame that are submitted after the write and before the next frame's write:
+  /// - the point light storage buffer and the cluster uniform: staged into the light cluster submit, then read by it and
+  ///   by shading,
+  /// - the cluster light list: written by the light cluster compute pass, then read by shading,
+  /// - the exposure and tonemap uniforms: written when their render graph passes are recorded, and read only by those,
+  /// - the deferred uniform: staged into the deferred lighting submit, and read only by it,
+  /// - the instance transform and material buffers: rewritten for each mesh batch, and read only by that batch's draws.
+  struct RenderFrameSlot {
+    wgpu::Buffer camera_uniform_buffer = nullptr;
+    wgpu::Buffer light_uniform_buffer = nullptr;
+    wgpu::Buffer cascade_uniform_buffer = nullptr;
+    wgpu::BindGroup light_cluster_bind_group = nullptr;
+    /// Receives the frame's begin and end GPU timestamps, if the device supports timestamp queries.
+    wgpu::Buffer timestamp_readback_buffer = nullptr;
+  };
 }
 namespace broccoli {
   class RenderCamera {
@@ -123,6 +326,7 @@ namespace broccoli {
 }
 namespace broccoli {
   class RenderTexture {
+    friend RenderTextureStreamer;
   private:
     wgpu::Texture m_texture;
     wgpu::TextureView m_view;
@@ -132,23 +336,55 @@ namespace broccoli {
     std::string m_wgpu_view_label;
     std::string m_wgpu_sampler_label;
     glm::i64vec3 m_dim;
+    uint32_t m_mip_level_count;
+    wgpu::AddressMode m_address_mode;
   private:
-    RenderTexture(wgpu::Device &device, std::string name, glm::i64vec3 dim, wgpu::FilterMode filter, bool is_depth);
+    RenderTexture(
+      wgpu::Device &device, 
+      std::string name, 
+      glm::i64vec3 dim, 
+      wgpu::FilterMode filter, 
+      bool is_depth, 
+      uint32_t mip_level_count,
+      wgpu::AddressMode address_mode,
+      wgpu::TextureUsage extra_usage
+    );
   public:
     RenderTexture(RenderTexture &&other) = default;
     ~RenderTexture() = default;
   private:
-    void create(wgpu::Device &device, glm::i64vec3 dim, wgpu::FilterMode filter, bool is_depth);
-    void upload(wgpu::Device &device, Bitmap const &bitmap);
+    void create(wgpu::Device &device, glm::i64vec3 dim, wgpu::FilterMode filter, bool is_depth, uint32_t mip_level_count, wgpu::AddressMode address_mode, wgpu::TextureUsage extra_usage);
+    void upload(wgpu::Device &device, Bitmap const &bitmap, uint32_t mip_level);
+    void generateMipmapsOnCpu(wgpu::Device &device, Bitmap const &base);
+    void generateMipmapsOnGpu(wgpu::Device &device, ComputePipeline<1> const &mipmap_pipeline);
+    static Bitmap downsample(Bitmap const &src);
   public:
+    static uint32_t fullMipLevelCount(glm::i64vec2 size);
     static RenderTexture createForDepth(wgpu::Device &device, std::string name, glm::i64vec3 dim, wgpu::FilterMode filter);
-    static RenderTexture createForColor(wgpu::Device &device, std::string name, glm::i64vec3 dim, wgpu::FilterMode filter);
-    static RenderTexture createForColorFromBitmap(wgpu::Device &device, std::string name, Bitmap bitmap, wgpu::FilterMode filter);
+    static RenderTexture createForColor(
+      wgpu::Device &device, 
+      std::string name, 
+      glm::i64vec3 dim, 
+      wgpu::FilterMode filter, 
+      uint32_t mip_level_count = 1,
+      wgpu::AddressMode address_mode = wgpu::AddressMode::ClampToEdge,
+      wgpu::TextureUsage extra_usage = wgpu::TextureUsage::None
+    );
+    static RenderTexture createForColorFromBitmap(
+      wgpu::Device &device, 
+      std::string name, 
+      Bitmap bitmap, 
+      wgpu::FilterMode filter,
+      ComputePipeline<1> const *mipmap_pipeline = nullptr,
+      wgpu::AddressMode address_mode = wgpu::AddressMode::ClampToEdge
+    );
   public:
     wgpu::Texture const &texture() const;
     wgpu::TextureView const &view() const;
     wgpu::Sampler const &sampler() const;
     glm::i64vec3 dim() const;
+    uint32_t mipLevelCount() const;
+    wgpu::AddressMode addressMode() const;
   };
   class RenderTextureView {
   private:
@@ -163,6 +399,90 @@ namespace broccoli {
     glm::dvec2 uv_size() const;
   };
 }
+namespace broccoli {
+  /// RenderTextureAtlas packs small textures of one channel count into shared pages using a skyline (bottom-left)
+  /// packer, so that materials whose maps share pages also share bind groups (and thus draws). Each packed texture is
+  /// surrounded by a gutter of replicated edge texels, and allocations are aligned to the gutter size, so that 
+  /// bilinear filtering (and the first few mip levels) never blend in a neighbour.
+  /// Only textures sampled with 'ClampToEdge' are packed, since a page's sampler cannot wrap within an allocation: the
+  /// final shader clamps atlased UVs instead, which the gutter makes equivalent.
+  class RenderTextureAtlas {
+  private:
+    struct Page { RenderTexture texture; std::vector<glm::i32vec3> skyline; };
+    struct Allocation { size_t page_index; glm::i32vec2 offset; glm::i32vec2 size; wgpu::Texture source; };
+  private:
+    std::string m_name;
+    int32_t m_channel_count;
+    std::deque<Page> m_pages;
+    robin_hood::unordered_map<WGPUTexture, Allocation> m_allocation_map;
+  public:
+    RenderTextureAtlas(std::string name, int32_t channel_count);
+  public:
+    std::optional<RenderTextureView> insert(wgpu::Device &device, RenderTexture const &texture, RenderPipeline<1, 0> const &blit_pipeline);
+    size_t pageCount() const;
+  private:
+    std::optional<Allocation> allocate(wgpu::Device &device, glm::i32vec2 size);
+    static std::optional<glm::i32vec2> allocateInPage(Page &page, glm::i32vec2 padded_size);
+    void blit(wgpu::Device &device, RenderTexture const &texture, Allocation const &allocation, RenderPipeline<1, 0> const &blit_pipeline);
+    RenderTextureView view(Allocation const &allocation) const;
+  };
+}
+namespace broccoli {
+  struct StreamedTexture {
+    size_t value;
+  };
+  /// TextureResidency reports how much of a streamed texture's mip chain is on the GPU: all mip levels from 
+  /// 'resident_mip_level' down to the coarsest, while the renderer would like 'requested_mip_level' to be resident.
+  struct TextureResidency {
+    uint32_t mip_level_count;
+    uint32_t resident_mip_level;
+    uint32_t requested_mip_level;
+    uint64_t resident_byte_count;
+  };
+}
+namespace broccoli {
+  /// RenderTextureStreamer keeps each streamed texture's full mip chain on the CPU, but only uploads the mip levels that 
+  /// are needed on-screen. Residency starts at the coarse tail of each chain, then rises one mip level per update 
+  /// toward the finest level requested by Renderer this frame. Whenever the resident total would exceed the GPU memory 
+  /// budget, the least recently requested textures are evicted back toward their tails first.
+  /// NOTE: WebGPU has no sparse textures, so each change in residency re-creates the texture with a different base size:
+  /// see RenderManager::updateTextureStreaming, which rebinds affected materials.
+  class RenderTextureStreamer {
+  private:
+    struct Entry {
+      std::string name;
+      std::vector<Bitmap> mip_chain;
+      wgpu::FilterMode filter;
+      std::optional<RenderTexture> texture;
+      uint32_t resident_mip_level;
+      uint32_t requested_mip_level;
+      uint64_t last_request_frame;
+    };
+  private:
+    std::vector<Entry> m_entries;
+    std::vector<wgpu::TextureView> m_retired_views;
+    uint64_t m_budget_byte_count;
+    uint64_t m_resident_byte_count;
+    uint64_t m_frame_index;
+  public:
+    RenderTextureStreamer(uint64_t budget_byte_count);
+  public:
+    StreamedTexture create(wgpu::Device &device, std::string name, Bitmap bitmap, wgpu::FilterMode filter);
+    void request(StreamedTexture texture, double screen_extent);
+    std::vector<StreamedTexture> update(wgpu::Device &device);
+    std::vector<wgpu::TextureView> takeRetiredViews();
+  public:
+    RenderTexture const &texture(StreamedTexture texture) const;
+    TextureResidency residency(StreamedTexture texture) const;
+    uint64_t budgetByteCount() const;
+    void setBudgetByteCount(uint64_t budget_byte_count);
+    uint64_t residentByteCount() const;
+  private:
+    void makeResident(wgpu::Device &device, Entry &entry, uint32_t mip_level);
+    static uint32_t tailMipLevel(Entry const &entry);
+    static uint64_t byteCount(Entry const &entry, uint32_t mip_level);
+  };
+}
 namespace broccoli {
   template <uint32_t bind_group_count, uint32_t bind_group_prefix_count>
   struct RenderPipeline {
@@ -186,7 +506,17 @@ namespace broccoli {
     inline void setBindGroups(wgpu::RenderPassEncoder& encoder, std::array<wgpu::BindGroup, BIND_GROUP_SUFFIX_COUNT> suffix) const requires IsPositiveU32<BIND_GROUP_SUFFIX_COUNT>;
     inline void setBindGroups(wgpu::RenderPassEncoder& encoder) const requires IsZeroU32<BIND_GROUP_SUFFIX_COUNT>;
   };
-  struct FinalRenderPipeline: public RenderPipeline<2, 1> {
+  /// A final render pipeline shades meshes directly into the scene's color attachment, while its G-buffer pipeline,
+  /// which shares its layout, writes their material parameters into the G-buffer instead: see ShadingPath.
+  /// Its prefix bind groups are those of the current frame slot, selected from 'frame_slot_bind_groups_prefix' when
+  /// each frame begins.
+  struct FinalRenderPipeline: public RenderPipeline<3, 2> {
+  public:
+    std::vector<std::array<wgpu::BindGroup, 2>> frame_slot_bind_groups_prefix;
+    wgpu::RenderPipeline gbuffer_pipeline = nullptr;
+    bool is_requested = false;
+  public:
+    inline wgpu::BindGroupLayout shadowBindGroupLayout() const;
     inline wgpu::BindGroupLayout materialBindGroupLayout() const;
   };
   struct ShadowRenderPipeline: public RenderPipeline<2, 1> {
@@ -196,119 +526,479 @@ namespace broccoli {
     inline wgpu::BindGroupLayout textureSelectBindGroupLayout() const;
   };
 }
+namespace broccoli {
+  template <uint32_t bind_group_count>
+  struct ComputePipeline {
+  public:
+    static constexpr const uint32_t BIND_GROUP_COUNT = bind_group_count;
+  public:
+    ComputePipeline() = default;
+  public:
+    std::array<wgpu::BindGroupLayout, bind_group_count> bind_group_layouts = {};
+    wgpu::PipelineLayout pipeline_layout = nullptr;
+    wgpu::ComputePipeline pipeline = nullptr;
+  };
+  struct ShadowBlurComputePipeline: public ComputePipeline<1> {
+    inline wgpu::BindGroupLayout textureBindGroupLayout() const;
+  };
+}
 namespace broccoli {
   class RenderShadowMaps {
   public:
     struct ShadowMapUbo { ShadowUniform state; wgpu::Buffer buffer; wgpu::BindGroup bind_group; };
+    struct BlurBindGroups { wgpu::BindGroup horizontal; wgpu::BindGroup vertical; };
   private:
     wgpu::Texture m_texture = nullptr;
+    wgpu::TextureView m_array_read_view = nullptr;
     std::vector<wgpu::TextureView> m_write_views = {};
     std::vector<wgpu::TextureView> m_read_views = {};
     std::vector<ShadowMapUbo> m_shadow_map_ubo_vec = {};
+    wgpu::Texture m_depth_scratch_texture = nullptr;
+    wgpu::TextureView m_depth_scratch_view = nullptr;
+    wgpu::Texture m_blur_scratch_texture = nullptr;
+    wgpu::TextureView m_blur_scratch_view = nullptr;
+    std::vector<BlurBindGroups> m_blur_bind_groups = {};
+    ShadowMapRepresentation m_representation = ShadowMapRepresentation::Depth;
+    wgpu::TextureFormat m_depth_format = wgpu::TextureFormat::Undefined;
     int32_t m_light_count_lg2 = 0;
     int32_t m_cascades_per_light_lg2 = 0;
     int32_t m_size_lg2 = 0;
   public:
     RenderShadowMaps() = default;
   public:
-    void init(wgpu::Device &dev, const ShadowRenderPipeline &pipeline, int32_t light_count_lg2, int32_t cascades_per_light_lg2, int32_t size_lg2, std::string name);
+    void init(
+      wgpu::Device &dev,
+      const ShadowRenderPipeline &pipeline,
+      const ShadowBlurComputePipeline &blur_pipeline,
+      ShadowMapRepresentation representation,
+      wgpu::TextureFormat depth_format,
+      int32_t light_count_lg2,
+      int32_t cascades_per_light_lg2,
+      int32_t size_lg2,
+      std::string name
+    );
   public:
     wgpu::Texture texture() const;
+    wgpu::TextureFormat format() const;
+    ShadowMapRepresentation representation() const;
+    int32_t sizeLg2() const;
+    int32_t lightCount() const;
+    int32_t cascadesPerLight() const;
+    const wgpu::TextureView &getArrayReadView() const;
     const wgpu::TextureView &getWriteView(int32_t light_idx, int32_t cascade_idx) const;
     const wgpu::TextureView &getReadView(int32_t light_idx, int32_t cascade_idx) const;
     const ShadowMapUbo &getShadowMapUbo(int32_t light_idx, int32_t cascade_idx) const;
+    const BlurBindGroups &getBlurBindGroups(int32_t light_idx, int32_t cascade_idx) const;
+    const wgpu::TextureView &getDepthScratchView() const;
+  };
+}
+namespace broccoli {
+  /// RenderVirtualShadowMap is a single, very high resolution shadow map for a directional light that is backed by a
+  /// small atlas of physical pages. A page table maps each virtual page to a physical page (or to nothing), and the final
+  /// pass writes the virtual pages its fragments need into a request buffer that is read back asynchronously. Only the
+  /// requested pages are ever rendered, and rendered pages stay cached across frames until the light moves, a caster
+  /// overlapping the page moves, appears or disappears, or the page is evicted (least-recently-used first).
+  class RenderVirtualShadowMap {
+  public:
+    /// The world-space bounding box of one shadow-casting instance. Casters are told apart by their bounds alone, so a
+    /// caster whose bounds match one from the last frame is assumed not to have moved.
+    struct CasterBounds { glm::vec3 bounds_min; glm::vec3 bounds_max; };
+  private:
+    struct PhysicalPage { glm::i64vec2 page_coord; uint64_t last_used_frame; bool is_resident; };
+    struct PageRequestReadback { wgpu::Buffer buffer; glm::i64vec2 origin_page_coord; bool is_pending; };
+  private:
+    wgpu::Texture m_atlas_texture = nullptr;
+    wgpu::TextureView m_atlas_read_view = nullptr;
+    wgpu::Sampler m_atlas_sampler = nullptr;
+    std::vector<wgpu::TextureView> m_page_write_views = {};
+    std::vector<RenderShadowMaps::ShadowMapUbo> m_page_ubo_vec = {};
+    wgpu::Buffer m_uniform_buffer = nullptr;
+    wgpu::Buffer m_page_table_buffer = nullptr;
+    wgpu::Buffer m_page_request_buffer = nullptr;
+    std::array<PageRequestReadback, 2> m_page_request_readbacks = {};
+    std::vector<PhysicalPage> m_physical_pages = {};
+    robin_hood::unordered_map<uint64_t, int32_t> m_resident_page_map = {};
+    std::vector<glm::i64vec2> m_received_page_requests = {};
+    std::vector<uint32_t> m_page_table = {};
+    std::vector<CasterBounds> m_caster_bounds = {};
+    glm::dmat3 m_light_view_matrix = glm::dmat3{0.0};
+    glm::i64vec2 m_origin_page_coord = glm::i64vec2{0};
+    int64_t m_origin_depth_coord = 0;
+    uint64_t m_frame_index = 0;
+    wgpu::TextureFormat m_depth_format = wgpu::TextureFormat::Undefined;
+    int32_t m_page_table_size_lg2 = 0;
+    int32_t m_page_size_lg2 = 0;
+    double m_world_size = 0.0;
+    double m_depth_radius = 0.0;
+    bool m_is_enabled = false;
+  public:
+    RenderVirtualShadowMap() = default;
+    RenderVirtualShadowMap(RenderVirtualShadowMap const &other) = delete;
+    RenderVirtualShadowMap &operator=(RenderVirtualShadowMap &&other) = default;
+    ~RenderVirtualShadowMap();
+  public:
+    void init(wgpu::Device &dev, const ShadowRenderPipeline &pipeline, wgpu::TextureFormat depth_format, int32_t page_table_size_lg2, int32_t page_size_lg2, int32_t physical_page_count, double world_size, double depth_radius, std::string name);
+    void cancelPageReadbacks();
+  public:
+    std::vector<int32_t> beginFrame(wgpu::CommandEncoder &encoder, RenderStagingBelt &staging_belt, glm::dmat3 light_view_matrix, glm::dvec3 camera_position, std::vector<CasterBounds> caster_bounds);
+    void disable(const wgpu::Queue &queue);
+    void requestPageReadback(const wgpu::Device &dev);
+  public:
+    bool isEnabled() const;
+    int32_t pageTableSize() const;
+    uint64_t pageTableByteCount() const;
+    int32_t pageSize() const;
+    const wgpu::TextureView &getPageWriteView(int32_t physical_page_idx) const;
+    const RenderShadowMaps::ShadowMapUbo &getPageUbo(int32_t physical_page_idx) const;
+    const wgpu::TextureView &atlasReadView() const;
+    const wgpu::Sampler &atlasSampler() const;
+    const wgpu::Buffer &uniformBuffer() const;
+    const wgpu::Buffer &pageTableBuffer() const;
+    const wgpu::Buffer &pageRequestBuffer() const;
+  private:
+    void invalidate();
+    void dirtyChangedCasterPages(std::vector<CasterBounds> caster_bounds, std::vector<int32_t> &dirty_pages);
+    int32_t allocatePhysicalPage(glm::i64vec2 page_coord);
+    glm::dmat4x4 computeViewMatrix() const;
+    glm::dmat4x4 computePageProjViewMatrix(glm::i64vec2 page_coord) const;
+    double pageWorldSize() const;
+    static uint64_t pageKey(glm::i64vec2 page_coord);
+  };
+  /// RenderOcclusionCuller culls instances on the GPU against a hierarchical-Z (Hi-Z) pyramid: a mip chain built from
+  /// the scene's depth buffer in which each texel holds the farthest depth it covers, so that any bounding box is tested
+  /// with at most 4 texel fetches. Instances are grouped into chunks that share a mesh, and visible instances are 
+  /// compacted and drawn with one indirect draw per chunk and phase, without any readback:
+  /// 1. Every instance is tested against last frame's pyramid, as seen from last frame's camera, and those that pass 
+  ///    are drawn.
+  /// 2. The pyramid is rebuilt from the depth drawn so far, and the instances rejected by the first phase are re-tested
+  ///    against it with this frame's camera. Those that pass were disoccluded since last frame, and are drawn too.
+  /// Since the second phase catches everything the stale pyramid hid, nothing pops in a frame late.
+  class RenderOcclusionCuller {
+  public:
+    static constexpr uint32_t PHASE_COUNT = 2;
+  private:
+    wgpu::Texture m_hiz_texture = nullptr;
+    wgpu::TextureView m_hiz_read_view = nullptr;
+    std::vector<wgpu::TextureView> m_hiz_mip_views = {};
+    std::vector<wgpu::BindGroup> m_hiz_downsample_bind_groups = {};
+    glm::ivec2 m_depth_size = glm::ivec2{0};
+    wgpu::Buffer m_chunk_buffer = nullptr;
+    wgpu::Buffer m_candidate_transform_buffer = nullptr;
+    wgpu::Buffer m_candidate_material_buffer = nullptr;
+    wgpu::Buffer m_visible_transform_buffer = nullptr;
+    wgpu::Buffer m_visible_material_buffer = nullptr;
+    wgpu::Buffer m_rejected_instance_buffer = nullptr;
+    wgpu::Buffer m_draw_args_buffer = nullptr;
+    std::array<wgpu::Buffer, PHASE_COUNT> m_uniform_buffers = {};
+    std::array<wgpu::BindGroup, PHASE_COUNT> m_cull_bind_groups = {};
+    std::vector<OcclusionCullChunk> m_chunks = {};
+    uint64_t m_instance_capacity = 0;
+    uint64_t m_chunk_capacity = 0;
+    OcclusionCullUniform m_frame_uniform = {};
+    OcclusionCullUniform m_hiz_uniform = {};
+    bool m_is_hiz_valid = false;
+  public:
+    RenderOcclusionCuller() = default;
+  public:
+    void init(wgpu::Device &dev);
+    void invalidate();
+  public:
+    void beginFrame(
+      const wgpu::Device &dev,
+      wgpu::CommandEncoder &encoder,
+      RenderStagingBelt &staging_belt,
+      const ComputePipeline<1> &cull_pipeline,
+      const ComputePipeline<1> &hiz_downsample_pipeline,
+      glm::ivec2 depth_size,
+      OcclusionCullUniform uniform,
+      std::vector<OcclusionCullChunk> chunks,
+      std::span<const glm::mat4x4> transforms,
+      std::span<const uint32_t> material_indices
+    );
+    void cull(wgpu::CommandEncoder &encoder, const ComputePipeline<1> &cull_pipeline, uint32_t phase) const;
+    void copyVisibleInstances(wgpu::CommandEncoder &encoder, size_t chunk_index, const wgpu::Buffer &transform_buffer, const wgpu::Buffer &material_buffer) const;
+    void buildPyramid(
+      const wgpu::Device &dev,
+      wgpu::CommandEncoder &encoder,
+      const ComputePipeline<1> &hiz_init_pipeline,
+      const ComputePipeline<1> &hiz_downsample_pipeline,
+      const wgpu::TextureView &depth_view
+    );
+  public:
+    size_t chunkCount() const;
+    const wgpu::Buffer &drawArgsBuffer() const;
+    uint64_t drawArgsOffset(size_t chunk_index, uint32_t phase) const;
+  private:
+    void reinitPyramid(const wgpu::Device &dev, const ComputePipeline<1> &hiz_downsample_pipeline, glm::ivec2 depth_size);
+    void reinitBuffers(const wgpu::Device &dev, uint64_t instance_count, uint64_t chunk_count);
+    void reinitCullBindGroups(const wgpu::Device &dev, const ComputePipeline<1> &cull_pipeline);
+    glm::ivec2 hizSize() const;
+    uint32_t hizMipLevelCount() const;
   };
 }
 
 namespace broccoli {
+  /// RenderManagerSources holds the CPU-only inputs to RenderManager initialization. Loading these needs no device, so
+  /// 'RenderManager::loadSources' can run on a worker thread while the device is being requested.
+  struct RenderManagerSources {
+    std::string final_shader_text;
+    std::string shadow_shader_text;
+    std::string shadow_blur_shader_text;
+    std::string light_cluster_shader_text;
+    std::string mipmap_shader_text;
+    std::string texture_atlas_shader_text;
+    std::string overlay_shader_text;
+    std::string tonemap_shader_text;
+    std::string exposure_shader_text;
+    std::string fxaa_shader_text;
+    std::string upscale_shader_text;
+    std::string hiz_shader_text;
+    std::string occlusion_cull_shader_text;
+    Bitmap placeholder_bitmap;
+  };
+}
+namespace broccoli {
+  /// Frames may be submitted on another thread than the one they are recorded on (see RenderFrame), while the
+  /// recording thread carries on with other work. The submitting thread holds the submission lock (see 
+  /// 'lockSubmission') while it submits a frame and runs device callbacks, and every public method that creates
+  /// resources or changes settings takes it too, so that such calls wait for the frame being submitted instead of
+  /// racing it.
+  /// The materials table is locked from when a Renderer is created until its frame's 'draw' returns, always on the
+  /// recording thread: materials cannot be created or modified while recording.
   class RenderManager {
+    friend MaterialTableEntry;
+    friend RenderFrame;
   private:
     wgpu::Device &m_wgpu_device;
-    wgpu::ShaderModule m_wgpu_pbr_shader_module = nullptr;
-    wgpu::ShaderModule m_wgpu_blinn_phong_shader_module = nullptr;
+    wgpu::ShaderModule m_wgpu_final_shader_module = nullptr;
     wgpu::ShaderModule m_wgpu_shadow_shader_module = nullptr;
-    wgpu::ShaderModule m_wgpu_overlay_monochrome_shader_module = nullptr;
-    wgpu::ShaderModule m_wgpu_overlay_rgba_shader_module = nullptr;
-    wgpu::Buffer m_wgpu_light_uniform_buffer = nullptr;
-    wgpu::Buffer m_wgpu_camera_uniform_buffer = nullptr;
+    wgpu::ShaderModule m_wgpu_shadow_blur_shader_module = nullptr;
+    wgpu::ShaderModule m_wgpu_light_cluster_shader_module = nullptr;
+    wgpu::ShaderModule m_wgpu_mipmap_shader_module = nullptr;
+    wgpu::ShaderModule m_wgpu_texture_atlas_shader_module = nullptr;
+    wgpu::ShaderModule m_wgpu_overlay_shader_module = nullptr;
+    wgpu::ShaderModule m_wgpu_tonemap_shader_module = nullptr;
+    wgpu::ShaderModule m_wgpu_exposure_shader_module = nullptr;
+    wgpu::ShaderModule m_wgpu_fxaa_shader_module = nullptr;
+    wgpu::ShaderModule m_wgpu_upscale_shader_module = nullptr;
+    wgpu::ShaderModule m_wgpu_hiz_shader_module = nullptr;
+    wgpu::ShaderModule m_wgpu_occlusion_cull_shader_module = nullptr;
+    std::vector<RenderFrameSlot> m_frame_slots;
     wgpu::Buffer m_wgpu_transform_uniform_buffer = nullptr;
+    wgpu::Buffer m_wgpu_instance_material_uniform_buffer = nullptr;
+    wgpu::Buffer m_wgpu_material_storage_buffer = nullptr;
+    wgpu::Buffer m_wgpu_cluster_uniform_buffer = nullptr;
+    wgpu::Buffer m_wgpu_point_light_storage_buffer = nullptr;
+    wgpu::Buffer m_wgpu_cluster_light_storage_buffer = nullptr;
     wgpu::Buffer m_wgpu_overlay_vertex_buffer = nullptr;
     wgpu::Buffer m_wgpu_overlay_uniform_buffer = nullptr;
+    wgpu::Buffer m_wgpu_tonemap_uniform_buffer = nullptr;
+    wgpu::Buffer m_wgpu_exposure_uniform_buffer = nullptr;
+    wgpu::Buffer m_wgpu_exposure_storage_buffer = nullptr;
+    wgpu::Buffer m_wgpu_luminance_histogram_storage_buffer = nullptr;
+    wgpu::Buffer m_wgpu_deferred_uniform_buffer = nullptr;
+    wgpu::QuerySet m_wgpu_timestamp_query_set = nullptr;
+    wgpu::Buffer m_wgpu_timestamp_resolve_buffer = nullptr;
     Bitmap m_final_overlay_bitmap;
     wgpu::Texture m_wgpu_final_overlay_texture = nullptr;
     wgpu::TextureView m_wgpu_final_overlay_texture_view = nullptr;
     wgpu::Sampler m_wgpu_final_overlay_sampler = nullptr;
     wgpu::BindGroup m_wgpu_final_overlay_bind_group_1 = nullptr;
-    FinalRenderPipeline m_wgpu_pbr_final_render_pipeline;
-    FinalRenderPipeline m_wgpu_blinn_phong_final_render_pipeline;
+    wgpu::Sampler m_wgpu_post_process_sampler = nullptr;
+    EnumMap<MaterialParameterSource, FinalRenderPipeline> m_wgpu_pbr_final_render_pipelines;
+    EnumMap<MaterialParameterSource, FinalRenderPipeline> m_wgpu_blinn_phong_final_render_pipelines;
+    RenderPipeline<3, 2> m_deferred_lighting_render_pipeline;
     ShadowRenderPipeline m_shadow_render_pipeline;
+    ShadowRenderPipeline m_shadow_moments_render_pipeline;
+    ShadowBlurComputePipeline m_shadow_blur_horizontal_compute_pipeline;
+    ShadowBlurComputePipeline m_shadow_blur_vertical_compute_pipeline;
+    ComputePipeline<1> m_light_cluster_compute_pipeline;
+    ComputePipeline<1> m_mipmap_compute_pipeline;
+    RenderPipeline<1, 0> m_texture_atlas_monochrome_render_pipeline;
+    RenderPipeline<1, 0> m_texture_atlas_rgba_render_pipeline;
     OverlayRenderPipeline m_overlay_monochrome_render_pipeline;
     OverlayRenderPipeline m_overlay_rgba_render_pipeline;
-    wgpu::Texture m_wgpu_render_target_color_texture = nullptr;
-    wgpu::TextureView m_wgpu_render_target_color_texture_view = nullptr;
-    wgpu::Texture m_wgpu_render_target_depth_stencil_texture = nullptr;
-    wgpu::TextureView m_wgpu_render_target_depth_stencil_texture_view = nullptr;
+    RenderPipeline<1, 0> m_tonemap_render_pipeline;
+    ComputePipeline<1> m_luminance_histogram_compute_pipeline;
+    ComputePipeline<1> m_exposure_average_compute_pipeline;
+    RenderPipeline<1, 0> m_fxaa_render_pipeline;
+    RenderPipeline<1, 0> m_upscale_render_pipeline;
+    ComputePipeline<1> m_hiz_init_compute_pipeline;
+    ComputePipeline<1> m_hiz_init_multisampled_compute_pipeline;
+    ComputePipeline<1> m_hiz_downsample_compute_pipeline;
+    std::array<ComputePipeline<1>, RenderOcclusionCuller::PHASE_COUNT> m_occlusion_cull_compute_pipelines;
+    RenderGraphTexturePool m_render_graph_texture_pool;
+    RenderStagingBelt m_staging_belt;
     EnumMap<LightType, RenderShadowMaps> m_light_shadow_maps;
-    RenderTexture m_rgb_palette;
-    RenderTexture m_monochrome_palette;
+    RenderVirtualShadowMap m_virtual_shadow_map;
+    RenderOcclusionCuller m_occlusion_culler;
+    std::unique_ptr<SoftwareOcclusionCuller> m_software_occlusion_culler;
+    ShadowSettings m_shadow_settings;
+    ToneMappingSettings m_tone_mapping_settings;
+    std::chrono::steady_clock::time_point m_exposure_timestamp;
+    AntiAliasingMode m_anti_aliasing_mode;
+    ShadingPath m_shading_path;
+    DynamicResolutionSettings m_dynamic_resolution_settings;
+    double m_render_scale;
+    double m_smoothed_frame_time_ms;
+    uint32_t m_render_scale_cooldown;
+    bool m_is_occlusion_culling_enabled;
+    bool m_is_software_occlusion_culling_enabled;
+    RenderTexture m_placeholder_texture;
+    RenderTextureAtlas m_rgba_texture_atlas;
+    RenderTextureAtlas m_monochrome_texture_atlas;
+    RenderTextureStreamer m_texture_streamer;
+    std::map<std::array<WGPUTextureView, 4>, wgpu::BindGroup> m_material_bind_group_map;
     std::vector<MaterialTableEntry> m_materials;
+    std::vector<uint8_t> m_material_uniform_data;
+    robin_hood::unordered_map<uint64_t, uint32_t> m_material_uniform_slot_map;
+    wgpu::BindGroup m_wgpu_constant_material_bind_group = nullptr;
     glm::ivec2 m_framebuffer_size;
     wgpu::Buffer m_wgpu_debug_takeout_buffer = nullptr;
+    std::mutex m_submission_mutex;
     bool m_materials_locked = false;
+    uint32_t m_pending_pipeline_count = 0;
+    uint32_t m_frame_slot_index = 0;
+    uint32_t m_frames_in_flight = 0;
+    uint32_t m_max_frames_in_flight;
+  public:
+    RenderManager(wgpu::Device &device, glm::ivec2 framebuffer_size, ShadowSettings shadow_settings = {});
+    RenderManager(
+      wgpu::Device &device, 
+      glm::ivec2 framebuffer_size, 
+      RenderManagerSources sources, 
+      StartupTimeline *startup_timeline, 
+      ShadowSettings shadow_settings = {}
+    );
   public:
-    RenderManager(wgpu::Device &device, glm::ivec2 framebuffer_size);
+    static RenderManagerSources loadSources(StartupTimeline *startup_timeline = nullptr);
   public:
     RenderManager(RenderManager const &other) = delete;
-    RenderManager(RenderManager &&other) = default;
-    ~RenderManager() = default;
-  private:
-    static Bitmap initMonochromePalette();
-    static Bitmap initRgbPalette();
-    void initFinalShaderModules();
-    void initShadowShaderModule();
-    void initOverlayShaderModules();
-    wgpu::ShaderModule initShaderModuleVariant(const char *filepath, const std::string &text, std::unordered_map<std::string, std::string> rw_map);
-    wgpu::ShaderModule initShaderModuleVariant(const char *filepath, const std::string &text);
+    RenderManager(RenderManager &&other) = delete;
+    ~RenderManager();
+  private:
+    static Bitmap initPlaceholderBitmap();
+    void initFinalShaderModule(const RenderManagerSources &sources);
+    void initShadowShaderModule(const RenderManagerSources &sources);
+    void initShadowBlurShaderModule(const RenderManagerSources &sources);
+    void initLightClusterShaderModule(const RenderManagerSources &sources);
+    void initMipmapShaderModule(const RenderManagerSources &sources);
+    void initTextureAtlasShaderModule(const RenderManagerSources &sources);
+    void initOverlayShaderModule(const RenderManagerSources &sources);
+    void initTonemapShaderModule(const RenderManagerSources &sources);
+    void initExposureShaderModule(const RenderManagerSources &sources);
+    void initFxaaShaderModule(const RenderManagerSources &sources);
+    void initUpscaleShaderModule(const RenderManagerSources &sources);
+    void initHizShaderModule(const RenderManagerSources &sources);
+    void initOcclusionCullShaderModule(const RenderManagerSources &sources);
+    wgpu::ShaderModule initShaderModule(const char *filepath, const std::string &shader_text);
+    void createRenderPipelineAsync(const wgpu::RenderPipelineDescriptor &descriptor, wgpu::RenderPipeline &out);
+    void createComputePipelineAsync(const wgpu::ComputePipelineDescriptor &descriptor, wgpu::ComputePipeline &out);
+    void waitForPendingPipelines();
+    void waitForFramesInFlight(uint32_t max_frames_in_flight);
+    void acquireFrameSlot();
+    void releaseFrameSlot();
+    void beginFrameTimer();
+    void endFrameTimer();
     void initBuffers();
-    FinalRenderPipeline helpInitFinalRenderPipeline(uint32_t lighting_model_id);
+    void helpInitFinalRenderPipeline(FinalRenderPipeline &out);
+    void requestFinalRenderPipeline(uint32_t lighting_model_id, MaterialParameterSource source);
+    EnumMap<MaterialParameterSource, FinalRenderPipeline> &finalRenderPipelines(uint32_t lighting_model_id);
+    const EnumMap<MaterialParameterSource, FinalRenderPipeline> &finalRenderPipelines(uint32_t lighting_model_id) const;
     void initFinalPbrRenderPipeline();
     void initFinalBlinnPhongRenderPipeline();
+    void initDeferredLightingRenderPipeline();
     void initShadowRenderPipeline();
-    OverlayRenderPipeline helpInitOverlayRenderPipeline(uint32_t overlay_texture_type);
+    void helpInitShadowRenderPipeline(const ShadowRenderPipeline &layout_source, ShadowMapRepresentation representation, wgpu::RenderPipeline &out);
+    void initShadowBlurComputePipeline();
+    void initLightClusterComputePipeline();
+    void initMipmapComputePipeline();
+    void helpInitTextureAtlasRenderPipeline(RenderPipeline<1, 0> &render_pipeline, wgpu::TextureFormat format);
+    void initTextureAtlasRenderPipeline();
+    void helpInitOverlayRenderPipeline(OverlayRenderPipeline &render_pipeline, uint32_t overlay_texture_type);
     void initOverlayRenderPipeline();
     void initOverlayElementRenderPipeline();
+    void initTonemapRenderPipeline();
+    void initExposureComputePipeline();
+    void initPostProcessSampler();
+    void initFxaaRenderPipeline();
+    void initUpscaleRenderPipeline();
+    void initHizComputePipeline();
+    void initOcclusionCullComputePipeline();
     void initShadowMaps();
     void initMaterialTable();
+    void initMaterialStorage();
   private:
     void resize(glm::i32vec2 framebuffer_size);
-    void reinitColorTexture(glm::ivec2 framebuffer_size);
-    void reinitDepthStencilTexture(glm::ivec2 framebuffer_size);
     void reinitOverlayTexture(glm::ivec2 framebuffer_size);
   private:
-    void lazyInitDebugTakeoutBuffer();
+    void addExposurePass(RenderGraph &graph, RenderGraphTexture scene_texture);
+    void addTonemapPass(RenderGraph &graph, RenderGraphTexture scene_texture, RenderGraphTexture target_texture, glm::dvec3 clear_color, float exposure_bias);
+    void addFxaaPass(RenderGraph &graph, RenderGraphTexture source_texture, RenderGraphTexture target_texture);
+    void addUpscalePass(RenderGraph &graph, RenderGraphTexture source_texture, RenderGraphTexture target_texture);
+    uint32_t sceneSampleCount() const;
+    glm::ivec2 sceneSize(glm::ivec2 target_size) const;
+    void recordFrameTime(double frame_time_ms);
+    void updateRenderScale();
+  private:
+    void lazyInitDebugTakeoutBuffer(uint64_t min_byte_count);
   private:
     Material emplaceMaterial(MaterialTableEntry material);
+    uint32_t acquireMaterialUniformSlot(const MaterialUniform &uniform);
+    wgpu::BindGroup acquireMaterialBindGroup(std::array<wgpu::TextureView, 4> views, std::array<wgpu::Sampler, 4> samplers);
+    RenderTextureView atlasTexture(RenderTexture const &texture);
   public:
     GeometryBuilder createGeometryBuilder();
     GeometryFactory createGeometryFactory();
+  public:
+    RenderTexture createTexture(std::string name, Bitmap bitmap, wgpu::FilterMode filter = wgpu::FilterMode::Linear, wgpu::AddressMode address_mode = wgpu::AddressMode::ClampToEdge);
+    StreamedTexture createStreamedTexture(std::string name, Bitmap bitmap, wgpu::FilterMode filter = wgpu::FilterMode::Linear);
+  public:
+    void updateTextureStreaming();
+    TextureResidency streamedTextureResidency(StreamedTexture texture) const;
+    const RenderTexture &streamedTexture(StreamedTexture texture) const;
+    RenderTextureStreamer &textureStreamer();
+    const RenderTextureStreamer &textureStreamer() const;
   public:
     Material createBlinnPhongMaterial(
       std::string name,
-      std::variant<glm::dvec3, RenderTexture> albedo_map, 
-      std::variant<glm::dvec3, RenderTexture> normal_map,
+      std::variant<glm::dvec3, RenderTexture, StreamedTexture> albedo_map, 
+      std::variant<glm::dvec3, RenderTexture, StreamedTexture> normal_map,
       double shininess
     );
     Material createPbrMaterial(
       std::string name,
-      std::variant<glm::dvec3, RenderTexture> albedo_map, 
-      std::variant<glm::dvec3, RenderTexture> normal_map,
-      std::variant<double, RenderTexture> metalness_map,
-      std::variant<double, RenderTexture> roughness_map,
+      std::variant<glm::dvec3, RenderTexture, StreamedTexture> albedo_map, 
+      std::variant<glm::dvec3, RenderTexture, StreamedTexture> normal_map,
+      std::variant<double, RenderTexture, StreamedTexture> metalness_map,
+      std::variant<double, RenderTexture, StreamedTexture> roughness_map,
       glm::dvec3 fresnel0
     );
   public:
     void lockMaterialsTable();
     void unlockMaterialsTable();
+    std::unique_lock<std::mutex> lockSubmission();
+  public:
+    void setMaterialShadowProxy(Material material, std::optional<Geometry> shadow_proxy);
+  public:
+    const ShadowSettings &shadowSettings() const;
+    void setShadowSettings(ShadowSettings shadow_settings);
+    const ToneMappingSettings &toneMappingSettings() const;
+    void setToneMappingSettings(ToneMappingSettings tone_mapping_settings);
+    AntiAliasingMode antiAliasingMode() const;
+    void setAntiAliasingMode(AntiAliasingMode anti_aliasing_mode);
+    ShadingPath shadingPath() const;
+    void setShadingPath(ShadingPath shading_path);
+    const DynamicResolutionSettings &dynamicResolutionSettings() const;
+    void setDynamicResolutionSettings(DynamicResolutionSettings dynamic_resolution_settings);
+    double renderScale() const;
+    bool isOcclusionCullingEnabled() const;
+    void setOcclusionCullingEnabled(bool is_enabled);
+    bool isSoftwareOcclusionCullingEnabled() const;
+    void setSoftwareOcclusionCullingEnabled(bool is_enabled);
+    uint32_t maxFramesInFlight() const;
+    void setMaxFramesInFlight(uint32_t max_frames_in_flight);
+    uint32_t framesInFlight() const;
   public:
     const MaterialTableEntry &getMaterialInfo(Material material) const;
   public:
@@ -317,30 +1007,58 @@ namespace broccoli {
     const wgpu::Buffer &wgpuLightUniformBuffer() const;
     const wgpu::Buffer &wgpuCameraUniformBuffer() const;
     const wgpu::Buffer &wgpuTransformUniformBuffer() const;
-    wgpu::ShaderModule wgpuFinalShaderModule(uint32_t lighting_model_id) const;
-    wgpu::ShaderModule wgpuOverlayShaderModule(uint32_t sample_mode_id) const;
-    const FinalRenderPipeline &getFinalRenderPipeline(uint32_t lighting_model_id) const;
-    const ShadowRenderPipeline &getShadowRenderPipeline() const;
+    const wgpu::Buffer &wgpuCascadeUniformBuffer() const;
+    const wgpu::Buffer &wgpuClusterUniformBuffer() const;
+    const wgpu::Buffer &wgpuPointLightStorageBuffer() const;
+    const wgpu::Buffer &wgpuInstanceMaterialUniformBuffer() const;
+    const wgpu::Buffer &wgpuDeferredUniformBuffer() const;
+    wgpu::BindGroup wgpuConstantMaterialBindGroup() const;
+    wgpu::ShaderModule wgpuFinalShaderModule() const;
+    wgpu::ShaderModule wgpuOverlayShaderModule() const;
+    const FinalRenderPipeline &getFinalRenderPipeline(uint32_t lighting_model_id, MaterialParameterSource source) const;
+    const RenderPipeline<3, 2> &getDeferredLightingRenderPipeline() const;
+    const ShadowRenderPipeline &getShadowRenderPipeline(ShadowMapRepresentation representation = ShadowMapRepresentation::Depth) const;
+    const ShadowBlurComputePipeline &getShadowBlurComputePipeline(bool is_vertical) const;
+    const ComputePipeline<1> &getLightClusterComputePipeline() const;
+    wgpu::BindGroup wgpuLightClusterBindGroup() const;
+    glm::u32vec3 lightClusterGridSize() const;
+    const ComputePipeline<1> &getMipmapComputePipeline() const;
     const OverlayRenderPipeline &getOverlayRenderPipeline(uint32_t sample_mode_id) const;
     const wgpu::Texture wgpuOverlayTexture() const;
     const wgpu::Buffer &wgpuOverlayUniformBuffer() const;
     const wgpu::Buffer &wgpuOverlayVertexBuffer() const;
     wgpu::BindGroup wgpuOverlayBindGroup1() const;
-    const wgpu::TextureView &wgpuRenderTargetColorTextureView() const;
-    const wgpu::TextureView &wgpuRenderTargetDepthStencilTextureView() const;
+    RenderGraphTexturePool &renderGraphTexturePool();
+    RenderStagingBelt &stagingBelt();
     RenderShadowMaps &getShadowMaps(LightType light_type);
     const RenderShadowMaps &getShadowMaps(LightType light_type) const;
-    const RenderTexture &rgbPalette() const;
-    const RenderTexture &monochromePalette() const;
+    RenderVirtualShadowMap &getVirtualShadowMap();
+    const RenderVirtualShadowMap &getVirtualShadowMap() const;
+    RenderOcclusionCuller &getOcclusionCuller();
+    SoftwareOcclusionCuller &getSoftwareOcclusionCuller();
+    const ComputePipeline<1> &getHizInitComputePipeline(uint32_t depth_sample_count) const;
+    const ComputePipeline<1> &getHizDownsampleComputePipeline() const;
+    const ComputePipeline<1> &getOcclusionCullComputePipeline(uint32_t phase) const;
+    ShadowTechnique dirLightShadowTechnique() const;
+    const RenderTexture &placeholderTexture() const;
     const std::vector<MaterialTableEntry> &materials() const;
   public:
     void debug_takeoutShadowMap(LightType light_type, int32_t light_index, int32_t cascade_index, std::function<void(FloatBitmap)> cb);
   public:
-    RenderFrame frame(RenderTarget target);
+    std::unique_ptr<RenderFrame> frame(RenderTarget target);
   };
 }
 
 namespace broccoli {
+  /// RenderFrame records one frame's passes into a RenderGraph, which is executed when the frame is destroyed. The
+  /// scene is drawn into transient HDR attachments, then tonemapped (and anti-aliased, for post-process modes) into the
+  /// frame's target, over which the overlay is drawn at the target's resolution.
+  /// When the scene is not multisampled, its color attachment is the scene texture itself. When the scene is drawn at a
+  /// reduced render scale, it is upscaled into the target after tonemapping, so the overlay stays at native resolution.
+  /// When deferred shading, the scene's meshes are first drawn into transient G-buffer textures: see ShadingPath.
+  /// Recording a frame (clear, draw, overlay) only gathers what it draws, and encodes nothing: everything is encoded
+  /// and submitted by 'submit', or else when the frame is destroyed. Once recorded, a frame may be submitted from
+  /// another thread holding the RenderManager's submission lock, as long as no other frame is recorded meanwhile.
   class RenderFrame {
     friend RenderManager;
   public:
@@ -354,14 +1072,34 @@ namespace broccoli {
     RenderTarget m_target;
     Bitmap &m_overlay_bitmap;
     uint32_t m_state;
+    RenderGraph m_graph;
+    AntiAliasingMode m_anti_aliasing_mode;
+    ShadingPath m_shading_path;
+    glm::ivec2 m_scene_size;
+    RenderGraphTexture m_target_texture;
+    RenderGraphTexture m_scene_texture;
+    RenderGraphTexture m_color_texture;
+    RenderGraphTexture m_depth_stencil_texture;
+    std::array<RenderGraphTexture, 4> m_gbuffer_textures;
+    glm::dvec3 m_clear_color;
+    float m_exposure_bias;
+    bool m_is_tonemapped;
+    bool m_is_submitted;
   public:
     RenderFrame(RenderManager &manager, RenderTarget target, Bitmap &bitmap);
+    RenderFrame(RenderFrame const &other) = delete;
+    ~RenderFrame();
   public:
     void clear(glm::dvec3 clear_color);
     void draw(RenderCamera camera, std::function<void(Renderer&)> draw_cb);
     void overlay(std::function<void(OverlayRenderer&)> draw_cb);
+    void submit();
   private:
-    void drawClear(glm::dvec3 cc);
+    void tonemap();
+    uint32_t sceneSampleCount() const;
+    bool isMultisampled() const;
+    std::optional<RenderGraphTexture> sceneResolveTarget() const;
+    RenderAttachments attachments() const;
   };
 }
 
@@ -370,13 +1108,13 @@ namespace broccoli {
     friend RenderFrame;
   private:
     RenderManager &m_manager;
-    RenderTarget &m_target;
     Bitmap &m_bitmap;
     std::vector<OverlayTextureDrawRequestInfo> m_texture_draw_requests;
     EnumMap<LightType, std::vector<WgpuShadowMapTextureOverlayResource>> m_shadow_map_view_resources;
   private:
-    OverlayRenderer(RenderManager &manager, RenderTarget &target, Bitmap &bitmap);
-    ~OverlayRenderer();
+    OverlayRenderer(RenderManager &manager, Bitmap &bitmap);
+  public:
+    OverlayRenderer(OverlayRenderer const &other) = delete;
   private:
     void initAllShadowMapViewResources();
   public:
@@ -385,20 +1123,33 @@ namespace broccoli {
   public:
     void drawShadowMapTexture(glm::i32vec2 vp_center, glm::i32vec2 vp_size, LightType light_type, int32_t light_idx, int32_t cascade_idx);
   private:
-    void drawOverlayBitmap() const;
-    void drawOverlayTextures() const;
-    void drawShadowMapOverlayTexture(glm::i32vec2 vp_center, glm::i32vec2 vp_size, LightType light_type, int32_t light_idx, int32_t cascade_idx) const;
-    void helpDrawOverlayTexture(glm::i32vec2 vp_center, glm::i32vec2 vp_size, uint32_t sample_mode_id, std::function<void(wgpu::RenderPassEncoder&, OverlayRenderPipeline const&)> cb) const;
+    void uploadOverlayBitmap() const;
+    void draw(wgpu::RenderPassEncoder &rp_encoder) const;
+    void drawOverlayBitmap(wgpu::RenderPassEncoder &rp_encoder) const;
+    void drawOverlayTextures(wgpu::RenderPassEncoder &rp_encoder) const;
+    void drawShadowMapOverlayTexture(wgpu::RenderPassEncoder &rp_encoder, glm::i32vec2 vp_center, glm::i32vec2 vp_size, LightType light_type, int32_t light_idx, int32_t cascade_idx) const;
+    void helpDrawOverlayTexture(wgpu::RenderPassEncoder &rp_encoder, glm::i32vec2 vp_center, glm::i32vec2 vp_size, uint32_t sample_mode_id, std::function<void(wgpu::RenderPassEncoder&, OverlayRenderPipeline const&)> cb) const;
   };
 }
 
 namespace broccoli {
   class Renderer {
     friend RenderFrame;
+  private:
+    /// Instances are batched by pipeline, material bind group and mesh: since material parameters are indexed per 
+    /// instance, every constant material sharing a lighting model and mesh is drawn with a single instanced draw.
+    struct MeshDrawBatch {
+      const FinalRenderPipeline *render_pipeline;
+      wgpu::BindGroup material_bind_group;
+      const Geometry *mesh;
+      std::vector<glm::mat4x4> transforms;
+      std::vector<uint32_t> material_indices;
+    };
   private:
     RenderManager &m_manager;
     RenderTarget m_target;
     RenderCamera m_camera;
+    RenderAttachments m_attachments;
     std::vector<std::vector<MeshInstanceList>> m_mesh_instance_lists;
     std::vector<DirectionalLight> m_directional_light_vec;
     std::vector<PointLight> m_point_light_vec;
@@ -407,29 +1158,44 @@ namespace broccoli {
   private:
     Renderer(RenderManager &manager, RenderTarget target, RenderCamera camera);
   public:
-    ~Renderer();
+    Renderer(Renderer const &other) = delete;
   public:
     void addMesh(Material material_id, const Geometry &geometry);
     void addMesh(Material material_id, const Geometry &geometry, glm::mat4x4 instance_transform);
     void addMesh(Material material_id, const Geometry &geometry, std::span<glm::mat4x4> instance_transforms);
     void addMesh(Material material_id, const Geometry &geometry, std::vector<glm::mat4x4> instance_transforms);
+    void addMesh(Material material_id, const Geometry &geometry, const Geometry &shadow_proxy, std::vector<glm::mat4x4> instance_transforms);
     void addDirectionalLight(glm::vec3 direction, float intensity, glm::vec3 color);
     void addPointLight(glm::vec3 position, float intensity, glm::vec3 color);
+    void addPointLight(glm::vec3 position, float intensity, glm::vec3 color, float range);
+    void requestTextureResolution(StreamedTexture texture, glm::vec3 world_center, float world_radius);
   private:
-    void sendCameraData(RenderCamera camera, RenderTarget target);
-    void sendLightData(std::vector<DirectionalLight> const &direction_light_vec, std::vector<PointLight> const &point_light_vec);
+    void render(RenderAttachments attachments);
+    void requestMaterialTextureResolution(Material material, std::span<const glm::mat4x4> transforms);
+    void sendCameraData(wgpu::CommandEncoder &command_encoder, RenderCamera camera, RenderTarget target);
+    void sendLightData(wgpu::CommandEncoder &command_encoder, RenderTarget target, std::vector<DirectionalLight> const &direction_light_vec, std::vector<PointLight> const &point_light_vec);
+    void buildLightClusters(wgpu::CommandEncoder &command_encoder);
     void drawShadowMaps(RenderCamera camera, RenderTarget target, std::vector<DirectionalLight> const &light_vec, const std::vector<std::vector<MeshInstanceList>> &mesh_instance_lists);
+    void drawCascadedShadowMaps(RenderCamera camera, RenderTarget target, std::vector<DirectionalLight> const &light_vec, const std::vector<std::vector<MeshInstanceList>> &mesh_instance_lists);
+    void drawVirtualShadowMap(RenderCamera camera, std::vector<DirectionalLight> const &light_vec, const std::vector<std::vector<MeshInstanceList>> &mesh_instance_lists);
     void drawShadowMap(glm::mat4x4 proj_view_matrix, const RenderShadowMaps &shadow_maps, int32_t light_idx, int32_t cascade_idx, const std::vector<std::vector<MeshInstanceList>> &mesh_instance_lists);
     void clearShadowMap(const RenderShadowMaps &shadow_maps, int32_t light_idx, int32_t cascade_idx);
+    void blurShadowMap(const RenderShadowMaps &shadow_maps, int32_t light_idx, int32_t cascade_idx);
+    void sendCascadeData(std::span<const glm::mat4x4> proj_view_matrices, bool is_enabled);
     void drawShadowMapMeshInstanceListVec(glm::mat4x4 proj_view_matrix, const RenderShadowMaps &shadow_maps, int32_t light_idx, int32_t cascade_idx, const std::vector<std::vector<MeshInstanceList>> &mesh_instance_list_vec);
     void drawShadowMapMeshInstanceList(glm::mat4x4 proj_view_matrix, const RenderShadowMaps &shadow_maps, int32_t light_idx, int32_t cascade_idx, const MeshInstanceList &mesh_instance_list);
     void drawMeshInstanceListVec(std::vector<std::vector<MeshInstanceList>> mesh_instance_list_vec);
-    void drawMeshInstanceList(Material material, const MeshInstanceList &mesh_instance_list);
+    void drawMeshBatch(const FinalRenderPipeline &render_pipeline, wgpu::BindGroup material_bind_group, const Geometry &mesh, std::span<const glm::mat4x4> transform_list, std::span<const uint32_t> material_index_list);
+    void drawOcclusionCulledMeshBatches(const std::vector<MeshDrawBatch> &batches);
+    void cullSoftwareOccludedMeshInstances(std::vector<std::vector<MeshInstanceList>> &mesh_instance_list_vec);
+    wgpu::RenderPassEncoder beginFinalRenderPass(wgpu::CommandEncoder &command_encoder) const;
+    const wgpu::RenderPipeline &meshRenderPipeline(const FinalRenderPipeline &render_pipeline) const;
+    void drawDeferredLighting();
 
   private:
     /// computeDirLightCascadeProjectionMatrix computes the orthographic projection matrix for drawing the cascaded 
     /// shadow map of this directional light at a specified cascade.
-    static glm::mat4x4 computeDirLightCascadeProjectionMatrix(RenderCamera camera, RenderTarget target, glm::dmat4x4 inv_light_transform, size_t cascade_index);
+    static glm::mat4x4 computeDirLightCascadeProjectionMatrix(const ShadowSettings &settings, RenderCamera camera, RenderTarget target, glm::dmat4x4 inv_light_transform, size_t cascade_index);
 
     /// computeFrustumSection returns a matrix where each column is a corner of a conic section of the view frustum.
     /// The order of each point in the column mimics traditional 2D coordinate systems, where 0 is top-right and we go
@@ -476,6 +1242,16 @@ namespace broccoli {
     wgpu::Buffer idx_buffer;
     uint32_t vtx_count;
     uint32_t idx_count;
+    /// The bounding box of every vertex, in model space: used to cull instances (see RenderOcclusionCuller).
+    glm::vec3 bounds_min = glm::vec3{0.0f};
+    glm::vec3 bounds_max = glm::vec3{0.0f};
+    std::shared_ptr<const Geometry> shadow_proxy = nullptr;
+    /// The triangles drawn on the CPU to hide other instances, if this geometry was built as an occluder (see 
+    /// SoftwareOcclusionCuller).
+    std::shared_ptr<const OccluderGeometry> occluder = nullptr;
+  public:
+    /// The geometry drawn into shadow maps in place of this one: the shadow proxy if present, else this geometry.
+    const Geometry &shadowGeometry() const;
   };
 }
 
@@ -489,6 +1265,7 @@ namespace broccoli {
     robin_hood::unordered_map<Vertex, uint32_t> m_vtx_compression_map;
     std::vector<Vertex> m_vtx_buf;
     std::vector<uint32_t> m_idx_buf;
+    bool m_is_occluder;
   private:
     GeometryBuilder(RenderManager &device);
   public:
@@ -498,8 +1275,16 @@ namespace broccoli {
   public:
     void triangle(Vtx v1, Vtx v2, Vtx v3, bool double_faced = false);
     void quad(Vtx v1, Vtx v2, Vtx v3, Vtx v4, bool double_faced = false);
+    /// Occluders keep a copy of their triangles on the CPU, which the SoftwareOcclusionCuller draws to hide the 
+    /// instances behind them: only large, simple, opaque geometry is worth flagging.
+    void setIsOccluder(bool is_occluder);
   public:
     static Geometry finish(GeometryBuilder &&mb);
+    static Geometry finishWithShadowProxy(GeometryBuilder &&mb, double proxy_cell_size);
+  private:
+    static Geometry upload(RenderManager &manager, std::span<const Vertex> vtx_buf, std::span<const uint32_t> idx_buf);
+    static std::shared_ptr<const OccluderGeometry> createOccluder(std::span<const Vertex> vtx_buf, std::span<const uint32_t> idx_buf);
+    static std::optional<Geometry> createDecimatedShadowProxy(RenderManager &manager, std::span<const Vertex> vtx_buf, std::span<const uint32_t> idx_buf, double cell_size);
   private:
     void singleFaceTriangle(Vtx v1, Vtx v2, Vtx v3);
   private:
@@ -525,7 +1310,7 @@ namespace broccoli {
   private:
     GeometryFactory(RenderManager &manager);
   public:
-    Geometry createCuboid(glm::dvec3 dimensions);
+    Geometry createCuboid(glm::dvec3 dimensions, bool is_occluder = false);
   };
 }
 
@@ -548,25 +1333,29 @@ namespace broccoli {
   class MaterialTableEntry {
   private:
     RenderManager &m_render_manager;
-    wgpu::Buffer m_wgpu_material_buffer;
     wgpu::BindGroup m_wgpu_material_bind_group;
+    uint32_t m_material_uniform_index;
     std::string m_name;
-    std::string m_wgpu_material_buffer_label;
-    std::string m_wgpu_material_bind_group_label;
     MaterialLightingModel m_lighting_model;
+    MaterialParameterSource m_parameter_source;
+    std::array<wgpu::TextureView, 4> m_texture_views;
+    std::array<wgpu::Sampler, 4> m_texture_samplers;
+    std::array<std::optional<StreamedTexture>, 4> m_streamed_textures;
     bool m_is_shadow_casting;
+    std::optional<Geometry> m_shadow_proxy;
   public:
     MaterialTableEntry(
       RenderManager &render_manager,
       std::string name,
-      std::variant<glm::dvec3, RenderTexture> albedo_map, 
-      std::variant<glm::dvec3, RenderTexture> normal_map,
-      std::variant<double, RenderTexture> metalness_map,
-      std::variant<double, RenderTexture> roughness_map,
+      std::variant<glm::dvec3, RenderTexture, StreamedTexture> albedo_map, 
+      std::variant<glm::dvec3, RenderTexture, StreamedTexture> normal_map,
+      std::variant<double, RenderTexture, StreamedTexture> metalness_map,
+      std::variant<double, RenderTexture, StreamedTexture> roughness_map,
       glm::dvec3 pbr_fresnel0,
       double blinn_phong_shininess,
       MaterialLightingModel lighting_model,
-      bool is_shadow_casting = true
+      bool is_shadow_casting = true,
+      std::optional<Geometry> shadow_proxy = std::nullopt
     );
     MaterialTableEntry(MaterialTableEntry const &other) = delete;
     MaterialTableEntry(MaterialTableEntry &&other) = default;
@@ -574,36 +1363,43 @@ namespace broccoli {
     virtual ~MaterialTableEntry() = default;
   private:
     void init(
-      std::variant<glm::dvec3, RenderTexture> const &albedo_map, 
-      std::variant<glm::dvec3, RenderTexture> const &normal_map,
-      std::variant<double, RenderTexture> const &metalness_map,
-      std::variant<double, RenderTexture> const &roughness_map,
+      std::variant<glm::dvec3, RenderTexture, StreamedTexture> const &albedo_map, 
+      std::variant<glm::dvec3, RenderTexture, StreamedTexture> const &normal_map,
+      std::variant<double, RenderTexture, StreamedTexture> const &metalness_map,
+      std::variant<double, RenderTexture, StreamedTexture> const &roughness_map,
       glm::dvec3 pbr_fresnel0,
       double blinn_phong_shininess,
       MaterialLightingModel lighting_model
     );
   public:
     uint32_t lightingModelID() const;
+    MaterialParameterSource parameterSource() const;
     const wgpu::BindGroup &wgpuMaterialBindGroup() const;
+    uint32_t materialUniformIndex() const;
     bool isShadowCasting() const;
+    const Geometry *shadowProxy() const;
+    void setShadowProxy(std::optional<Geometry> shadow_proxy);
+    const std::array<std::optional<StreamedTexture>, 4> &streamedTextures() const;
+    bool usesStreamedTexture(StreamedTexture texture) const;
+    void rebindStreamedTextures();
   private:
-    RenderTextureView getColorOrTexture(RenderManager &rm, std::variant<glm::dvec3, RenderTexture> const &map);
-    RenderTextureView getColorOrTexture(RenderManager &rm, std::variant<double, RenderTexture> const &map);
+    RenderTextureView getColorOrTexture(RenderManager &rm, std::variant<glm::dvec3, RenderTexture, StreamedTexture> const &map);
+    RenderTextureView getColorOrTexture(RenderManager &rm, std::variant<double, RenderTexture, StreamedTexture> const &map);
   public:
     static MaterialTableEntry createBlinnPhongMaterial(
       RenderManager &render_manager,
       std::string name,
-      std::variant<glm::dvec3, RenderTexture> albedo_map, 
-      std::variant<glm::dvec3, RenderTexture> normal_map,
+      std::variant<glm::dvec3, RenderTexture, StreamedTexture> albedo_map, 
+      std::variant<glm::dvec3, RenderTexture, StreamedTexture> normal_map,
       double shininess
     );
     static MaterialTableEntry createPbrMaterial(
       RenderManager &render_manager,
       std::string name,
-      std::variant<glm::dvec3, RenderTexture> albedo_map, 
-      std::variant<glm::dvec3, RenderTexture> normal_map,
-      std::variant<double, RenderTexture> metalness_map,
-      std::variant<double, RenderTexture> roughness_map,
+      std::variant<glm::dvec3, RenderTexture, StreamedTexture> albedo_map, 
+      std::variant<glm::dvec3, RenderTexture, StreamedTexture> normal_map,
+      std::variant<double, RenderTexture, StreamedTexture> metalness_map,
+      std::variant<double, RenderTexture, StreamedTexture> roughness_map,
       glm::dvec3 fresnel0
     );
   };
@@ -617,6 +1413,7 @@ namespace broccoli {
 namespace broccoli {
   struct MeshInstanceList {
     const Geometry &mesh;
+    const Geometry &shadow_mesh;
     std::vector<glm::mat4x4> instance_list;
   };
   struct DirectionalLight {
@@ -626,6 +1423,7 @@ namespace broccoli {
   struct PointLight {
     glm::vec3 position;
     glm::vec3 color;
+    float range;
   };
 }
 
@@ -653,9 +1451,15 @@ namespace broccoli {
   }
 }
 namespace broccoli {
-  inline wgpu::BindGroupLayout FinalRenderPipeline::materialBindGroupLayout() const {
+  inline wgpu::BindGroupLayout ShadowBlurComputePipeline::textureBindGroupLayout() const {
+    return this->bind_group_layouts[0];
+  }
+  inline wgpu::BindGroupLayout FinalRenderPipeline::shadowBindGroupLayout() const {
     return this->bind_group_layouts[1];
   }
+  inline wgpu::BindGroupLayout FinalRenderPipeline::materialBindGroupLayout() const {
+    return this->bind_group_layouts[2];
+  }
 }
 namespace broccoli {
   inline wgpu::BindGroupLayout ShadowRenderPipeline::shadowUniformBindGroupLayout() const {
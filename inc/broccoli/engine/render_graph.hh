@@ -0,0 +1,183 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include "webgpu/webgpu_cpp.h"
+#include "glm/vec2.hpp"
+
+#include "core.hh"
+
+namespace broccoli {
+  class RenderGraph;
+  class RenderGraphTexturePool;
+}
+
+//
+// RenderGraph resources:
+//
+
+namespace broccoli {
+  /// A handle to a texture declared in one frame's RenderGraph.
+  struct RenderGraphTexture {
+    uint32_t value;
+  };
+  struct RenderGraphTextureInfo {
+    glm::ivec2 size;
+    wgpu::TextureFormat format;
+    wgpu::TextureUsage usage;
+    uint32_t sample_count = 1;
+  };
+  bool operator==(const RenderGraphTextureInfo &lt, const RenderGraphTextureInfo &rt);
+}
+
+//
+// RenderGraph passes:
+//
+
+namespace broccoli {
+  struct RenderGraphColorAttachment {
+    RenderGraphTexture texture;
+    std::optional<RenderGraphTexture> resolve_target = {};
+    wgpu::LoadOp load_op = wgpu::LoadOp::Load;
+    wgpu::Color clear_value = {};
+  };
+  struct RenderGraphDepthStencilAttachment {
+    RenderGraphTexture texture;
+    wgpu::LoadOp load_op = wgpu::LoadOp::Load;
+    float clear_value = 1.0f;
+  };
+  /// Every resource a pass touches must be declared, since culling, merging and aliasing are all derived from these
+  /// declarations. Attachments are declared implicitly: as a write, and as a read unless they are cleared.
+  struct RenderGraphPassInfo {
+    std::string name;
+    std::vector<RenderGraphTexture> reads = {};
+    std::vector<RenderGraphTexture> writes = {};
+    std::optional<RenderGraphColorAttachment> color_attachment = {};
+    std::optional<RenderGraphDepthStencilAttachment> depth_stencil_attachment = {};
+    bool has_side_effects = false;
+  };
+  enum class RenderGraphPassType {
+    /// Recorded into a render pass that the graph begins from the pass' attachments, possibly shared with adjacent
+    /// raster passes.
+    Raster,
+    /// Recorded directly into the graph's command encoder, e.g. for compute passes or copies.
+    Encoder,
+    /// Encodes and submits its own commands. The graph submits everything recorded before it first, so that queue
+    /// order still matches pass order.
+    External,
+  };
+}
+
+//
+// RenderGraphTexturePool:
+//
+
+namespace broccoli {
+  /// RenderGraphTexturePool owns the physical textures behind every RenderGraph's transient textures, and outlives the
+  /// graphs themselves so that steady-state frames allocate nothing.
+  /// A texture that goes unused for 'MAX_IDLE_FRAMES' frames is destroyed, so the pool only ever holds what recent
+  /// frames needed at their peak: e.g. textures left behind by a resize, or by a pass that is no longer added, are
+  /// released shortly after.
+  class RenderGraphTexturePool {
+  public:
+    static constexpr uint64_t MAX_IDLE_FRAMES = 2;
+  private:
+    struct Entry {
+      RenderGraphTextureInfo info;
+      wgpu::Texture texture;
+      wgpu::TextureView texture_view;
+      uint64_t last_used_frame;
+      bool is_acquired;
+    };
+  private:
+    wgpu::Device m_device;
+    std::vector<Entry> m_entries;
+    uint64_t m_frame_index;
+  public:
+    explicit RenderGraphTexturePool(wgpu::Device device);
+    RenderGraphTexturePool(RenderGraphTexturePool const &other) = delete;
+  public:
+    void beginFrame();
+    size_t acquire(const RenderGraphTextureInfo &info);
+    void release(size_t entry_index);
+  public:
+    const wgpu::Texture &texture(size_t entry_index) const;
+    const wgpu::TextureView &textureView(size_t entry_index) const;
+    size_t size() const;
+  };
+}
+
+//
+// RenderGraph:
+//
+
+namespace broccoli {
+  /// RenderGraph collects one frame's passes along with the textures they read and write, then executes them in
+  /// declaration order.
+  /// Before executing, the graph:
+  /// - culls every pass that contributes to no imported texture (passes marked 'has_side_effects' are always kept),
+  /// - merges adjacent raster passes that share attachments and only load them into a single render pass, and
+  /// - binds each transient texture to a pooled texture only between its first and last use, so that transients whose
+  ///   lifetimes do not overlap alias the same memory.
+  /// Transient attachments whose contents are never read after their last render pass are not stored at all.
+  class RenderGraph {
+  public:
+    using RasterCallback = std::function<void(wgpu::RenderPassEncoder&, const RenderGraph&)>;
+    using EncoderCallback = std::function<void(wgpu::CommandEncoder&, const RenderGraph&)>;
+    using ExternalCallback = std::function<void(const RenderGraph&)>;
+  private:
+    static constexpr size_t NO_POOL_ENTRY = SIZE_MAX;
+    struct Texture {
+      std::string name;
+      RenderGraphTextureInfo info;
+      bool is_imported;
+      wgpu::TextureView imported_texture_view;
+      size_t pool_entry;
+    };
+    struct Pass {
+      RenderGraphPassType type;
+      RenderGraphPassInfo info;
+      RasterCallback raster_cb;
+      EncoderCallback encoder_cb;
+      ExternalCallback external_cb;
+    };
+    struct PassGroup {
+      RenderGraphPassType type;
+      std::vector<size_t> pass_indices;
+    };
+  private:
+    wgpu::Device m_device;
+    RenderGraphTexturePool &m_pool;
+    std::vector<Texture> m_textures;
+    std::vector<Pass> m_passes;
+    bool m_is_executed;
+  public:
+    RenderGraph(wgpu::Device device, RenderGraphTexturePool &pool);
+    RenderGraph(RenderGraph const &other) = delete;
+  public:
+    RenderGraphTexture importTexture(std::string name, wgpu::TextureView texture_view, glm::ivec2 size);
+    RenderGraphTexture createTexture(std::string name, RenderGraphTextureInfo info);
+    void addRasterPass(RenderGraphPassInfo info, RasterCallback cb);
+    void addEncoderPass(RenderGraphPassInfo info, EncoderCallback cb);
+    void addExternalPass(RenderGraphPassInfo info, ExternalCallback cb);
+  public:
+    void execute();
+  public:
+    /// Only valid while the pass using 'texture' is being recorded.
+    const wgpu::TextureView &textureView(RenderGraphTexture texture) const;
+    /// Only valid while the pass using 'texture' is being recorded. Imported textures have no texture.
+    wgpu::Texture texture(RenderGraphTexture texture) const;
+    glm::ivec2 textureSize(RenderGraphTexture texture) const;
+  private:
+    void addPass(RenderGraphPassType type, RenderGraphPassInfo info, RasterCallback raster_cb, EncoderCallback encoder_cb, ExternalCallback external_cb);
+    std::vector<size_t> cullPasses() const;
+    std::vector<PassGroup> mergePasses(const std::vector<size_t> &live_pass_indices) const;
+    void beginRenderPass(wgpu::CommandEncoder &encoder, const PassGroup &group, const std::vector<uint32_t> &last_use_group, size_t group_index, wgpu::RenderPassEncoder &out) const;
+    static bool canMergeRasterPasses(const Pass &prev, const Pass &next);
+  };
+}
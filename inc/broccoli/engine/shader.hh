@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <cstdint>
+
+#include "core.hh"
+
+//
+// ShaderPreprocessor:
+//
+
+namespace broccoli {
+  /// ShaderPreprocessor expands C-like directives in WGSL source in a single pass over its lines:
+  /// - '#include "path"' pastes a file in place, resolved relative to the including file. Each file is included at most
+  ///   once per shader, since WGSL rejects duplicate declarations.
+  /// - '#define NAME value' and '#undef NAME' manage object-like macros. Every identifier token of an active line that
+  ///   names a macro is replaced by its value: the defines passed to 'preprocess' are predefined macros.
+  /// - '#if', '#ifdef', '#ifndef', '#elif', '#else' and '#endif' select lines. '#if' takes integer expressions over
+  ///   literals, macros and 'defined(NAME)', with C operators and precedence.
+  /// Directive lines and skipped lines are kept as blank lines, so that line numbers in compilation errors match the
+  /// source until the first '#include'.
+  /// Results are not cached: every shader variant is preprocessed exactly once, when RenderManager loads its sources.
+  class ShaderPreprocessor {
+  public:
+    using Defines = std::unordered_map<std::string, std::string>;
+  private:
+    struct Condition { bool is_active; bool was_taken; bool is_parent_active; };
+    struct State { Defines defines; std::unordered_set<std::string> included_paths; std::vector<Condition> conditions; };
+  public:
+    ShaderPreprocessor() = default;
+  public:
+    std::string preprocess(const char *filepath, const std::string &text, const Defines &defines) const;
+  private:
+    static void expand(State &state, const std::string &filepath, std::string_view text, std::string &output);
+    static void expandDirective(State &state, const std::string &filepath, std::string_view directive, std::string &output);
+    static void expandLine(const State &state, std::string_view line, std::string &output);
+    static int64_t evaluateCondition(const State &state, std::string_view expression);
+    static bool isActive(const State &state);
+  };
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <span>
+#include <array>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include "glm/vec2.hpp"
+#include "glm/vec3.hpp"
+#include "glm/mat4x4.hpp"
+
+#include "core.hh"
+
+namespace broccoli {
+  struct OccluderGeometry;
+  struct SoftwareOccluderInstance;
+  struct SoftwareOcclusionCamera;
+  struct SoftwareOcclusionStats;
+  class SoftwareOcclusionWorkerPool;
+  class SoftwareOcclusionCuller;
+}
+
+//
+// Occluders:
+//
+
+namespace broccoli {
+  /// The triangles of a Geometry flagged as an occluder, kept on the CPU in model space so that they can be drawn by
+  /// the SoftwareOcclusionCuller.
+  struct OccluderGeometry {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+  };
+  struct SoftwareOccluderInstance {
+    const OccluderGeometry *geometry;
+    glm::mat4x4 transform;
+  };
+  /// The camera occluders are drawn from, matching the perspective projection of the final render pass.
+  struct SoftwareOcclusionCamera {
+    glm::mat4x4 view_matrix;
+    float cot_half_fovy;
+    float aspect_inv;
+    float zmin;
+    float zmax;
+  };
+  struct SoftwareOcclusionStats {
+    uint64_t occluder_triangle_count = 0;
+    uint64_t rasterized_triangle_count = 0;
+    uint64_t tested_instance_count = 0;
+    uint64_t culled_instance_count = 0;
+  };
+}
+
+//
+// SoftwareOcclusionWorkerPool:
+//
+
+namespace broccoli {
+  /// A fixed set of worker threads that run the tasks of one 'parallelFor' call at a time. The calling thread runs tasks
+  /// too, so a pool of one thread spawns no workers and runs everything inline.
+  class SoftwareOcclusionWorkerPool {
+  private:
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_task_cv;
+    std::condition_variable m_done_cv;
+    const std::function<void(uint32_t)> *m_task;
+    uint32_t m_task_count;
+    uint32_t m_next_task_index;
+    uint32_t m_done_task_count;
+    uint64_t m_generation;
+    bool m_is_stopping;
+  public:
+    explicit SoftwareOcclusionWorkerPool(uint32_t thread_count);
+    SoftwareOcclusionWorkerPool(SoftwareOcclusionWorkerPool const &other) = delete;
+    ~SoftwareOcclusionWorkerPool();
+  public:
+    uint32_t threadCount() const;
+    void parallelFor(uint32_t task_count, const std::function<void(uint32_t)> &task);
+  private:
+    void workerMain();
+    void runTasks(std::unique_lock<std::mutex> &lock);
+  };
+}
+
+//
+// SoftwareOcclusionCuller:
+//
+
+namespace broccoli {
+  /// SoftwareOcclusionCuller draws occluders into a low-resolution depth buffer on the CPU, after masked software
+  /// occlusion culling (Hasselgren et al., 2016), then tests instances' bounding boxes against it before they are
+  /// uploaded and drawn. Unlike RenderOcclusionCuller, it needs no GPU features beyond those of every adapter, and
+  /// culls in the frame it is drawn in.
+  /// The buffer is split into tiles of 8x4 pixels, each holding a coverage mask and two depths instead of a depth per
+  /// pixel: the reference depth, which every pixel of the tile lies in front of, and the working depth, which every
+  /// covered pixel lies in front of. Once a tile is fully covered, its working depth becomes its reference depth.
+  /// Depths are stored as 1/w, which interpolates linearly in screen space: larger values are nearer.
+  /// Triangles are set up in parallel, then rasterized in parallel over horizontal strips of tiles, so that no two
+  /// threads ever write to the same tile.
+  class SoftwareOcclusionCuller {
+  public:
+    static constexpr int32_t TILE_WIDTH = 8;
+    static constexpr int32_t TILE_HEIGHT = 4;
+  private:
+    struct Tile {
+      uint32_t coverage_mask;
+      float reference_depth;
+      float working_depth;
+    };
+    struct Triangle {
+      // Edge functions, non-negative inside the triangle, and the depth plane: each holds '(a, b, c)' and is evaluated
+      // at (x, y) as 'a*x + b*y + c'.
+      std::array<glm::vec3, 3> edges;
+      glm::vec3 depth_plane;
+      float depth_min;
+      glm::ivec2 tile_min;
+      glm::ivec2 tile_max;
+    };
+  private:
+    SoftwareOcclusionWorkerPool m_workers;
+    glm::ivec2 m_size;
+    glm::ivec2 m_tile_count;
+    std::vector<Tile> m_tiles;
+    std::vector<std::vector<Triangle>> m_thread_triangles;
+    SoftwareOcclusionCamera m_camera;
+    SoftwareOcclusionStats m_stats;
+  public:
+    SoftwareOcclusionCuller(uint32_t thread_count);
+    SoftwareOcclusionCuller(SoftwareOcclusionCuller const &other) = delete;
+  public:
+    void beginFrame(const SoftwareOcclusionCamera &camera, glm::ivec2 size);
+    void rasterizeOccluders(std::span<const SoftwareOccluderInstance> occluders);
+    bool isVisible(glm::vec3 bounds_min, glm::vec3 bounds_max, const glm::mat4x4 &transform) const;
+    size_t cullInstances(glm::vec3 bounds_min, glm::vec3 bounds_max, std::vector<glm::mat4x4> &transforms);
+  public:
+    glm::ivec2 size() const;
+    const SoftwareOcclusionStats &stats() const;
+  private:
+    void setupTriangles(std::span<const SoftwareOccluderInstance> occluders, uint32_t task_index, uint32_t task_count);
+    void rasterizeTriangle(const Triangle &triangle, int32_t tile_row_min, int32_t tile_row_max);
+    static void updateTile(Tile &tile, uint32_t coverage_mask, float depth);
+  };
+}
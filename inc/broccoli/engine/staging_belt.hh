@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "webgpu/webgpu_cpp.h"
+
+#include "core.hh"
+
+namespace broccoli {
+  struct RenderStagingBeltStats;
+  class RenderStagingBelt;
+}
+
+//
+// RenderStagingBelt:
+//
+
+namespace broccoli {
+  struct RenderStagingBeltStats {
+    /// Bytes uploaded through the belt, this frame and in total. 'Queue::WriteBuffer' and 'Queue::WriteTexture' would
+    /// each have copied these bytes once more, into Dawn's own staging memory.
+    uint64_t frame_saved_copy_byte_count = 0;
+    uint64_t saved_copy_byte_count = 0;
+    uint64_t upload_count = 0;
+    /// Every chunk the belt holds, whether open, in flight or free.
+    uint64_t chunk_count = 0;
+    uint64_t chunk_byte_count = 0;
+  };
+  /// RenderStagingBelt uploads data through a ring of 'MapWrite | CopySrc' chunks, which the CPU writes into directly
+  /// while they are mapped, and which are then copied into place by commands encoded into the caller's encoder. Copies
+  /// run in queue order, so an upload lands just where an equivalent 'Queue::WriteBuffer' would have.
+  /// Each chunk cycles through these states:
+  /// - open: mapped, with uploads for a single encoder suballocated from it,
+  /// - in flight: unmapped by 'submit' before its encoder's commands are submitted, then mapped again right after; the
+  ///   mapping completes once the GPU is done with those commands,
+  /// - free: mapped and empty, ready to be opened again.
+  /// Uploads larger than 'CHUNK_SIZE' get a chunk of their own. A free chunk that goes unused for 'MAX_IDLE_FRAMES'
+  /// frames is destroyed, as in RenderGraphTexturePool.
+  /// NOTE: every encoder written through the belt must be submitted with 'submit', since a buffer cannot be used by the
+  /// queue while mapped: it only unmaps the chunks open for that encoder, so several encoders may be recorded at once.
+  /// NOTE: per-frame uploads that are recorded next to their consumer's commands go through the belt (camera, lights,
+  /// shadow and virtual shadow map uniforms, transforms, deferred uniforms). 'Queue::WriteBuffer' remains for one-off
+  /// uploads at creation (textures, materials, overlay geometry), for writes with no encoder of their own (the cascade
+  /// uniform, disabling the virtual shadow map), and for render graph passes, whose encoder the graph owns.
+  class RenderStagingBelt {
+  public:
+    static constexpr uint64_t CHUNK_SIZE = 1 << 20;
+    static constexpr uint64_t MAX_IDLE_FRAMES = 2;
+  private:
+    struct Chunk {
+      wgpu::Buffer buffer;
+      uint64_t size;
+      uint64_t offset;
+      uint8_t *data;
+      uint64_t last_used_frame;
+      WGPUCommandEncoder encoder;
+    };
+    struct Allocation {
+      wgpu::Buffer buffer;
+      uint64_t offset;
+      uint8_t *data;
+    };
+  private:
+    wgpu::Device m_device;
+    std::vector<Chunk> m_open_chunks;
+    std::vector<Chunk> m_in_flight_chunks;
+    std::vector<Chunk> m_free_chunks;
+    uint64_t m_frame_index;
+    RenderStagingBeltStats m_stats;
+  public:
+    explicit RenderStagingBelt(wgpu::Device device);
+    RenderStagingBelt(RenderStagingBelt const &other) = delete;
+    ~RenderStagingBelt();
+  public:
+    void beginFrame();
+    void writeBuffer(wgpu::CommandEncoder &encoder, const wgpu::Buffer &buffer, uint64_t offset, const void *data, size_t size);
+    void writeTexture(wgpu::CommandEncoder &encoder, const wgpu::ImageCopyTexture &destination, const void *data, const wgpu::TextureDataLayout &data_layout, const wgpu::Extent3D &write_size, uint32_t texel_size);
+    void submit(wgpu::CommandEncoder &encoder);
+  public:
+    const RenderStagingBeltStats &stats() const;
+  private:
+    Allocation allocate(wgpu::CommandEncoder &encoder, uint64_t size, uint64_t alignment);
+    Chunk createChunk(uint64_t size);
+    void recall(Chunk chunk);
+  };
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <ostream>
+
+#include "core.hh"
+
+//
+// StartupTimeline:
+//
+
+namespace broccoli {
+  /// StartupTimeline records when each named phase of startup began and ended, relative to the timeline's construction.
+  /// Phases may be recorded from any thread, and phases on different threads may overlap: 'report' prints them in order
+  /// of their start, along with the thread that ran each one, so that the main thread's phases read as the critical
+  /// path and worker phases as the work taken off it.
+  class StartupTimeline {
+  public:
+    using Clock = std::chrono::steady_clock;
+    struct Phase { std::string name; Clock::time_point begin; Clock::time_point end; std::thread::id thread; };
+    class Scope;
+  private:
+    Clock::time_point m_origin;
+    std::thread::id m_main_thread;
+    mutable std::mutex m_mutex;
+    std::vector<Phase> m_phases;
+  public:
+    StartupTimeline();
+    StartupTimeline(StartupTimeline const &other) = delete;
+  public:
+    Scope scope(std::string name);
+    void record(std::string name, Clock::time_point begin, Clock::time_point end);
+  public:
+    Clock::time_point origin() const;
+    double elapsedMs() const;
+    void report(std::ostream &out) const;
+  private:
+    double toMs(Clock::time_point t) const;
+  };
+}
+namespace broccoli {
+  /// Records a phase spanning the lifetime of this object. A null timeline records nothing.
+  class StartupTimeline::Scope {
+  private:
+    StartupTimeline *m_timeline;
+    std::string m_name;
+    Clock::time_point m_begin;
+  public:
+    Scope(StartupTimeline *timeline, std::string name);
+    Scope(Scope const &other) = delete;
+    ~Scope();
+  };
+}
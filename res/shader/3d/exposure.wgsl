@@ -0,0 +1,82 @@
+// Overrides:
+override p_WORKGROUP_SIZE: u32;   // the width and height of each histogram workgroup, whose area is the bin count
+
+#include "include/exposure.wgsl"
+
+struct ExposureUniform {
+  min_log2_luminance: f32,
+  log2_luminance_range: f32,
+  adaptation_rate: f32,
+  rsv00: u32,
+}
+
+@group(0) @binding(0) var u_scene: texture_2d<f32>;
+@group(0) @binding(1) var<uniform> u_exposure_params: ExposureUniform;
+@group(0) @binding(2) var<storage, read_write> u_histogram: array<atomic<u32>, p_HISTOGRAM_BIN_COUNT>;
+@group(0) @binding(3) var<storage, read_write> u_exposure: ExposureState;
+
+const LUMA = vec3<f32>(0.2126, 0.7152, 0.0722);
+const KEY_LUMINANCE = 0.18;
+
+var<workgroup> wg_histogram: array<atomic<u32>, p_HISTOGRAM_BIN_COUNT>;
+var<workgroup> wg_weighted_counts: array<u32, p_HISTOGRAM_BIN_COUNT>;
+var<workgroup> wg_counts: array<u32, p_HISTOGRAM_BIN_COUNT>;
+
+/// Bin 0 holds black texels, and the remaining bins split the log2 luminance range evenly.
+fn binIndex(luminance: f32) -> u32 {
+  if (luminance < 1e-5) {
+    return 0u;
+  }
+  let t = saturate((log2(luminance) - u_exposure_params.min_log2_luminance) / u_exposure_params.log2_luminance_range);
+  return u32(t * f32(p_HISTOGRAM_BIN_COUNT - 2u)) + 1u;
+}
+
+/// Bins the luminance of every covered scene texel. Texels are un-premultiplied by their coverage (see 'tonemap.wgsl'), 
+/// and texels nothing was drawn to are skipped, so that the clear color never affects exposure.
+@compute @workgroup_size(p_WORKGROUP_SIZE, p_WORKGROUP_SIZE)
+fn histogramMain(
+  @builtin(global_invocation_id) id: vec3<u32>,
+  @builtin(local_invocation_index) local_index: u32
+) {
+  atomicStore(&wg_histogram[local_index], 0u);
+  workgroupBarrier();
+  if (all(id.xy < textureDimensions(u_scene))) {
+    let texel = textureLoad(u_scene, id.xy, 0);
+    if (texel.a > 0.0) {
+      let luminance = dot(texel.rgb / texel.a, LUMA);
+      atomicAdd(&wg_histogram[binIndex(luminance)], 1u);
+    }
+  }
+  workgroupBarrier();
+  atomicAdd(&u_histogram[local_index], atomicLoad(&wg_histogram[local_index]));
+}
+
+/// Averages the histogram in log2 space, ignoring black texels, then eases the stored average towards it. Runs as a 
+/// single workgroup with one invocation per bin, and clears the histogram for the next frame.
+@compute @workgroup_size(p_HISTOGRAM_BIN_COUNT)
+fn averageMain(@builtin(local_invocation_index) local_index: u32) {
+  let count = atomicExchange(&u_histogram[local_index], 0u);
+  let is_black_bin = local_index == 0u;
+  wg_counts[local_index] = select(count, 0u, is_black_bin);
+  wg_weighted_counts[local_index] = select(count * (local_index - 1u), 0u, is_black_bin);
+  workgroupBarrier();
+  for (var stride = p_HISTOGRAM_BIN_COUNT / 2u; stride > 0u; stride >>= 1u) {
+    if (local_index < stride) {
+      wg_counts[local_index] += wg_counts[local_index + stride];
+      wg_weighted_counts[local_index] += wg_weighted_counts[local_index + stride];
+    }
+    workgroupBarrier();
+  }
+  if (local_index == 0u && wg_counts[0] > 0u) {
+    let average_bin = f32(wg_weighted_counts[0]) / f32(wg_counts[0]);
+    let t = average_bin / f32(p_HISTOGRAM_BIN_COUNT - 2u);
+    let average_log2_luminance = u_exposure_params.min_log2_luminance + t * u_exposure_params.log2_luminance_range;
+    var adapted = average_log2_luminance;
+    if (u_exposure.is_initialized != 0u) {
+      adapted = mix(u_exposure.average_log2_luminance, average_log2_luminance, u_exposure_params.adaptation_rate);
+    }
+    u_exposure.average_log2_luminance = adapted;
+    u_exposure.exposure = KEY_LUMINANCE / exp2(adapted);
+    u_exposure.is_initialized = 1u;
+  }
+}
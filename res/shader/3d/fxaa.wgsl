@@ -0,0 +1,145 @@
+#include "include/fullscreen.wgsl"
+
+// FXAA, after Timothy Lottes' FXAA 3.11 (quality preset): edges are detected from the luma contrast around each pixel,
+// walked along in both directions to find where they end, and the pixel is then re-sampled across the edge with an
+// offset that depends on how far it lies from either end.
+// The source is the tonemapped, gamma-encoded image, so that luma contrast matches what is seen on screen.
+
+override p_EDGE_THRESHOLD: f32 = 0.125;         // the minimum contrast (relative to the local maximum) to anti-alias
+override p_EDGE_THRESHOLD_MIN: f32 = 0.0312;    // the minimum contrast to anti-alias, which skips dark regions
+override p_SUBPIXEL_QUALITY: f32 = 0.75;        // how strongly sub-pixel aliasing (e.g. thin lines) is blurred
+
+const EDGE_SEARCH_STEP_COUNT = 10u;
+
+@group(0) @binding(0) var u_source: texture_2d<f32>;
+@group(0) @binding(1) var u_source_sampler: sampler;
+
+struct FragmentInput {
+  @builtin(position) clip_position: vec4<f32>,
+}
+
+@vertex
+fn vertexShaderMain(@builtin(vertex_index) vertex_index: u32) -> FragmentInput {
+  var out: FragmentInput;
+  out.clip_position = fullscreenTrianglePosition(vertex_index);
+  return out;
+}
+
+@fragment
+fn fragmentShaderMain(in: FragmentInput) -> @location(0) vec4<f32> {
+  let texel_size = 1.0f / vec2<f32>(textureDimensions(u_source, 0));
+  let uv = in.clip_position.xy * texel_size;
+  let color_center = sampleSource(uv);
+
+  // Skipping pixels without enough local contrast:
+  let luma_center = luma(color_center.rgb);
+  let luma_n = luma(sampleSourceOffset(uv, texel_size, vec2<f32>(0.0, -1.0)).rgb);
+  let luma_s = luma(sampleSourceOffset(uv, texel_size, vec2<f32>(0.0, 1.0)).rgb);
+  let luma_w = luma(sampleSourceOffset(uv, texel_size, vec2<f32>(-1.0, 0.0)).rgb);
+  let luma_e = luma(sampleSourceOffset(uv, texel_size, vec2<f32>(1.0, 0.0)).rgb);
+  let luma_min = min(luma_center, min(min(luma_n, luma_s), min(luma_w, luma_e)));
+  let luma_max = max(luma_center, max(max(luma_n, luma_s), max(luma_w, luma_e)));
+  let luma_range = luma_max - luma_min;
+  if (luma_range < max(p_EDGE_THRESHOLD_MIN, luma_max * p_EDGE_THRESHOLD)) {
+    return color_center;
+  }
+
+  // Finding the edge's orientation, and which side of this pixel it lies on:
+  let luma_nw = luma(sampleSourceOffset(uv, texel_size, vec2<f32>(-1.0, -1.0)).rgb);
+  let luma_ne = luma(sampleSourceOffset(uv, texel_size, vec2<f32>(1.0, -1.0)).rgb);
+  let luma_sw = luma(sampleSourceOffset(uv, texel_size, vec2<f32>(-1.0, 1.0)).rgb);
+  let luma_se = luma(sampleSourceOffset(uv, texel_size, vec2<f32>(1.0, 1.0)).rgb);
+  let luma_ns = luma_n + luma_s;
+  let luma_we = luma_w + luma_e;
+  let luma_w_corners = luma_nw + luma_sw;
+  let luma_e_corners = luma_ne + luma_se;
+  let luma_n_corners = luma_nw + luma_ne;
+  let luma_s_corners = luma_sw + luma_se;
+  let edge_horizontal =
+    abs(-2.0 * luma_w + luma_w_corners) +
+    abs(-2.0 * luma_center + luma_ns) * 2.0 +
+    abs(-2.0 * luma_e + luma_e_corners);
+  let edge_vertical =
+    abs(-2.0 * luma_n + luma_n_corners) +
+    abs(-2.0 * luma_center + luma_we) * 2.0 +
+    abs(-2.0 * luma_s + luma_s_corners);
+  let is_horizontal = edge_horizontal >= edge_vertical;
+  let luma_1 = select(luma_w, luma_n, is_horizontal);
+  let luma_2 = select(luma_e, luma_s, is_horizontal);
+  let gradient_1 = luma_1 - luma_center;
+  let gradient_2 = luma_2 - luma_center;
+  let is_1_steepest = abs(gradient_1) >= abs(gradient_2);
+  let gradient_scaled = 0.25 * max(abs(gradient_1), abs(gradient_2));
+  var step_length = select(texel_size.x, texel_size.y, is_horizontal);
+  var luma_local_average: f32;
+  if (is_1_steepest) {
+    step_length = -step_length;
+    luma_local_average = 0.5 * (luma_1 + luma_center);
+  } else {
+    luma_local_average = 0.5 * (luma_2 + luma_center);
+  }
+
+  // Walking along the edge, half a pixel towards it, until the luma along it changes on either side:
+  var edge_uv = uv;
+  if (is_horizontal) {
+    edge_uv.y += 0.5 * step_length;
+  } else {
+    edge_uv.x += 0.5 * step_length;
+  }
+  let step_offset = select(vec2<f32>(0.0, texel_size.y), vec2<f32>(texel_size.x, 0.0), is_horizontal);
+  var step_scales = array<f32, EDGE_SEARCH_STEP_COUNT>(1.0, 1.0, 1.0, 1.0, 1.0, 1.5, 2.0, 2.0, 4.0, 8.0);
+  var uv_1 = edge_uv - step_offset;
+  var uv_2 = edge_uv + step_offset;
+  var luma_end_1 = luma(sampleSource(uv_1).rgb) - luma_local_average;
+  var luma_end_2 = luma(sampleSource(uv_2).rgb) - luma_local_average;
+  var is_done_1 = abs(luma_end_1) >= gradient_scaled;
+  var is_done_2 = abs(luma_end_2) >= gradient_scaled;
+  for (var i = 1u; i < EDGE_SEARCH_STEP_COUNT && !(is_done_1 && is_done_2); i++) {
+    if (!is_done_1) {
+      uv_1 -= step_offset * step_scales[i];
+      luma_end_1 = luma(sampleSource(uv_1).rgb) - luma_local_average;
+      is_done_1 = abs(luma_end_1) >= gradient_scaled;
+    }
+    if (!is_done_2) {
+      uv_2 += step_offset * step_scales[i];
+      luma_end_2 = luma(sampleSource(uv_2).rgb) - luma_local_average;
+      is_done_2 = abs(luma_end_2) >= gradient_scaled;
+    }
+  }
+
+  // Offsetting towards the edge only if this pixel lies on the side of it that its nearest end varies towards:
+  let distance_1 = select(uv.x - uv_1.x, uv.y - uv_1.y, !is_horizontal);
+  let distance_2 = select(uv_2.x - uv.x, uv_2.y - uv.y, !is_horizontal);
+  let is_direction_1 = distance_1 < distance_2;
+  let distance_final = min(distance_1, distance_2);
+  let edge_length = distance_1 + distance_2;
+  let is_luma_center_smaller = luma_center < luma_local_average;
+  let is_correct_variation = (select(luma_end_2, luma_end_1, is_direction_1) < 0.0) != is_luma_center_smaller;
+  var final_offset = select(0.0, 0.5 - distance_final / edge_length, is_correct_variation);
+
+  // Blurring sub-pixel features, whose contrast with their neighborhood is high relative to the local range:
+  let luma_average = (1.0 / 12.0) * (2.0 * (luma_ns + luma_we) + luma_w_corners + luma_e_corners);
+  let subpixel_offset_1 = clamp(abs(luma_average - luma_center) / luma_range, 0.0, 1.0);
+  let subpixel_offset_2 = (-2.0 * subpixel_offset_1 + 3.0) * subpixel_offset_1 * subpixel_offset_1;
+  final_offset = max(final_offset, subpixel_offset_2 * subpixel_offset_2 * p_SUBPIXEL_QUALITY);
+
+  var final_uv = uv;
+  if (is_horizontal) {
+    final_uv.y += final_offset * step_length;
+  } else {
+    final_uv.x += final_offset * step_length;
+  }
+  return sampleSource(final_uv);
+}
+
+fn sampleSource(uv: vec2<f32>) -> vec4<f32> {
+  return textureSampleLevel(u_source, u_source_sampler, uv, 0.0);
+}
+
+fn sampleSourceOffset(uv: vec2<f32>, texel_size: vec2<f32>, offset: vec2<f32>) -> vec4<f32> {
+  return sampleSource(uv + offset * texel_size);
+}
+
+fn luma(color: vec3<f32>) -> f32 {
+  return dot(color, vec3<f32>(0.299, 0.587, 0.114));
+}
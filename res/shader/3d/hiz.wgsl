@@ -0,0 +1,71 @@
+// Builds the hierarchical-Z (Hi-Z) pyramid that instances are occlusion culled against (see 'occlusion_cull.wgsl').
+// Each texel holds the farthest depth of the texels it covers, so an instance whose nearest depth lies beyond it is
+// hidden everywhere under it.
+// Level 0 is half the depth buffer's size (rounded up), so that each of its texels covers a 2x2 block of depth texels.
+// Mip levels are rounded down, so the last row or column of an odd-sized level is folded into the last texel of the
+// next level: every texel of each level stays covered.
+
+override p_WORKGROUP_SIZE: u32 = 8u;
+
+@group(0) @binding(0) var u_depth: texture_depth_2d;
+@group(0) @binding(0) var u_depth_multisampled: texture_depth_multisampled_2d;
+@group(0) @binding(0) var u_source: texture_2d<f32>;
+@group(0) @binding(1) var u_destination: texture_storage_2d<r32float, write>;
+
+@compute @workgroup_size(p_WORKGROUP_SIZE, p_WORKGROUP_SIZE, 1)
+fn initMain(@builtin(global_invocation_id) global_id: vec3<u32>) {
+  let dst_coord = global_id.xy;
+  if (any(dst_coord >= textureDimensions(u_destination))) {
+    return;
+  }
+  let src_max_coord = textureDimensions(u_depth) - 1u;
+  var depth = 0.0;
+  for (var y = 0u; y < 2u; y++) {
+    for (var x = 0u; x < 2u; x++) {
+      let src_coord = min(2u * dst_coord + vec2<u32>(x, y), src_max_coord);
+      depth = max(depth, textureLoad(u_depth, src_coord, 0));
+    }
+  }
+  textureStore(u_destination, dst_coord, vec4<f32>(depth, 0.0, 0.0, 0.0));
+}
+
+@compute @workgroup_size(p_WORKGROUP_SIZE, p_WORKGROUP_SIZE, 1)
+fn initMultisampledMain(@builtin(global_invocation_id) global_id: vec3<u32>) {
+  let dst_coord = global_id.xy;
+  if (any(dst_coord >= textureDimensions(u_destination))) {
+    return;
+  }
+  let src_max_coord = textureDimensions(u_depth_multisampled) - 1u;
+  let sample_count = textureNumSamples(u_depth_multisampled);
+  var depth = 0.0;
+  for (var y = 0u; y < 2u; y++) {
+    for (var x = 0u; x < 2u; x++) {
+      let src_coord = min(2u * dst_coord + vec2<u32>(x, y), src_max_coord);
+      for (var i = 0u; i < sample_count; i++) {
+        depth = max(depth, textureLoad(u_depth_multisampled, src_coord, i));
+      }
+    }
+  }
+  textureStore(u_destination, dst_coord, vec4<f32>(depth, 0.0, 0.0, 0.0));
+}
+
+@compute @workgroup_size(p_WORKGROUP_SIZE, p_WORKGROUP_SIZE, 1)
+fn downsampleMain(@builtin(global_invocation_id) global_id: vec3<u32>) {
+  let dst_coord = global_id.xy;
+  let dst_size = textureDimensions(u_destination);
+  if (any(dst_coord >= dst_size)) {
+    return;
+  }
+  let src_size = textureDimensions(u_source, 0);
+  let is_last = dst_coord == dst_size - 1u;
+  let is_odd = (src_size & vec2<u32>(1u)) == vec2<u32>(1u);
+  let extent = select(vec2<u32>(2u), vec2<u32>(3u), is_last & is_odd);
+  var depth = 0.0;
+  for (var y = 0u; y < extent.y; y++) {
+    for (var x = 0u; x < extent.x; x++) {
+      let src_coord = min(2u * dst_coord + vec2<u32>(x, y), src_size - 1u);
+      depth = max(depth, textureLoad(u_source, src_coord, 0).r);
+    }
+  }
+  textureStore(u_destination, dst_coord, vec4<f32>(depth, 0.0, 0.0, 0.0));
+}
@@ -0,0 +1,18 @@
+// Shared by every shader that binds the camera uniform buffer (see 'CameraUniform' in render.cc).
+
+struct CameraUniform {
+  view_matrix: mat4x4<f32>,
+  world_position: vec4<f32>,
+  camera_cot_half_fovy: f32,
+  camera_aspect_inv: f32,
+  camera_zmin: f32,
+  camera_zmax: f32,
+  camera_logarithmic_z_scale: f32,
+  hdr_exposure_bias: f32,
+  rsv00: u32,
+  rsv01: u32,
+  rsv02: u32,
+  rsv03: u32,
+  rsv04: u32,
+  rsv05: u32,
+}
@@ -0,0 +1,8 @@
+// Shared by the luminance histogram, which adapts exposure, and the tonemap pass, which applies it.
+
+struct ExposureState {
+  average_log2_luminance: f32,
+  exposure: f32,
+  is_initialized: u32,
+  rsv00: u32,
+}
@@ -0,0 +1,8 @@
+// Shared by the fullscreen post-processing passes, which draw a single triangle covering the screen without any vertex
+// buffers.
+
+/// Returns the clip-space position of the fullscreen triangle's 'vertex_index'-th vertex.
+fn fullscreenTrianglePosition(vertex_index: u32) -> vec4<f32> {
+  let uv = vec2<f32>(f32((vertex_index << 1u) & 2u), f32(vertex_index & 2u));
+  return vec4<f32>(uv * 2.0 - 1.0, 0.0, 1.0);
+}
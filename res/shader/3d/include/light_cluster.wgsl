@@ -0,0 +1,11 @@
+// Shared by the light cluster builder and the shaders that read its output.
+
+struct ClusterUniform {
+  screen_size: vec2<f32>,
+  point_light_count: u32,
+  rsv00: u32,
+}
+struct PointLight {
+  position_range: vec4<f32>,
+  color: vec4<f32>,
+}
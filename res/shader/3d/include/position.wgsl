@@ -0,0 +1,14 @@
+/// Unpacks a fixed-point vertex position: the low 20 bits of each component are the fractional part.
+fn unpackPosition(raw_position: vec3<i32>) -> vec3<f32> {
+  let position_lo = vec3<f32>(
+    f32(raw_position.x & 0xFFFFF) / 1048576.0,
+    f32(raw_position.y & 0xFFFFF) / 1048576.0,
+    f32(raw_position.z & 0xFFFFF) / 1048576.0,
+  );
+  let position_hi = vec3<f32>(
+    f32(raw_position.x >> 20),
+    f32(raw_position.y >> 20),
+    f32(raw_position.z >> 20),
+  );
+  return position_hi + position_lo;
+}
@@ -0,0 +1,73 @@
+// Overrides:
+override p_CLUSTER_GRID_X: u32;           // the number of clusters across the screen
+override p_CLUSTER_GRID_Y: u32;           // the number of clusters down the screen
+override p_CLUSTER_GRID_Z: u32;           // the number of (exponentially distributed) depth slices
+override p_CLUSTER_LIGHT_CAPACITY: u32;   // the maximum number of point lights assigned to each cluster
+
+#include "include/camera.wgsl"
+#include "include/light_cluster.wgsl"
+
+@group(0) @binding(0) var<uniform> u_camera: CameraUniform;
+@group(0) @binding(1) var<uniform> u_cluster: ClusterUniform;
+@group(0) @binding(2) var<storage, read> u_point_lights: array<PointLight>;
+@group(0) @binding(3) var<storage, read_write> u_cluster_lights: array<u32>;
+
+/// Builds the light list of one cluster: each cluster stores its light count followed by up to
+/// p_CLUSTER_LIGHT_CAPACITY light indices. One workgroup handles one row of clusters.
+@compute @workgroup_size(p_CLUSTER_GRID_X)
+fn buildClustersMain(@builtin(global_invocation_id) id: vec3<u32>) {
+  let cluster_index = (id.z * p_CLUSTER_GRID_Y + id.y) * p_CLUSTER_GRID_X + id.x;
+  let base = cluster_index * (p_CLUSTER_LIGHT_CAPACITY + 1u);
+  let aabb = clusterViewAabb(id);
+
+  var count = 0u;
+  for (var i = 0u; i < u_cluster.point_light_count && count < p_CLUSTER_LIGHT_CAPACITY; i++) {
+    let light = u_point_lights[i];
+    let view_position = (u_camera.view_matrix * vec4<f32>(light.position_range.xyz, 1.0)).xyz;
+    if (sphereIntersectsAabb(view_position, light.position_range.w, aabb[0], aabb[1])) {
+      u_cluster_lights[base + 1u + count] = i;
+      count++;
+    }
+  }
+  u_cluster_lights[base] = count;
+}
+
+/// Returns the view-space bounding box (min, max) of a cluster. Tiles split NDC evenly (tile row 0 is at the top of
+/// the screen) and depth slices split [zmin, zmax] exponentially, which keeps clusters roughly cubical.
+fn clusterViewAabb(id: vec3<u32>) -> array<vec3<f32>, 2> {
+  let grid_xy = vec2<f32>(f32(p_CLUSTER_GRID_X), f32(p_CLUSTER_GRID_Y));
+  let ndc_min = vec2<f32>(
+    2.0 * f32(id.x) / grid_xy.x - 1.0,
+    1.0 - 2.0 * f32(id.y + 1u) / grid_xy.y,
+  );
+  let ndc_max = vec2<f32>(
+    2.0 * f32(id.x + 1u) / grid_xy.x - 1.0,
+    1.0 - 2.0 * f32(id.y) / grid_xy.y,
+  );
+  let near_depth = sliceDepth(id.z);
+  let far_depth = sliceDepth(id.z + 1u);
+
+  // Inverting the projection: NDC = view / (depth * scale), where 'depth' is the distance along -Z.
+  let scale = vec2<f32>(
+    1.0 / (u_camera.camera_cot_half_fovy * u_camera.camera_aspect_inv),
+    1.0 / u_camera.camera_cot_half_fovy,
+  );
+  let near_min = ndc_min * scale * near_depth;
+  let near_max = ndc_max * scale * near_depth;
+  let far_min = ndc_min * scale * far_depth;
+  let far_max = ndc_max * scale * far_depth;
+  return array<vec3<f32>, 2>(
+    vec3<f32>(min(near_min, far_min), -far_depth),
+    vec3<f32>(max(near_max, far_max), -near_depth),
+  );
+}
+fn sliceDepth(slice: u32) -> f32 {
+  let zmin = u_camera.camera_zmin;
+  let zmax = u_camera.camera_zmax;
+  return zmin * pow(zmax / zmin, f32(slice) / f32(p_CLUSTER_GRID_Z));
+}
+fn sphereIntersectsAabb(center: vec3<f32>, radius: f32, aabb_min: vec3<f32>, aabb_max: vec3<f32>) -> bool {
+  let closest = clamp(center, aabb_min, aabb_max);
+  let offset = center - closest;
+  return dot(offset, offset) <= radius * radius;
+}
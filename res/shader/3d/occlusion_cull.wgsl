@@ -0,0 +1,142 @@
+// Culls instances against the view frustum and the Hi-Z pyramid (see 'hiz.wgsl'), in two phases:
+// - Phase 0 tests every instance against last frame's pyramid, as seen from last frame's camera. Instances that pass
+//   are appended to their chunk's visible instances and drawn first; the rest are appended to its rejected instances.
+// - Phase 1 re-tests only the rejected instances against a pyramid rebuilt from the depth drawn by phase 0, as seen
+//   from this frame's camera. Instances that pass were disoccluded since last frame, and are drawn second.
+// Each chunk is drawn with one indirect draw per phase, whose instance count is the number of instances appended.
+// Workgroups are dispatched along X over a chunk's instances, and along Y over chunks.
+
+override p_WORKGROUP_SIZE: u32 = 64u;
+override p_PHASE: u32 = 0u;
+
+struct OcclusionCullUniform {
+  view_matrix: mat4x4<f32>,
+  camera_cot_half_fovy: f32,
+  camera_aspect_inv: f32,
+  camera_zmin: f32,
+  camera_zmax: f32,
+  camera_logarithmic_z_scale: f32,
+  hiz_mip_count: u32,
+  depth_size: vec2<u32>,
+  is_hiz_valid: u32,
+  chunk_count: u32,
+  rsv00: u32,
+  rsv01: u32,
+}
+struct OcclusionCullChunk {
+  bounds_min: vec3<f32>,
+  instance_offset: u32,
+  bounds_max: vec3<f32>,
+  instance_count: u32,
+  index_count: u32,
+  rsv00: u32,
+  rsv01: u32,
+  rsv02: u32,
+}
+
+// Each chunk's draw arguments: one DrawIndexedIndirect command per phase, then the number of rejected instances.
+const DRAW_ARGS_STRIDE = 12u;
+const DRAW_ARGS_PHASE_STRIDE = 5u;
+const DRAW_ARGS_INSTANCE_COUNT = 1u;
+const DRAW_ARGS_REJECTED_COUNT = 10u;
+
+@group(0) @binding(0) var<uniform> u_cull: OcclusionCullUniform;
+@group(0) @binding(1) var<storage, read> u_chunks: array<OcclusionCullChunk>;
+@group(0) @binding(2) var<storage, read> u_candidate_transforms: array<mat4x4<f32>>;
+@group(0) @binding(3) var<storage, read> u_candidate_materials: array<u32>;
+@group(0) @binding(4) var<storage, read_write> u_visible_transforms: array<mat4x4<f32>>;
+@group(0) @binding(5) var<storage, read_write> u_visible_materials: array<u32>;
+@group(0) @binding(6) var<storage, read_write> u_rejected_instances: array<u32>;
+@group(0) @binding(7) var<storage, read_write> u_draw_args: array<atomic<u32>>;
+@group(0) @binding(8) var u_hiz: texture_2d<f32>;
+
+@compute @workgroup_size(p_WORKGROUP_SIZE, 1, 1)
+fn cullMain(@builtin(global_invocation_id) global_id: vec3<u32>) {
+  let chunk_index = global_id.y;
+  if (chunk_index >= u_cull.chunk_count) {
+    return;
+  }
+  let chunk = u_chunks[chunk_index];
+  let draw_args_offset = chunk_index * DRAW_ARGS_STRIDE;
+
+  // Phase 0 reads every instance in the chunk, while phase 1 only reads those rejected by phase 0:
+  var instance_index = global_id.x;
+  if (p_PHASE == 0u) {
+    if (instance_index >= chunk.instance_count) {
+      return;
+    }
+  } else {
+    if (instance_index >= atomicLoad(&u_draw_args[draw_args_offset + DRAW_ARGS_REJECTED_COUNT])) {
+      return;
+    }
+    instance_index = u_rejected_instances[chunk.instance_offset + instance_index];
+  }
+  let candidate_index = chunk.instance_offset + instance_index;
+  let transform = u_candidate_transforms[candidate_index];
+
+  if (isVisible(transform, chunk.bounds_min, chunk.bounds_max)) {
+    let draw_instance_count_offset = draw_args_offset + p_PHASE * DRAW_ARGS_PHASE_STRIDE + DRAW_ARGS_INSTANCE_COUNT;
+    let slot = atomicAdd(&u_draw_args[draw_instance_count_offset], 1u);
+    u_visible_transforms[chunk.instance_offset + slot] = transform;
+    u_visible_materials[chunk.instance_offset + slot] = u_candidate_materials[candidate_index];
+  } else if (p_PHASE == 0u) {
+    let slot = atomicAdd(&u_draw_args[draw_args_offset + DRAW_ARGS_REJECTED_COUNT], 1u);
+    u_rejected_instances[chunk.instance_offset + slot] = instance_index;
+  }
+}
+
+fn isVisible(transform: mat4x4<f32>, bounds_min: vec3<f32>, bounds_max: vec3<f32>) -> bool {
+  // Projecting the bounding box's corners: a box reaching the near plane is always visible, since its projection is
+  // unbounded.
+  var ndc_min = vec2<f32>(1.0e30);
+  var ndc_max = vec2<f32>(-1.0e30);
+  var nearest_depth = 1.0e30;
+  for (var i = 0u; i < 8u; i++) {
+    let corner = select(bounds_min, bounds_max, (vec3<u32>(i, i >> 1u, i >> 2u) & vec3<u32>(1u)) == vec3<u32>(1u));
+    let view_position = u_cull.view_matrix * (transform * vec4<f32>(corner, 1.0));
+    let depth = -view_position.z;
+    if (depth <= u_cull.camera_zmin) {
+      return true;
+    }
+    let ndc = vec2<f32>(
+      view_position.x * u_cull.camera_cot_half_fovy * u_cull.camera_aspect_inv,
+      view_position.y * u_cull.camera_cot_half_fovy
+    ) / depth;
+    ndc_min = min(ndc_min, ndc);
+    ndc_max = max(ndc_max, ndc);
+    nearest_depth = min(nearest_depth, depth);
+  }
+
+  // Frustum culling:
+  if (any(ndc_max < vec2<f32>(-1.0)) || any(ndc_min > vec2<f32>(1.0)) || nearest_depth > u_cull.camera_zmax) {
+    return false;
+  }
+  if (u_cull.is_hiz_valid == 0u) {
+    return true;
+  }
+
+  // Occlusion culling: the pyramid level is chosen so that the box's screen rectangle spans at most 2x2 of its texels,
+  // which must all lie in front of the box's nearest depth for it to be hidden.
+  // NOTE: the depth buffer holds log depth interpolated across each triangle, which never lies below the log depth of
+  // the triangle's nearest vertex, so comparing against the box's nearest depth is conservative.
+  let screen_min = clamp(vec2<f32>(0.5, -0.5) * vec2<f32>(ndc_min.x, ndc_max.y) + 0.5, vec2<f32>(0.0), vec2<f32>(1.0));
+  let screen_max = clamp(vec2<f32>(0.5, -0.5) * vec2<f32>(ndc_max.x, ndc_min.y) + 0.5, vec2<f32>(0.0), vec2<f32>(1.0));
+  let depth_size = vec2<f32>(u_cull.depth_size);
+  let texel_min = screen_min * depth_size;
+  let texel_max = screen_max * depth_size;
+  let extent = max(texel_max.x - texel_min.x, texel_max.y - texel_min.y);
+  let level = min(u32(max(ceil(log2(max(extent, 1.0))) - 1.0, 0.0)), u_cull.hiz_mip_count - 1u);
+  let level_texel_size = f32(2u << level);
+  let level_max_coord = textureDimensions(u_hiz, level) - 1u;
+  let coord_min = min(vec2<u32>(texel_min / level_texel_size), level_max_coord);
+  let coord_max = min(vec2<u32>(texel_max / level_texel_size), level_max_coord);
+  let occluder_depth = max(
+    max(textureLoad(u_hiz, coord_min, level).r, textureLoad(u_hiz, vec2<u32>(coord_max.x, coord_min.y), level).r),
+    max(textureLoad(u_hiz, vec2<u32>(coord_min.x, coord_max.y), level).r, textureLoad(u_hiz, coord_max, level).r)
+  );
+  let c = u_cull.camera_logarithmic_z_scale;
+  let zmin = u_cull.camera_zmin;
+  let zmax = u_cull.camera_zmax;
+  let box_depth = log2(c * (nearest_depth - zmin) + 1.0) / log2(c * (zmax - zmin) + 1.0);
+  return box_depth <= occluder_depth;
+}
@@ -1,6 +1,12 @@
-// Parameters:
+// Parameters (substituted into the source, since they size arrays):
 // - p_INSTANCE_COUNT: u32 => the maximum instance count drawn
 
+// Overrides (specialized per render pipeline):
+override p_EVSM_POSITIVE_EXPONENT: f32;   // the exponent used to warp depth for the positive EVSM moments
+override p_EVSM_NEGATIVE_EXPONENT: f32;   // the exponent used to warp depth for the negative EVSM moments
+
+#include "include/position.wgsl"
+
 struct ShadowUniform {
   proj_view_matrix: mat4x4<f32>,
 }
@@ -32,22 +38,13 @@ fn fragmentShaderMain(in: FragmentInput) -> @location(0) vec4<f32> {
   return vec4(0.0);
 }
 
-//
-// Utility:
-//
-
-// FIXME: this is copy-pasted from 'ubershader'
-
-fn unpackPosition(raw_position: vec3<i32>) -> vec3<f32> {
-  let position_lo = vec3<f32>(
-    f32(raw_position.x & 0xFFFFF) / 1048576.0,
-    f32(raw_position.y & 0xFFFFF) / 1048576.0,
-    f32(raw_position.z & 0xFFFFF) / 1048576.0,
-  );
-  let position_hi = vec3<f32>(
-    f32(raw_position.x >> 20),
-    f32(raw_position.y >> 20),
-    f32(raw_position.z >> 20),
-  );
-  return position_hi + position_lo;
+/// Writes exponential variance shadow map (EVSM4) moments: (e^(c+ d), e^(2 c+ d), -e^(-c- d), e^(-2 c- d)), where d is
+/// the depth remapped to [-1, 1].
+/// See: https://developer.nvidia.com/gpugems/gpugems3/part-ii-light-and-shadows/chapter-8-summed-area-variance-shadow-maps
+@fragment
+fn momentsFragmentShaderMain(in: FragmentInput) -> @location(0) vec4<f32> {
+  let depth = 2.0 * in.clip_position.z - 1.0;
+  let positive = exp(p_EVSM_POSITIVE_EXPONENT * depth);
+  let negative = -exp(-p_EVSM_NEGATIVE_EXPONENT * depth);
+  return vec4<f32>(positive, positive * positive, negative, negative * negative);
 }
@@ -0,0 +1,35 @@
+// Overrides:
+override p_BLUR_RADIUS: i32;      // the number of texels sampled on either side of the center texel
+override p_WORKGROUP_SIZE: u32;   // the width and height of each workgroup
+
+@group(0) @binding(0) var src_texture: texture_2d<f32>;
+@group(0) @binding(1) var dst_texture: texture_storage_2d<rgba16float, write>;
+
+@compute @workgroup_size(p_WORKGROUP_SIZE, p_WORKGROUP_SIZE)
+fn blurHorizontalMain(@builtin(global_invocation_id) id: vec3<u32>) {
+  blur(vec2<i32>(id.xy), vec2<i32>(1, 0));
+}
+
+@compute @workgroup_size(p_WORKGROUP_SIZE, p_WORKGROUP_SIZE)
+fn blurVerticalMain(@builtin(global_invocation_id) id: vec3<u32>) {
+  blur(vec2<i32>(id.xy), vec2<i32>(0, 1));
+}
+
+/// One pass of a separable gaussian blur. Moments are linear in depth, so filtering them (unlike filtering depth) is
+/// meaningful: this is what lets a low resolution moment shadow map look soft rather than aliased.
+fn blur(coord: vec2<i32>, direction: vec2<i32>) {
+  let size = vec2<i32>(textureDimensions(src_texture));
+  if (any(coord >= size)) {
+    return;
+  }
+  let sigma = max(f32(p_BLUR_RADIUS) / 2.0, 0.5);
+  var sum = vec4<f32>(0.0);
+  var total_weight = 0.0;
+  for (var i = -p_BLUR_RADIUS; i <= p_BLUR_RADIUS; i++) {
+    let sample_coord = clamp(coord + direction * i, vec2<i32>(0), size - 1);
+    let weight = exp(-f32(i * i) / (2.0 * sigma * sigma));
+    sum += weight * textureLoad(src_texture, sample_coord, 0);
+    total_weight += weight;
+  }
+  textureStore(dst_texture, coord, sum / total_weight);
+}
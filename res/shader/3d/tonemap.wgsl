@@ -0,0 +1,72 @@
+#include "include/exposure.wgsl"
+#include "include/fullscreen.wgsl"
+
+struct TonemapUniform {
+  clear_color: vec4<f32>,
+  exposure_bias: f32,
+  tonemap_operator: u32,
+  is_auto_exposure_enabled: u32,
+  rsv00: u32,
+}
+
+@group(0) @binding(0) var u_scene: texture_2d<f32>;
+@group(0) @binding(1) var<uniform> u_tonemap: TonemapUniform;
+@group(0) @binding(2) var<storage, read> u_exposure: ExposureState;
+
+struct FragmentInput {
+  @builtin(position) clip_position: vec4<f32>,
+}
+
+/// Draws a single triangle covering the screen.
+@vertex
+fn vertexShaderMain(@builtin(vertex_index) vertex_index: u32) -> FragmentInput {
+  var out: FragmentInput;
+  out.clip_position = fullscreenTrianglePosition(vertex_index);
+  return out;
+}
+
+/// The scene is cleared to transparent black and every final pipeline writes an alpha of 1, so after the MSAA resolve
+/// alpha is the fraction of each pixel covered by geometry and color is premultiplied by it. Covered color is
+/// tonemapped, then composited over the clear color, which is already display-referred.
+@fragment
+fn fragmentShaderMain(in: FragmentInput) -> @location(0) vec4<f32> {
+  let texel = textureLoad(u_scene, vec2<i32>(in.clip_position.xy), 0);
+  let coverage = texel.a;
+  var exposure = 1.0f;
+  if (u_tonemap.is_auto_exposure_enabled != 0u && u_exposure.is_initialized != 0u) {
+    exposure = u_exposure.exposure;
+  }
+  let color_hdr = exposure * texel.rgb / max(coverage, 1e-4f);
+  var color_ldr: vec3<f32>;
+  switch (u_tonemap.tonemap_operator) {
+    case 1u: { color_ldr = reinhardTonemap(u_tonemap.exposure_bias * color_hdr); }
+    default: { color_ldr = naughtyDogTonemap(color_hdr, u_tonemap.exposure_bias); }
+  }
+  return vec4<f32>(mix(u_tonemap.clear_color.rgb, color_ldr, coverage), 1.0f);
+}
+
+fn reinhardTonemap(color0: vec3<f32>) -> vec3<f32> {
+  let color1 = color0 / (color0 + vec3(1.0));
+  let color2 = pow(color1, vec3(1.0/2.2));
+  return color2;
+}
+fn naughtyDogTonemap(x: vec3<f32>, exposure_bias: f32) -> vec3<f32> {
+  // Naughty Dog filmic tonemapping operator.
+  // See: http://www.adriancourreges.com/blog/2015/11/02/gta-v-graphics-study/
+  // See: http://duikerresearch.com/2015/09/filmic-tonemapping-for-real-time-rendering/
+  // 'exposure_bias' is an exposure quantity used to control exposure time.
+  const w = 11.20f;
+  let curr = exposure_bias * naughtyDogTonemapHelper(x);
+  let white_scale = 1.0f / naughtyDogTonemapHelper(vec3<f32>(w));
+  let color = curr * white_scale;
+  return pow(color, vec3<f32>(1.0f/2.2f));
+}
+fn naughtyDogTonemapHelper(x: vec3<f32>) -> vec3<f32> {
+  const a = 0.15f;
+  const b = 0.50f;
+  const c = 0.10f;
+  const d = 0.20f;
+  const e = 0.02f;
+  const f = 0.30f;
+  return (x * (a * x + c * b) + d * e) / (x * (a * x + b) + d * f) - (e / f);
+}
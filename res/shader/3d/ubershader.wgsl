@@ -1,37 +1,31 @@
-// Parameters:
-// - p_LIGHTING_MODEL: u32 => whether to use Blinn-Phong or PBR
+// Parameters (substituted into the source, since they size arrays):
 // - p_INSTANCE_COUNT: u32 => the maximum instance count drawn
 // - p_DIRECTIONAL_LIGHT_COUNT: u32 => the maximum directional lights drawn
-// - p_POINT_LIGHT_COUNT: u32 => the maximum point lights drawn
+// - p_DIR_LIGHT_SHADOW_CASCADE_COUNT: u32 => the maximum number of shadow cascades per directional light
+
+// Overrides (specialized per render pipeline):
+override p_LIGHTING_MODEL: u32;           // whether to use Blinn-Phong or PBR
+override p_MATERIAL_SOURCE: u32;          // whether material parameters are constants (0) or textures (1)
+override p_CLUSTER_GRID_X: u32;           // the number of light clusters across the screen
+override p_CLUSTER_GRID_Y: u32;           // the number of light clusters down the screen
+override p_CLUSTER_GRID_Z: u32;           // the number of light cluster depth slices
+override p_CLUSTER_LIGHT_CAPACITY: u32;   // the maximum number of point lights assigned to each cluster
+
+#include "include/camera.wgsl"
+#include "include/light_cluster.wgsl"
+#include "include/position.wgsl"
+#include "include/fullscreen.wgsl"
 
 const PI: f32 = 3.14159265;
 
 struct LightUniform {
   directional_light_dir_array: array<vec4<f32>, p_DIRECTIONAL_LIGHT_COUNT>,
   directional_light_color_array: array<vec4<f32>, p_DIRECTIONAL_LIGHT_COUNT>,
-  point_light_pos_array: array<vec4<f32>, p_POINT_LIGHT_COUNT>,
-  point_light_color_array: array<vec4<f32>, p_POINT_LIGHT_COUNT>,
   directional_light_count: u32,
   point_light_count: u32,
   ambient_glow: f32,
   rsv0: u32,
-  rsv1: array<vec4<u32>, 23>,
-}
-struct CameraUniform {
-  view_matrix: mat4x4<f32>,
-  world_position: vec4<f32>,
-  camera_cot_half_fovy: f32,
-  camera_aspect_inv: f32,
-  camera_zmin: f32,
-  camera_zmax: f32,
-  camera_logarithmic_z_scale: f32,
-  hdr_exposure_bias: f32,
-  rsv00: u32,
-  rsv01: u32,
-  rsv02: u32,
-  rsv03: u32,
-  rsv04: u32,
-  rsv05: u32,
+  rsv1: array<vec4<u32>, 55>,
 }
 struct MaterialUniform {
   albedo_uv_offset: vec2<f32>,
@@ -43,18 +37,33 @@ struct MaterialUniform {
   metalness_uv_offset: vec2<f32>,
   metalness_uv_size: vec2<f32>,
   pbr_fresnel0: vec4<f32>,
+  albedo_constant: vec4<f32>,
+  normal_constant: vec4<f32>,
   blinn_phong_shininess: f32,
+  metalness_constant: f32,
+  roughness_constant: f32,
   rsv00: u32,
-  rsv01: u32,
-  rsv02: u32,
-  rsv03: u32,
-  rsv04: u32,
-  rsv05: u32,
-  rsv06: u32,
-  rsv07: u32,
-  rsv08: u32,
-  rsv09: u32,
-  rsv10: u32,
+}
+struct VirtualShadowMapUniform {
+  proj_view_matrix: mat4x4<f32>,
+  page_table_size: u32,
+  page_size: u32,
+  depth_bias: f32,
+  is_enabled: u32,
+}
+struct CascadeUniform {
+  proj_view_matrices: array<mat4x4<f32>, p_DIRECTIONAL_LIGHT_COUNT * p_DIR_LIGHT_SHADOW_CASCADE_COUNT>,
+  cascade_max_distances: array<vec4<f32>, p_DIR_LIGHT_SHADOW_CASCADE_COUNT>,
+  cascade_count: u32,
+  representation: u32,
+  depth_bias: f32,
+  is_enabled: u32,
+  evsm_exponents: vec2<f32>,
+  evsm_light_bleed_reduction: f32,
+  light_count: u32,
+}
+struct DeferredUniform {
+  camera_transform_matrix: mat4x4<f32>,
 }
 struct VertexInput {
   @builtin(vertex_index) vertex_index: u32,
@@ -73,20 +82,59 @@ struct FragmentInput {
   @location(4) @interpolate(linear) uv: vec2<f32>,
   @location(5) @interpolate(flat) instance_index: u32,
 };
+/// The G-buffer written by 'gbufferFragmentShaderMain': see 'deferredFragmentShaderMain', which shades it.
+struct GBufferOutput {
+  @location(0) albedo_metalness: vec4<f32>,
+  @location(1) normal_roughness: vec4<f32>,
+  @location(2) material_parameters: vec4<f32>,
+  @location(3) view_depth: f32,
+}
+/// The inputs to lighting at one point of a surface: interpolated and sampled by 'fragmentShaderMain' when forward
+/// shading, or read back from the G-buffer by 'deferredFragmentShaderMain' when deferred shading.
+struct Surface {
+  frag_coord: vec2<f32>,
+  position: vec3<f32>,
+  normal: vec3<f32>,
+  albedo: vec3<f32>,
+  metalness: f32,
+  roughness: f32,
+}
 
 @group(0) @binding(0) var<uniform> u_camera: CameraUniform;
 @group(0) @binding(1) var<uniform> u_light: LightUniform;
 @group(0) @binding(2) var<uniform> u_model_mats: array<mat4x4<f32>, p_INSTANCE_COUNT>;
+@group(0) @binding(3) var<uniform> u_cluster: ClusterUniform;
+@group(0) @binding(4) var<storage, read> u_point_lights: array<PointLight>;
+@group(0) @binding(5) var<storage, read> u_cluster_lights: array<u32>;
+@group(0) @binding(6) var<uniform> u_instance_materials: array<vec4<u32>, p_INSTANCE_COUNT / 4>;
+
+@group(1) @binding(0) var<uniform> u_vsm: VirtualShadowMapUniform;
+@group(1) @binding(1) var<storage, read> u_vsm_page_table: array<u32>;
+@group(1) @binding(2) var<storage, read_write> u_vsm_page_requests: array<u32>;
+@group(1) @binding(3) var vsm_atlas_texture: texture_depth_2d_array;
+@group(1) @binding(4) var vsm_atlas_sampler: sampler_comparison;
+@group(1) @binding(5) var<uniform> u_cascade: CascadeUniform;
+@group(1) @binding(6) var cascade_texture: texture_2d_array<f32>;
+@group(1) @binding(7) var cascade_sampler: sampler;
 
-@group(1) @binding(0) var<uniform> u_material: MaterialUniform;
-@group(1) @binding(1) var albedo_texture: texture_2d<f32>;
-@group(1) @binding(2) var normal_texture: texture_2d<f32>;
-@group(1) @binding(3) var metalness_texture: texture_2d<f32>;
-@group(1) @binding(4) var roughness_texture: texture_2d<f32>;
-@group(1) @binding(5) var albedo_texture_sampler: sampler;
-@group(1) @binding(6) var normal_texture_sampler: sampler;
-@group(1) @binding(7) var metalness_texture_sampler: sampler;
-@group(1) @binding(8) var roughness_texture_sampler: sampler;
+@group(2) @binding(0) var<storage, read> u_materials: array<MaterialUniform>;
+@group(2) @binding(1) var albedo_texture: texture_2d<f32>;
+@group(2) @binding(2) var normal_texture: texture_2d<f32>;
+@group(2) @binding(3) var metalness_texture: texture_2d<f32>;
+@group(2) @binding(4) var roughness_texture: texture_2d<f32>;
+@group(2) @binding(5) var albedo_texture_sampler: sampler;
+@group(2) @binding(6) var normal_texture_sampler: sampler;
+@group(2) @binding(7) var metalness_texture_sampler: sampler;
+@group(2) @binding(8) var roughness_texture_sampler: sampler;
+
+// Deferred shading replaces the material bind group with the G-buffer, numbered after the material bindings so that
+// both can be declared in this module.
+@group(2) @binding(9) var<uniform> u_deferred: DeferredUniform;
+@group(2) @binding(10) var gbuffer_albedo_metalness: texture_2d<f32>;
+@group(2) @binding(11) var gbuffer_normal_roughness: texture_2d<f32>;
+@group(2) @binding(12) var gbuffer_material_parameters: texture_2d<f32>;
+@group(2) @binding(13) var gbuffer_view_depth: texture_2d<f32>;
+@group(2) @binding(14) var gbuffer_depth: texture_depth_2d;
 
 @vertex
 fn vertexShaderMain(vertex_input: VertexInput) -> FragmentInput {
@@ -118,22 +166,14 @@ fn vertexShaderMain(vertex_input: VertexInput) -> FragmentInput {
   in.instance_index = vertex_input.instance_index;
   return in;
 }
-fn unpackPosition(raw_position: vec3<i32>) -> vec3<f32> {
-  let position_lo = vec3<f32>(
-    f32(raw_position.x & 0xFFFFF) / 1048576.0,
-    f32(raw_position.y & 0xFFFFF) / 1048576.0,
-    f32(raw_position.z & 0xFFFFF) / 1048576.0,
-  );
-  let position_hi = vec3<f32>(
-    f32(raw_position.x >> 20),
-    f32(raw_position.y >> 20),
-    f32(raw_position.z >> 20),
-  );
-  return position_hi + position_lo;
-}
+
+/// The parameters of the material of the instance being shaded, looked up by 'fragmentShaderMain' and
+/// 'gbufferFragmentShaderMain', or read back from the G-buffer by 'deferredFragmentShaderMain'.
+var<private> material: MaterialUniform;
 
 @fragment
 fn fragmentShaderMain(in: FragmentInput) -> @location(0) vec4f {
+  material = u_materials[u_instance_materials[in.instance_index / 4u][in.instance_index % 4u]];
   // return vec4(computeNormal(in.world_normal.xyz, in.world_tangent.xyz, in.world_bitangent.xyz, in.uv), 1.0);
   switch (p_LIGHTING_MODEL) {
     case 1: { return blinnPhongMain(in); }
@@ -142,20 +182,116 @@ fn fragmentShaderMain(in: FragmentInput) -> @location(0) vec4f {
   }
 }
 
+// Deferred shading: the G-buffer pass writes every material parameter lighting reads, and the lighting pass then shades
+// each covered pixel exactly once, however many meshes were drawn over it.
+// - 'albedo_metalness' holds the albedo and metalness,
+// - 'normal_roughness' holds the world-space normal and roughness,
+// - 'material_parameters' holds the Blinn-Phong shininess (in x) or the PBR Fresnel reflectance (in xyz), then the
+//   lighting model (in w),
+// - 'view_depth' holds the distance along the view axis, from which the world position is reconstructed: the log depth
+//   buffer is interpolated linearly in screen space, so it is too coarse across large triangles.
+@fragment
+fn gbufferFragmentShaderMain(in: FragmentInput) -> GBufferOutput {
+  material = u_materials[u_instance_materials[in.instance_index / 4u][in.instance_index % 4u]];
+  var out: GBufferOutput;
+  let normal = computeNormal(in.world_normal.xyz, in.world_tangent.xyz, in.world_bitangent.xyz, in.uv);
+  out.albedo_metalness = vec4<f32>(sampleAlbedo(in.uv), sampleMetalness(in.uv));
+  out.normal_roughness = vec4<f32>(normal, sampleRoughness(in.uv));
+  switch (p_LIGHTING_MODEL) {
+    case 1: { out.material_parameters = vec4<f32>(material.blinn_phong_shininess, 0.0, 0.0, 1.0); }
+    default: { out.material_parameters = vec4<f32>(material.pbr_fresnel0.xyz, 2.0); }
+  }
+  out.view_depth = -(u_camera.view_matrix * vec4<f32>(in.world_position.xyz, 1.0)).z;
+  return out;
+}
+
+@vertex
+fn deferredVertexShaderMain(@builtin(vertex_index) vertex_index: u32) -> @builtin(position) vec4<f32> {
+  return fullscreenTrianglePosition(vertex_index);
+}
+
+@fragment
+fn deferredFragmentShaderMain(@builtin(position) frag_coord: vec4<f32>) -> @location(0) vec4<f32> {
+  // Pixels no mesh was drawn over keep the scene's clear value:
+  let coord = vec2<u32>(frag_coord.xy);
+  if (textureLoad(gbuffer_depth, coord, 0) >= 1.0) {
+    discard;
+  }
+  let albedo_metalness = textureLoad(gbuffer_albedo_metalness, coord, 0);
+  let normal_roughness = textureLoad(gbuffer_normal_roughness, coord, 0);
+  let material_parameters = textureLoad(gbuffer_material_parameters, coord, 0);
+  let view_depth = textureLoad(gbuffer_view_depth, coord, 0).r;
+
+  // Reconstructing the position along the pixel's view ray:
+  let screen_size = vec2<f32>(textureDimensions(gbuffer_view_depth));
+  let ndc = vec2<f32>(2.0 * frag_coord.x / screen_size.x - 1.0, 1.0 - 2.0 * frag_coord.y / screen_size.y);
+  let view_position = vec3<f32>(
+    ndc.x * view_depth / (u_camera.camera_cot_half_fovy * u_camera.camera_aspect_inv),
+    ndc.y * view_depth / u_camera.camera_cot_half_fovy,
+    -view_depth
+  );
+
+  var surface: Surface;
+  surface.frag_coord = frag_coord.xy;
+  surface.position = (u_deferred.camera_transform_matrix * vec4<f32>(view_position, 1.0)).xyz;
+  surface.normal = normal_roughness.xyz;
+  surface.albedo = albedo_metalness.rgb;
+  surface.metalness = albedo_metalness.a;
+  surface.roughness = normal_roughness.w;
+  material.blinn_phong_shininess = material_parameters.x;
+  material.pbr_fresnel0 = vec4<f32>(material_parameters.xyz, 0.0);
+  switch (u32(round(material_parameters.w))) {
+    case 1u: { return vec4<f32>(shadeBlinnPhong(surface), 1.0); }
+    default: { return vec4<f32>(shadePbr(surface), 1.0); }
+  }
+}
+
 fn albedoUv(uv: vec2<f32>) -> vec2<f32> {
-  return computeVirtualUv(uv, u_material.albedo_uv_offset, u_material.albedo_uv_size);
+  return computeVirtualUv(uv, material.albedo_uv_offset, material.albedo_uv_size);
 }
 fn normalUv(uv: vec2<f32>) -> vec2<f32> {
-  return computeVirtualUv(uv, u_material.normal_uv_offset, u_material.normal_uv_size);
+  return computeVirtualUv(uv, material.normal_uv_offset, material.normal_uv_size);
 }
 fn metalnessUv(uv: vec2<f32>) -> vec2<f32> {
-  return computeVirtualUv(uv, u_material.metalness_uv_offset, u_material.metalness_uv_size);
+  return computeVirtualUv(uv, material.metalness_uv_offset, material.metalness_uv_size);
 }
 fn roughnessUv(uv: vec2<f32>) -> vec2<f32> {
-  return computeVirtualUv(uv, u_material.roughness_uv_offset, u_material.roughness_uv_size);
+  return computeVirtualUv(uv, material.roughness_uv_offset, material.roughness_uv_size);
 }
+/// Atlased textures (any view but the whole texture) are always clamped to their edges, which their page's sampler
+/// cannot do for a sub-rectangle, so their UVs are clamped before remapping. Whole textures are left to their sampler.
 fn computeVirtualUv(uv: vec2<f32>, offset: vec2<f32>, size: vec2<f32>) -> vec2<f32> {
-  return offset + uv * size;
+  let is_atlased = any(size != vec2<f32>(1.0));
+  let clamped_uv = select(uv, clamp(uv, vec2<f32>(0.0), vec2<f32>(1.0)), is_atlased);
+  return offset + clamped_uv * size;
+}
+
+// Material parameters: constant materials read their uniform and never touch their (placeholder) textures.
+// Textures are sampled with implicit derivatives so that their mip chains apply: branching on p_MATERIAL_SOURCE keeps
+// control flow uniform.
+fn sampleAlbedo(uv: vec2<f32>) -> vec3<f32> {
+  if (p_MATERIAL_SOURCE == 0u) {
+    return material.albedo_constant.xyz;
+  }
+  return textureSample(albedo_texture, albedo_texture_sampler, albedoUv(uv)).xyz;
+}
+fn sampleNormal(uv: vec2<f32>) -> vec3<f32> {
+  if (p_MATERIAL_SOURCE == 0u) {
+    return material.normal_constant.xyz;
+  }
+  return textureSample(normal_texture, normal_texture_sampler, normalUv(uv)).xyz;
+}
+fn sampleMetalness(uv: vec2<f32>) -> f32 {
+  if (p_MATERIAL_SOURCE == 0u) {
+    return material.metalness_constant;
+  }
+  return textureSample(metalness_texture, metalness_texture_sampler, metalnessUv(uv)).x;
+}
+fn sampleRoughness(uv: vec2<f32>) -> f32 {
+  if (p_MATERIAL_SOURCE == 0u) {
+    return material.roughness_constant;
+  }
+  return textureSample(roughness_texture, roughness_texture_sampler, roughnessUv(uv)).x;
 }
 
 fn computeNormal(normal: vec3<f32>, tangent: vec3<f32>, bitangent: vec3<f32>, uv: vec2<f32>) -> vec3<f32> {
@@ -166,7 +302,7 @@ fn computeNormal(normal: vec3<f32>, tangent: vec3<f32>, bitangent: vec3<f32>, uv
   // texture coordinates (UV) used to define the tangent and bitangent are different than those used to query textures:
   // the V axis is inverted.
   let is_tangent_zero = dot(tangent, tangent) <= 1e-5f;
-  let sample = textureSampleLevel(normal_texture, normal_texture_sampler, normalUv(uv), 0.0).xyz;
+  let sample = sampleNormal(uv);
   if is_tangent_zero {
     return normal;
   } else {
@@ -198,31 +334,174 @@ fn perspectiveProjection(in: vec4<f32>) -> vec4<f32> {
   );
 }
 
+// Clustered point lights
+/// Returns the offset of the light list of the cluster containing a fragment in 'u_cluster_lights': the first entry is
+/// the light count, followed by the indices of the lights. See 'light_cluster.wgsl', which builds these lists.
+fn clusterBase(frag_coord: vec2<f32>, world_position: vec3<f32>) -> u32 {
+  let grid = vec3<u32>(p_CLUSTER_GRID_X, p_CLUSTER_GRID_Y, p_CLUSTER_GRID_Z);
+  let view_depth = -(u_camera.view_matrix * vec4<f32>(world_position, 1.0)).z;
+  let tile = vec2<u32>(clamp(
+    frag_coord / u_cluster.screen_size * vec2<f32>(grid.xy),
+    vec2<f32>(0.0),
+    vec2<f32>(grid.xy - 1u)
+  ));
+  let zmin = u_camera.camera_zmin;
+  let zmax = u_camera.camera_zmax;
+  let slice_f = log(max(view_depth, zmin) / zmin) / log(zmax / zmin) * f32(grid.z);
+  let slice = u32(clamp(slice_f, 0.0, f32(grid.z - 1u)));
+  let cluster_index = (slice * grid.y + tile.y) * grid.x + tile.x;
+  return cluster_index * (p_CLUSTER_LIGHT_CAPACITY + 1u);
+}
+/// Smoothly fades a point light to zero at its range, so that culling lights by range introduces no seams.
+/// See: https://www.unrealengine.com/en-US/blog/physically-based-shading-on-mobile (Karis, 2013)
+fn rangeWindow(light_distance: f32, range: f32) -> f32 {
+  let ratio = light_distance / range;
+  let ratio4 = ratio * ratio * ratio * ratio;
+  let window = clamp(1.0 - ratio4, 0.0, 1.0);
+  return window * window;
+}
+
+// Shadows
+/// Returns the fraction of light from directional light 'light_index' that reaches 'world_position'.
+/// Cascaded shadow maps cover the first 'light_count' directional lights, while the virtual shadow map only covers the
+/// first one.
+fn directionalShadowVisibility(light_index: u32, world_position: vec3<f32>) -> f32 {
+  if (u_cascade.is_enabled != 0u) {
+    if (light_index >= u_cascade.light_count) {
+      return 1.0;
+    }
+    return cascadedShadowVisibility(light_index, world_position);
+  }
+  if (light_index != 0u) {
+    return 1.0;
+  }
+  return virtualShadowVisibility(world_position);
+}
+/// Picks the nearest cascade containing 'world_position' by view depth, then samples it using the representation the
+/// cascades were rendered with (1 = depth with 2x2 PCF, 2 = filtered EVSM moments).
+fn cascadedShadowVisibility(light_index: u32, world_position: vec3<f32>) -> f32 {
+  let view_depth = -(u_camera.view_matrix * vec4<f32>(world_position, 1.0)).z;
+  var cascade_index = u_cascade.cascade_count;
+  for (var i = 0u; i < u_cascade.cascade_count; i++) {
+    if (view_depth <= u_cascade.cascade_max_distances[i].x) {
+      cascade_index = i;
+      break;
+    }
+  }
+  if (cascade_index == u_cascade.cascade_count) {
+    return 1.0;
+  }
+  let layer = light_index * u_cascade.cascade_count + cascade_index;
+  let light_clip = u_cascade.proj_view_matrices[layer] * vec4<f32>(world_position, 1.0);
+  let uv = vec2<f32>(0.5 * light_clip.x + 0.5, 0.5 - 0.5 * light_clip.y);
+  if (any(uv < vec2<f32>(0.0)) || any(uv > vec2<f32>(1.0)) || light_clip.z < 0.0 || light_clip.z > 1.0) {
+    return 1.0;
+  }
+  switch (u_cascade.representation) {
+    case 2u: { return evsmVisibility(uv, layer, light_clip.z); }
+    default: { return pcfVisibility(uv, layer, light_clip.z - u_cascade.depth_bias); }
+  }
+}
+fn pcfVisibility(uv: vec2<f32>, layer: u32, depth: f32) -> f32 {
+  let size = vec2<i32>(textureDimensions(cascade_texture));
+  let texel = uv * vec2<f32>(size) - 0.5;
+  let base = vec2<i32>(floor(texel));
+  let weight = fract(texel);
+  var lit = vec4<f32>(0.0);
+  for (var i = 0; i < 4; i++) {
+    let coord = clamp(base + vec2<i32>(i & 1, i >> 1u), vec2<i32>(0), size - 1);
+    let occluder_depth = textureLoad(cascade_texture, coord, layer, 0).r;
+    lit[i] = select(0.0, 1.0, depth <= occluder_depth);
+  }
+  return mix(mix(lit.x, lit.y, weight.x), mix(lit.z, lit.w, weight.x), weight.y);
+}
+fn evsmVisibility(uv: vec2<f32>, layer: u32, depth: f32) -> f32 {
+  let moments = textureSampleLevel(cascade_texture, cascade_sampler, uv, layer, 0.0);
+  let warped_depth = 2.0 * depth - 1.0;
+  let positive = exp(u_cascade.evsm_exponents.x * warped_depth);
+  let negative = -exp(-u_cascade.evsm_exponents.y * warped_depth);
+  let positive_min_variance = 1e-4 * positive * positive;
+  let negative_min_variance = 1e-4 * negative * negative;
+  let positive_visibility = chebyshevUpperBound(moments.xy, positive, positive_min_variance);
+  let negative_visibility = chebyshevUpperBound(moments.zw, negative, negative_min_variance);
+  return min(positive_visibility, negative_visibility);
+}
+/// The one-tailed Chebyshev inequality bounds the fraction of occluders further than 't', with the low end of the bound
+/// cut off to reduce light bleeding.
+fn chebyshevUpperBound(moments: vec2<f32>, t: f32, min_variance: f32) -> f32 {
+  if (t <= moments.x) {
+    return 1.0;
+  }
+  let variance = max(moments.y - moments.x * moments.x, min_variance);
+  let d = t - moments.x;
+  let p_max = variance / (variance + d * d);
+  let reduction = u_cascade.evsm_light_bleed_reduction;
+  return clamp((p_max - reduction) / (1.0 - reduction), 0.0, 1.0);
+}
+/// Marks the virtual page covering 'world_position' as requested (so the CPU renders it for the next frame), then 
+/// samples it if it is already resident. Pages that are not resident yet are treated as fully lit.
+fn virtualShadowVisibility(world_position: vec3<f32>) -> f32 {
+  if (u_vsm.is_enabled == 0u) {
+    return 1.0;
+  }
+  let light_clip = u_vsm.proj_view_matrix * vec4<f32>(world_position, 1.0);
+  let uv = vec2<f32>(0.5 * light_clip.x + 0.5, 0.5 - 0.5 * light_clip.y);
+  if (any(uv < vec2<f32>(0.0)) || any(uv >= vec2<f32>(1.0)) || light_clip.z < 0.0 || light_clip.z > 1.0) {
+    return 1.0;
+  }
+  let texel = uv * f32(u_vsm.page_table_size * u_vsm.page_size) / f32(u_vsm.page_size);
+  let page_coord = min(vec2<u32>(texel), vec2<u32>(u_vsm.page_table_size - 1u));
+  let page_index = page_coord.y * u_vsm.page_table_size + page_coord.x;
+  u_vsm_page_requests[page_index] = 1u;
+  let page_entry = u_vsm_page_table[page_index];
+  if (page_entry == 0u) {
+    return 1.0;
+  }
+  let page_uv = fract(texel);
+  return textureSampleCompareLevel(
+    vsm_atlas_texture, vsm_atlas_sampler,
+    page_uv, page_entry - 1u,
+    light_clip.z - u_vsm.depth_bias
+  );
+}
+
 // Blinn-Phong
 // see: https://learnopengl.com/Advanced-Lighting/Advanced-Lighting
 // see: https://www.rorydriscoll.com/2009/01/25/energy-conservation-in-games/
 fn blinnPhongMain(in: FragmentInput) -> vec4<f32> {
-  let albedo = textureSampleLevel(albedo_texture, albedo_texture_sampler, albedoUv(in.uv), 0.0).xyz;
-  let normal = computeNormal(in.world_normal.xyz, in.world_tangent.xyz, in.world_bitangent.xyz, in.uv);
-  let position = in.world_position.xyz;
+  var surface: Surface;
+  surface.frag_coord = in.clip_position.xy;
+  surface.position = in.world_position.xyz;
+  surface.normal = computeNormal(in.world_normal.xyz, in.world_tangent.xyz, in.world_bitangent.xyz, in.uv);
+  surface.albedo = sampleAlbedo(in.uv);
+  return vec4(shadeBlinnPhong(surface), 1.0);
+}
+fn shadeBlinnPhong(surface: Surface) -> vec3<f32> {
+  let albedo = surface.albedo;
+  let normal = surface.normal;
+  let position = surface.position;
   var result = blinnPhongAmbient(albedo, u_light.ambient_glow).xyz;
   for (var i = 0u; i < u_light.directional_light_count; i += 1) {
     let light_dir = u_light.directional_light_dir_array[i].xyz;
     let light_color = u_light.directional_light_color_array[i].xyz;
+    let visibility = directionalShadowVisibility(i, position);
     result = clamp(
-      result + blinnPhongDir(albedo, normal, position, light_dir, light_color),
+      result + visibility * blinnPhongDir(albedo, normal, position, light_dir, light_color),
       vec3(0.0), vec3(1.0)
     );
   }
-  for (var i = 0u; i < u_light.point_light_count; i += 1) {
-    let light_pos = u_light.point_light_pos_array[i].xyz;
-    let light_color = u_light.point_light_color_array[i].xyz;
+  let cluster_base = clusterBase(surface.frag_coord, position);
+  let cluster_light_count = u_cluster_lights[cluster_base];
+  for (var j = 0u; j < cluster_light_count; j += 1) {
+    let light = u_point_lights[u_cluster_lights[cluster_base + 1u + j]];
+    let light_pos = light.position_range.xyz;
+    let light_color = light.color.xyz * rangeWindow(distance(light_pos, position), light.position_range.w);
     result = clamp(
       result + blinnPhongPt(albedo, normal, position, light_pos, light_color),
       vec3(0.0), vec3(1.0)
     );
   }
-  return vec4(result, 1.0);
+  return result;
 }
 fn blinnPhongDir(
   albedo: vec3<f32>, world_normal: vec3<f32>, world_position: vec3<f32>,
@@ -237,7 +516,7 @@ fn blinnPhongSpecularDir(
   world_normal: vec3<f32>, world_position: vec3<f32>,
   light_dir: vec3<f32>, light_color: vec3<f32>
 ) -> vec3<f32> {
-  let shininess = u_material.blinn_phong_shininess;
+  let shininess = material.blinn_phong_shininess;
   let normal = world_normal;
   let view_pos = u_camera.world_position.xyz;
   let frag_pos = world_position;
@@ -269,7 +548,7 @@ fn blinnPhongSpecularPt(
   world_normal: vec3<f32>, world_position: vec3<f32>,
   light_pos: vec3<f32>, light_color: vec3<f32>
 ) -> vec3<f32> {
-  let shininess = u_material.blinn_phong_shininess;
+  let shininess = material.blinn_phong_shininess;
   let normal = world_normal;
   let view_pos = u_camera.world_position.xyz;
   let frag_pos = world_position;
@@ -294,30 +573,43 @@ fn blinnPhongAmbient(albedo: vec3<f32>, ambient_glow: f32) -> vec3<f32> {
 
 // see: https://learnopengl.com/PBR/Lighting
 fn pbrMain(in: FragmentInput) -> vec4<f32> {
-  let exposure_bias = u_camera.hdr_exposure_bias;
+  var surface: Surface;
+  surface.frag_coord = in.clip_position.xy;
+  surface.position = in.world_position.xyz;
+  surface.normal = computeNormal(in.world_normal.xyz, in.world_tangent.xyz, in.world_bitangent.xyz, in.uv);
+  surface.albedo = sampleAlbedo(in.uv);
+  surface.metalness = sampleMetalness(in.uv);
+  surface.roughness = sampleRoughness(in.uv);
+  // Tonemapping and exposure are applied once per pixel, by the tonemap pass.
+  return vec4<f32>(shadePbr(surface), 1.0f);
+}
+fn shadePbr(surface: Surface) -> vec3<f32> {
   let pbr_ao = 1.0f;
-  let fresnel0 = u_material.pbr_fresnel0.xyz;
-  let albedo = textureSampleLevel(albedo_texture, albedo_texture_sampler, albedoUv(in.uv), 0.0).xyz;
-  let metalness = textureSampleLevel(metalness_texture, metalness_texture_sampler, metalnessUv(in.uv), 0.0).x;
-  let roughness = textureSampleLevel(roughness_texture, roughness_texture_sampler, roughnessUv(in.uv), 0.0).x;
-  let normal = computeNormal(in.world_normal.xyz, in.world_tangent.xyz, in.world_bitangent.xyz, in.uv);
-  let position = in.world_position.xyz;
+  let fresnel0 = material.pbr_fresnel0.xyz;
+  let albedo = surface.albedo;
+  let metalness = surface.metalness;
+  let roughness = surface.roughness;
+  let normal = surface.normal;
+  let position = surface.position;
 
   var lo = vec3<f32>(0.0);
   var i: u32;
   for (i = 0u; i < u_light.directional_light_count; i += 1) {
     let light_dir = -u_light.directional_light_dir_array[i].xyz;
     let light_color = u_light.directional_light_color_array[i].xyz;
-    lo += pbrDir(position, fresnel0, albedo, normal, metalness, roughness, light_dir, light_color, 1.0);
+    let visibility = directionalShadowVisibility(i, position);
+    lo += pbrDir(position, fresnel0, albedo, normal, metalness, roughness, light_dir, light_color, visibility);
   }
-  for (i = 0u; i < u_light.point_light_count; i++) {
-    let light_pos = u_light.point_light_pos_array[i].xyz;
-    let light_color = u_light.point_light_color_array[i].xyz;
+  let cluster_base = clusterBase(surface.frag_coord, position);
+  let cluster_light_count = u_cluster_lights[cluster_base];
+  for (i = 0u; i < cluster_light_count; i++) {
+    let light = u_point_lights[u_cluster_lights[cluster_base + 1u + i]];
+    let light_pos = light.position_range.xyz;
+    let light_color = light.color.xyz * rangeWindow(distance(light_pos, position), light.position_range.w);
     lo += pbrPt(position, fresnel0, albedo, normal, metalness, roughness, light_pos, light_color);
   }
   let ambient = vec3<f32>(u_light.ambient_glow) * albedo * pbr_ao;
-  let color_hdr = ambient + lo;
-  return vec4<f32>(naughtyDogTonemap(color_hdr.xyz, exposure_bias), 1.0f);
+  return ambient + lo;
 }
 fn pbrPt(
   world_position: vec3<f32>,
@@ -388,28 +680,3 @@ fn distributionGGX(n: vec3<f32>, h: vec3<f32>, roughness: f32) -> f32 {
 fn fresnelSchlick(cos_theta: f32, f0: vec3<f32>) -> vec3<f32> {
   return f0 + (1.0 - f0) * pow(clamp(1.0 - cos_theta, 0.0, 1.0), 5.0);
 }
-fn reinhardTonemap(color0: vec3<f32>) -> vec3<f32> {
-  let color1 = color0 / (color0 + vec3(1.0));
-  let color2 = pow(color1, vec3(1.0/2.2));
-  return color2;
-}
-fn naughtyDogTonemap(x: vec3<f32>, exposure_bias: f32) -> vec3<f32> {
-  // Naughty Dog filmic tonemapping operator.
-  // See: http://www.adriancourreges.com/blog/2015/11/02/gta-v-graphics-study/
-  // See: http://duikerresearch.com/2015/09/filmic-tonemapping-for-real-time-rendering/
-  // 'exposure_bias' is an exposure quantity used to control exposure time.
-  const w = 11.20f;
-  let curr = exposure_bias * naughtyDogTonemapHelper(x);
-  let white_scale = 1.0f / naughtyDogTonemapHelper(vec3<f32>(w));
-  let color = curr * white_scale;
-  return pow(color, vec3<f32>(1.0f/2.2f));
-}
-fn naughtyDogTonemapHelper(x: vec3<f32>) -> vec3<f32> {
-  const a = 0.15f;
-  const b = 0.50f;
-  const c = 0.10f;
-  const d = 0.20f;
-  const e = 0.02f;
-  const f = 0.30f;
-  return (x * (a * x + c * b) + d * e) / (x * (a * x + b) + d * f) - (e / f);
-}
@@ -0,0 +1,58 @@
+#include "include/fullscreen.wgsl"
+
+// Upscales the tonemapped scene, drawn at a reduced render scale, to the target's resolution with a Catmull-Rom filter,
+// which stays noticeably sharper than a bilinear one. The 4x4 filter footprint is covered by 9 bilinear taps, by
+// merging each pair of inner taps into one tap between them.
+// See: https://gist.github.com/TheRealMJP/c83b8c0f46b63f3a88a5986f4fa982b1
+
+@group(0) @binding(0) var u_source: texture_2d<f32>;
+@group(0) @binding(1) var u_source_sampler: sampler;
+
+struct FragmentInput {
+  @builtin(position) clip_position: vec4<f32>,
+  @location(0) uv: vec2<f32>,
+}
+
+@vertex
+fn vertexShaderMain(@builtin(vertex_index) vertex_index: u32) -> FragmentInput {
+  var out: FragmentInput;
+  out.clip_position = fullscreenTrianglePosition(vertex_index);
+  out.uv = vec2<f32>(0.5, -0.5) * out.clip_position.xy + 0.5;
+  return out;
+}
+
+@fragment
+fn fragmentShaderMain(in: FragmentInput) -> @location(0) vec4<f32> {
+  let source_size = vec2<f32>(textureDimensions(u_source, 0));
+  let sample_position = in.uv * source_size;
+  let texel_position_1 = floor(sample_position - 0.5) + 0.5;
+  let f = sample_position - texel_position_1;
+
+  // Catmull-Rom weights of the 4 texels around the sample position along each axis:
+  let w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+  let w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+  let w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+  let w3 = f * f * (-0.5 + 0.5 * f);
+  let w12 = w1 + w2;
+  let uv_0 = (texel_position_1 - 1.0) / source_size;
+  let uv_12 = (texel_position_1 + w2 / w12) / source_size;
+  let uv_3 = (texel_position_1 + 2.0) / source_size;
+
+  var color = vec4<f32>(0.0);
+  color += sampleSource(vec2<f32>(uv_0.x, uv_0.y)) * w0.x * w0.y;
+  color += sampleSource(vec2<f32>(uv_12.x, uv_0.y)) * w12.x * w0.y;
+  color += sampleSource(vec2<f32>(uv_3.x, uv_0.y)) * w3.x * w0.y;
+  color += sampleSource(vec2<f32>(uv_0.x, uv_12.y)) * w0.x * w12.y;
+  color += sampleSource(vec2<f32>(uv_12.x, uv_12.y)) * w12.x * w12.y;
+  color += sampleSource(vec2<f32>(uv_3.x, uv_12.y)) * w3.x * w12.y;
+  color += sampleSource(vec2<f32>(uv_0.x, uv_3.y)) * w0.x * w3.y;
+  color += sampleSource(vec2<f32>(uv_12.x, uv_3.y)) * w12.x * w3.y;
+  color += sampleSource(vec2<f32>(uv_3.x, uv_3.y)) * w3.x * w3.y;
+
+  // The filter's negative lobes overshoot around sharp edges:
+  return clamp(color, vec4<f32>(0.0), vec4<f32>(1.0));
+}
+
+fn sampleSource(uv: vec2<f32>) -> vec4<f32> {
+  return textureSampleLevel(u_source, u_source_sampler, uv, 0.0);
+}
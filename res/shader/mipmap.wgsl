@@ -0,0 +1,24 @@
+// Overrides:
+override p_WORKGROUP_SIZE: u32;   // the width and height of each workgroup
+
+@group(0) @binding(0) var src_texture: texture_2d<f32>;
+@group(0) @binding(1) var dst_texture: texture_storage_2d<rgba8unorm, write>;
+
+/// Computes one texel of the next mip level as the 2x2 box average of the level above it. Odd source dimensions clamp
+/// the last row/column rather than reading out of bounds.
+@compute @workgroup_size(p_WORKGROUP_SIZE, p_WORKGROUP_SIZE)
+fn downsampleMain(@builtin(global_invocation_id) id: vec3<u32>) {
+  let coord = vec2<i32>(id.xy);
+  if (any(coord >= vec2<i32>(textureDimensions(dst_texture)))) {
+    return;
+  }
+  let src_max = vec2<i32>(textureDimensions(src_texture)) - 1;
+  let base = 2 * coord;
+  var sum = vec4<f32>(0.0);
+  for (var dy = 0; dy < 2; dy++) {
+    for (var dx = 0; dx < 2; dx++) {
+      sum += textureLoad(src_texture, min(base + vec2<i32>(dx, dy), src_max), 0);
+    }
+  }
+  textureStore(dst_texture, coord, 0.25 * sum);
+}
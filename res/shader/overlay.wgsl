@@ -1,5 +1,5 @@
-// Parameters:
-// - p_SAMPLE_MODE: u32 => whether to broadcast a monochrome sample (1) or reproduce color (2)
+// Overrides:
+override p_SAMPLE_MODE: u32;   // whether to broadcast a monochrome sample (1) or reproduce color (4)
 
 struct VertexInput {
   @location(0) normalized_offset: vec2f,
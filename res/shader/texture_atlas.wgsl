@@ -0,0 +1,31 @@
+@group(0) @binding(0) var src_texture: texture_2d<f32>;
+
+struct FragmentInput {
+  @builtin(position) clip_position: vec4<f32>,
+  @location(0) texel_position: vec2<f32>,
+}
+
+/// Draws a single triangle covering the viewport, which spans one mip level of a packed texture and its gutter. The
+/// gutter width (in texels of this mip level) is passed as the instance index, so that 'texel_position' runs from
+/// '-gutter' to 'size + gutter' across the viewport.
+@vertex
+fn vertexShaderMain(
+  @builtin(vertex_index) vertex_index: u32,
+  @builtin(instance_index) gutter_size: u32
+) -> FragmentInput {
+  let uv = vec2<f32>(f32((vertex_index << 1u) & 2u), f32(vertex_index & 2u));
+  let gutter = f32(gutter_size);
+  let size = vec2<f32>(textureDimensions(src_texture));
+  var out: FragmentInput;
+  out.clip_position = vec4<f32>(2.0 * uv.x - 1.0, 1.0 - 2.0 * uv.y, 0.0, 1.0);
+  out.texel_position = uv * (size + 2.0 * gutter) - gutter;
+  return out;
+}
+
+/// Copies the source texel, or the nearest edge texel within the gutter.
+@fragment
+fn fragmentShaderMain(in: FragmentInput) -> @location(0) vec4<f32> {
+  let src_max = vec2<i32>(textureDimensions(src_texture)) - 1;
+  let coord = clamp(vec2<i32>(floor(in.texel_position)), vec2<i32>(0), src_max);
+  return textureLoad(src_texture, coord, 0);
+}
@@ -0,0 +1,146 @@
+#include "broccoli/engine/blob_cache.hh"
+
+#include <fstream>
+#include <span>
+#include <vector>
+#include <algorithm>
+#include <system_error>
+
+//
+// PipelineBlobCache:
+//
+
+namespace broccoli {
+  PipelineBlobCache::PipelineBlobCache(std::filesystem::path root_directory)
+  : m_root_directory(std::move(root_directory) / ("v" + std::to_string(VERSION))),
+    m_adapter_directory(),
+    m_isolation_key(),
+    m_store_mutex(),
+    m_hit_count(0),
+    m_miss_count(0),
+    m_store_count(0)
+  {}
+}
+namespace broccoli {
+  void PipelineBlobCache::setAdapter(wgpu::Adapter const &adapter) {
+    // Blobs compiled for one adapter or driver are useless to another, so each gets its own directory.
+    wgpu::AdapterProperties properties = {};
+    adapter.GetProperties(&properties);
+    Fnv1aHasher hasher;
+    hasher.write(&properties.vendorID);
+    hasher.write(&properties.deviceID);
+    hasher.write(&properties.backendType);
+    hasher.write(&properties.adapterType);
+    for (const char *s: {properties.name, properties.driverDescription}) {
+      if (s != nullptr) {
+        hasher.write(std::span<const uint8_t>{reinterpret_cast<const uint8_t*>(s), std::char_traits<char>::length(s)});
+      }
+      hasher.write(static_cast<uint8_t>(0));
+    }
+    m_isolation_key = fmt::format("{:016x}", hasher.finish());
+    m_adapter_directory = m_root_directory / m_isolation_key;
+  }
+  std::string const &PipelineBlobCache::isolationKey() const {
+    return m_isolation_key;
+  }
+}
+namespace broccoli {
+  uint64_t PipelineBlobCache::hitCount() const {
+    return m_hit_count.load(std::memory_order_relaxed);
+  }
+  uint64_t PipelineBlobCache::missCount() const {
+    return m_miss_count.load(std::memory_order_relaxed);
+  }
+  uint64_t PipelineBlobCache::storeCount() const {
+    return m_store_count.load(std::memory_order_relaxed);
+  }
+}
+namespace broccoli {
+  dawn::platform::CachingInterface *PipelineBlobCache::GetCachingInterface() {
+    return this;
+  }
+}
+namespace broccoli {
+  size_t PipelineBlobCache::LoadData(const void *key, size_t key_size, void *value_out, size_t value_size) {
+    // Dawn first queries the size with 'value_out == nullptr', then loads into a buffer of that size: only the query
+    // counts towards hits and misses.
+    bool is_query = value_out == nullptr;
+    auto miss = [this, is_query] () -> size_t {
+      if (is_query) {
+        m_miss_count.fetch_add(1, std::memory_order_relaxed);
+      }
+      return 0;
+    };
+    if (m_adapter_directory.empty()) {
+      return miss();
+    }
+    std::ifstream f{blobPath(key, key_size), std::ios::binary | std::ios::ate};
+    if (!f.good()) {
+      return miss();
+    }
+
+    // Checking the stored key:
+    auto file_size = static_cast<size_t>(f.tellg());
+    f.seekg(0, std::ios::beg);
+    uint64_t stored_key_size = 0;
+    f.read(reinterpret_cast<char*>(&stored_key_size), sizeof(stored_key_size));
+    if (!f.good() || stored_key_size != key_size || file_size < sizeof(stored_key_size) + key_size) {
+      return miss();
+    }
+    std::vector<char> stored_key(key_size);
+    f.read(stored_key.data(), static_cast<std::streamsize>(key_size));
+    if (!f.good() || !std::equal(stored_key.begin(), stored_key.end(), static_cast<const char*>(key))) {
+      return miss();
+    }
+
+    // Reading the value:
+    size_t blob_size = file_size - sizeof(stored_key_size) - key_size;
+    if (is_query) {
+      m_hit_count.fetch_add(1, std::memory_order_relaxed);
+      return blob_size;
+    }
+    if (value_size < blob_size) {
+      return 0;
+    }
+    f.read(static_cast<char*>(value_out), static_cast<std::streamsize>(blob_size));
+    return f.good() ? blob_size : 0;
+  }
+  void PipelineBlobCache::StoreData(const void *key, size_t key_size, const void *value, size_t value_size) {
+    if (m_adapter_directory.empty()) {
+      return;
+    }
+
+    // Blobs are written to a temporary file and then renamed, so that a crash mid-write never leaves a truncated blob
+    // behind. Failing to store is not an error: the next run just recompiles.
+    std::lock_guard lock{m_store_mutex};
+    std::error_code ec;
+    std::filesystem::create_directories(m_adapter_directory, ec);
+    if (ec) {
+      return;
+    }
+    auto path = blobPath(key, key_size);
+    auto tmp_path = path;
+    tmp_path += ".tmp";
+    {
+      std::ofstream f{tmp_path, std::ios::binary | std::ios::trunc};
+      uint64_t stored_key_size = key_size;
+      f.write(reinterpret_cast<const char*>(&stored_key_size), sizeof(stored_key_size));
+      f.write(static_cast<const char*>(key), static_cast<std::streamsize>(key_size));
+      f.write(static_cast<const char*>(value), static_cast<std::streamsize>(value_size));
+      if (!f.good()) {
+        return;
+      }
+    }
+    std::filesystem::rename(tmp_path, path, ec);
+    if (!ec) {
+      m_store_count.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+namespace broccoli {
+  std::filesystem::path PipelineBlobCache::blobPath(const void *key, size_t key_size) const {
+    Fnv1aHasher hasher;
+    hasher.write(std::span<const uint8_t>{static_cast<const uint8_t*>(key), key_size});
+    return m_adapter_directory / fmt::format("{:016x}.bin", hasher.finish());
+  }
+}
@@ -52,50 +52,3 @@ namespace broccoli {
     return res;
   }
 }
-
-//
-// String replacement:
-//
-
-namespace broccoli {
-  static std::string replaceAllHelper(const std::string &s, const std::string &find, const std::string &replacement) {
-    size_t offset = 0;
-    std::stringstream res;
-    while (offset < s.size()) {
-      size_t found = s.find(find, offset);
-      for (auto copy_idx = offset; copy_idx < std::min(s.size(), found); copy_idx++) {
-        res << s[copy_idx];
-      }
-      if (found == std::string::npos) {
-        break;
-      }
-      res << replacement;
-      offset = found + find.size();
-    }
-    return res.str();
-  }
-  std::string replaceAll(const std::string &s, std::unordered_map<std::string, std::string> const &rw_map) {
-    // TODO: switch to a more efficient Regex-based rewriting solution.
-    
-    // First, sort all keys by length:
-    std::vector<std::string> replaced_vec;
-    replaced_vec.reserve(rw_map.size());
-    for (const auto &[replaced, _]: rw_map) {
-      replaced_vec.push_back(replaced);
-    }
-    std::sort(
-      replaced_vec.begin(), replaced_vec.end(), 
-      [] (const std::string &lt, const std::string &rt) -> bool {
-        return lt.size() > rt.size();
-      }
-    );
-
-    // Next, replace from longest key to shortest:
-    std::string acc = s;
-    for (const auto &replaced: replaced_vec) {
-      acc = replaceAllHelper(std::move(acc), replaced, rw_map.find(replaced)->second);
-    }
-    
-    return acc;
-  }
-}
@@ -1,6 +1,7 @@
 #include "broccoli/engine/engine.hh"
 
 #include <iostream>
+#include <future>
 
 #include "webgpu/webgpu_cpp.h"
 #include "webgpu/webgpu_glfw.h"
@@ -8,6 +9,14 @@
 #include "dawn/native/DawnNative.h"
 #include "GLFW/glfw3.h"
 
+//
+// Engine constants:
+//
+
+namespace broccoli {
+  static const char *ENGINE_PIPELINE_CACHE_DIRECTORY = "cache";
+}
+
 //
 // Activity:
 //
@@ -58,13 +67,91 @@ namespace broccoli {
   }
 }
 
+//
+// Render submission thread:
+//
+
+namespace broccoli {
+  RenderSubmissionThread::RenderSubmissionThread(wgpu::Instance &instance, wgpu::SwapChain &swapchain, RenderManager &renderer)
+  : m_wgpu_instance(instance),
+    m_wgpu_swapchain(swapchain),
+    m_renderer(renderer),
+    m_mutex(),
+    m_packet_cv(),
+    m_idle_cv(),
+    m_packet(nullptr),
+    m_is_submitting(false),
+    m_is_stopping(false),
+    m_thread()
+  {
+    m_thread = std::thread([this] () { threadMain(); });
+  }
+  RenderSubmissionThread::~RenderSubmissionThread() {
+    waitUntilIdle();
+    {
+      std::lock_guard lock{m_mutex};
+      m_is_stopping = true;
+    }
+    m_packet_cv.notify_one();
+    m_thread.join();
+  }
+}
+namespace broccoli {
+  void RenderSubmissionThread::submit(std::unique_ptr<RenderFramePacket> packet) {
+    {
+      std::lock_guard lock{m_mutex};
+      CHECK(!m_is_submitting, "Expected the render thread to be idle before submitting a frame");
+      m_packet = std::move(packet);
+      m_is_submitting = true;
+    }
+    m_packet_cv.notify_one();
+  }
+  void RenderSubmissionThread::waitUntilIdle() {
+    std::unique_lock lock{m_mutex};
+    m_idle_cv.wait(lock, [this] () { return !m_is_submitting; });
+  }
+}
+namespace broccoli {
+  void RenderSubmissionThread::threadMain() {
+    for (;;) {
+      std::unique_ptr<RenderFramePacket> packet;
+      {
+        std::unique_lock lock{m_mutex};
+        m_packet_cv.wait(lock, [this] () { return m_is_stopping || m_packet != nullptr; });
+        if (m_packet == nullptr) {
+          return;
+        }
+        packet = std::move(m_packet);
+      }
+      {
+        auto submission_lock = m_renderer.lockSubmission();
+        if (packet->frame != nullptr) {
+          packet->frame->submit();
+        }
+        // The frame refers to the target texture view, so it is released first. The view must be released before the
+        // swapchain presents.
+        packet = nullptr;
+        m_wgpu_instance.ProcessEvents();
+      }
+      m_wgpu_swapchain.Present();
+      {
+        std::lock_guard lock{m_mutex};
+        m_is_submitting = false;
+      }
+      m_idle_cv.notify_all();
+    }
+  }
+}
+
 //
 // Engine
 //
 
 namespace broccoli {
   Engine::Engine(glm::ivec2 size, const char *caption, bool fullscreen, double fixed_update_hz)
-  : m_glfw(size, caption, fullscreen),
+  : m_startup_timeline(),
+    m_glfw(size, caption, fullscreen),
+    m_pipeline_blob_cache(std::make_unique<PipelineBlobCache>(ENGINE_PIPELINE_CACHE_DIRECTORY)),
     m_wgpu_instance(nullptr),
     m_wgpu_surface(nullptr),
     m_wgpu_adapter(nullptr),
@@ -77,55 +164,108 @@ namespace broccoli {
     m_fixed_update_accum_time(0.0),
     m_fixed_update_delta_sec(1.0 / fixed_update_hz),
     m_renderer(nullptr),
+    m_render_thread(nullptr),
     m_is_running(false)
   {
-    dawnProcSetProcs(&dawn::native::GetProcs());
+    // GLFW was initialized by 'm_glfw' above, right after the timeline started:
+    m_startup_timeline.record("Engine.Glfw", m_startup_timeline.origin(), StartupTimeline::Clock::now());
+
+    // The renderer's CPU-only inputs (shader sources, bitmaps) need no device, so they load on a worker thread while 
+    // the device is created below:
+    auto render_sources_future = std::async(std::launch::async, [this] () {
+      return RenderManager::loadSources(&m_startup_timeline);
+    });
 
     int framebuffer_width, framebuffer_height;
     glfwGetFramebufferSize(m_glfw.window(), &framebuffer_width, &framebuffer_height);
     m_framebuffer_size = glm::ivec2{framebuffer_width, framebuffer_height};
 
-    wgpu::InstanceDescriptor instance_descriptor = {};
-    m_wgpu_instance = wgpu::CreateInstance(&instance_descriptor);
-    CHECK(m_wgpu_instance != nullptr, "Failed to create a WebGPU instance");
+    {
+      auto scope = m_startup_timeline.scope("Engine.Instance");
+      dawnProcSetProcs(&dawn::native::GetProcs());
 
-    m_wgpu_surface = wgpu::glfw::CreateSurfaceForWindow(m_wgpu_instance, m_glfw.window());
-    CHECK(m_wgpu_surface != nullptr, "Failed to create a WebGPU surface");
+      // Dawn persists compiled shaders and pipelines through the platform's caching interface:
+      dawn::native::DawnInstanceDescriptor dawn_instance_descriptor;
+      dawn_instance_descriptor.platform = m_pipeline_blob_cache.get();
+      wgpu::InstanceDescriptor instance_descriptor = {.nextInChain = &dawn_instance_descriptor};
+      m_wgpu_instance = wgpu::CreateInstance(&instance_descriptor);
+      CHECK(m_wgpu_instance != nullptr, "Failed to create a WebGPU instance");
 
-    wgpu::RequestAdapterOptions adapter_opts = {.compatibleSurface=m_wgpu_surface};
-    m_wgpu_adapter = requestAdapter(m_wgpu_instance, &adapter_opts);
+      m_wgpu_surface = wgpu::glfw::CreateSurfaceForWindow(m_wgpu_instance, m_glfw.window());
+      CHECK(m_wgpu_surface != nullptr, "Failed to create a WebGPU surface");
+    }
 
-    wgpu::DeviceDescriptor device_descriptor = {
-      .nextInChain = nullptr,
-      .label = "Broccoli.Kernel.DeviceDescriptor",
-      .defaultQueue = {
-        .nextInChain = nullptr,
-        .label = "Broccoli.Kernel.DefaultQueue",
-      },
-    };
-    m_wgpu_device = requestDevice(m_wgpu_adapter, &device_descriptor);
-    m_wgpu_device.SetUncapturedErrorCallback(Engine::onUncapturedWgpuError, nullptr);
-    m_wgpu_device.SetLoggingCallback(Engine::onWgpuLog, nullptr);
+    {
+      auto scope = m_startup_timeline.scope("Engine.Adapter");
+      wgpu::RequestAdapterOptions adapter_opts = {.compatibleSurface=m_wgpu_surface};
+      m_wgpu_adapter = requestAdapter(m_wgpu_instance, &adapter_opts);
+      m_pipeline_blob_cache->setAdapter(m_wgpu_adapter);
+    }
 
-    wgpu::SwapChainDescriptor swapchain_descriptor = {
-      .nextInChain = nullptr,
-      .label = "Broccoli.Kernel.SwapchainDescriptor",
-      .usage = wgpu::TextureUsage::RenderAttachment,
-      .format = wgpu::TextureFormat::BGRA8Unorm,
-      .width = static_cast<uint32_t>(framebuffer_width),
-      .height = static_cast<uint32_t>(framebuffer_height),
-      .presentMode = wgpu::PresentMode::Mailbox,
-    };
-    m_wgpu_swapchain = m_wgpu_device.CreateSwapChain(m_wgpu_surface, &swapchain_descriptor);
+    {
+      auto scope = m_startup_timeline.scope("Engine.Device");
+      wgpu::DawnCacheDeviceDescriptor cache_device_descriptor;
+      cache_device_descriptor.isolationKey = m_pipeline_blob_cache->isolationKey().c_str();
+      // Timestamp queries time each frame on the GPU, for dynamic resolution: they are optional.
+      std::vector<wgpu::FeatureName> required_features;
+      if (m_wgpu_adapter.HasFeature(wgpu::FeatureName::TimestampQuery)) {
+        required_features.push_back(wgpu::FeatureName::TimestampQuery);
+      }
+      wgpu::DeviceDescriptor device_descriptor = {
+        .nextInChain = &cache_device_descriptor,
+        .label = "Broccoli.Kernel.DeviceDescriptor",
+        .requiredFeatureCount = required_features.size(),
+        .requiredFeatures = required_features.data(),
+        .defaultQueue = {
+          .nextInChain = nullptr,
+          .label = "Broccoli.Kernel.DefaultQueue",
+        },
+      };
+      m_wgpu_device = requestDevice(m_wgpu_adapter, &device_descriptor);
+      m_wgpu_device.SetUncapturedErrorCallback(Engine::onUncapturedWgpuError, nullptr);
+      m_wgpu_device.SetLoggingCallback(Engine::onWgpuLog, nullptr);
+    }
 
-    m_renderer = std::make_unique<RenderManager>(m_wgpu_device, m_framebuffer_size);
+    {
+      auto scope = m_startup_timeline.scope("Engine.SwapChain");
+      wgpu::SwapChainDescriptor swapchain_descriptor = {
+        .nextInChain = nullptr,
+        .label = "Broccoli.Kernel.SwapchainDescriptor",
+        .usage = wgpu::TextureUsage::RenderAttachment,
+        .format = wgpu::TextureFormat::BGRA8Unorm,
+        .width = static_cast<uint32_t>(framebuffer_width),
+        .height = static_cast<uint32_t>(framebuffer_height),
+        .presentMode = wgpu::PresentMode::Mailbox,
+      };
+      m_wgpu_swapchain = m_wgpu_device.CreateSwapChain(m_wgpu_surface, &swapchain_descriptor);
+    }
+
+    // Any time spent here is time the worker could not hide behind device creation:
+    RenderManagerSources render_sources;
+    {
+      auto scope = m_startup_timeline.scope("Engine.WaitForRenderSources");
+      render_sources = render_sources_future.get();
+    }
+    m_renderer = std::make_unique<RenderManager>(m_wgpu_device, m_framebuffer_size, std::move(render_sources), &m_startup_timeline);
+    m_render_thread = std::make_unique<RenderSubmissionThread>(m_wgpu_instance, m_wgpu_swapchain, *m_renderer);
+    std::cout 
+      << "Broccoli: pipeline cache: " 
+      << m_pipeline_blob_cache->hitCount() << " hit(s), " 
+      << m_pipeline_blob_cache->missCount() << " miss(es), " 
+      << m_pipeline_blob_cache->storeCount() << " store(s)" << std::endl;
   }
 }
 namespace broccoli {
   void Engine::run() {
+    {
+      auto scope = m_startup_timeline.scope("Engine.FirstFrame");
+      updateActivityStack();
+      draw();
+      m_render_thread->waitUntilIdle();
+    }
+    m_startup_timeline.report(std::cout);
+    reportStagingBelt();
     glfwSetTime(0.0);
-    updateActivityStack();
-    draw();
     m_prev_update_timestamp_sec = glfwGetTime();
     m_fixed_update_accum_time = 0.0;
     m_is_running = true;
@@ -137,6 +277,8 @@ namespace broccoli {
       draw();
       endFrame();
     }
+    m_render_thread->waitUntilIdle();
+    reportStagingBelt();
   }
 }
 namespace broccoli {
@@ -178,25 +320,33 @@ namespace broccoli {
   void Engine::endFrame() {
     updateActivityStack();
   }
+  void Engine::reportStagingBelt() {
+    // Only read while the render thread is idle, since it uploads through the belt while submitting:
+    const auto &stats = m_renderer->stagingBelt().stats();
+    std::cout
+      << "Broccoli: staging belt: "
+      << stats.upload_count << " upload(s), "
+      << stats.saved_copy_byte_count << " byte(s) uploaded in total, "
+      << stats.frame_saved_copy_byte_count << " byte(s) in the last frame, "
+      << stats.chunk_count << " chunk(s) holding "
+      << stats.chunk_byte_count << " byte(s)" << std::endl;
+  }
   void Engine::dispatchEvents() {
     glfwPollEvents();
   }
   void Engine::draw() {
-    {
-      wgpu::TextureView target_texture_view = m_wgpu_swapchain.GetCurrentTextureView();
-      CHECK(target_texture_view != nullptr, "Cannot acquire next swapchain texture view");
-      if (!m_activity_stack.empty()) {
-        {
-          RenderTarget render_target{target_texture_view, m_framebuffer_size};
-          RenderFrame frame = m_renderer->frame(render_target);
-          m_activity_stack.top()->draw(frame);
-        }
-      }
-      // 'target_texture_view' goes out of scope here, resulting in the destructor being invoked and the view being
-      // released.
+    // The previous frame must be submitted before this one is recorded, then this one is submitted while the next
+    // frame's events and updates run.
+    m_render_thread->waitUntilIdle();
+    auto packet = std::make_unique<RenderFramePacket>();
+    packet->target_texture_view = m_wgpu_swapchain.GetCurrentTextureView();
+    CHECK(packet->target_texture_view != nullptr, "Cannot acquire next swapchain texture view");
+    if (!m_activity_stack.empty()) {
+      RenderTarget render_target{packet->target_texture_view, m_framebuffer_size};
+      packet->frame = m_renderer->frame(render_target);
+      m_activity_stack.top()->draw(*packet->frame);
     }
-    m_wgpu_instance.ProcessEvents();
-    m_wgpu_swapchain.Present();
+    m_render_thread->submit(std::move(packet));
   }
   void Engine::update() {
     m_fixed_update_accum_time += m_curr_update_dt_sec;
@@ -209,6 +359,10 @@ namespace broccoli {
     }
   }
   void Engine::updateActivityStack() {
+    // Activities create and destroy the resources frames draw, so the stack only changes between submissions.
+    if (!m_activity_stack_action_fifo.empty()) {
+      m_render_thread->waitUntilIdle();
+    }
     while (!m_activity_stack_action_fifo.empty()) {
       auto [action_type, opt_build_cb] = std::move(m_activity_stack_action_fifo.front());
       m_activity_stack_action_fifo.pop();
@@ -5,8 +5,18 @@
 #include <sstream>
 #include <limits>
 #include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <iterator>
+#include <thread>
+#include <filesystem>
+#include <cctype>
 
 #include "glm/gtc/packing.hpp"
+#include "glm/ext/matrix_clip_space.hpp"
+#include "glm/ext/matrix_transform.hpp"
 
 #include "broccoli/engine/config.hh"
 #include "broccoli/engine/core.hh"
@@ -18,112 +28,251 @@
 namespace broccoli {
   static const char *R3D_UBERSHADER_FILEPATH = "res/shader/3d/ubershader.wgsl";
   static const char *R3D_SHADOW_SHADER_FILEPATH = "res/shader/3d/shadow.wgsl";
+  static const char *R3D_SHADOW_BLUR_SHADER_FILEPATH = "res/shader/3d/shadow_blur.wgsl";
   static const char *R3D_OVERLAY_SHADER_FILEPATH = "res/shader/overlay.wgsl";
+  static const char *R3D_LIGHT_CLUSTER_SHADER_FILEPATH = "res/shader/3d/light_cluster.wgsl";
+  static const char *R3D_MIPMAP_SHADER_FILEPATH = "res/shader/mipmap.wgsl";
+  static const char *R3D_TEXTURE_ATLAS_SHADER_FILEPATH = "res/shader/texture_atlas.wgsl";
+  static const char *R3D_TONEMAP_SHADER_FILEPATH = "res/shader/3d/tonemap.wgsl";
+  static const char *R3D_EXPOSURE_SHADER_FILEPATH = "res/shader/3d/exposure.wgsl";
+  static const char *R3D_FXAA_SHADER_FILEPATH = "res/shader/3d/fxaa.wgsl";
+  static const char *R3D_UPSCALE_SHADER_FILEPATH = "res/shader/3d/upscale.wgsl";
+  static const char *R3D_HIZ_SHADER_FILEPATH = "res/shader/3d/hiz.wgsl";
+  static const char *R3D_OCCLUSION_CULL_SHADER_FILEPATH = "res/shader/3d/occlusion_cull.wgsl";
   static const char *R3D_SHADER_VS_ENTRY_POINT_NAME = "vertexShaderMain";
   static const char *R3D_SHADER_FS_ENTRY_POINT_NAME = "fragmentShaderMain";
+  static const char *R3D_SHADER_GBUFFER_FS_ENTRY_POINT_NAME = "gbufferFragmentShaderMain";
+  static const char *R3D_SHADER_DEFERRED_VS_ENTRY_POINT_NAME = "deferredVertexShaderMain";
+  static const char *R3D_SHADER_DEFERRED_FS_ENTRY_POINT_NAME = "deferredFragmentShaderMain";
+  static const char *R3D_SHADOW_SHADER_MOMENTS_FS_ENTRY_POINT_NAME = "momentsFragmentShaderMain";
+  static const char *R3D_SHADOW_BLUR_SHADER_HORIZONTAL_ENTRY_POINT_NAME = "blurHorizontalMain";
+  static const char *R3D_SHADOW_BLUR_SHADER_VERTICAL_ENTRY_POINT_NAME = "blurVerticalMain";
+  static const char *R3D_LIGHT_CLUSTER_SHADER_ENTRY_POINT_NAME = "buildClustersMain";
+  static const char *R3D_MIPMAP_SHADER_ENTRY_POINT_NAME = "downsampleMain";
+  static const char *R3D_EXPOSURE_SHADER_HISTOGRAM_ENTRY_POINT_NAME = "histogramMain";
+  static const char *R3D_EXPOSURE_SHADER_AVERAGE_ENTRY_POINT_NAME = "averageMain";
+  static const char *R3D_HIZ_SHADER_INIT_ENTRY_POINT_NAME = "initMain";
+  static const char *R3D_HIZ_SHADER_INIT_MULTISAMPLED_ENTRY_POINT_NAME = "initMultisampledMain";
+  static const char *R3D_HIZ_SHADER_DOWNSAMPLE_ENTRY_POINT_NAME = "downsampleMain";
+  static const char *R3D_OCCLUSION_CULL_SHADER_ENTRY_POINT_NAME = "cullMain";
 }
 namespace broccoli {
   static const uint64_t R3D_VERTEX_BUFFER_CAPACITY = 1 << 16;
   static const uint64_t R3D_INDEX_BUFFER_CAPACITY = 1 << 20;
   static const uint64_t R3D_INSTANCE_CAPACITY = 1 << 10;
   static const uint64_t R3D_DIRECTIONAL_LIGHT_CAPACITY_LG2 = 2;
-  static const uint64_t R3D_POINT_LIGHT_CAPACITY_LG2 = 4;
+  static const uint64_t R3D_POINT_LIGHT_CAPACITY_LG2 = 10;
   static const uint64_t R3D_DIRECTIONAL_LIGHT_CAPACITY = 1LLU << R3D_DIRECTIONAL_LIGHT_CAPACITY_LG2;
   static const uint64_t R3D_POINT_LIGHT_CAPACITY = 1LLU << R3D_POINT_LIGHT_CAPACITY_LG2;
   static const float R3D_DEFAULT_AMBIENT_GLOW = 0.05f;
 }
+namespace broccoli {
+  static const float R3D_CAMERA_ZMIN = 0.05f;
+  static const float R3D_CAMERA_ZMAX = 100.0f;
+  static const float R3D_CAMERA_LOGARITHMIC_Z_SCALE = 1.0f;
+}
+namespace broccoli {
+  // Clustered forward lighting: the view frustum is split into a grid of tiles x exponential depth slices, and a compute
+  // pass assigns each point light (by its range) to the clusters it touches. The grid's X extent is also the
+  // workgroup size of the cluster-building shader.
+  static const uint32_t R3D_LIGHT_CLUSTER_GRID_X = 16;
+  static const uint32_t R3D_LIGHT_CLUSTER_GRID_Y = 9;
+  static const uint32_t R3D_LIGHT_CLUSTER_GRID_Z = 24;
+  static const uint32_t R3D_LIGHT_CLUSTER_COUNT = R3D_LIGHT_CLUSTER_GRID_X * R3D_LIGHT_CLUSTER_GRID_Y * R3D_LIGHT_CLUSTER_GRID_Z;
+  static const uint32_t R3D_LIGHT_CLUSTER_LIGHT_CAPACITY = 127;
+  static const uint64_t R3D_LIGHT_CLUSTER_BUFFER_SIZE = 
+    sizeof(uint32_t) * R3D_LIGHT_CLUSTER_COUNT * (R3D_LIGHT_CLUSTER_LIGHT_CAPACITY + 1);
+}
 namespace broccoli {
   static const wgpu::TextureFormat R3D_SWAPCHAIN_TEXTURE_FORMAT = wgpu::TextureFormat::BGRA8Unorm;
-  static const wgpu::TextureFormat R3D_COLOR_TEXTURE_FORMAT = wgpu::TextureFormat::BGRA8Unorm;
+  // The scene is drawn in linear HDR, and only the tonemap pass writes to the swapchain.
+  static const wgpu::TextureFormat R3D_COLOR_TEXTURE_FORMAT = wgpu::TextureFormat::RGBA16Float;
   static const wgpu::TextureFormat R3D_DEPTH_TEXTURE_FORMAT = wgpu::TextureFormat::Depth24Plus;
 }
 namespace broccoli {
+  // WebGPU only guarantees 1 and 4 samples per pixel, so 4 is the only multisampled mode.
   static const uint32_t R3D_MSAA_SAMPLE_COUNT = 4;
+  static const AntiAliasingMode R3D_DEFAULT_ANTI_ALIASING_MODE = AntiAliasingMode::Msaa4x;
+}
+namespace broccoli {
+  // Deferred shading's G-buffer, in the order of 'GBufferOutput' in the ubershader: albedo and metalness, normal and
+  // roughness, lighting model parameters, then view depth.
+  static const std::array<wgpu::TextureFormat, 4> R3D_GBUFFER_TEXTURE_FORMATS = {
+    wgpu::TextureFormat::RGBA8Unorm,
+    wgpu::TextureFormat::RGBA16Float,
+    wgpu::TextureFormat::RGBA16Float,
+    wgpu::TextureFormat::R32Float,
+  };
+  static const ShadingPath R3D_DEFAULT_SHADING_PATH = ShadingPath::Forward;
+}
+namespace broccoli {
+  // Frames in flight: the uniforms rewritten by every frame are kept in a ring of frame slots, so the most frames that
+  // may ever be in flight at once is the slot count. The CPU waits before beginning a frame that would exceed the
+  // maximum, which trades latency (lower) against CPU/GPU overlap (higher).
+  static const uint32_t R3D_FRAME_SLOT_COUNT = 3;
+  static const uint32_t R3D_DEFAULT_MAX_FRAMES_IN_FLIGHT = 2;
+  // Waits on the device (for pipelines or frames in flight) tick it at this interval, sleeping in between.
+  static const std::chrono::microseconds R3D_DEVICE_POLL_INTERVAL{250};
+  // 'ResolveQuerySet' writes at offsets aligned to this many bytes.
+  static const uint64_t R3D_TIMESTAMP_RESOLVE_ALIGNMENT = 256;
 }
 namespace broccoli {
-  static const int64_t R3D_RGB_PALETTE_TEXTURE_SIZE = 4096;
-  static const int64_t R3D_MONO_PALETTE_TEXTURE_SIZE = 16;
-  static_assert(R3D_RGB_PALETTE_TEXTURE_SIZE * R3D_RGB_PALETTE_TEXTURE_SIZE == 256 * 256 * 256);
-  static_assert(R3D_MONO_PALETTE_TEXTURE_SIZE * R3D_MONO_PALETTE_TEXTURE_SIZE == 256);
+  // Dynamic resolution: the render scale moves in coarse steps, and waits a few frames after each change for the 
+  // smoothed frame time to reflect it, so that transient textures are only re-allocated when the scale settles on a new
+  // step rather than every frame.
+  static const double R3D_RENDER_SCALE_STEP = 0.05;
+  static const uint32_t R3D_RENDER_SCALE_COOLDOWN_FRAMES = 10;
+  static const double R3D_FRAME_TIME_SMOOTHING = 0.2;
+  static const double R3D_FRAME_TIME_BUDGET_HEADROOM = 0.9;
 }
 namespace broccoli {
   static const size_t R3D_MATERIAL_TABLE_INIT_CAPACITY = 256;
+  static const uint64_t R3D_MATERIAL_UNIFORM_CAPACITY = 1 << 10;
+}
+namespace broccoli {
+  static const int32_t R3D_TEXTURE_ATLAS_PAGE_SIZE = 2048;
+  static const int32_t R3D_TEXTURE_ATLAS_MAX_TEXTURE_SIZE = 512;
+  static const int32_t R3D_TEXTURE_ATLAS_GUTTER_SIZE = 4;
+  // Pages keep only the mip levels whose gutters are still at least one texel wide: log2(gutter size) + 1.
+  static const uint32_t R3D_TEXTURE_ATLAS_MIP_LEVEL_COUNT = 3;
+}
+namespace broccoli {
+  static const uint32_t R3D_MIPMAP_WORKGROUP_SIZE = 8;
+}
+namespace broccoli {
+  // Occlusion culling: each chunk of up to R3D_INSTANCE_CAPACITY instances has 12 u32s of draw arguments, namely a
+  // DrawIndexedIndirect command (5 u32s) per phase, followed by its rejected instance count and padding (see 
+  // 'occlusion_cull.wgsl').
+  static const wgpu::TextureFormat R3D_HIZ_TEXTURE_FORMAT = wgpu::TextureFormat::R32Float;
+  static const uint32_t R3D_HIZ_WORKGROUP_SIZE = 8;
+  static const uint32_t R3D_OCCLUSION_CULL_WORKGROUP_SIZE = 64;
+  static const uint64_t R3D_OCCLUSION_CULL_DRAW_ARGS_SIZE = 12 * sizeof(uint32_t);
+  static const uint64_t R3D_OCCLUSION_CULL_DRAW_ARGS_PHASE_SIZE = 5 * sizeof(uint32_t);
+  static const bool R3D_DEFAULT_OCCLUSION_CULLING_ENABLED = false;
+}
+namespace broccoli {
+  // Software occlusion culling: occluders are drawn at a fixed width, and a height matching the target's aspect ratio.
+  static const int32_t R3D_SOFTWARE_OCCLUSION_BUFFER_WIDTH = 256;
+  static const uint32_t R3D_SOFTWARE_OCCLUSION_MAX_THREAD_COUNT = 4;
+  static const bool R3D_DEFAULT_SOFTWARE_OCCLUSION_CULLING_ENABLED = false;
+}
+namespace broccoli {
+  // Auto-exposure: each histogram workgroup bins a square tile of the scene into workgroup memory with one invocation 
+  // per bin, so the tile's area is the bin count.
+  static const uint32_t R3D_LUMINANCE_HISTOGRAM_WORKGROUP_SIZE = 16;
+  static const uint32_t R3D_LUMINANCE_HISTOGRAM_BIN_COUNT = R3D_LUMINANCE_HISTOGRAM_WORKGROUP_SIZE * R3D_LUMINANCE_HISTOGRAM_WORKGROUP_SIZE;
+  static const uint64_t R3D_EXPOSURE_STATE_SIZE = 16;
+}
+namespace broccoli {
+  // Texture streaming: mip levels up to this size are always resident; larger levels are uploaded on request, within 
+  // the (runtime-configurable) budget, at most one level per texture and roughly this many bytes per update.
+  static const int32_t R3D_TEXTURE_STREAMING_TAIL_SIZE = 64;
+  static const uint64_t R3D_TEXTURE_STREAMING_DEFAULT_BUDGET = 256LLU << 20;
+  static const uint64_t R3D_TEXTURE_STREAMING_UPLOAD_BYTE_BUDGET = 16LLU << 20;
 }
 namespace broccoli {
   // Common:
-  static const wgpu::TextureFormat R3D_CSM_TEXTURE_FORMAT = wgpu::TextureFormat::Depth32Float;
+  // Everything else that is shadow-related is configured at runtime via ShadowSettings.
+  static const float R3D_CSM_DEPTH_BIAS = 1.0e-4f;
+
+  // Moments (EVSM4): exponentially warped depth moments in a filterable format, blurred once after rendering.
+  // The exponents are bounded by the f16 range: exp(2 * 5.0) ~= 22026 < 65504.
+  static const wgpu::TextureFormat R3D_CSM_MOMENTS_TEXTURE_FORMAT = wgpu::TextureFormat::RGBA16Float;
+  static const float R3D_CSM_EVSM_POSITIVE_EXPONENT = 5.0f;
+  static const float R3D_CSM_EVSM_NEGATIVE_EXPONENT = 5.0f;
+  static const float R3D_CSM_EVSM_LIGHT_BLEED_REDUCTION = 0.2f;
+  static const int32_t R3D_CSM_BLUR_RADIUS = 2;
+  static const uint32_t R3D_CSM_BLUR_WORKGROUP_SIZE = 8;
 
   // Directional lights:
-  static const int32_t R3D_DIR_LIGHT_SHADOW_CASCADE_COUNT_LG2 = 2;
-  static const int32_t R3D_DIR_LIGHT_SHADOW_CASCADE_COUNT = 1LLU << R3D_DIR_LIGHT_SHADOW_CASCADE_COUNT_LG2;
-  static const int32_t R3D_DIR_LIGHT_SHADOW_CASCADE_MAP_RESOLUTION_LG2 = 10;
-  static const std::array<double, R3D_DIR_LIGHT_SHADOW_CASCADE_COUNT> R3D_DIR_LIGHT_SHADOW_CASCADE_MAX_DISTANCES = 
-    std::to_array({2.0, 16.0, 128.0, 1024.0});
-  static const double R3D_DIR_LIGHT_SHADOW_RADIUS = 1024.0;
+  // The cascade capacity sizes the CascadeUniform; ShadowSettings may use fewer cascades than this.
+  static const int32_t R3D_DIR_LIGHT_SHADOW_CASCADE_CAPACITY_LG2 = ShadowSettings::dir_light_cascade_capacity_lg2;
+  static const int32_t R3D_DIR_LIGHT_SHADOW_CASCADE_CAPACITY = 1LLU << R3D_DIR_LIGHT_SHADOW_CASCADE_CAPACITY_LG2;
 
-  // Point lights:
-  static const int32_t R3D_POINT_LIGHT_SHADOW_CASCADE_COUNT_LG2 = 2;
-  static const int32_t R3D_POINT_LIGHT_SHADOW_CASCADE_COUNT = 1LLU << R3D_POINT_LIGHT_SHADOW_CASCADE_COUNT_LG2;
-  static const size_t R3D_POINT_LIGHT_SHADOW_CASCADE_MAP_RESOLUTION_LG2 = 10;
-  // static const std::array<double, R3D_POINT_LIGHT_SHADOW_CASCADE_COUNT> R3D_POINT_LIGHT_SHADOW_CASCADE_MAX_DISTANCES = 
-  //   std::to_array({2.0, 16.0, 128.0, 1024.0});
+  // Virtual shadow map (first directional light only):
+  // With the default settings, the virtual map is 2^(7+7) = 16384 texels across and covers 
+  // ShadowSettings::vsm_world_size meters centered on the camera.
+  // Page coordinates are absolute (snapped to a world-stable grid in light space), so cached pages stay valid while the
+  // camera moves, and only need to be re-rendered when the light turns (see R3D_VSM_LIGHT_ROTATION_TOLERANCE) or when
+  // a caster overlapping them changes.
+  static const float R3D_VSM_DEPTH_BIAS = 1.0e-4f;
+  // Cached pages are kept until the light has turned by more than this angle (in radians, ~0.6 degrees), so that a 
+  // slowly animated sun does not re-render the whole map every frame.
+  static const double R3D_VSM_LIGHT_ROTATION_TOLERANCE = 0.01;
 }
 namespace broccoli {
-  inline int32_t r3d_light_capacity_lg2(LightType light_type) {
-    switch (light_type) {
-      case LightType::Directional: return R3D_DIRECTIONAL_LIGHT_CAPACITY_LG2;
-      case LightType::Point: return R3D_POINT_LIGHT_CAPACITY_LG2;
-      default: PANIC("unknown/invalid light_type");
-    }
-  }
-  inline int32_t r3d_light_capacity(LightType light_type) {
-    switch (light_type) {
-      case LightType::Directional: return R3D_DIRECTIONAL_LIGHT_CAPACITY;
-      case LightType::Point: return R3D_POINT_LIGHT_CAPACITY;
-      default: PANIC("unknown/invalid light_type");
+  inline wgpu::TextureFormat r3d_shadow_depth_texture_format(ShadowDepthFormat depth_format) {
+    switch (depth_format) {
+      case ShadowDepthFormat::Depth32Float: return wgpu::TextureFormat::Depth32Float;
+      case ShadowDepthFormat::Depth16Unorm: return wgpu::TextureFormat::Depth16Unorm;
+      default: PANIC("unknown/invalid shadow depth format");
     }
   }
-  inline int32_t r3d_shadow_cascade_map_count_lg2(LightType light_type) {
-    switch (light_type) {
-      case LightType::Directional: return R3D_DIR_LIGHT_SHADOW_CASCADE_COUNT_LG2;
-      case LightType::Point: return R3D_POINT_LIGHT_SHADOW_CASCADE_COUNT_LG2;
-      default: PANIC("unknown/invalid light_type");
+  inline void r3d_check_shadow_settings(const ShadowSettings &settings) {
+    const auto dir_light_capacity_lg2 = static_cast<int32_t>(R3D_DIRECTIONAL_LIGHT_CAPACITY_LG2);
+    const auto point_light_capacity_lg2 = static_cast<int32_t>(R3D_POINT_LIGHT_CAPACITY_LG2);
+    CHECK(
+      0 <= settings.dir_light_shadow_count_lg2 && settings.dir_light_shadow_count_lg2 <= dir_light_capacity_lg2,
+      "Invalid directional light shadow count: exceeds directional light capacity"
+    );
+    CHECK(
+      0 <= settings.dir_light_cascade_count_lg2 && settings.dir_light_cascade_count_lg2 <= R3D_DIR_LIGHT_SHADOW_CASCADE_CAPACITY_LG2,
+      "Invalid directional light cascade count: exceeds cascade capacity"
+    );
+    CHECK(
+      0 <= settings.point_light_shadow_count_lg2 && settings.point_light_shadow_count_lg2 <= point_light_capacity_lg2,
+      "Invalid point light shadow count: exceeds point light capacity"
+    );
+    CHECK(settings.point_light_cascade_count_lg2 >= 0, "Invalid point light cascade count");
+    // Debug takeout copies need rows of at least 256 bytes, i.e. 128 texels of the smallest (2B) texel format.
+    CHECK(
+      7 <= settings.dir_light_cascade_map_resolution_lg2 && settings.dir_light_cascade_map_resolution_lg2 <= 13,
+      "Invalid directional light shadow map resolution"
+    );
+    CHECK(
+      7 <= settings.point_light_cascade_map_resolution_lg2 && settings.point_light_cascade_map_resolution_lg2 <= 13,
+      "Invalid point light shadow map resolution"
+    );
+    int32_t cascade_count = 1 << settings.dir_light_cascade_count_lg2;
+    for (int32_t i = 0; i < cascade_count; i++) {
+      double min_distance = i == 0 ? 0.0 : settings.dir_light_cascade_max_distances[i - 1];
+      CHECK(settings.dir_light_cascade_max_distances[i] > min_distance, "Expected cascade distances to be increasing");
     }
+    CHECK(settings.dir_light_shadow_radius > 0.0, "Invalid directional light shadow radius");
+    CHECK(settings.vsm_page_table_size_lg2 > 0, "Invalid virtual shadow map page table size");
+    CHECK(settings.vsm_page_size_lg2 > 0, "Invalid virtual shadow map page size");
+    CHECK(settings.vsm_physical_page_count > 0, "Invalid virtual shadow map physical page count");
+    CHECK(settings.vsm_world_size > 0.0, "Invalid virtual shadow map world size");
   }
-  inline int32_t r3d_shadow_cascade_map_count(LightType light_type) {
-    switch (light_type) {
-      case LightType::Directional: return R3D_DIR_LIGHT_SHADOW_CASCADE_COUNT;
-      case LightType::Point: return R3D_POINT_LIGHT_SHADOW_CASCADE_COUNT;
-      default: PANIC("unknown/invalid light_type");
-    }
+  inline void r3d_check_tone_mapping_settings(const ToneMappingSettings &settings) {
+    CHECK(
+      settings.auto_exposure_min_log2_luminance < settings.auto_exposure_max_log2_luminance,
+      "Invalid auto-exposure luminance range: expected min to be less than max"
+    );
+    CHECK(settings.auto_exposure_adaptation_speed >= 0.0f, "Invalid auto-exposure adaptation speed");
   }
-  inline int32_t r3d_shadow_cascade_map_resolution_lg2(LightType light_type) {
-    switch (light_type) {
-      case LightType::Directional: return R3D_DIR_LIGHT_SHADOW_CASCADE_MAP_RESOLUTION_LG2;
-      case LightType::Point: return R3D_POINT_LIGHT_SHADOW_CASCADE_MAP_RESOLUTION_LG2;
-      default: PANIC("unknown/invalid light_type");
-    }
+  inline void r3d_check_dynamic_resolution_settings(const DynamicResolutionSettings &settings) {
+    CHECK(settings.frame_time_budget_ms > 0.0, "Invalid dynamic resolution frame time budget");
+    CHECK(
+      0.0 < settings.min_render_scale && 
+      settings.min_render_scale <= settings.max_render_scale && 
+      settings.max_render_scale <= 1.0,
+      "Invalid render scale range: expected 0 < min <= max <= 1"
+    );
   }
-  inline double minDirLightCascadeDistance(size_t cascade_index) {
-    CHECK(cascade_index < R3D_DIR_LIGHT_SHADOW_CASCADE_COUNT, "Bad cascade index");
+  inline double minDirLightCascadeDistance(const ShadowSettings &settings, size_t cascade_index) {
+    CHECK(cascade_index < (1U << settings.dir_light_cascade_count_lg2), "Bad cascade index");
     if (cascade_index == 0) {
       return 0.0;
     } else {
-      return R3D_DIR_LIGHT_SHADOW_CASCADE_MAX_DISTANCES[cascade_index - 1];
+      return settings.dir_light_cascade_max_distances[cascade_index - 1];
     }
   }
-  inline double maxDirLightCascadeDistance(size_t cascade_index) {
-    CHECK(cascade_index < R3D_DIR_LIGHT_SHADOW_CASCADE_COUNT, "Bad cascade index");
-    return R3D_DIR_LIGHT_SHADOW_CASCADE_MAX_DISTANCES[cascade_index];
+  inline double maxDirLightCascadeDistance(const ShadowSettings &settings, size_t cascade_index) {
+    CHECK(cascade_index < (1U << settings.dir_light_cascade_count_lg2), "Bad cascade index");
+    return settings.dir_light_cascade_max_distances[cascade_index];
   }
 }
-namespace broccoli {
-  static const uint32_t R3D_DEBUG_TAKEOUT_BUFFER_SIZE = std::max<uint32_t>({
-    (1U << (2 * R3D_DIR_LIGHT_SHADOW_CASCADE_MAP_RESOLUTION_LG2)) * sizeof(float),
-    (1U << (2 * R3D_POINT_LIGHT_SHADOW_CASCADE_MAP_RESOLUTION_LG2)) * sizeof(float),
-    0
-  });
-}
 
 //
 // GPU binary interface:
@@ -133,12 +282,19 @@ namespace broccoli {
   struct LightUniform {
     std::array<glm::vec4, R3D_DIRECTIONAL_LIGHT_CAPACITY> directional_light_dir_array;
     std::array<glm::vec4, R3D_DIRECTIONAL_LIGHT_CAPACITY> directional_light_color_array;
-    std::array<glm::vec4, R3D_POINT_LIGHT_CAPACITY> point_light_pos_array;
-    std::array<glm::vec4, R3D_POINT_LIGHT_CAPACITY> point_light_color_array;
     uint32_t directional_light_count;
     uint32_t point_light_count;
     float ambient_glow;
-    std::array<uint32_t, 93> rsv;
+    std::array<uint32_t, 221> rsv;
+  };
+  struct ClusterUniform {
+    glm::fvec2 screen_size;
+    uint32_t point_light_count;
+    uint32_t rsv00 = 0;
+  };
+  struct PointLightData {
+    glm::fvec4 position_range;
+    glm::fvec4 color;
   };
   struct CameraUniform {
     glm::mat4x4 view_matrix;
@@ -156,6 +312,9 @@ namespace broccoli {
     uint32_t rsv04 = 0;
     uint32_t rsv05 = 0;
   };
+  struct DeferredUniform {
+    glm::mat4x4 camera_transform_matrix;
+  };
   struct MaterialUniform {
     glm::fvec2 albedo_uv_offset = {0.0f, 0.0f};
     glm::fvec2 albedo_uv_size = {0.0f, 0.0f};
@@ -166,32 +325,51 @@ namespace broccoli {
     glm::fvec2 metalness_uv_offset = {0.0f, 0.0f};
     glm::fvec2 metalness_uv_size = {0.0f, 0.0f};
     glm::fvec4 pbr_fresnel0 = {0.0f, 0.0f, 0.0f, 0.0f};
+    glm::fvec4 albedo_constant = {0.0f, 0.0f, 0.0f, 0.0f};
+    glm::fvec4 normal_constant = {0.0f, 0.0f, 0.0f, 0.0f};
     float blinn_phong_shininess = 0.0f;
+    float metalness_constant = 0.0f;
+    float roughness_constant = 0.0f;
     uint32_t rsv00 = 0;
-    uint32_t rsv01 = 0;
-    uint32_t rsv02 = 0;
-    uint32_t rsv03 = 0;
-    uint32_t rsv04 = 0;
-    uint32_t rsv05 = 0;
-    uint32_t rsv06 = 0;
-    uint32_t rsv07 = 0;
-    uint32_t rsv08 = 0;
-    uint32_t rsv09 = 0;
-    uint32_t rsv10 = 0;
+  };
+  struct CascadeUniform {
+    std::array<glm::mat4x4, R3D_DIRECTIONAL_LIGHT_CAPACITY * R3D_DIR_LIGHT_SHADOW_CASCADE_CAPACITY> proj_view_matrices;
+    std::array<glm::vec4, R3D_DIR_LIGHT_SHADOW_CASCADE_CAPACITY> cascade_max_distances;
+    uint32_t cascade_count;
+    uint32_t representation;
+    float depth_bias;
+    uint32_t is_enabled;
+    glm::fvec2 evsm_exponents;
+    float evsm_light_bleed_reduction;
+    uint32_t light_count;
   };
   struct OverlayUniform {
     glm::i32vec2 screen_size;
     glm::i32vec2 rect_size;
     glm::i32vec2 rect_center;
   };
+  struct TonemapUniform {
+    glm::fvec4 clear_color;
+    float exposure_bias;
+    uint32_t tonemap_operator;
+    uint32_t is_auto_exposure_enabled;
+    uint32_t rsv00 = 0;
+  };
+  struct ExposureUniform {
+    float min_log2_luminance;
+    float log2_luminance_range;
+    float adaptation_rate;
+    uint32_t rsv00 = 0;
+  };
   static_assert(sizeof(LightUniform) == 1024, "invalid LightUniform size");
   static_assert(sizeof(CameraUniform) == 128, "invalid CameraUniform size");
+  static_assert(sizeof(TonemapUniform) == 32, "invalid TonemapUniform size");
+  static_assert(sizeof(ExposureUniform) == 16, "invalid ExposureUniform size");
+  static_assert(sizeof(ClusterUniform) == 16, "invalid ClusterUniform size");
+  static_assert(sizeof(PointLightData) == 32, "invalid PointLightData size");
   static_assert(sizeof(MaterialUniform) == 128, "invalid MaterialUniform size");
-}
-namespace broccoli {
-  static bool operator== (ShadowUniform s1, ShadowUniform s2) {
-    return s1.proj_view_matrix == s2.proj_view_matrix;
-  }
+  static_assert(sizeof(CascadeUniform) % 16 == 0, "invalid CascadeUniform size");
+  static_assert(sizeof(VirtualShadowMapUniform) == 80, "invalid VirtualShadowMapUniform size");
 }
 
 //
@@ -269,7 +447,10 @@ namespace broccoli {
     std::string name,
     glm::i64vec3 dim,
     wgpu::FilterMode filter,
-    bool is_depth
+    bool is_depth,
+    uint32_t mip_level_count,
+    wgpu::AddressMode address_mode,
+    wgpu::TextureUsage extra_usage
   )
   : m_texture(nullptr),
     m_view(nullptr),
@@ -279,20 +460,28 @@ namespace broccoli {
     m_wgpu_view_label(m_name + ".WGPUTextureView"),
     m_wgpu_sampler_label(m_name + ".WGPUSampler")
   {
-    create(device, dim, filter, is_depth);
+    create(device, dim, filter, is_depth, mip_level_count, address_mode, extra_usage);
   }
 }
 namespace broccoli {
-  void RenderTexture::create(wgpu::Device &device, glm::i64vec3 dim, wgpu::FilterMode filter, bool is_depth) {
+  void RenderTexture::create(wgpu::Device &device, glm::i64vec3 dim, wgpu::FilterMode filter, bool is_depth, uint32_t mip_level_count, wgpu::AddressMode address_mode, wgpu::TextureUsage extra_usage) {
     CHECK(!m_texture, "expected WGPU texture to be uninit.");
     CHECK(!m_view, "expected WGPU texture view to be uninit.");
+    m_dim = dim;
+    m_mip_level_count = mip_level_count;
+    m_address_mode = address_mode;
     
     // Check parameters:
     if (is_depth) {
       CHECK(dim.z == 1 || dim.z == 2, "Expected either 1 or 2 channels for depth.");
+      CHECK(mip_level_count == 1, "Expected a single mip level for depth.");
     } else {
       CHECK(dim.z == 1 || dim.z == 4, "Expected either 1 or 4 channels for color.");
     }
+    CHECK(
+      1 <= mip_level_count && mip_level_count <= fullMipLevelCount(glm::i64vec2{dim}),
+      "Invalid mip level count."
+    );
 
     // Select a format:
     auto format = 
@@ -301,12 +490,18 @@ namespace broccoli {
       (dim.z == 1 ? wgpu::TextureFormat::R8Unorm : wgpu::TextureFormat::RGBA8Unorm);
     
     // Create a texture:
+    // NOTE: only RGBA8 mip chains can be generated by compute, since R8Unorm is not a storage texture format.
+    auto usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::CopySrc | wgpu::TextureUsage::TextureBinding | extra_usage;
+    if (!is_depth && dim.z == 4 && mip_level_count > 1) {
+      usage |= wgpu::TextureUsage::StorageBinding;
+    }
     wgpu::TextureDescriptor texture_desc = {
       .label = m_wgpu_texture_label.c_str(),
-      .usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::TextureBinding,
+      .usage = usage,
       .dimension = wgpu::TextureDimension::e2D,
       .size = {.width=static_cast<uint32_t>(dim.x), .height=static_cast<uint32_t>(dim.y), .depthOrArrayLayers=1},
       .format = format,
+      .mipLevelCount = mip_level_count,
     };
     m_texture = device.CreateTexture(&texture_desc);
 
@@ -319,15 +514,21 @@ namespace broccoli {
     m_view = m_texture.CreateView(&view_desc);
 
     // Create a sampler:
+    // Mipmapped textures blend between mip levels with the same filter as within a level: i.e. trilinear if linear.
     wgpu::SamplerDescriptor sampler_desc = {
       .label = m_wgpu_sampler_label.c_str(),
+      .addressModeU = address_mode,
+      .addressModeV = address_mode,
       .magFilter = filter,
       .minFilter = filter,
+      .mipmapFilter = mip_level_count > 1 && filter == wgpu::FilterMode::Linear ? 
+        wgpu::MipmapFilterMode::Linear : 
+        wgpu::MipmapFilterMode::Nearest,
     };
     m_sampler = device.CreateSampler(&sampler_desc);
   }
-  void RenderTexture::upload(wgpu::Device &device, Bitmap const &bitmap) {
-    wgpu::ImageCopyTexture copy_dst_desc = {.texture = m_texture};
+  void RenderTexture::upload(wgpu::Device &device, Bitmap const &bitmap, uint32_t mip_level) {
+    wgpu::ImageCopyTexture copy_dst_desc = {.texture = m_texture, .mipLevel = mip_level};
     wgpu::TextureDataLayout copy_src_layout_desc = {
       .bytesPerRow = static_cast<uint32_t>(bitmap.pitch()),
       .rowsPerImage = static_cast<uint32_t>(bitmap.rows()),
@@ -341,17 +542,119 @@ namespace broccoli {
       &copy_size
     );
   }
+  void RenderTexture::generateMipmapsOnCpu(wgpu::Device &device, Bitmap const &base) {
+    if (m_mip_level_count <= 1) {
+      return;
+    }
+    Bitmap level = downsample(base);
+    upload(device, level, 1);
+    for (uint32_t mip_level = 2; mip_level < m_mip_level_count; mip_level++) {
+      level = downsample(level);
+      upload(device, level, mip_level);
+    }
+  }
+  void RenderTexture::generateMipmapsOnGpu(wgpu::Device &device, ComputePipeline<1> const &mipmap_pipeline) {
+    CHECK(m_dim.z == 4, "Expected an RGBA texture for GPU mipmap generation.");
+    wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.Mipmap.CommandEncoder"};
+    wgpu::CommandEncoder command_encoder = device.CreateCommandEncoder(&command_encoder_descriptor);
+    for (uint32_t mip_level = 1; mip_level < m_mip_level_count; mip_level++) {
+      wgpu::TextureViewDescriptor src_view_desc = {
+        .format = wgpu::TextureFormat::RGBA8Unorm,
+        .dimension = wgpu::TextureViewDimension::e2D,
+        .baseMipLevel = mip_level - 1,
+        .mipLevelCount = 1,
+      };
+      wgpu::TextureViewDescriptor dst_view_desc = {
+        .format = wgpu::TextureFormat::RGBA8Unorm,
+        .dimension = wgpu::TextureViewDimension::e2D,
+        .baseMipLevel = mip_level,
+        .mipLevelCount = 1,
+      };
+      auto entries = std::to_array({
+        wgpu::BindGroupEntry {.binding=0, .textureView=m_texture.CreateView(&src_view_desc)},
+        wgpu::BindGroupEntry {.binding=1, .textureView=m_texture.CreateView(&dst_view_desc)},
+      });
+      wgpu::BindGroupDescriptor bind_group_desc = {
+        .label = "Broccoli.Render.Mipmap.BindGroup0",
+        .layout = mipmap_pipeline.bind_group_layouts[0],
+        .entryCount = entries.size(),
+        .entries = entries.data(),
+      };
+      auto bind_group = device.CreateBindGroup(&bind_group_desc);
+
+      glm::u32vec2 level_size = glm::max(glm::u32vec2{glm::i64vec2{m_dim} >> int64_t(mip_level)}, glm::u32vec2{1});
+      glm::u32vec2 workgroup_count = (level_size + R3D_MIPMAP_WORKGROUP_SIZE - 1u) / R3D_MIPMAP_WORKGROUP_SIZE;
+      wgpu::ComputePassDescriptor compute_pass_descriptor = {.label="Broccoli.Render.Mipmap.ComputePass"};
+      wgpu::ComputePassEncoder cp_encoder = command_encoder.BeginComputePass(&compute_pass_descriptor);
+      cp_encoder.SetPipeline(mipmap_pipeline.pipeline);
+      cp_encoder.SetBindGroup(0, bind_group);
+      cp_encoder.DispatchWorkgroups(workgroup_count.x, workgroup_count.y);
+      cp_encoder.End();
+    }
+    wgpu::CommandBuffer command_buffer = command_encoder.Finish();
+    device.GetQueue().Submit(1, &command_buffer);
+  }
+  Bitmap RenderTexture::downsample(Bitmap const &src) {
+    // A 2x2 box filter, clamping the last row/column of odd-sized levels (see 'mipmap.wgsl').
+    glm::i32vec3 src_dim = src.dim();
+    glm::i32vec3 dst_dim{std::max(src_dim.x / 2, 1), std::max(src_dim.y / 2, 1), src_dim.z};
+    Bitmap dst{dst_dim};
+    for (int32_t y = 0; y < dst_dim.y; y++) {
+      for (int32_t x = 0; x < dst_dim.x; x++) {
+        auto dst_ptr = dst(x, y);
+        for (int32_t c = 0; c < dst_dim.z; c++) {
+          uint32_t sum = 0;
+          for (int32_t dy = 0; dy < 2; dy++) {
+            for (int32_t dx = 0; dx < 2; dx++) {
+              sum += src(std::min(2 * x + dx, src_dim.x - 1), std::min(2 * y + dy, src_dim.y - 1))[c];
+            }
+          }
+          dst_ptr[c] = static_cast<uint8_t>((sum + 2) / 4);
+        }
+      }
+    }
+    return dst;
+  }
+  uint32_t RenderTexture::fullMipLevelCount(glm::i64vec2 size) {
+    uint32_t count = 1;
+    for (int64_t extent = std::max(size.x, size.y); extent > 1; extent >>= 1) {
+      count++;
+    }
+    return count;
+  }
   RenderTexture RenderTexture::createForDepth(wgpu::Device &device, std::string name, glm::i64vec3 dim, wgpu::FilterMode filter) {
     bool is_depth = true;
-    return {device, std::move(name), dim, filter, is_depth};
-  }
-  RenderTexture RenderTexture::createForColor(wgpu::Device &device, std::string name, glm::i64vec3 dim, wgpu::FilterMode filter) {
+    return {device, std::move(name), dim, filter, is_depth, 1, wgpu::AddressMode::ClampToEdge, wgpu::TextureUsage::None};
+  }
+  RenderTexture RenderTexture::createForColor(
+    wgpu::Device &device, 
+    std::string name, 
+    glm::i64vec3 dim, 
+    wgpu::FilterMode filter, 
+    uint32_t mip_level_count, 
+    wgpu::AddressMode address_mode, 
+    wgpu::TextureUsage extra_usage
+  ) {
     bool is_depth = false;
-    return {device, std::move(name), dim, filter, is_depth};
+    return {device, std::move(name), dim, filter, is_depth, mip_level_count, address_mode, extra_usage};
   }
-  RenderTexture RenderTexture::createForColorFromBitmap(wgpu::Device &device, std::string name, Bitmap bitmap, wgpu::FilterMode filter) {
-    RenderTexture res = createForColor(device, std::move(name), bitmap.dim(), filter);
-    res.upload(device, bitmap);
+  RenderTexture RenderTexture::createForColorFromBitmap(
+    wgpu::Device &device, 
+    std::string name, 
+    Bitmap bitmap, 
+    wgpu::FilterMode filter,
+    ComputePipeline<1> const *mipmap_pipeline,
+    wgpu::AddressMode address_mode
+  ) {
+    // Builds a full mip chain: on the GPU when given the mipmap pipeline (RGBA only), else on the CPU.
+    uint32_t mip_level_count = fullMipLevelCount(glm::i64vec2{bitmap.dim()});
+    RenderTexture res = createForColor(device, std::move(name), bitmap.dim(), filter, mip_level_count, address_mode);
+    res.upload(device, bitmap, 0);
+    if (mipmap_pipeline != nullptr && bitmap.dim().z == 4) {
+      res.generateMipmapsOnGpu(device, *mipmap_pipeline);
+    } else {
+      res.generateMipmapsOnCpu(device, bitmap);
+    }
     return res;
   }
 }
@@ -368,6 +671,12 @@ namespace broccoli {
   glm::i64vec3 RenderTexture::dim() const {
     return m_dim;
   }
+  uint32_t RenderTexture::mipLevelCount() const {
+    return m_mip_level_count;
+  }
+  wgpu::AddressMode RenderTexture::addressMode() const {
+    return m_address_mode;
+  }
 }
 namespace broccoli {
   RenderTextureView::RenderTextureView(RenderTexture const &rt, glm::dvec2 uv_offset, glm::dvec2 uv_size)
@@ -388,10 +697,428 @@ namespace broccoli {
   }
 }
 
+//
+// Interface: RenderTextureAtlas
+//
+
+namespace broccoli {
+  RenderTextureAtlas::RenderTextureAtlas(std::string name, int32_t channel_count)
+  : m_name(std::move(name)),
+    m_channel_count(channel_count),
+    m_pages(),
+    m_allocation_map()
+  {
+    CHECK(channel_count == 1 || channel_count == 4, "Expected either 1 or 4 channels for a texture atlas.");
+  }
+}
+namespace broccoli {
+  std::optional<RenderTextureView> RenderTextureAtlas::insert(wgpu::Device &device, RenderTexture const &texture, RenderPipeline<1, 0> const &blit_pipeline) {
+    glm::i32vec2 size{texture.dim()};
+    CHECK(texture.dim().z == m_channel_count, "Texture channel count does not match atlas.");
+    if (size.x > R3D_TEXTURE_ATLAS_MAX_TEXTURE_SIZE || size.y > R3D_TEXTURE_ATLAS_MAX_TEXTURE_SIZE) {
+      return std::nullopt;
+    }
+    if (texture.addressMode() != wgpu::AddressMode::ClampToEdge) {
+      // Repeating would sample neighbouring allocations: the shader can only clamp atlased UVs (see 'computeVirtualUv').
+      return std::nullopt;
+    }
+    if (texture.mipLevelCount() < R3D_TEXTURE_ATLAS_MIP_LEVEL_COUNT) {
+      return std::nullopt;
+    }
+
+    // Textures shared by several materials are only packed once: the allocation keeps a reference to its source, so
+    // the source handle cannot be recycled for another texture while it is a key in this map.
+    auto it = m_allocation_map.find(texture.texture().Get());
+    if (it != m_allocation_map.end()) {
+      return view(it->second);
+    }
+    auto allocation = allocate(device, size);
+    if (!allocation.has_value()) {
+      return std::nullopt;
+    }
+    allocation->source = texture.texture();
+    blit(device, texture, allocation.value(), blit_pipeline);
+    m_allocation_map.insert({texture.texture().Get(), allocation.value()});
+    return view(allocation.value());
+  }
+  size_t RenderTextureAtlas::pageCount() const {
+    return m_pages.size();
+  }
+}
+namespace broccoli {
+  std::optional<RenderTextureAtlas::Allocation> RenderTextureAtlas::allocate(wgpu::Device &device, glm::i32vec2 size) {
+    // Padding by the gutter and aligning to it keeps every allocation's origin on a multiple of the gutter size.
+    const int32_t gutter = R3D_TEXTURE_ATLAS_GUTTER_SIZE;
+    glm::i32vec2 padded_size = ((size + 2 * gutter + gutter - 1) / gutter) * gutter;
+    for (size_t page_index = 0; page_index < m_pages.size(); page_index++) {
+      auto origin = allocateInPage(m_pages[page_index], padded_size);
+      if (origin.has_value()) {
+        return Allocation{page_index, origin.value() + gutter, size, nullptr};
+      }
+    }
+
+    // Out of space: open a new page.
+    auto page_name = m_name + ".Page" + std::to_string(m_pages.size());
+    auto page_dim = glm::i64vec3{R3D_TEXTURE_ATLAS_PAGE_SIZE, R3D_TEXTURE_ATLAS_PAGE_SIZE, m_channel_count};
+    m_pages.push_back(Page {
+      .texture = RenderTexture::createForColor(
+        device, 
+        std::move(page_name), 
+        page_dim, 
+        wgpu::FilterMode::Linear, 
+        R3D_TEXTURE_ATLAS_MIP_LEVEL_COUNT,
+        wgpu::AddressMode::ClampToEdge,
+        wgpu::TextureUsage::RenderAttachment
+      ),
+      .skyline = {glm::i32vec3{0, 0, R3D_TEXTURE_ATLAS_PAGE_SIZE}},
+    });
+    auto origin = allocateInPage(m_pages.back(), padded_size);
+    CHECK(origin.has_value(), "Expected a fresh atlas page to fit any atlased texture.");
+    return Allocation{m_pages.size() - 1, origin.value() + gutter, size, nullptr};
+  }
+  std::optional<glm::i32vec2> RenderTextureAtlas::allocateInPage(Page &page, glm::i32vec2 padded_size) {
+    // Skyline nodes are (x, y, width) segments of the packed region's upper envelope, sorted by x.
+    auto &skyline = page.skyline;
+    auto fit = [&skyline, padded_size] (size_t node_index) -> std::optional<int32_t> {
+      if (skyline[node_index].x + padded_size.x > R3D_TEXTURE_ATLAS_PAGE_SIZE) {
+        return std::nullopt;
+      }
+      int32_t y = 0;
+      int32_t width_left = padded_size.x;
+      for (size_t i = node_index; width_left > 0; i++) {
+        y = std::max(y, skyline[i].y);
+        if (y + padded_size.y > R3D_TEXTURE_ATLAS_PAGE_SIZE) {
+          return std::nullopt;
+        }
+        width_left -= skyline[i].z;
+      }
+      return y;
+    };
+
+    // Bottom-left heuristic: lowest resulting top edge, ties broken by the narrowest node.
+    std::optional<size_t> best_index = std::nullopt;
+    glm::i32vec2 best_origin{0};
+    int32_t best_top = std::numeric_limits<int32_t>::max();
+    int32_t best_width = std::numeric_limits<int32_t>::max();
+    for (size_t i = 0; i < skyline.size(); i++) {
+      auto y = fit(i);
+      if (!y.has_value()) {
+        continue;
+      }
+      int32_t top = y.value() + padded_size.y;
+      if (top < best_top || (top == best_top && skyline[i].z < best_width)) {
+        best_index = i;
+        best_origin = {skyline[i].x, y.value()};
+        best_top = top;
+        best_width = skyline[i].z;
+      }
+    }
+    if (!best_index.has_value()) {
+      return std::nullopt;
+    }
+
+    // Raising the skyline over the new allocation, trimming or removing the nodes it covers:
+    size_t index = best_index.value();
+    skyline.insert(skyline.begin() + index, glm::i32vec3{best_origin.x, best_top, padded_size.x});
+    for (size_t i = index + 1; i < skyline.size(); ) {
+      int32_t covered_end = skyline[i - 1].x + skyline[i - 1].z;
+      if (skyline[i].x >= covered_end) {
+        break;
+      }
+      int32_t shrink = covered_end - skyline[i].x;
+      skyline[i].x += shrink;
+      skyline[i].z -= shrink;
+      if (skyline[i].z > 0) {
+        break;
+      }
+      skyline.erase(skyline.begin() + i);
+    }
+    for (size_t i = 0; i + 1 < skyline.size(); ) {
+      if (skyline[i].y == skyline[i + 1].y) {
+        skyline[i].z += skyline[i + 1].z;
+        skyline.erase(skyline.begin() + i + 1);
+      } else {
+        i++;
+      }
+    }
+    return best_origin;
+  }
+}
+namespace broccoli {
+  void RenderTextureAtlas::blit(wgpu::Device &device, RenderTexture const &texture, Allocation const &allocation, RenderPipeline<1, 0> const &blit_pipeline) {
+    // Draws the texture into its allocation with one render pass per page mip level, over a viewport that also covers 
+    // the gutter: gutter texels read the nearest edge texel (see 'texture_atlas.wgsl').
+    // Each page mip level is filled from the same source mip level: since allocations are aligned to the gutter size,
+    // the allocation's origin and gutter shrink exactly with each level.
+    const auto &page = m_pages[allocation.page_index].texture.texture();
+    wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.TextureAtlas.CommandEncoder"};
+    wgpu::CommandEncoder command_encoder = device.CreateCommandEncoder(&command_encoder_descriptor);
+    for (uint32_t mip_level = 0; mip_level < R3D_TEXTURE_ATLAS_MIP_LEVEL_COUNT; mip_level++) {
+      const int32_t gutter = R3D_TEXTURE_ATLAS_GUTTER_SIZE >> mip_level;
+      const glm::i32vec2 size = glm::max(allocation.size >> int32_t(mip_level), glm::i32vec2{1});
+      const glm::i32vec2 origin = allocation.offset >> int32_t(mip_level);
+      wgpu::TextureViewDescriptor src_view_desc = {
+        .dimension = wgpu::TextureViewDimension::e2D,
+        .baseMipLevel = mip_level,
+        .mipLevelCount = 1,
+      };
+      wgpu::TextureViewDescriptor dst_view_desc = {
+        .dimension = wgpu::TextureViewDimension::e2D,
+        .baseMipLevel = mip_level,
+        .mipLevelCount = 1,
+      };
+      auto entries = std::to_array({
+        wgpu::BindGroupEntry {.binding=0, .textureView=texture.texture().CreateView(&src_view_desc)},
+      });
+      wgpu::BindGroupDescriptor bind_group_desc = {
+        .label = "Broccoli.Render.TextureAtlas.BindGroup0",
+        .layout = blit_pipeline.bind_group_layouts[0],
+        .entryCount = entries.size(),
+        .entries = entries.data(),
+      };
+      auto bind_group = device.CreateBindGroup(&bind_group_desc);
+      wgpu::RenderPassColorAttachment color_attachment = {
+        .view = page.CreateView(&dst_view_desc),
+        .loadOp = wgpu::LoadOp::Load,
+        .storeOp = wgpu::StoreOp::Store,
+      };
+      wgpu::RenderPassDescriptor render_pass_descriptor = {
+        .label = "Broccoli.Render.TextureAtlas.RenderPass",
+        .colorAttachmentCount = 1,
+        .colorAttachments = &color_attachment,
+      };
+      wgpu::RenderPassEncoder rp_encoder = command_encoder.BeginRenderPass(&render_pass_descriptor);
+      rp_encoder.SetPipeline(blit_pipeline.pipeline);
+      blit_pipeline.setBindGroups(rp_encoder, std::to_array({bind_group}));
+      rp_encoder.SetViewport(
+        static_cast<float>(origin.x - gutter), static_cast<float>(origin.y - gutter),
+        static_cast<float>(size.x + 2 * gutter), static_cast<float>(size.y + 2 * gutter),
+        0.0f, 1.0f
+      );
+      rp_encoder.Draw(3, 1, 0, static_cast<uint32_t>(gutter));
+      rp_encoder.End();
+    }
+    wgpu::CommandBuffer command_buffer = command_encoder.Finish();
+    device.GetQueue().Submit(1, &command_buffer);
+  }
+  RenderTextureView RenderTextureAtlas::view(Allocation const &allocation) const {
+    const double page_size = R3D_TEXTURE_ATLAS_PAGE_SIZE;
+    return {
+      m_pages[allocation.page_index].texture,
+      glm::dvec2{allocation.offset} / page_size,
+      glm::dvec2{allocation.size} / page_size
+    };
+  }
+}
+
+namespace broccoli {
+  RenderTextureStreamer::RenderTextureStreamer(uint64_t budget_byte_count)
+  : m_entries(),
+    m_retired_views(),
+    m_budget_byte_count(budget_byte_count),
+    m_resident_byte_count(0),
+    m_frame_index(1)
+  {}
+}
+namespace broccoli {
+  StreamedTexture RenderTextureStreamer::create(wgpu::Device &device, std::string name, Bitmap bitmap, wgpu::FilterMode filter) {
+    // The full mip chain is built once on the CPU: every later upload is a plain copy out of it.
+    uint32_t mip_level_count = RenderTexture::fullMipLevelCount(glm::i64vec2{bitmap.dim()});
+    std::vector<Bitmap> mip_chain;
+    mip_chain.reserve(mip_level_count);
+    mip_chain.push_back(std::move(bitmap));
+    for (uint32_t mip_level = 1; mip_level < mip_level_count; mip_level++) {
+      mip_chain.push_back(RenderTexture::downsample(mip_chain.back()));
+    }
+    m_entries.push_back(Entry {
+      .name = std::move(name),
+      .mip_chain = std::move(mip_chain),
+      .filter = filter,
+      .texture = std::nullopt,
+      .resident_mip_level = mip_level_count,
+      .requested_mip_level = mip_level_count - 1,
+      .last_request_frame = 0,
+    });
+    auto &entry = m_entries.back();
+    entry.requested_mip_level = tailMipLevel(entry);
+    makeResident(device, entry, entry.requested_mip_level);
+    return {m_entries.size() - 1};
+  }
+  void RenderTextureStreamer::request(StreamedTexture texture, double screen_extent) {
+    // The finest level worth having is the one whose texels are about as large as the pixels they cover. Requests within
+    // a frame accumulate: the finest one wins.
+    auto &entry = m_entries[texture.value];
+    auto dim = entry.mip_chain[0].dim();
+    auto texel_extent = static_cast<double>(std::max(dim.x, dim.y));
+    auto mip_level_count = static_cast<uint32_t>(entry.mip_chain.size());
+    uint32_t mip_level = 0;
+    if (screen_extent < texel_extent) {
+      double lod = std::floor(std::log2(texel_extent / std::max(screen_extent, 1.0)));
+      mip_level = std::min(static_cast<uint32_t>(lod), mip_level_count - 1);
+    }
+    if (entry.last_request_frame == m_frame_index) {
+      entry.requested_mip_level = std::min(entry.requested_mip_level, mip_level);
+    } else {
+      entry.requested_mip_level = mip_level;
+      entry.last_request_frame = m_frame_index;
+    }
+  }
+  std::vector<StreamedTexture> RenderTextureStreamer::update(wgpu::Device &device) {
+    // Target levels: textures requested this frame aim for their requested level, others keep what they have.
+    std::vector<uint32_t> target_mip_levels(m_entries.size());
+    uint64_t target_byte_count = 0;
+    for (size_t i = 0; i < m_entries.size(); i++) {
+      const auto &entry = m_entries[i];
+      bool is_requested = entry.last_request_frame == m_frame_index;
+      target_mip_levels[i] = is_requested ? std::min(entry.requested_mip_level, tailMipLevel(entry)) : entry.resident_mip_level;
+      target_byte_count += byteCount(entry, target_mip_levels[i]);
+    }
+
+    // Over budget: the least recently requested textures are coarsened first, larger ones first among equals, but never 
+    // past their tails.
+    if (target_byte_count > m_budget_byte_count) {
+      std::vector<size_t> eviction_order(m_entries.size());
+      std::iota(eviction_order.begin(), eviction_order.end(), 0);
+      std::sort(eviction_order.begin(), eviction_order.end(), [this, &target_mip_levels] (size_t a, size_t b) {
+        const auto &entry_a = m_entries[a];
+        const auto &entry_b = m_entries[b];
+        if (entry_a.last_request_frame != entry_b.last_request_frame) {
+          return entry_a.last_request_frame < entry_b.last_request_frame;
+        }
+        return byteCount(entry_a, target_mip_levels[a]) > byteCount(entry_b, target_mip_levels[b]);
+      });
+      for (size_t i: eviction_order) {
+        const auto &entry = m_entries[i];
+        uint32_t tail = tailMipLevel(entry);
+        while (target_byte_count > m_budget_byte_count && target_mip_levels[i] < tail) {
+          target_byte_count -= byteCount(entry, target_mip_levels[i]) - byteCount(entry, target_mip_levels[i] + 1);
+          target_mip_levels[i]++;
+        }
+        if (target_byte_count <= m_budget_byte_count) {
+          break;
+        }
+      }
+    }
+
+    // Evictions apply at once, freeing memory before any uploads. Residency then rises by one level per texture per 
+    // update, so that coarse levels always arrive first.
+    std::vector<StreamedTexture> changed_textures;
+    for (size_t i = 0; i < m_entries.size(); i++) {
+      auto &entry = m_entries[i];
+      if (target_mip_levels[i] > entry.resident_mip_level) {
+        makeResident(device, entry, target_mip_levels[i]);
+        changed_textures.push_back({i});
+      }
+    }
+    uint64_t upload_byte_count = 0;
+    for (size_t i = 0; i < m_entries.size() && upload_byte_count < R3D_TEXTURE_STREAMING_UPLOAD_BYTE_BUDGET; i++) {
+      auto &entry = m_entries[i];
+      if (target_mip_levels[i] < entry.resident_mip_level) {
+        uint32_t mip_level = entry.resident_mip_level - 1;
+        makeResident(device, entry, mip_level);
+        upload_byte_count += entry.mip_chain[mip_level].dataSize();
+        changed_textures.push_back({i});
+      }
+    }
+
+    m_frame_index++;
+    return changed_textures;
+  }
+  std::vector<wgpu::TextureView> RenderTextureStreamer::takeRetiredViews() {
+    return std::exchange(m_retired_views, {});
+  }
+}
+namespace broccoli {
+  void RenderTextureStreamer::makeResident(wgpu::Device &device, Entry &entry, uint32_t mip_level) {
+    // Re-creates the texture with 'mip_level' as its base. Levels that were already resident are copied over on the GPU,
+    // and only the rest are uploaded from the CPU.
+    auto mip_level_count = static_cast<uint32_t>(entry.mip_chain.size());
+    std::optional<RenderTexture> old_texture = std::nullopt;
+    uint32_t old_mip_level = entry.resident_mip_level;
+    if (entry.texture.has_value()) {
+      m_resident_byte_count -= byteCount(entry, old_mip_level);
+      m_retired_views.push_back(entry.texture->view());
+      old_texture.emplace(std::move(entry.texture.value()));
+      entry.texture.reset();
+    }
+    entry.texture.emplace(
+      RenderTexture::createForColor(
+        device,
+        entry.name + ".Mip" + std::to_string(mip_level),
+        glm::i64vec3{entry.mip_chain[mip_level].dim()},
+        entry.filter,
+        mip_level_count - mip_level
+      )
+    );
+    wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.TextureStreamer.CommandEncoder"};
+    wgpu::CommandEncoder command_encoder = device.CreateCommandEncoder(&command_encoder_descriptor);
+    for (uint32_t i = mip_level; i < mip_level_count; i++) {
+      if (old_texture.has_value() && i >= old_mip_level) {
+        auto dim = entry.mip_chain[i].dim();
+        wgpu::ImageCopyTexture src = {.texture = old_texture->texture(), .mipLevel = i - old_mip_level};
+        wgpu::ImageCopyTexture dst = {.texture = entry.texture->texture(), .mipLevel = i - mip_level};
+        wgpu::Extent3D extent = {.width=static_cast<uint32_t>(dim.x), .height=static_cast<uint32_t>(dim.y)};
+        command_encoder.CopyTextureToTexture(&src, &dst, &extent);
+      } else {
+        entry.texture->upload(device, entry.mip_chain[i], i - mip_level);
+      }
+    }
+    wgpu::CommandBuffer command_buffer = command_encoder.Finish();
+    device.GetQueue().Submit(1, &command_buffer);
+    entry.resident_mip_level = mip_level;
+    m_resident_byte_count += byteCount(entry, mip_level);
+  }
+  uint32_t RenderTextureStreamer::tailMipLevel(Entry const &entry) {
+    // The tail is the coarsest few levels, which stay resident so that every texture can be drawn at once.
+    uint32_t mip_level = 0;
+    while (mip_level + 1 < entry.mip_chain.size()) {
+      auto dim = entry.mip_chain[mip_level].dim();
+      if (std::max(dim.x, dim.y) <= R3D_TEXTURE_STREAMING_TAIL_SIZE) {
+        break;
+      }
+      mip_level++;
+    }
+    return mip_level;
+  }
+  uint64_t RenderTextureStreamer::byteCount(Entry const &entry, uint32_t mip_level) {
+    uint64_t byte_count = 0;
+    for (uint32_t i = mip_level; i < entry.mip_chain.size(); i++) {
+      byte_count += entry.mip_chain[i].dataSize();
+    }
+    return byte_count;
+  }
+}
+namespace broccoli {
+  RenderTexture const &RenderTextureStreamer::texture(StreamedTexture texture) const {
+    return m_entries[texture.value].texture.value();
+  }
+  TextureResidency RenderTextureStreamer::residency(StreamedTexture texture) const {
+    const auto &entry = m_entries[texture.value];
+    return {
+      .mip_level_count = static_cast<uint32_t>(entry.mip_chain.size()),
+      .resident_mip_level = entry.resident_mip_level,
+      .requested_mip_level = entry.requested_mip_level,
+      .resident_byte_count = byteCount(entry, entry.resident_mip_level),
+    };
+  }
+  uint64_t RenderTextureStreamer::budgetByteCount() const {
+    return m_budget_byte_count;
+  }
+  void RenderTextureStreamer::setBudgetByteCount(uint64_t budget_byte_count) {
+    m_budget_byte_count = budget_byte_count;
+  }
+  uint64_t RenderTextureStreamer::residentByteCount() const {
+    return m_resident_byte_count;
+  }
+}
+
 namespace broccoli {
   void RenderShadowMaps::init(
     wgpu::Device &dev,
     const ShadowRenderPipeline &pipeline,
+    const ShadowBlurComputePipeline &blur_pipeline,
+    ShadowMapRepresentation representation,
+    wgpu::TextureFormat depth_format,
     int32_t light_count_lg2,
     int32_t cascades_per_light_lg2,
     int32_t size_lg2,
@@ -405,13 +1132,20 @@ namespace broccoli {
     CHECK(m_read_views.empty(), "Expected shadow map texture views to be uninitialized");
     CHECK(m_shadow_map_ubo_vec.empty(), "Expected shadow map UBOs to be uninitialized");
 
+    m_representation = representation;
+    m_depth_format = depth_format;
     m_light_count_lg2 = light_count_lg2;
     m_cascades_per_light_lg2 = cascades_per_light_lg2;
     m_size_lg2 = size_lg2;
     int32_t shadow_map_count = 1 << (light_count_lg2 + cascades_per_light_lg2);
+    bool is_moments = representation == ShadowMapRepresentation::Moments;
+    wgpu::TextureFormat texture_format = format();
+    wgpu::TextureAspect write_aspect = is_moments ? wgpu::TextureAspect::All : wgpu::TextureAspect::DepthOnly;
 
     std::string texture_descriptor_label = name + ".Texture";
+    std::string array_read_view_descriptor_label = name + ".ArrayReadView";
     wgpu::TextureUsage texture_usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
+    texture_usage |= is_moments ? wgpu::TextureUsage::StorageBinding : static_cast<wgpu::TextureUsage>(0);
     texture_usage |= BROCCOLI_DEBUG ? wgpu::TextureUsage::CopySrc : static_cast<wgpu::TextureUsage>(0);
     wgpu::TextureDescriptor texture_descriptor = {
       .label = texture_descriptor_label.c_str(),
@@ -422,9 +1156,18 @@ namespace broccoli {
         .height = 1U << size_lg2,
         .depthOrArrayLayers = static_cast<uint32_t>(shadow_map_count),
       },
-      .format = R3D_CSM_TEXTURE_FORMAT,
+      .format = texture_format,
     };
     m_texture = dev.CreateTexture(&texture_descriptor);
+    wgpu::TextureViewDescriptor array_read_view_descriptor = {
+      .label = array_read_view_descriptor_label.c_str(),
+      .format = texture_format,
+      .dimension = wgpu::TextureViewDimension::e2DArray,
+      .baseArrayLayer = 0,
+      .arrayLayerCount = static_cast<uint32_t>(shadow_map_count),
+      .aspect = wgpu::TextureAspect::All,
+    };
+    m_array_read_view = m_texture.CreateView(&array_read_view_descriptor);
 
     m_write_views.reserve(shadow_map_count);
     m_read_views.reserve(shadow_map_count);
@@ -433,15 +1176,15 @@ namespace broccoli {
       std::string read_view_descriptor_label = name + ".ReadView";
       wgpu::TextureViewDescriptor write_view_descriptor = {
         .label = write_view_descriptor_label.c_str(),
-        .format = R3D_CSM_TEXTURE_FORMAT,
+        .format = texture_format,
         .dimension = wgpu::TextureViewDimension::e2D,
         .baseArrayLayer = static_cast<uint32_t>(i),
         .arrayLayerCount = 1,
-        .aspect = wgpu::TextureAspect::DepthOnly,
+        .aspect = write_aspect,
       };
       wgpu::TextureViewDescriptor read_view_descriptor = {
         .label = read_view_descriptor_label.c_str(),
-        .format = R3D_CSM_TEXTURE_FORMAT,
+        .format = texture_format,
         .dimension = wgpu::TextureViewDimension::e2D,
         .baseArrayLayer = static_cast<uint32_t>(i),
         .arrayLayerCount = 1,
@@ -481,12 +1224,105 @@ namespace broccoli {
       };
       m_shadow_map_ubo_vec.push_back(std::move(ubo));
     }
+
+    if (!is_moments) {
+      return;
+    }
+
+    // Moments are rendered as color, so depth testing needs a separate (shared) depth buffer. Since cascades are drawn
+    // one after the other, a single scratch texture suffices.
+    {
+      std::string depth_scratch_label = name + ".DepthScratch";
+      wgpu::TextureDescriptor depth_scratch_descriptor = {
+        .label = depth_scratch_label.c_str(),
+        .usage = wgpu::TextureUsage::RenderAttachment,
+        .dimension = wgpu::TextureDimension::e2D,
+        .size = wgpu::Extent3D {
+          .width = 1U << size_lg2,
+          .height = 1U << size_lg2,
+          .depthOrArrayLayers = 1,
+        },
+        .format = depth_format,
+      };
+      m_depth_scratch_texture = dev.CreateTexture(&depth_scratch_descriptor);
+      m_depth_scratch_view = m_depth_scratch_texture.CreateView();
+    }
+
+    // The separable blur ping-pongs each layer through a single scratch texture: horizontal reads the layer and writes the
+    // scratch texture, vertical reads the scratch texture and writes back to the layer.
+    {
+      std::string blur_scratch_label = name + ".BlurScratch";
+      wgpu::TextureDescriptor blur_scratch_descriptor = {
+        .label = blur_scratch_label.c_str(),
+        .usage = wgpu::TextureUsage::StorageBinding | wgpu::TextureUsage::TextureBinding,
+        .dimension = wgpu::TextureDimension::e2D,
+        .size = wgpu::Extent3D {
+          .width = 1U << size_lg2,
+          .height = 1U << size_lg2,
+          .depthOrArrayLayers = 1,
+        },
+        .format = texture_format,
+      };
+      m_blur_scratch_texture = dev.CreateTexture(&blur_scratch_descriptor);
+      m_blur_scratch_view = m_blur_scratch_texture.CreateView();
+    }
+    m_blur_bind_groups.reserve(shadow_map_count);
+    for (int32_t i = 0; i < shadow_map_count; i++) {
+      std::string horizontal_label = name + ".Blur.Horizontal.BindGroup";
+      std::string vertical_label = name + ".Blur.Vertical.BindGroup";
+      auto horizontal_entries = std::to_array({
+        wgpu::BindGroupEntry{.binding = 0, .textureView = m_read_views[i]},
+        wgpu::BindGroupEntry{.binding = 1, .textureView = m_blur_scratch_view},
+      });
+      auto vertical_entries = std::to_array({
+        wgpu::BindGroupEntry{.binding = 0, .textureView = m_blur_scratch_view},
+        wgpu::BindGroupEntry{.binding = 1, .textureView = m_read_views[i]},
+      });
+      wgpu::BindGroupDescriptor horizontal_descriptor = {
+        .label = horizontal_label.c_str(),
+        .layout = blur_pipeline.textureBindGroupLayout(),
+        .entryCount = horizontal_entries.size(),
+        .entries = horizontal_entries.data(),
+      };
+      wgpu::BindGroupDescriptor vertical_descriptor = {
+        .label = vertical_label.c_str(),
+        .layout = blur_pipeline.textureBindGroupLayout(),
+        .entryCount = vertical_entries.size(),
+        .entries = vertical_entries.data(),
+      };
+      m_blur_bind_groups.push_back(BlurBindGroups {
+        .horizontal = dev.CreateBindGroup(&horizontal_descriptor),
+        .vertical = dev.CreateBindGroup(&vertical_descriptor),
+      });
+    }
   }
 }
 namespace broccoli {
   wgpu::Texture RenderShadowMaps::texture() const {
     return m_texture;
   }
+  wgpu::TextureFormat RenderShadowMaps::format() const {
+    switch (m_representation) {
+      case ShadowMapRepresentation::Depth: return m_depth_format;
+      case ShadowMapRepresentation::Moments: return R3D_CSM_MOMENTS_TEXTURE_FORMAT;
+      default: PANIC("unknown/invalid shadow map representation");
+    }
+  }
+  ShadowMapRepresentation RenderShadowMaps::representation() const {
+    return m_representation;
+  }
+  int32_t RenderShadowMaps::sizeLg2() const {
+    return m_size_lg2;
+  }
+  int32_t RenderShadowMaps::lightCount() const {
+    return 1 << m_light_count_lg2;
+  }
+  int32_t RenderShadowMaps::cascadesPerLight() const {
+    return 1 << m_cascades_per_light_lg2;
+  }
+  const wgpu::TextureView &RenderShadowMaps::getArrayReadView() const {
+    return m_array_read_view;
+  }
   const wgpu::TextureView &RenderShadowMaps::getWriteView(int32_t light_idx, int32_t cascade_idx) const {
     return m_write_views[(light_idx << m_cascades_per_light_lg2) + cascade_idx];
   }
@@ -496,895 +1332,3227 @@ namespace broccoli {
   const RenderShadowMaps::ShadowMapUbo &RenderShadowMaps::getShadowMapUbo(int32_t light_idx, int32_t cascade_idx) const {
     return m_shadow_map_ubo_vec[(light_idx << m_cascades_per_light_lg2) + cascade_idx];
   }
+  const RenderShadowMaps::BlurBindGroups &RenderShadowMaps::getBlurBindGroups(int32_t light_idx, int32_t cascade_idx) const {
+    CHECK(m_representation == ShadowMapRepresentation::Moments, "Only moment shadow maps are blurred");
+    return m_blur_bind_groups[(light_idx << m_cascades_per_light_lg2) + cascade_idx];
+  }
+  const wgpu::TextureView &RenderShadowMaps::getDepthScratchView() const {
+    CHECK(m_representation == ShadowMapRepresentation::Moments, "Only moment shadow maps use a depth scratch texture");
+    return m_depth_scratch_view;
+  }
 }
 
-//
-// Interface: Renderer
-//
-
 namespace broccoli {
-  RenderManager::RenderManager(wgpu::Device &device, glm::ivec2 framebuffer_size)
-  : m_wgpu_device(device),
-    m_rgb_palette(
-      RenderTexture::createForColorFromBitmap(
-        m_wgpu_device,
-        "Broccoli.Render.Texture.RgbPalette",
-        initRgbPalette(),
-        wgpu::FilterMode::Nearest
-      )
-    ),
-    m_monochrome_palette(
-      RenderTexture::createForColorFromBitmap(
-        m_wgpu_device,
-        "Broccoli.Render.Texture.MonochromePalette",
-        initMonochromePalette(),
-        wgpu::FilterMode::Nearest
-      )
-    ),
-    m_framebuffer_size(0)
-  {
-    initFinalShaderModules();
-    initShadowShaderModule();
-    initOverlayShaderModules();
-    initBuffers();
-    initFinalPbrRenderPipeline();
-    initFinalBlinnPhongRenderPipeline();
-    initShadowRenderPipeline();
-    initOverlayRenderPipeline();
-    initShadowMaps();
-    resize(framebuffer_size);
-  }
+  void RenderVirtualShadowMap::init(
+    wgpu::Device &dev,
+    const ShadowRenderPipeline &pipeline,
+    wgpu::TextureFormat depth_format,
+    int32_t page_table_size_lg2,
+    int32_t page_size_lg2,
+    int32_t physical_page_count,
+    double world_size,
+    double depth_radius,
+    std::string name
+  ) {
+    CHECK(page_table_size_lg2 > 0, "invalid virtual shadow map page table size lg2");
+    CHECK(page_size_lg2 > 0, "invalid virtual shadow map page size lg2");
+    CHECK(physical_page_count > 0, "invalid virtual shadow map physical page count");
+    CHECK(world_size > 0.0 && depth_radius > 0.0, "invalid virtual shadow map extent");
+    CHECK(!m_atlas_texture, "Expected virtual shadow map atlas to be uninitialized");
+    CHECK(m_page_write_views.empty(), "Expected virtual shadow map page views to be uninitialized");
+    CHECK(m_page_ubo_vec.empty(), "Expected virtual shadow map page UBOs to be uninitialized");
 
-  Bitmap RenderManager::initMonochromePalette() {
-    Bitmap bitmap{glm::i32vec3{R3D_MONO_PALETTE_TEXTURE_SIZE, R3D_MONO_PALETTE_TEXTURE_SIZE, 1}};
-    for (int64_t r = 0; r <= 255; r++) {
-      auto ptr = bitmap((r & 0x0F) >> 0, (r & 0xF0) >> 4);
-      *ptr = static_cast<uint8_t>(r);
+    m_depth_format = depth_format;
+    m_page_table_size_lg2 = page_table_size_lg2;
+    m_page_size_lg2 = page_size_lg2;
+    m_world_size = world_size;
+    m_depth_radius = depth_radius;
+    m_page_table.resize(1LLU << (2 * page_table_size_lg2), 0);
+    m_physical_pages.resize(physical_page_count, PhysicalPage{.page_coord = glm::i64vec2{0}, .last_used_frame = 0, .is_resident = false});
+    m_resident_page_map.reserve(physical_page_count);
+    uint64_t page_table_byte_count = m_page_table.size() * sizeof(uint32_t);
+
+    // physical page atlas: one array layer per page
+    {
+      std::string texture_label = name + ".Atlas.Texture";
+      std::string read_view_label = name + ".Atlas.ReadView";
+      std::string sampler_label = name + ".Atlas.Sampler";
+      wgpu::TextureDescriptor texture_descriptor = {
+        .label = texture_label.c_str(),
+        .usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding,
+        .dimension = wgpu::TextureDimension::e2D,
+        .size = wgpu::Extent3D {
+          .width = 1U << page_size_lg2,
+          .height = 1U << page_size_lg2,
+          .depthOrArrayLayers = static_cast<uint32_t>(physical_page_count),
+        },
+        .format = depth_format,
+      };
+      m_atlas_texture = dev.CreateTexture(&texture_descriptor);
+      wgpu::TextureViewDescriptor read_view_descriptor = {
+        .label = read_view_label.c_str(),
+        .format = depth_format,
+        .dimension = wgpu::TextureViewDimension::e2DArray,
+        .baseArrayLayer = 0,
+        .arrayLayerCount = static_cast<uint32_t>(physical_page_count),
+        .aspect = wgpu::TextureAspect::All,
+      };
+      m_atlas_read_view = m_atlas_texture.CreateView(&read_view_descriptor);
+      wgpu::SamplerDescriptor sampler_descriptor = {
+        .label = sampler_label.c_str(),
+        .addressModeU = wgpu::AddressMode::ClampToEdge,
+        .addressModeV = wgpu::AddressMode::ClampToEdge,
+        .addressModeW = wgpu::AddressMode::ClampToEdge,
+        .magFilter = wgpu::FilterMode::Linear,
+        .minFilter = wgpu::FilterMode::Linear,
+        .compare = wgpu::CompareFunction::LessEqual,
+      };
+      m_atlas_sampler = dev.CreateSampler(&sampler_descriptor);
     }
-    return bitmap;
-  }
 
-  Bitmap RenderManager::initRgbPalette() {
-    Bitmap bitmap{glm::i32vec3{R3D_RGB_PALETTE_TEXTURE_SIZE, R3D_RGB_PALETTE_TEXTURE_SIZE, 4}};
-    for (int64_t r = 0; r <= 255; r++) {
-      for (int64_t g = 0; g <= 255; g++) {
-        for (int64_t b = 0; b <= 255; b++) {
-          int64_t index = (r << 0) | (g << 8) | (b << 16);
-          auto ptr = bitmap((index & 0x000FFF) >> 0, (index & 0xFFF000) >> 12);
-          ptr[0] = static_cast<uint8_t>(r);
-          ptr[1] = static_cast<uint8_t>(g);
-          ptr[2] = static_cast<uint8_t>(b);
-          ptr[3] = static_cast<uint8_t>(0xFF);
-        }
+    // per-page write views and shadow UBOs:
+    m_page_write_views.reserve(physical_page_count);
+    m_page_ubo_vec.reserve(physical_page_count);
+    for (int32_t i = 0; i < physical_page_count; i++) {
+      std::string write_view_label = name + ".Atlas.WriteView";
+      std::string buffer_label = name + ".PageUbo.Buffer";
+      std::string bind_group_label = name + ".PageUbo.BindGroup";
+      wgpu::TextureViewDescriptor write_view_descriptor = {
+        .label = write_view_label.c_str(),
+        .format = depth_format,
+        .dimension = wgpu::TextureViewDimension::e2D,
+        .baseArrayLayer = static_cast<uint32_t>(i),
+        .arrayLayerCount = 1,
+        .aspect = wgpu::TextureAspect::DepthOnly,
+      };
+      m_page_write_views.push_back(m_atlas_texture.CreateView(&write_view_descriptor));
+      wgpu::BufferDescriptor buffer_descriptor = {
+        .label = buffer_label.c_str(),
+        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform,
+        .size = sizeof(ShadowUniform),
+      };
+      wgpu::Buffer buffer = dev.CreateBuffer(&buffer_descriptor);
+      auto bind_group_entries = std::to_array({
+        wgpu::BindGroupEntry {
+          .binding = 0,
+          .buffer = buffer,
+          .size = sizeof(ShadowUniform),
+        },
+      });
+      wgpu::BindGroupDescriptor bind_group_descriptor = {
+        .label = bind_group_label.c_str(),
+        .layout = pipeline.shadowUniformBindGroupLayout(),
+        .entryCount = bind_group_entries.size(),
+        .entries = bind_group_entries.data(),
+      };
+      RenderShadowMaps::ShadowMapUbo ubo = {
+        .state = {},
+        .buffer = buffer,
+        .bind_group = dev.CreateBindGroup(&bind_group_descriptor),
+      };
+      m_page_ubo_vec.push_back(std::move(ubo));
+    }
+
+    // uniform, page table, page requests, and page request readback ring:
+    {
+      std::string uniform_label = name + ".Uniform";
+      std::string page_table_label = name + ".PageTable";
+      std::string page_request_label = name + ".PageRequests";
+      std::string readback_label = name + ".PageRequests.Readback";
+      wgpu::BufferDescriptor uniform_descriptor = {
+        .label = uniform_label.c_str(),
+        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform,
+        .size = sizeof(VirtualShadowMapUniform),
+      };
+      m_uniform_buffer = dev.CreateBuffer(&uniform_descriptor);
+      wgpu::BufferDescriptor page_table_descriptor = {
+        .label = page_table_label.c_str(),
+        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage,
+        .size = page_table_byte_count,
+      };
+      m_page_table_buffer = dev.CreateBuffer(&page_table_descriptor);
+      wgpu::BufferDescriptor page_request_descriptor = {
+        .label = page_request_label.c_str(),
+        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::Storage,
+        .size = page_table_byte_count,
+      };
+      m_page_request_buffer = dev.CreateBuffer(&page_request_descriptor);
+      for (auto &readback: m_page_request_readbacks) {
+        wgpu::BufferDescriptor readback_descriptor = {
+          .label = readback_label.c_str(),
+          .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead,
+          .size = page_table_byte_count,
+        };
+        readback.buffer = dev.CreateBuffer(&readback_descriptor);
+        readback.origin_page_coord = glm::i64vec2{0};
+        readback.is_pending = false;
       }
     }
-    return bitmap;
+
+    // initially disabled:
+    disable(dev.GetQueue());
   }
-  
-  void RenderManager::initFinalShaderModules() {
-    const char *filepath = R3D_UBERSHADER_FILEPATH;
-    std::string raw_shader_text = readTextFile(filepath);
-    m_wgpu_pbr_shader_module = initShaderModuleVariant(
-      filepath, 
-      raw_shader_text,
-      std::unordered_map<std::string, std::string> {
-        {"p_LIGHTING_MODEL", std::to_string(static_cast<uint32_t>(MaterialLightingModel::PhysicallyBased))},
-        {"p_INSTANCE_COUNT", std::to_string(static_cast<uint32_t>(R3D_INSTANCE_CAPACITY))},
-        {"p_DIRECTIONAL_LIGHT_COUNT", std::to_string(static_cast<uint32_t>(R3D_DIRECTIONAL_LIGHT_CAPACITY))},
-        {"p_POINT_LIGHT_COUNT", std::to_string(static_cast<uint32_t>(R3D_POINT_LIGHT_CAPACITY))},
+}
+namespace broccoli {
+  std::vector<int32_t> RenderVirtualShadowMap::beginFrame(wgpu::CommandEncoder &encoder, RenderStagingBelt &staging_belt, glm::dmat3 light_view_matrix, glm::dvec3 camera_position, std::vector<CasterBounds> caster_bounds) {
+    m_frame_index++;
+    m_is_enabled = true;
+
+    // The cached light orientation is only replaced (invalidating every page) once the light has turned past the 
+    // tolerance. Until then, shadows are cast along the cached direction, lagging the shading by at most that angle.
+    // The angle of the rotation between both orientations follows from its trace: 'tr(R) = 1 + 2 cos(angle)'.
+    auto relative_rotation = light_view_matrix * glm::transpose(m_light_view_matrix);
+    auto cos_angle = 0.5 * (relative_rotation[0][0] + relative_rotation[1][1] + relative_rotation[2][2] - 1.0);
+    bool is_light_rotated = cos_angle < glm::cos(R3D_VSM_LIGHT_ROTATION_TOLERANCE);
+    if (is_light_rotated) {
+      m_light_view_matrix = light_view_matrix;
+    }
+
+    // Snapping the origin to whole pages keeps texels world-stable (no shimmering), and lets cached pages be re-used as
+    // the camera moves. Snapping depth to the radius does the same for the near/far planes, which are shared by all pages.
+    auto light_space_camera_position = m_light_view_matrix * camera_position;
+    auto origin_page_coord = glm::i64vec2{glm::round(glm::dvec2{light_space_camera_position} / pageWorldSize())};
+    auto origin_depth_coord = static_cast<int64_t>(glm::round(light_space_camera_position.z / m_depth_radius));
+    if (is_light_rotated || origin_depth_coord != m_origin_depth_coord) {
+      invalidate();
+    }
+    m_origin_page_coord = origin_page_coord;
+    m_origin_depth_coord = origin_depth_coord;
+
+    // Resolve page requests read back since the last frame, allocating (and so dirtying) pages that are not cached:
+    int64_t page_table_size = 1LL << m_page_table_size_lg2;
+    int64_t half_page_table_size = page_table_size / 2;
+    std::vector<int32_t> dirty_pages;
+    for (auto page_coord: m_received_page_requests) {
+      auto rel_page_coord = page_coord - m_origin_page_coord;
+      bool is_in_view = (
+        -half_page_table_size <= rel_page_coord.x && rel_page_coord.x < half_page_table_size &&
+        -half_page_table_size <= rel_page_coord.y && rel_page_coord.y < half_page_table_size
+      );
+      if (!is_in_view) {
+        continue;
       }
-    );
-    m_wgpu_blinn_phong_shader_module = initShaderModuleVariant(
-      filepath, 
-      raw_shader_text,
-      std::unordered_map<std::string, std::string> {
-        {"p_LIGHTING_MODEL", std::to_string(static_cast<uint32_t>(MaterialLightingModel::BlinnPhong))},
-        {"p_INSTANCE_COUNT", std::to_string(static_cast<uint32_t>(R3D_INSTANCE_CAPACITY))},
-        {"p_DIRECTIONAL_LIGHT_COUNT", std::to_string(static_cast<uint32_t>(R3D_DIRECTIONAL_LIGHT_CAPACITY))},
-        {"p_POINT_LIGHT_COUNT", std::to_string(static_cast<uint32_t>(R3D_POINT_LIGHT_CAPACITY))},
+      auto it = m_resident_page_map.find(pageKey(page_coord));
+      if (it != m_resident_page_map.end()) {
+        m_physical_pages[it->second].last_used_frame = m_frame_index;
+        continue;
       }
-    );
-  }
-
-  void RenderManager::initShadowShaderModule() {
-    const char *filepath = R3D_SHADOW_SHADER_FILEPATH;
-    std::string raw_shader_text = readTextFile(filepath);
-    m_wgpu_shadow_shader_module = initShaderModuleVariant(
-      filepath, 
-      raw_shader_text,
-      std::unordered_map<std::string, std::string> {
-        {"p_INSTANCE_COUNT", std::to_string(static_cast<uint32_t>(R3D_INSTANCE_CAPACITY))},
+      int32_t physical_page_idx = allocatePhysicalPage(page_coord);
+      if (physical_page_idx < 0) {
+        // Every page is in use this frame: the remaining requests fall back to 'unshadowed' until the next frame.
+        break;
       }
-    );
-  }
+      dirty_pages.push_back(physical_page_idx);
+    }
+    m_received_page_requests.clear();
+    dirtyChangedCasterPages(std::move(caster_bounds), dirty_pages);
 
-  void RenderManager::initOverlayShaderModules() {
-    const char *filepath = R3D_OVERLAY_SHADER_FILEPATH;
-    std::string shader_text = readTextFile(filepath);
-    m_wgpu_overlay_monochrome_shader_module = initShaderModuleVariant(
-      filepath, 
-      shader_text,
-      std::unordered_map<std::string, std::string> {
-        {"p_SAMPLE_MODE", "1"}
+    // Build and upload the page table for the current window: entries are 'physical page index + 1', or 0 if absent.
+    std::fill(m_page_table.begin(), m_page_table.end(), 0);
+    for (size_t i = 0; i < m_physical_pages.size(); i++) {
+      const auto &page = m_physical_pages[i];
+      if (!page.is_resident) {
+        continue;
       }
-    );
-    m_wgpu_overlay_rgba_shader_module = initShaderModuleVariant(
-      filepath, 
-      shader_text,
-      std::unordered_map<std::string, std::string> {
-        {"p_SAMPLE_MODE", "4"}
+      int64_t vx = page.page_coord.x - m_origin_page_coord.x + half_page_table_size;
+      int64_t vy = m_origin_page_coord.y + half_page_table_size - 1 - page.page_coord.y;
+      if (0 <= vx && vx < page_table_size && 0 <= vy && vy < page_table_size) {
+        m_page_table[vy * page_table_size + vx] = static_cast<uint32_t>(i + 1);
       }
+    }
+    staging_belt.writeBuffer(encoder, m_page_table_buffer, 0, m_page_table.data(), m_page_table.size() * sizeof(uint32_t));
+
+    // Upload the whole-map transform:
+    auto half_world_size = 0.5 * m_world_size;
+    auto origin = glm::dvec2{m_origin_page_coord} * pageWorldSize();
+    auto proj_matrix = glm::orthoRH_ZO(
+      origin.x - half_world_size, origin.x + half_world_size,
+      origin.y - half_world_size, origin.y + half_world_size,
+      -m_depth_radius, +m_depth_radius
     );
-  }
+    VirtualShadowMapUniform uniform = {
+      .proj_view_matrix = glm::mat4x4{proj_matrix * computeViewMatrix()},
+      .page_table_size = static_cast<uint32_t>(page_table_size),
+      .page_size = static_cast<uint32_t>(pageSize()),
+      .depth_bias = R3D_VSM_DEPTH_BIAS,
+      .is_enabled = 1,
+    };
+    staging_belt.writeBuffer(encoder, m_uniform_buffer, 0, &uniform, sizeof(uniform));
 
-  wgpu::ShaderModule RenderManager::initShaderModuleVariant(
-    const char *filepath,
-    const std::string &raw_shader_text,
-    std::unordered_map<std::string, std::string> rw_map
-  ) {
-    std::string shader_text = replaceAll(raw_shader_text, rw_map);
-    return initShaderModuleVariant(filepath, shader_text);
+    // Upload per-page transforms for the pages that need rendering. Like the atlas they render into, these are shared by
+    // all frame slots (see RenderFrameSlot): they are read only by this frame's page passes.
+    for (auto physical_page_idx: dirty_pages) {
+      auto &ubo = m_page_ubo_vec[physical_page_idx];
+      ubo.state.proj_view_matrix = glm::mat4x4{computePageProjViewMatrix(m_physical_pages[physical_page_idx].page_coord)};
+      staging_belt.writeBuffer(encoder, ubo.buffer, 0, &ubo.state, sizeof(ubo.state));
+    }
+
+    return dirty_pages;
+  }
+  void RenderVirtualShadowMap::disable(const wgpu::Queue &queue) {
+    m_is_enabled = false;
+    VirtualShadowMapUniform uniform = {
+      .proj_view_matrix = glm::mat4x4{1.0f},
+      .page_table_size = static_cast<uint32_t>(pageTableSize()),
+      .page_size = static_cast<uint32_t>(pageSize()),
+      .depth_bias = R3D_VSM_DEPTH_BIAS,
+      .is_enabled = 0,
+    };
+    queue.WriteBuffer(m_uniform_buffer, 0, &uniform, sizeof(uniform));
   }
+  void RenderVirtualShadowMap::requestPageReadback(const wgpu::Device &dev) {
+    if (!m_is_enabled) {
+      return;
+    }
 
-  wgpu::ShaderModule RenderManager::initShaderModuleVariant(const char *filepath, const std::string &shader_text) {
-    // Compiling:
-    wgpu::ShaderModuleWGSLDescriptor shader_module_wgsl_descriptor;
-    shader_module_wgsl_descriptor.nextInChain = nullptr;
-    shader_module_wgsl_descriptor.code = shader_text.c_str();
-    wgpu::ShaderModuleDescriptor shader_module_descriptor = {
-      .nextInChain = &shader_module_wgsl_descriptor,
-      .label = "Broccoli.Render.Final.ShaderModule",
+    // If both readback slots are still in flight, keep accumulating requests on the GPU and try again next frame.
+    auto it = std::find_if(
+      m_page_request_readbacks.begin(), m_page_request_readbacks.end(), 
+      [](const PageRequestReadback &readback) { return !readback.is_pending; }
+    );
+    if (it == m_page_request_readbacks.end()) {
+      return;
+    }
+    auto &readback = *it;
+    readback.origin_page_coord = m_origin_page_coord;
+    readback.is_pending = true;
+
+    uint64_t size = m_page_table.size() * sizeof(uint32_t);
+    wgpu::CommandEncoderDescriptor encoder_descriptor = {
+      .label = "Broccoli.Render.VirtualShadowMap.PageRequests.CommandEncoder"
     };
-    auto shader_module = m_wgpu_device.CreateShaderModule(&shader_module_descriptor);
-    
-    // Checking:
-    struct ShaderCompileResult { const char *filepath; bool completed; };
-    ShaderCompileResult result = {filepath, false};
-    shader_module.GetCompilationInfo(
-      [] (WGPUCompilationInfoRequestStatus status, const WGPUCompilationInfo *info, void *userdata) {
-        auto data = reinterpret_cast<ShaderCompileResult*>(userdata);
-        auto error_thunk = [data, info] () {
-          std::stringstream ss;
-          ss << "Shader compilation failed:" << std::endl;
-          for (size_t i = 0; i < info->messageCount; i++) {
-            auto const &message = info->messages[i];
-            ss 
-              << "* " << message.message << std::endl
-              << "  see: " << data->filepath << ":" << message.lineNum << ":" << message.linePos << std::endl;
+    wgpu::CommandEncoder encoder = dev.CreateCommandEncoder(&encoder_descriptor);
+    encoder.CopyBufferToBuffer(m_page_request_buffer, 0, readback.buffer, 0, size);
+    encoder.ClearBuffer(m_page_request_buffer, 0, size);
+    wgpu::CommandBufferDescriptor command_buffer_descriptor = {
+      .label = "Broccoli.Render.VirtualShadowMap.PageRequests.CommandBuffer"
+    };
+    wgpu::CommandBuffer command_buffer = encoder.Finish(&command_buffer_descriptor);
+    dev.GetQueue().Submit(1, &command_buffer);
+
+    // The callback refers to this object and its readback slot directly. This is safe since every pending map is 
+    // cancelled (see 'cancelPageReadbacks') before this object is destroyed or replaced, which fires the callback 
+    // synchronously (see 'initShadowMaps' and the destructor), and since this object cannot be copied.
+    struct MapUserData {
+      RenderVirtualShadowMap *self;
+      PageRequestReadback *readback;
+    };
+    readback.buffer.MapAsync(
+      wgpu::MapMode::Read,
+      0,
+      size,
+      [] (WGPUBufferMapAsyncStatus status, void *userdata) {
+        MapUserData *data = reinterpret_cast<MapUserData*>(userdata);
+        auto self = data->self;
+        auto &readback = *data->readback;
+        delete data;
+        readback.is_pending = false;
+        if (status != WGPUBufferMapAsyncStatus_Success) {
+          return;
+        }
+
+        // Convert window-relative requests back to absolute page coordinates, using the window they were made in:
+        int64_t page_table_size = 1LL << self->m_page_table_size_lg2;
+        int64_t half_page_table_size = page_table_size / 2;
+        uint64_t size = self->m_page_table.size() * sizeof(uint32_t);
+        auto requests = reinterpret_cast<const uint32_t*>(readback.buffer.GetConstMappedRange(0, size));
+        for (int64_t vy = 0; vy < page_table_size; vy++) {
+          for (int64_t vx = 0; vx < page_table_size; vx++) {
+            if (requests[vy * page_table_size + vx] != 0) {
+              self->m_received_page_requests.push_back(glm::i64vec2{
+                readback.origin_page_coord.x - half_page_table_size + vx,
+                readback.origin_page_coord.y + half_page_table_size - 1 - vy,
+              });
+            }
           }
-          return ss.str();
-        };
-        CHECK(status == WGPUCompilationInfoRequestStatus_Success, error_thunk);
-        data->completed = true;
+        }
+        readback.buffer.Unmap();
       },
-      &result
+      new MapUserData{this, &readback}
     );
-    CHECK(result.completed, "Expected shader compilation check to be sync, not async");
-
-    // All done:
-    return shader_module;
   }
-
-  void RenderManager::initBuffers() {
-    // light uniform buffer:
-    {
-      wgpu::BufferDescriptor light_uniform_buffer_descriptor = {
-        .label = "Broccoli.Render.LightUniformBuffer",
-        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
-        .size = sizeof(LightUniform),
-      };
-      m_wgpu_light_uniform_buffer = m_wgpu_device.CreateBuffer(&light_uniform_buffer_descriptor);
+  RenderVirtualShadowMap::~RenderVirtualShadowMap() {
+    cancelPageReadbacks();
+  }
+  void RenderVirtualShadowMap::cancelPageReadbacks() {
+    // Unmapping a buffer with a pending map fires its callback (with a failure status) before returning, so no callback
+    // can refer to this object's readback slots afterward.
+    for (auto &readback: m_page_request_readbacks) {
+      if (readback.is_pending) {
+        readback.buffer.Unmap();
+      }
     }
-
-    // camera uniform buffer:
-    {
-      wgpu::BufferDescriptor camera_uniform_buffer_descriptor = {
-        .label = "Broccoli.Render.CameraUniformBuffer",
-        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
-        .size = sizeof(CameraUniform),
-      };
-      m_wgpu_camera_uniform_buffer = m_wgpu_device.CreateBuffer(&camera_uniform_buffer_descriptor);
+  }
+}
+namespace broccoli {
+  void RenderVirtualShadowMap::invalidate() {
+    for (auto &page: m_physical_pages) {
+      page.is_resident = false;
     }
-
-    // transform uniform buffer:
-    {
-      wgpu::BufferDescriptor draw_transform_uniform_buffer_descriptor = {
-        .label = "Broccoli.Render.TransformUniformBuffer",
-        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
-        .size = R3D_INSTANCE_CAPACITY * sizeof(glm::mat4x4),
-      };
-      m_wgpu_transform_uniform_buffer = m_wgpu_device.CreateBuffer(&draw_transform_uniform_buffer_descriptor);
+    m_resident_page_map.clear();
+  }
+  void RenderVirtualShadowMap::dirtyChangedCasterPages(std::vector<CasterBounds> caster_bounds, std::vector<int32_t> &dirty_pages) {
+    // Bounds found in only one of the last frame's and this frame's (sorted) lists belong to casters that moved, appeared
+    // or disappeared. Every cached page that such bounds overlap is re-rendered this frame, which covers both where a
+    // moved caster was and where it now is.
+    auto is_less = [] (const CasterBounds &lt, const CasterBounds &rt) {
+      return (
+        std::tie(lt.bounds_min.x, lt.bounds_min.y, lt.bounds_min.z, lt.bounds_max.x, lt.bounds_max.y, lt.bounds_max.z) <
+        std::tie(rt.bounds_min.x, rt.bounds_min.y, rt.bounds_min.z, rt.bounds_max.x, rt.bounds_max.y, rt.bounds_max.z)
+      );
+    };
+    std::sort(caster_bounds.begin(), caster_bounds.end(), is_less);
+    std::vector<CasterBounds> changed_bounds;
+    std::set_symmetric_difference(
+      m_caster_bounds.begin(), m_caster_bounds.end(),
+      caster_bounds.begin(), caster_bounds.end(),
+      std::back_inserter(changed_bounds),
+      is_less
+    );
+    m_caster_bounds = std::move(caster_bounds);
+    if (changed_bounds.empty()) {
+      return;
     }
 
-    // overlay vertex buffer:
-    {
-      wgpu::BufferDescriptor overlay_vertex_buffer_descriptor = {
-        .label = "Broccoli.Render.Overlay.VertexBuffer",
-        .usage = wgpu::BufferUsage::Vertex | wgpu::BufferUsage::CopyDst,
-        .size = sizeof(glm::f32vec2) * 6,
-      };
-      m_wgpu_overlay_vertex_buffer = m_wgpu_device.CreateBuffer(&overlay_vertex_buffer_descriptor);
-      auto vertex_data = std::to_array({
-        glm::fvec2{+1.0, +1.0},
-        glm::fvec2{-1.0, +1.0},
-        glm::fvec2{-1.0, -1.0},
-        glm::fvec2{+1.0, +1.0},
-        glm::fvec2{-1.0, -1.0},
-        glm::fvec2{+1.0, -1.0},
-      });
-      m_wgpu_device.GetQueue().WriteBuffer(
-        m_wgpu_overlay_vertex_buffer,
-        0,
-        &vertex_data,
-        sizeof(vertex_data)
-      );
+    // Pages are compared by their footprint in light space, ignoring depth: a caster outside the depth range only costs
+    // a redundant re-render.
+    std::vector<bool> is_dirty(m_physical_pages.size(), false);
+    for (auto physical_page_idx: dirty_pages) {
+      is_dirty[physical_page_idx] = true;
+    }
+    for (const auto &bounds: changed_bounds) {
+      auto light_space_min = glm::dvec2{std::numeric_limits<double>::max()};
+      auto light_space_max = glm::dvec2{std::numeric_limits<double>::lowest()};
+      for (int32_t corner_idx = 0; corner_idx < 8; corner_idx++) {
+        glm::dvec3 corner = {
+          (corner_idx & 1) ? bounds.bounds_max.x : bounds.bounds_min.x,
+          (corner_idx & 2) ? bounds.bounds_max.y : bounds.bounds_min.y,
+          (corner_idx & 4) ? bounds.bounds_max.z : bounds.bounds_min.z,
+        };
+        auto light_space_corner = glm::dvec2{m_light_view_matrix * corner};
+        light_space_min = glm::min(light_space_min, light_space_corner);
+        light_space_max = glm::max(light_space_max, light_space_corner);
+      }
+      auto min_page_coord = glm::i64vec2{glm::floor(light_space_min / pageWorldSize())};
+      auto max_page_coord = glm::i64vec2{glm::floor(light_space_max / pageWorldSize())};
+      for (size_t i = 0; i < m_physical_pages.size(); i++) {
+        const auto &page = m_physical_pages[i];
+        bool is_overlapped = (
+          page.is_resident && 
+          min_page_coord.x <= page.page_coord.x && page.page_coord.x <= max_page_coord.x &&
+          min_page_coord.y <= page.page_coord.y && page.page_coord.y <= max_page_coord.y
+        );
+        if (is_overlapped && !is_dirty[i]) {
+          is_dirty[i] = true;
+          dirty_pages.push_back(static_cast<int32_t>(i));
+        }
+      }
+    }
+  }
+  int32_t RenderVirtualShadowMap::allocatePhysicalPage(glm::i64vec2 page_coord) {
+    // Prefer a free page, otherwise evict the least-recently-used page not needed this frame.
+    int32_t chosen_idx = -1;
+    for (int32_t i = 0; i < static_cast<int32_t>(m_physical_pages.size()); i++) {
+      const auto &page = m_physical_pages[i];
+      if (!page.is_resident) {
+        chosen_idx = i;
+        break;
+      }
+      if (page.last_used_frame == m_frame_index) {
+        continue;
+      }
+      if (chosen_idx < 0 || page.last_used_frame < m_physical_pages[chosen_idx].last_used_frame) {
+        chosen_idx = i;
+      }
+    }
+    if (chosen_idx < 0) {
+      return -1;
     }
+    auto &page = m_physical_pages[chosen_idx];
+    if (page.is_resident) {
+      m_resident_page_map.erase(pageKey(page.page_coord));
+    }
+    page.page_coord = page_coord;
+    page.last_used_frame = m_frame_index;
+    page.is_resident = true;
+    m_resident_page_map[pageKey(page_coord)] = chosen_idx;
+    return chosen_idx;
+  }
+  glm::dmat4x4 RenderVirtualShadowMap::computeViewMatrix() const {
+    auto depth_offset = glm::dvec3{0.0, 0.0, -static_cast<double>(m_origin_depth_coord) * m_depth_radius};
+    return glm::translate(glm::dmat4x4{1.0}, depth_offset) * glm::dmat4x4{m_light_view_matrix};
+  }
+  glm::dmat4x4 RenderVirtualShadowMap::computePageProjViewMatrix(glm::i64vec2 page_coord) const {
+    auto min_xy = glm::dvec2{page_coord} * pageWorldSize();
+    auto max_xy = min_xy + pageWorldSize();
+    auto proj_matrix = glm::orthoRH_ZO(min_xy.x, max_xy.x, min_xy.y, max_xy.y, -m_depth_radius, +m_depth_radius);
+    return proj_matrix * computeViewMatrix();
+  }
+  double RenderVirtualShadowMap::pageWorldSize() const {
+    return m_world_size / static_cast<double>(1LL << m_page_table_size_lg2);
+  }
+  uint64_t RenderVirtualShadowMap::pageKey(glm::i64vec2 page_coord) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(page_coord.x)) << 32) | static_cast<uint32_t>(page_coord.y);
+  }
+}
+namespace broccoli {
+  bool RenderVirtualShadowMap::isEnabled() const {
+    return m_is_enabled;
+  }
+  int32_t RenderVirtualShadowMap::pageTableSize() const {
+    return 1 << m_page_table_size_lg2;
+  }
+  uint64_t RenderVirtualShadowMap::pageTableByteCount() const {
+    return m_page_table.size() * sizeof(uint32_t);
+  }
+  int32_t RenderVirtualShadowMap::pageSize() const {
+    return 1 << m_page_size_lg2;
+  }
+  const wgpu::TextureView &RenderVirtualShadowMap::getPageWriteView(int32_t physical_page_idx) const {
+    return m_page_write_views[physical_page_idx];
+  }
+  const RenderShadowMaps::ShadowMapUbo &RenderVirtualShadowMap::getPageUbo(int32_t physical_page_idx) const {
+    return m_page_ubo_vec[physical_page_idx];
+  }
+  const wgpu::TextureView &RenderVirtualShadowMap::atlasReadView() const {
+    return m_atlas_read_view;
+  }
+  const wgpu::Sampler &RenderVirtualShadowMap::atlasSampler() const {
+    return m_atlas_sampler;
+  }
+  const wgpu::Buffer &RenderVirtualShadowMap::uniformBuffer() const {
+    return m_uniform_buffer;
+  }
+  const wgpu::Buffer &RenderVirtualShadowMap::pageTableBuffer() const {
+    return m_page_table_buffer;
+  }
+  const wgpu::Buffer &RenderVirtualShadowMap::pageRequestBuffer() const {
+    return m_page_request_buffer;
+  }
+}
 
-    // overlay uniform buffer:
-    {
-      wgpu::BufferDescriptor overlay_uniform_buffer_descriptor = {
-        .label = "Broccoli.Render.Overlay.UniformBuffer",
-        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
-        .size = sizeof(OverlayUniform),
+//
+// Interface: RenderOcclusionCuller
+//
+
+namespace broccoli {
+  void RenderOcclusionCuller::init(wgpu::Device &dev) {
+    CHECK(!m_uniform_buffers[0], "Expected occlusion culler to be uninitialized");
+    for (auto &uniform_buffer: m_uniform_buffers) {
+      wgpu::BufferDescriptor descriptor = {
+        .label = "Broccoli.Render.OcclusionCull.UniformBuffer",
+        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform,
+        .size = sizeof(OcclusionCullUniform),
       };
-      m_wgpu_overlay_uniform_buffer = m_wgpu_device.CreateBuffer(&overlay_uniform_buffer_descriptor);
+      uniform_buffer = dev.CreateBuffer(&descriptor);
     }
   }
+  void RenderOcclusionCuller::invalidate() {
+    m_is_hiz_valid = false;
+  }
+}
+namespace broccoli {
+  void RenderOcclusionCuller::beginFrame(
+    const wgpu::Device &dev,
+    wgpu::CommandEncoder &encoder,
+    RenderStagingBelt &staging_belt,
+    const ComputePipeline<1> &cull_pipeline,
+    const ComputePipeline<1> &hiz_downsample_pipeline,
+    glm::ivec2 depth_size,
+    OcclusionCullUniform uniform,
+    std::vector<OcclusionCullChunk> chunks,
+    std::span<const glm::mat4x4> transforms,
+    std::span<const uint32_t> material_indices
+  ) {
+    CHECK(!chunks.empty(), "Expected at least one chunk to cull");
+    CHECK(transforms.size() == material_indices.size(), "Expected one material index per instance");
 
-  void RenderManager::reinitColorTexture(glm::ivec2 framebuffer_size) {
-    if (m_wgpu_render_target_color_texture) {
-      m_wgpu_render_target_color_texture.Destroy();
-      m_wgpu_render_target_color_texture = nullptr;
+    // Last frame's pyramid is only meaningful for a depth buffer of the same size:
+    bool is_pyramid_stale = depth_size != m_depth_size;
+    bool is_buffer_overflow = transforms.size() > m_instance_capacity || chunks.size() > m_chunk_capacity;
+    if (is_pyramid_stale) {
+      reinitPyramid(dev, hiz_downsample_pipeline, depth_size);
+    }
+    if (is_buffer_overflow) {
+      reinitBuffers(dev, transforms.size(), chunks.size());
+    }
+    if (is_pyramid_stale || is_buffer_overflow) {
+      reinitCullBindGroups(dev, cull_pipeline);
     }
 
-    wgpu::TextureDescriptor color_texture_descriptor = {
-      .label = "Broccoli.Render.Target.ColorTexture",
-      .usage = wgpu::TextureUsage::RenderAttachment,
-      .dimension = wgpu::TextureDimension::e2D,
-      .size = wgpu::Extent3D {
-        .width = static_cast<uint32_t>(framebuffer_size.x),
-        .height = static_cast<uint32_t>(framebuffer_size.y),
-      },
-      .format = R3D_COLOR_TEXTURE_FORMAT,
-      .mipLevelCount = 1,
-      .sampleCount = R3D_MSAA_SAMPLE_COUNT,
-    };
-    m_wgpu_render_target_color_texture = m_wgpu_device.CreateTexture(&color_texture_descriptor);
-    
-    wgpu::TextureViewDescriptor color_texture_view_descriptor = {
-      .label = "Broccoli.Render.Target.ColorTextureView",
-      .format = R3D_COLOR_TEXTURE_FORMAT,
-      .dimension = wgpu::TextureViewDimension::e2D,
-      .baseMipLevel = 0,
-      .mipLevelCount = 1,
-      .baseArrayLayer = 0,
-      .arrayLayerCount = 1,
-      .aspect = wgpu::TextureAspect::All,
-    };
-    m_wgpu_render_target_color_texture_view = m_wgpu_render_target_color_texture.CreateView(&color_texture_view_descriptor);
+    // The first phase sees the scene from the camera the pyramid was built with, while the second phase sees it from 
+    // this frame's camera:
+    m_chunks = std::move(chunks);
+    m_frame_uniform = uniform;
+    m_frame_uniform.hiz_mip_count = hizMipLevelCount();
+    m_frame_uniform.depth_size = glm::u32vec2{depth_size};
+    m_frame_uniform.is_hiz_valid = 1;
+    m_frame_uniform.chunk_count = static_cast<uint32_t>(m_chunks.size());
+    OcclusionCullUniform first_phase_uniform = m_is_hiz_valid ? m_hiz_uniform : m_frame_uniform;
+    first_phase_uniform.is_hiz_valid = m_is_hiz_valid ? 1 : 0;
+    first_phase_uniform.chunk_count = m_frame_uniform.chunk_count;
+
+    // Every draw starts out with no instances, and is filled in by the culling passes:
+    std::vector<uint32_t> draw_args(m_chunks.size() * R3D_OCCLUSION_CULL_DRAW_ARGS_SIZE / sizeof(uint32_t), 0);
+    for (size_t i = 0; i < m_chunks.size(); i++) {
+      for (uint32_t phase = 0; phase < PHASE_COUNT; phase++) {
+        draw_args[drawArgsOffset(i, phase) / sizeof(uint32_t)] = m_chunks[i].index_count;
+      }
+    }
+
+    staging_belt.writeBuffer(encoder, m_uniform_buffers[0], 0, &first_phase_uniform, sizeof(OcclusionCullUniform));
+    staging_belt.writeBuffer(encoder, m_uniform_buffers[1], 0, &m_frame_uniform, sizeof(OcclusionCullUniform));
+    staging_belt.writeBuffer(encoder, m_chunk_buffer, 0, m_chunks.data(), m_chunks.size() * sizeof(OcclusionCullChunk));
+    staging_belt.writeBuffer(encoder, m_candidate_transform_buffer, 0, transforms.data(), transforms.size_bytes());
+    staging_belt.writeBuffer(encoder, m_candidate_material_buffer, 0, material_indices.data(), material_indices.size_bytes());
+    staging_belt.writeBuffer(encoder, m_draw_args_buffer, 0, draw_args.data(), draw_args.size() * sizeof(uint32_t));
+  }
+  void RenderOcclusionCuller::cull(wgpu::CommandEncoder &encoder, const ComputePipeline<1> &cull_pipeline, uint32_t phase) const {
+    CHECK(phase < PHASE_COUNT, "Invalid occlusion culling phase");
+    uint32_t workgroup_count = (static_cast<uint32_t>(R3D_INSTANCE_CAPACITY) + R3D_OCCLUSION_CULL_WORKGROUP_SIZE - 1) / R3D_OCCLUSION_CULL_WORKGROUP_SIZE;
+    wgpu::ComputePassDescriptor compute_pass_descriptor = {.label="Broccoli.Render.OcclusionCull.ComputePass"};
+    wgpu::ComputePassEncoder cp_encoder = encoder.BeginComputePass(&compute_pass_descriptor);
+    cp_encoder.SetPipeline(cull_pipeline.pipeline);
+    cp_encoder.SetBindGroup(0, m_cull_bind_groups[phase]);
+    cp_encoder.DispatchWorkgroups(workgroup_count, static_cast<uint32_t>(m_chunks.size()));
+    cp_encoder.End();
+  }
+  void RenderOcclusionCuller::copyVisibleInstances(
+    wgpu::CommandEncoder &encoder, 
+    size_t chunk_index, 
+    const wgpu::Buffer &transform_buffer, 
+    const wgpu::Buffer &material_buffer
+  ) const {
+    // Only the first 'instanceCount' instances copied are visible, but that count is only known to the GPU: the whole
+    // chunk is copied, and the draw ignores the rest.
+    const auto &chunk = m_chunks[chunk_index];
+    encoder.CopyBufferToBuffer(
+      m_visible_transform_buffer, chunk.instance_offset * sizeof(glm::mat4x4),
+      transform_buffer, 0,
+      chunk.instance_count * sizeof(glm::mat4x4)
+    );
+    encoder.CopyBufferToBuffer(
+      m_visible_material_buffer, chunk.instance_offset * sizeof(uint32_t),
+      material_buffer, 0,
+      chunk.instance_count * sizeof(uint32_t)
+    );
   }
+  void RenderOcclusionCuller::buildPyramid(
+    const wgpu::Device &dev,
+    wgpu::CommandEncoder &encoder,
+    const ComputePipeline<1> &hiz_init_pipeline,
+    const ComputePipeline<1> &hiz_downsample_pipeline,
+    const wgpu::TextureView &depth_view
+  ) {
+    // The depth attachment is a transient texture, so the first level's bind group is re-created every frame:
+    auto entries = std::to_array({
+      wgpu::BindGroupEntry {.binding=0, .textureView=depth_view},
+      wgpu::BindGroupEntry {.binding=1, .textureView=m_hiz_mip_views[0]},
+    });
+    wgpu::BindGroupDescriptor bind_group_descriptor = {
+      .label = "Broccoli.Render.Hiz.InitBindGroup0",
+      .layout = hiz_init_pipeline.bind_group_layouts[0],
+      .entryCount = entries.size(),
+      .entries = entries.data(),
+    };
+    auto init_bind_group = dev.CreateBindGroup(&bind_group_descriptor);
 
-  void RenderManager::reinitDepthStencilTexture(glm::ivec2 framebuffer_size) {
-    if (m_wgpu_render_target_depth_stencil_texture) {
-      m_wgpu_render_target_depth_stencil_texture.Destroy();
-      m_wgpu_render_target_depth_stencil_texture = nullptr;
+    for (uint32_t mip_level = 0; mip_level < hizMipLevelCount(); mip_level++) {
+      glm::u32vec2 level_size = glm::max(glm::u32vec2{hizSize()} >> mip_level, glm::u32vec2{1});
+      glm::u32vec2 workgroup_count = (level_size + R3D_HIZ_WORKGROUP_SIZE - 1u) / R3D_HIZ_WORKGROUP_SIZE;
+      wgpu::ComputePassDescriptor compute_pass_descriptor = {.label="Broccoli.Render.Hiz.ComputePass"};
+      wgpu::ComputePassEncoder cp_encoder = encoder.BeginComputePass(&compute_pass_descriptor);
+      if (mip_level == 0) {
+        cp_encoder.SetPipeline(hiz_init_pipeline.pipeline);
+        cp_encoder.SetBindGroup(0, init_bind_group);
+      } else {
+        cp_encoder.SetPipeline(hiz_downsample_pipeline.pipeline);
+        cp_encoder.SetBindGroup(0, m_hiz_downsample_bind_groups[mip_level - 1]);
+      }
+      cp_encoder.DispatchWorkgroups(workgroup_count.x, workgroup_count.y);
+      cp_encoder.End();
     }
-    
-    wgpu::TextureDescriptor depth_texture_view_descriptor = {
-      .label = "Broccoli.Render.Target.DepthStencilTexture",
-      .usage = wgpu::TextureUsage::RenderAttachment,
+
+    // Next frame's first phase tests against this pyramid, as seen from this frame's camera:
+    m_hiz_uniform = m_frame_uniform;
+    m_is_hiz_valid = true;
+  }
+}
+namespace broccoli {
+  void RenderOcclusionCuller::reinitPyramid(const wgpu::Device &dev, const ComputePipeline<1> &hiz_downsample_pipeline, glm::ivec2 depth_size) {
+    m_depth_size = depth_size;
+    glm::ivec2 size = hizSize();
+    uint32_t mip_level_count = RenderTexture::fullMipLevelCount(size);
+    wgpu::TextureDescriptor texture_descriptor = {
+      .label = "Broccoli.Render.Hiz.Texture",
+      .usage = wgpu::TextureUsage::StorageBinding | wgpu::TextureUsage::TextureBinding,
       .dimension = wgpu::TextureDimension::e2D,
       .size = wgpu::Extent3D {
-        .width = static_cast<uint32_t>(framebuffer_size.x),
-        .height = static_cast<uint32_t>(framebuffer_size.y),
+        .width = static_cast<uint32_t>(size.x),
+        .height = static_cast<uint32_t>(size.y),
+        .depthOrArrayLayers = 1,
       },
-      .format = R3D_DEPTH_TEXTURE_FORMAT,
-      .mipLevelCount = 1,
-      .sampleCount = R3D_MSAA_SAMPLE_COUNT,
+      .format = R3D_HIZ_TEXTURE_FORMAT,
+      .mipLevelCount = mip_level_count,
     };
-    m_wgpu_render_target_depth_stencil_texture = m_wgpu_device.CreateTexture(&depth_texture_view_descriptor);
-    
-    wgpu::TextureViewDescriptor depth_view_descriptor = {
-      .label = "Broccoli.Render.Target.DepthStencilTextureView",
-      .format = R3D_DEPTH_TEXTURE_FORMAT,
+    m_hiz_texture = dev.CreateTexture(&texture_descriptor);
+    wgpu::TextureViewDescriptor read_view_descriptor = {
+      .label = "Broccoli.Render.Hiz.ReadView",
+      .format = R3D_HIZ_TEXTURE_FORMAT,
       .dimension = wgpu::TextureViewDimension::e2D,
       .baseMipLevel = 0,
-      .mipLevelCount = 1,
-      .baseArrayLayer = 0,
-      .arrayLayerCount = 1,
-      .aspect = wgpu::TextureAspect::DepthOnly,
+      .mipLevelCount = mip_level_count,
+    };
+    m_hiz_read_view = m_hiz_texture.CreateView(&read_view_descriptor);
+    m_hiz_mip_views.clear();
+    for (uint32_t mip_level = 0; mip_level < mip_level_count; mip_level++) {
+      wgpu::TextureViewDescriptor mip_view_descriptor = {
+        .label = "Broccoli.Render.Hiz.MipView",
+        .format = R3D_HIZ_TEXTURE_FORMAT,
+        .dimension = wgpu::TextureViewDimension::e2D,
+        .baseMipLevel = mip_level,
+        .mipLevelCount = 1,
+      };
+      m_hiz_mip_views.push_back(m_hiz_texture.CreateView(&mip_view_descriptor));
+    }
+    m_hiz_downsample_bind_groups.clear();
+    for (uint32_t mip_level = 1; mip_level < mip_level_count; mip_level++) {
+      auto entries = std::to_array({
+        wgpu::BindGroupEntry {.binding=0, .textureView=m_hiz_mip_views[mip_level - 1]},
+        wgpu::BindGroupEntry {.binding=1, .textureView=m_hiz_mip_views[mip_level]},
+      });
+      wgpu::BindGroupDescriptor bind_group_descriptor = {
+        .label = "Broccoli.Render.Hiz.DownsampleBindGroup0",
+        .layout = hiz_downsample_pipeline.bind_group_layouts[0],
+        .entryCount = entries.size(),
+        .entries = entries.data(),
+      };
+      m_hiz_downsample_bind_groups.push_back(dev.CreateBindGroup(&bind_group_descriptor));
+    }
+    invalidate();
+  }
+  void RenderOcclusionCuller::reinitBuffers(const wgpu::Device &dev, uint64_t instance_count, uint64_t chunk_count) {
+    // Capacities double as needed, so that a growing scene only re-allocates a few times:
+    m_instance_capacity = std::max<uint64_t>({instance_count, 2 * m_instance_capacity, R3D_INSTANCE_CAPACITY});
+    m_chunk_capacity = std::max<uint64_t>({chunk_count, 2 * m_chunk_capacity, 1});
+    auto create_buffer = [&dev] (const char *label, wgpu::BufferUsage usage, uint64_t size) {
+      wgpu::BufferDescriptor descriptor = {.label = label, .usage = usage, .size = size};
+      return dev.CreateBuffer(&descriptor);
+    };
+    m_chunk_buffer = create_buffer(
+      "Broccoli.Render.OcclusionCull.ChunkBuffer",
+      wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage,
+      m_chunk_capacity * sizeof(OcclusionCullChunk)
+    );
+    m_candidate_transform_buffer = create_buffer(
+      "Broccoli.Render.OcclusionCull.CandidateTransformBuffer",
+      wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage,
+      m_instance_capacity * sizeof(glm::mat4x4)
+    );
+    m_candidate_material_buffer = create_buffer(
+      "Broccoli.Render.OcclusionCull.CandidateMaterialBuffer",
+      wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage,
+      m_instance_capacity * sizeof(uint32_t)
+    );
+    m_visible_transform_buffer = create_buffer(
+      "Broccoli.Render.OcclusionCull.VisibleTransformBuffer",
+      wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::Storage,
+      m_instance_capacity * sizeof(glm::mat4x4)
+    );
+    m_visible_material_buffer = create_buffer(
+      "Broccoli.Render.OcclusionCull.VisibleMaterialBuffer",
+      wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::Storage,
+      m_instance_capacity * sizeof(uint32_t)
+    );
+    m_rejected_instance_buffer = create_buffer(
+      "Broccoli.Render.OcclusionCull.RejectedInstanceBuffer",
+      wgpu::BufferUsage::Storage,
+      m_instance_capacity * sizeof(uint32_t)
+    );
+    m_draw_args_buffer = create_buffer(
+      "Broccoli.Render.OcclusionCull.DrawArgsBuffer",
+      wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage | wgpu::BufferUsage::Indirect,
+      m_chunk_capacity * R3D_OCCLUSION_CULL_DRAW_ARGS_SIZE
+    );
+  }
+  void RenderOcclusionCuller::reinitCullBindGroups(const wgpu::Device &dev, const ComputePipeline<1> &cull_pipeline) {
+    for (uint32_t phase = 0; phase < PHASE_COUNT; phase++) {
+      auto entries = std::to_array({
+        wgpu::BindGroupEntry {.binding=0, .buffer=m_uniform_buffers[phase], .size=sizeof(OcclusionCullUniform)},
+        wgpu::BindGroupEntry {.binding=1, .buffer=m_chunk_buffer, .size=m_chunk_buffer.GetSize()},
+        wgpu::BindGroupEntry {.binding=2, .buffer=m_candidate_transform_buffer, .size=m_candidate_transform_buffer.GetSize()},
+        wgpu::BindGroupEntry {.binding=3, .buffer=m_candidate_material_buffer, .size=m_candidate_material_buffer.GetSize()},
+        wgpu::BindGroupEntry {.binding=4, .buffer=m_visible_transform_buffer, .size=m_visible_transform_buffer.GetSize()},
+        wgpu::BindGroupEntry {.binding=5, .buffer=m_visible_material_buffer, .size=m_visible_material_buffer.GetSize()},
+        wgpu::BindGroupEntry {.binding=6, .buffer=m_rejected_instance_buffer, .size=m_rejected_instance_buffer.GetSize()},
+        wgpu::BindGroupEntry {.binding=7, .buffer=m_draw_args_buffer, .size=m_draw_args_buffer.GetSize()},
+        wgpu::BindGroupEntry {.binding=8, .textureView=m_hiz_read_view},
+      });
+      wgpu::BindGroupDescriptor descriptor = {
+        .label = "Broccoli.Render.OcclusionCull.BindGroup0",
+        .layout = cull_pipeline.bind_group_layouts[0],
+        .entryCount = entries.size(),
+        .entries = entries.data(),
+      };
+      m_cull_bind_groups[phase] = dev.CreateBindGroup(&descriptor);
+    }
+  }
+  glm::ivec2 RenderOcclusionCuller::hizSize() const {
+    // Each texel of the first level covers 2x2 depth texels:
+    return glm::max((m_depth_size + 1) / 2, glm::ivec2{1});
+  }
+  uint32_t RenderOcclusionCuller::hizMipLevelCount() const {
+    return static_cast<uint32_t>(m_hiz_mip_views.size());
+  }
+}
+namespace broccoli {
+  size_t RenderOcclusionCuller::chunkCount() const {
+    return m_chunks.size();
+  }
+  const wgpu::Buffer &RenderOcclusionCuller::drawArgsBuffer() const {
+    return m_draw_args_buffer;
+  }
+  uint64_t RenderOcclusionCuller::drawArgsOffset(size_t chunk_index, uint32_t phase) const {
+    return chunk_index * R3D_OCCLUSION_CULL_DRAW_ARGS_SIZE + phase * R3D_OCCLUSION_CULL_DRAW_ARGS_PHASE_SIZE;
+  }
+}
+
+//
+// Interface: Renderer
+//
+
+namespace broccoli {
+  RenderManager::RenderManager(wgpu::Device &device, glm::ivec2 framebuffer_size, ShadowSettings shadow_settings)
+  : RenderManager(device, framebuffer_size, loadSources(), nullptr, shadow_settings)
+  {}
+  RenderManager::RenderManager(
+    wgpu::Device &device, 
+    glm::ivec2 framebuffer_size, 
+    RenderManagerSources sources, 
+    StartupTimeline *startup_timeline, 
+    ShadowSettings shadow_settings
+  )
+  : m_wgpu_device(device),
+    m_render_graph_texture_pool(m_wgpu_device),
+    m_staging_belt(m_wgpu_device),
+    m_shadow_settings(shadow_settings),
+    m_tone_mapping_settings(),
+    m_exposure_timestamp(std::chrono::steady_clock::now()),
+    m_anti_aliasing_mode(R3D_DEFAULT_ANTI_ALIASING_MODE),
+    m_shading_path(R3D_DEFAULT_SHADING_PATH),
+    m_dynamic_resolution_settings(),
+    m_render_scale(m_dynamic_resolution_settings.max_render_scale),
+    m_smoothed_frame_time_ms(0.0),
+    m_render_scale_cooldown(0),
+    m_is_occlusion_culling_enabled(R3D_DEFAULT_OCCLUSION_CULLING_ENABLED),
+    m_is_software_occlusion_culling_enabled(R3D_DEFAULT_SOFTWARE_OCCLUSION_CULLING_ENABLED),
+    m_placeholder_texture(
+      RenderTexture::createForColorFromBitmap(
+        m_wgpu_device,
+        "Broccoli.Render.Texture.Placeholder",
+        std::move(sources.placeholder_bitmap),
+        wgpu::FilterMode::Nearest
+      )
+    ),
+    m_rgba_texture_atlas("Broccoli.Render.TextureAtlas.Rgba", 4),
+    m_monochrome_texture_atlas("Broccoli.Render.TextureAtlas.Monochrome", 1),
+    m_texture_streamer(R3D_TEXTURE_STREAMING_DEFAULT_BUDGET),
+    m_framebuffer_size(0),
+    m_max_frames_in_flight(R3D_DEFAULT_MAX_FRAMES_IN_FLIGHT)
+  {
+    r3d_check_shadow_settings(m_shadow_settings);
+    {
+      StartupTimeline::Scope scope{startup_timeline, "RenderManager.ShaderModules"};
+      initFinalShaderModule(sources);
+      initShadowShaderModule(sources);
+      initShadowBlurShaderModule(sources);
+      initLightClusterShaderModule(sources);
+      initMipmapShaderModule(sources);
+      initTextureAtlasShaderModule(sources);
+      initOverlayShaderModule(sources);
+      initTonemapShaderModule(sources);
+      initExposureShaderModule(sources);
+      initFxaaShaderModule(sources);
+      initUpscaleShaderModule(sources);
+      initHizShaderModule(sources);
+      initOcclusionCullShaderModule(sources);
+    }
+    {
+      StartupTimeline::Scope scope{startup_timeline, "RenderManager.Buffers"};
+      initBuffers();
+      m_occlusion_culler.init(m_wgpu_device);
+    }
+    {
+      StartupTimeline::Scope scope{startup_timeline, "RenderManager.RequestPipelines"};
+      initShadowRenderPipeline();
+      initShadowBlurComputePipeline();
+      initLightClusterComputePipeline();
+      initMipmapComputePipeline();
+      initTextureAtlasRenderPipeline();
+      initExposureComputePipeline();
+      initHizComputePipeline();
+      initOcclusionCullComputePipeline();
+    }
+    {
+      StartupTimeline::Scope scope{startup_timeline, "RenderManager.ShadowMaps"};
+      initShadowMaps();
+    }
+    {
+      StartupTimeline::Scope scope{startup_timeline, "RenderManager.RequestFinalPipelines"};
+      initFinalPbrRenderPipeline();
+      initFinalBlinnPhongRenderPipeline();
+      initDeferredLightingRenderPipeline();
+      initMaterialStorage();
+      initOverlayRenderPipeline();
+      initTonemapRenderPipeline();
+      initPostProcessSampler();
+      initFxaaRenderPipeline();
+      initUpscaleRenderPipeline();
+    }
+    {
+      StartupTimeline::Scope scope{startup_timeline, "RenderManager.RenderTargets"};
+      resize(framebuffer_size);
+    }
+
+    // Every eagerly-created pipeline compiled in parallel with the rest of initialization: only now must they be ready.
+    {
+      StartupTimeline::Scope scope{startup_timeline, "RenderManager.WaitForPipelines"};
+      waitForPendingPipelines();
+    }
+  }
+  RenderManager::~RenderManager() {
+    // Frames still in flight call back into this manager once the GPU completes them.
+    waitForPendingPipelines();
+    waitForFramesInFlight(0);
+  }
+
+  Bitmap RenderManager::initPlaceholderBitmap() {
+    // Bound in place of absent material textures: materials with constant parameters never sample it.
+    Bitmap bitmap{glm::i32vec3{1, 1, 4}};
+    auto ptr = bitmap(0, 0);
+    ptr[0] = ptr[1] = ptr[2] = ptr[3] = 0xFF;
+    return bitmap;
+  }
+  
+  RenderManagerSources RenderManager::loadSources(StartupTimeline *startup_timeline) {
+    RenderManagerSources sources;
+    ShaderPreprocessor shader_preprocessor;
+    auto load_shader = [&shader_preprocessor, startup_timeline] (const char *filepath, const ShaderPreprocessor::Defines &defines) {
+      StartupTimeline::Scope scope{startup_timeline, std::string("RenderManager.LoadShader(") + filepath + ")"};
+      return shader_preprocessor.preprocess(filepath, readTextFile(filepath), defines);
+    };
+
+    // Only array sizes are substituted into the source: everything else is an override, so that every final render 
+    // pipeline variant specializes one module (see 'requestFinalRenderPipeline').
+    sources.final_shader_text = load_shader(
+      R3D_UBERSHADER_FILEPATH, 
+      ShaderPreprocessor::Defines {
+        {"p_INSTANCE_COUNT", std::to_string(static_cast<uint32_t>(R3D_INSTANCE_CAPACITY))},
+        {"p_DIRECTIONAL_LIGHT_COUNT", std::to_string(static_cast<uint32_t>(R3D_DIRECTIONAL_LIGHT_CAPACITY))},
+        {"p_DIR_LIGHT_SHADOW_CASCADE_COUNT", std::to_string(static_cast<uint32_t>(R3D_DIR_LIGHT_SHADOW_CASCADE_CAPACITY))},
+      }
+    );
+    sources.shadow_shader_text = load_shader(
+      R3D_SHADOW_SHADER_FILEPATH,
+      ShaderPreprocessor::Defines {
+        {"p_INSTANCE_COUNT", std::to_string(static_cast<uint32_t>(R3D_INSTANCE_CAPACITY))},
+      }
+    );
+    sources.shadow_blur_shader_text = load_shader(R3D_SHADOW_BLUR_SHADER_FILEPATH, {});
+    sources.light_cluster_shader_text = load_shader(R3D_LIGHT_CLUSTER_SHADER_FILEPATH, {});
+    sources.mipmap_shader_text = load_shader(R3D_MIPMAP_SHADER_FILEPATH, {});
+    sources.texture_atlas_shader_text = load_shader(R3D_TEXTURE_ATLAS_SHADER_FILEPATH, {});
+    sources.overlay_shader_text = load_shader(R3D_OVERLAY_SHADER_FILEPATH, {});
+    sources.tonemap_shader_text = load_shader(R3D_TONEMAP_SHADER_FILEPATH, {});
+    sources.exposure_shader_text = load_shader(
+      R3D_EXPOSURE_SHADER_FILEPATH,
+      ShaderPreprocessor::Defines {
+        {"p_HISTOGRAM_BIN_COUNT", std::to_string(R3D_LUMINANCE_HISTOGRAM_BIN_COUNT)},
+      }
+    );
+    sources.fxaa_shader_text = load_shader(R3D_FXAA_SHADER_FILEPATH, {});
+    sources.upscale_shader_text = load_shader(R3D_UPSCALE_SHADER_FILEPATH, {});
+    sources.hiz_shader_text = load_shader(R3D_HIZ_SHADER_FILEPATH, {});
+    sources.occlusion_cull_shader_text = load_shader(R3D_OCCLUSION_CULL_SHADER_FILEPATH, {});
+    {
+      StartupTimeline::Scope scope{startup_timeline, "RenderManager.PlaceholderBitmap"};
+      sources.placeholder_bitmap = initPlaceholderBitmap();
+    }
+    return sources;
+  }
+
+  void RenderManager::initFinalShaderModule(const RenderManagerSources &sources) {
+    m_wgpu_final_shader_module = initShaderModule(R3D_UBERSHADER_FILEPATH, sources.final_shader_text);
+  }
+
+  void RenderManager::initShadowShaderModule(const RenderManagerSources &sources) {
+    m_wgpu_shadow_shader_module = initShaderModule(R3D_SHADOW_SHADER_FILEPATH, sources.shadow_shader_text);
+  }
+
+  void RenderManager::initShadowBlurShaderModule(const RenderManagerSources &sources) {
+    m_wgpu_shadow_blur_shader_module = initShaderModule(R3D_SHADOW_BLUR_SHADER_FILEPATH, sources.shadow_blur_shader_text);
+  }
+
+  void RenderManager::initLightClusterShaderModule(const RenderManagerSources &sources) {
+    m_wgpu_light_cluster_shader_module = initShaderModule(R3D_LIGHT_CLUSTER_SHADER_FILEPATH, sources.light_cluster_shader_text);
+  }
+
+  void RenderManager::initMipmapShaderModule(const RenderManagerSources &sources) {
+    m_wgpu_mipmap_shader_module = initShaderModule(R3D_MIPMAP_SHADER_FILEPATH, sources.mipmap_shader_text);
+  }
+
+  void RenderManager::initTextureAtlasShaderModule(const RenderManagerSources &sources) {
+    m_wgpu_texture_atlas_shader_module = initShaderModule(R3D_TEXTURE_ATLAS_SHADER_FILEPATH, sources.texture_atlas_shader_text);
+  }
+
+  void RenderManager::initOverlayShaderModule(const RenderManagerSources &sources) {
+    m_wgpu_overlay_shader_module = initShaderModule(R3D_OVERLAY_SHADER_FILEPATH, sources.overlay_shader_text);
+  }
+
+  void RenderManager::initTonemapShaderModule(const RenderManagerSources &sources) {
+    m_wgpu_tonemap_shader_module = initShaderModule(R3D_TONEMAP_SHADER_FILEPATH, sources.tonemap_shader_text);
+  }
+
+  void RenderManager::initExposureShaderModule(const RenderManagerSources &sources) {
+    m_wgpu_exposure_shader_module = initShaderModule(R3D_EXPOSURE_SHADER_FILEPATH, sources.exposure_shader_text);
+  }
+
+  void RenderManager::initFxaaShaderModule(const RenderManagerSources &sources) {
+    m_wgpu_fxaa_shader_module = initShaderModule(R3D_FXAA_SHADER_FILEPATH, sources.fxaa_shader_text);
+  }
+
+  void RenderManager::initUpscaleShaderModule(const RenderManagerSources &sources) {
+    m_wgpu_upscale_shader_module = initShaderModule(R3D_UPSCALE_SHADER_FILEPATH, sources.upscale_shader_text);
+  }
+
+  void RenderManager::initHizShaderModule(const RenderManagerSources &sources) {
+    m_wgpu_hiz_shader_module = initShaderModule(R3D_HIZ_SHADER_FILEPATH, sources.hiz_shader_text);
+  }
+
+  void RenderManager::initOcclusionCullShaderModule(const RenderManagerSources &sources) {
+    m_wgpu_occlusion_cull_shader_module = initShaderModule(R3D_OCCLUSION_CULL_SHADER_FILEPATH, sources.occlusion_cull_shader_text);
+  }
+
+  wgpu::ShaderModule RenderManager::initShaderModule(const char *filepath, const std::string &shader_text) {
+    // Labelling after the file name, e.g. 'shadow_blur.wgsl' becomes 'Broccoli.Render.ShadowBlur.ShaderModule':
+    std::string label = "Broccoli.Render.";
+    bool is_word_start = true;
+    for (char c: std::filesystem::path(filepath).stem().string()) {
+      if (c == '_') {
+        is_word_start = true;
+        continue;
+      }
+      label += is_word_start ? static_cast<char>(std::toupper(static_cast<unsigned char>(c))) : c;
+      is_word_start = false;
+    }
+    label += ".ShaderModule";
+
+    // Compiling:
+    wgpu::ShaderModuleWGSLDescriptor shader_module_wgsl_descriptor;
+    shader_module_wgsl_descriptor.nextInChain = nullptr;
+    shader_module_wgsl_descriptor.code = shader_text.c_str();
+    wgpu::ShaderModuleDescriptor shader_module_descriptor = {
+      .nextInChain = &shader_module_wgsl_descriptor,
+      .label = label.c_str(),
+    };
+    auto shader_module = m_wgpu_device.CreateShaderModule(&shader_module_descriptor);
+    
+    // Checking:
+    struct ShaderCompileResult { const char *filepath; bool completed; };
+    ShaderCompileResult result = {filepath, false};
+    shader_module.GetCompilationInfo(
+      [] (WGPUCompilationInfoRequestStatus status, const WGPUCompilationInfo *info, void *userdata) {
+        auto data = reinterpret_cast<ShaderCompileResult*>(userdata);
+        auto error_thunk = [data, info] () {
+          std::stringstream ss;
+          ss << "Shader compilation failed:" << std::endl;
+          for (size_t i = 0; i < info->messageCount; i++) {
+            auto const &message = info->messages[i];
+            ss 
+              << "* " << message.message << std::endl
+              << "  see: " << data->filepath << ":" << message.lineNum << ":" << message.linePos << std::endl;
+          }
+          return ss.str();
+        };
+        CHECK(status == WGPUCompilationInfoRequestStatus_Success, error_thunk);
+        data->completed = true;
+      },
+      &result
+    );
+    CHECK(result.completed, "Expected shader compilation check to be sync, not async");
+
+    // All done:
+    return shader_module;
+  }
+
+  /// The state of one pipeline being created on Dawn's worker threads. 'out' points into the RenderManager, which waits 
+  /// for every pending pipeline before it is destroyed (see 'waitForPendingPipelines').
+  template <typename Pipeline>
+  struct PendingPipeline {
+    Pipeline *out;
+    std::string label;
+    uint32_t *pending_count;
+  };
+  template <typename Pipeline, typename RawPipeline>
+  static void r3d_on_pipeline_created(WGPUCreatePipelineAsyncStatus status, RawPipeline pipeline, const char *message, void *userdata) {
+    std::unique_ptr<PendingPipeline<Pipeline>> pending{reinterpret_cast<PendingPipeline<Pipeline>*>(userdata)};
+    CHECK(
+      status == WGPUCreatePipelineAsyncStatus_Success,
+      [&pending, message] () { return "Failed to create pipeline '" + pending->label + "': " + message; }
+    );
+    *pending->out = Pipeline::Acquire(pipeline);
+    (*pending->pending_count)--;
+  }
+  void RenderManager::createRenderPipelineAsync(const wgpu::RenderPipelineDescriptor &descriptor, wgpu::RenderPipeline &out) {
+    // Dawn copies everything it needs from the descriptor before returning, so it may point at locals.
+    auto pending = new PendingPipeline<wgpu::RenderPipeline>{&out, descriptor.label, &m_pending_pipeline_count};
+    m_pending_pipeline_count++;
+    m_wgpu_device.CreateRenderPipelineAsync(
+      &descriptor, 
+      r3d_on_pipeline_created<wgpu::RenderPipeline, WGPURenderPipeline>, 
+      pending
+    );
+  }
+  void RenderManager::createComputePipelineAsync(const wgpu::ComputePipelineDescriptor &descriptor, wgpu::ComputePipeline &out) {
+    auto pending = new PendingPipeline<wgpu::ComputePipeline>{&out, descriptor.label, &m_pending_pipeline_count};
+    m_pending_pipeline_count++;
+    m_wgpu_device.CreateComputePipelineAsync(
+      &descriptor, 
+      r3d_on_pipeline_created<wgpu::ComputePipeline, WGPUComputePipeline>, 
+      pending
+    );
+  }
+  void RenderManager::waitForPendingPipelines() {
+    // Completion callbacks only run when the device is ticked or its instance processes events: here, or on the thread
+    // frames are submitted on while it holds the submission lock (see 'lockSubmission'), so the count only ever drops
+    // while this loop is running or the lock is held.
+    m_wgpu_device.Tick();
+    while (m_pending_pipeline_count > 0) {
+      std::this_thread::sleep_for(R3D_DEVICE_POLL_INTERVAL);
+      m_wgpu_device.Tick();
+    }
+  }
+  void RenderManager::waitForFramesInFlight(uint32_t max_frames_in_flight) {
+    // The device has no blocking wait, so it is polled, sleeping between ticks rather than spinning a core while the
+    // GPU catches up.
+    m_wgpu_device.Tick();
+    while (m_frames_in_flight > max_frames_in_flight) {
+      std::this_thread::sleep_for(R3D_DEVICE_POLL_INTERVAL);
+      m_wgpu_device.Tick();
+    }
+  }
+  void RenderManager::acquireFrameSlot() {
+    // Waiting for a frame to complete before the next one begins caps how far the CPU runs ahead of the GPU. Since no
+    // more frames than there are slots are ever in flight, the next slot's previous frame has always completed, so its
+    // uniforms can be rewritten.
+    waitForFramesInFlight(m_max_frames_in_flight - 1);
+    m_frame_slot_index = (m_frame_slot_index + 1) % static_cast<uint32_t>(m_frame_slots.size());
+    m_frames_in_flight++;
+    for (auto *final_render_pipelines: {&m_wgpu_pbr_final_render_pipelines, &m_wgpu_blinn_phong_final_render_pipelines}) {
+      for (auto source: {MaterialParameterSource::Constant, MaterialParameterSource::Texture}) {
+        auto &render_pipeline = (*final_render_pipelines)[source];
+        render_pipeline.bind_groups_prefix = render_pipeline.frame_slot_bind_groups_prefix[m_frame_slot_index];
+      }
+    }
+    m_deferred_lighting_render_pipeline.bind_groups_prefix =
+      m_wgpu_pbr_final_render_pipelines[MaterialParameterSource::Constant].bind_groups_prefix;
+  }
+  void RenderManager::releaseFrameSlot() {
+    CHECK(m_frames_in_flight > 0, "Cannot release a frame slot that was not acquired.");
+    m_frames_in_flight--;
+  }
+  void RenderManager::beginFrameTimer() {
+    // Timestamps are only written at pass boundaries, so an empty compute pass marks where the frame's work starts. The
+    // queue runs it once the previous frame's work is done, so time spent queued behind that frame is not counted.
+    if (!m_wgpu_timestamp_query_set) {
+      return;
+    }
+    wgpu::ComputePassTimestampWrites timestamp_writes = {
+      .querySet = m_wgpu_timestamp_query_set,
+      .beginningOfPassWriteIndex = 2 * m_frame_slot_index,
+      .endOfPassWriteIndex = wgpu::kQuerySetIndexUndefined,
+    };
+    wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.FrameTimer.CommandEncoder"};
+    wgpu::CommandEncoder command_encoder = m_wgpu_device.CreateCommandEncoder(&command_encoder_descriptor);
+    wgpu::ComputePassDescriptor compute_pass_descriptor = {
+      .label = "Broccoli.Render.FrameTimer.BeginComputePass",
+      .timestampWrites = &timestamp_writes,
+    };
+    command_encoder.BeginComputePass(&compute_pass_descriptor).End();
+    wgpu::CommandBuffer command_buffer = command_encoder.Finish();
+    m_wgpu_device.GetQueue().Submit(1, &command_buffer);
+  }
+  void RenderManager::endFrameTimer() {
+    // The frame's slot is released once its work is done. Without timestamp queries, no GPU time is recorded: completion
+    // callbacks only run when events are next processed, which is usually after the next frame is submitted, so timing
+    // them would measure the CPU's frame interval instead.
+    if (!m_wgpu_timestamp_query_set) {
+      m_wgpu_device.GetQueue().OnSubmittedWorkDone(
+        [] (WGPUQueueWorkDoneStatus status, void *userdata) {
+          (void)status;
+          reinterpret_cast<RenderManager*>(userdata)->releaseFrameSlot();
+        },
+        this
+      );
+      return;
+    }
+
+    // Otherwise, the end timestamp is resolved and copied into the slot's readback buffer, which is then mapped: the
+    // mapping completes once the frame's work is done.
+    const auto &slot = m_frame_slots[m_frame_slot_index];
+    wgpu::ComputePassTimestampWrites timestamp_writes = {
+      .querySet = m_wgpu_timestamp_query_set,
+      .beginningOfPassWriteIndex = wgpu::kQuerySetIndexUndefined,
+      .endOfPassWriteIndex = 2 * m_frame_slot_index + 1,
+    };
+    wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.FrameTimer.CommandEncoder"};
+    wgpu::CommandEncoder command_encoder = m_wgpu_device.CreateCommandEncoder(&command_encoder_descriptor);
+    wgpu::ComputePassDescriptor compute_pass_descriptor = {
+      .label = "Broccoli.Render.FrameTimer.EndComputePass",
+      .timestampWrites = &timestamp_writes,
+    };
+    command_encoder.BeginComputePass(&compute_pass_descriptor).End();
+    uint64_t resolve_offset = m_frame_slot_index * R3D_TIMESTAMP_RESOLVE_ALIGNMENT;
+    command_encoder.ResolveQuerySet(m_wgpu_timestamp_query_set, 2 * m_frame_slot_index, 2, m_wgpu_timestamp_resolve_buffer, resolve_offset);
+    command_encoder.CopyBufferToBuffer(m_wgpu_timestamp_resolve_buffer, resolve_offset, slot.timestamp_readback_buffer, 0, 2 * sizeof(uint64_t));
+    wgpu::CommandBuffer command_buffer = command_encoder.Finish();
+    m_wgpu_device.GetQueue().Submit(1, &command_buffer);
+    struct MapUserData {
+      RenderManager *manager;
+      wgpu::Buffer buffer;
     };
-    auto texture_view = m_wgpu_render_target_depth_stencil_texture.CreateView(&depth_view_descriptor);
-    m_wgpu_render_target_depth_stencil_texture_view = texture_view;
+    slot.timestamp_readback_buffer.MapAsync(
+      wgpu::MapMode::Read,
+      0,
+      2 * sizeof(uint64_t),
+      [] (WGPUBufferMapAsyncStatus status, void *userdata) {
+        auto data = reinterpret_cast<MapUserData*>(userdata);
+        if (status == WGPUBufferMapAsyncStatus_Success) {
+          // Resolved timestamps are in nanoseconds. Their counter may be reset between frames, in which case the frame
+          // is skipped.
+          auto timestamps = reinterpret_cast<const uint64_t*>(data->buffer.GetConstMappedRange(0, 2 * sizeof(uint64_t)));
+          if (timestamps[1] > timestamps[0]) {
+            data->manager->recordFrameTime(static_cast<double>(timestamps[1] - timestamps[0]) / 1.0e6);
+          }
+          data->buffer.Unmap();
+        }
+        data->manager->releaseFrameSlot();
+        delete data;
+      },
+      new MapUserData{this, slot.timestamp_readback_buffer}
+    );
+  }
+
+  void RenderManager::initBuffers() {
+    // frame slots:
+    // Each holds its own light, camera and cascade uniform buffers (see 'acquireFrameSlot').
+    {
+      wgpu::BufferDescriptor light_uniform_buffer_descriptor = {
+        .label = "Broccoli.Render.LightUniformBuffer",
+        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
+        .size = sizeof(LightUniform),
+      };
+      wgpu::BufferDescriptor camera_uniform_buffer_descriptor = {
+        .label = "Broccoli.Render.CameraUniformBuffer",
+        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
+        .size = sizeof(CameraUniform),
+      };
+      wgpu::BufferDescriptor cascade_uniform_buffer_descriptor = {
+        .label = "Broccoli.Render.CascadeUniformBuffer",
+        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
+        .size = sizeof(CascadeUniform),
+      };
+      m_frame_slots.resize(R3D_FRAME_SLOT_COUNT);
+      for (auto &slot: m_frame_slots) {
+        slot.light_uniform_buffer = m_wgpu_device.CreateBuffer(&light_uniform_buffer_descriptor);
+        slot.camera_uniform_buffer = m_wgpu_device.CreateBuffer(&camera_uniform_buffer_descriptor);
+        slot.cascade_uniform_buffer = m_wgpu_device.CreateBuffer(&cascade_uniform_buffer_descriptor);
+      }
+    }
+
+    // frame timer:
+    // Each slot owns a begin and an end timestamp (see 'beginFrameTimer'), resolved at its own aligned offset.
+    if (m_wgpu_device.HasFeature(wgpu::FeatureName::TimestampQuery)) {
+      wgpu::QuerySetDescriptor timestamp_query_set_descriptor = {
+        .label = "Broccoli.Render.FrameTimer.QuerySet",
+        .type = wgpu::QueryType::Timestamp,
+        .count = 2 * R3D_FRAME_SLOT_COUNT,
+      };
+      wgpu::BufferDescriptor timestamp_resolve_buffer_descriptor = {
+        .label = "Broccoli.Render.FrameTimer.ResolveBuffer",
+        .usage = wgpu::BufferUsage::QueryResolve | wgpu::BufferUsage::CopySrc,
+        .size = R3D_FRAME_SLOT_COUNT * R3D_TIMESTAMP_RESOLVE_ALIGNMENT,
+      };
+      wgpu::BufferDescriptor timestamp_readback_buffer_descriptor = {
+        .label = "Broccoli.Render.FrameTimer.ReadbackBuffer",
+        .usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst,
+        .size = 2 * sizeof(uint64_t),
+      };
+      m_wgpu_timestamp_query_set = m_wgpu_device.CreateQuerySet(&timestamp_query_set_descriptor);
+      m_wgpu_timestamp_resolve_buffer = m_wgpu_device.CreateBuffer(&timestamp_resolve_buffer_descriptor);
+      for (auto &slot: m_frame_slots) {
+        slot.timestamp_readback_buffer = m_wgpu_device.CreateBuffer(&timestamp_readback_buffer_descriptor);
+      }
+    }
+
+    // transform uniform buffer:
+    {
+      wgpu::BufferDescriptor draw_transform_uniform_buffer_descriptor = {
+        .label = "Broccoli.Render.TransformUniformBuffer",
+        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
+        .size = R3D_INSTANCE_CAPACITY * sizeof(glm::mat4x4),
+      };
+      m_wgpu_transform_uniform_buffer = m_wgpu_device.CreateBuffer(&draw_transform_uniform_buffer_descriptor);
+    }
+
+    // instance material uniform buffer:
+    {
+      wgpu::BufferDescriptor instance_material_uniform_buffer_descriptor = {
+        .label = "Broccoli.Render.InstanceMaterialUniformBuffer",
+        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
+        .size = R3D_INSTANCE_CAPACITY * sizeof(uint32_t),
+      };
+      m_wgpu_instance_material_uniform_buffer = m_wgpu_device.CreateBuffer(&instance_material_uniform_buffer_descriptor);
+    }
+
+    // material storage buffer:
+    {
+      wgpu::BufferDescriptor material_storage_buffer_descriptor = {
+        .label = "Broccoli.Render.MaterialStorageBuffer",
+        .usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst,
+        .size = R3D_MATERIAL_UNIFORM_CAPACITY * sizeof(MaterialUniform),
+      };
+      m_wgpu_material_storage_buffer = m_wgpu_device.CreateBuffer(&material_storage_buffer_descriptor);
+    }
+
+    // light cluster buffers:
+    {
+      wgpu::BufferDescriptor cluster_uniform_buffer_descriptor = {
+        .label = "Broccoli.Render.LightCluster.UniformBuffer",
+        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
+        .size = sizeof(ClusterUniform),
+      };
+      wgpu::BufferDescriptor point_light_buffer_descriptor = {
+        .label = "Broccoli.Render.LightCluster.PointLightBuffer",
+        .usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst,
+        .size = R3D_POINT_LIGHT_CAPACITY * sizeof(PointLightData),
+      };
+      wgpu::BufferDescriptor cluster_light_buffer_descriptor = {
+        .label = "Broccoli.Render.LightCluster.ClusterLightBuffer",
+        .usage = wgpu::BufferUsage::Storage,
+        .size = R3D_LIGHT_CLUSTER_BUFFER_SIZE,
+      };
+      m_wgpu_cluster_uniform_buffer = m_wgpu_device.CreateBuffer(&cluster_uniform_buffer_descriptor);
+      m_wgpu_point_light_storage_buffer = m_wgpu_device.CreateBuffer(&point_light_buffer_descriptor);
+      m_wgpu_cluster_light_storage_buffer = m_wgpu_device.CreateBuffer(&cluster_light_buffer_descriptor);
+    }
+
+    // overlay vertex buffer:
+    {
+      wgpu::BufferDescriptor overlay_vertex_buffer_descriptor = {
+        .label = "Broccoli.Render.Overlay.VertexBuffer",
+        .usage = wgpu::BufferUsage::Vertex | wgpu::BufferUsage::CopyDst,
+        .size = sizeof(glm::f32vec2) * 6,
+      };
+      m_wgpu_overlay_vertex_buffer = m_wgpu_device.CreateBuffer(&overlay_vertex_buffer_descriptor);
+      auto vertex_data = std::to_array({
+        glm::fvec2{+1.0, +1.0},
+        glm::fvec2{-1.0, +1.0},
+        glm::fvec2{-1.0, -1.0},
+        glm::fvec2{+1.0, +1.0},
+        glm::fvec2{-1.0, -1.0},
+        glm::fvec2{+1.0, -1.0},
+      });
+      m_wgpu_device.GetQueue().WriteBuffer(
+        m_wgpu_overlay_vertex_buffer,
+        0,
+        &vertex_data,
+        sizeof(vertex_data)
+      );
+    }
+
+    // overlay uniform buffer:
+    {
+      wgpu::BufferDescriptor overlay_uniform_buffer_descriptor = {
+        .label = "Broccoli.Render.Overlay.UniformBuffer",
+        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
+        .size = sizeof(OverlayUniform),
+      };
+      m_wgpu_overlay_uniform_buffer = m_wgpu_device.CreateBuffer(&overlay_uniform_buffer_descriptor);
+    }
+
+    // tonemap uniform buffer:
+    {
+      wgpu::BufferDescriptor tonemap_uniform_buffer_descriptor = {
+        .label = "Broccoli.Render.Tonemap.UniformBuffer",
+        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
+        .size = sizeof(TonemapUniform),
+      };
+      m_wgpu_tonemap_uniform_buffer = m_wgpu_device.CreateBuffer(&tonemap_uniform_buffer_descriptor);
+    }
+
+    // exposure buffers:
+    // The exposure state and the histogram start out zeroed, which the exposure shader reads as 'not yet metered' and
+    // 'empty' respectively. The histogram is cleared again by each frame's averaging pass.
+    {
+      wgpu::BufferDescriptor exposure_uniform_buffer_descriptor = {
+        .label = "Broccoli.Render.Exposure.UniformBuffer",
+        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
+        .size = sizeof(ExposureUniform),
+      };
+      m_wgpu_exposure_uniform_buffer = m_wgpu_device.CreateBuffer(&exposure_uniform_buffer_descriptor);
+      wgpu::BufferDescriptor exposure_storage_buffer_descriptor = {
+        .label = "Broccoli.Render.Exposure.StateBuffer",
+        .usage = wgpu::BufferUsage::Storage,
+        .size = R3D_EXPOSURE_STATE_SIZE,
+      };
+      m_wgpu_exposure_storage_buffer = m_wgpu_device.CreateBuffer(&exposure_storage_buffer_descriptor);
+      wgpu::BufferDescriptor histogram_storage_buffer_descriptor = {
+        .label = "Broccoli.Render.Exposure.HistogramBuffer",
+        .usage = wgpu::BufferUsage::Storage,
+        .size = sizeof(uint32_t) * R3D_LUMINANCE_HISTOGRAM_BIN_COUNT,
+      };
+      m_wgpu_luminance_histogram_storage_buffer = m_wgpu_device.CreateBuffer(&histogram_storage_buffer_descriptor);
+    }
+
+    // deferred uniform buffer:
+    {
+      wgpu::BufferDescriptor deferred_uniform_buffer_descriptor = {
+        .label = "Broccoli.Render.DeferredLighting.UniformBuffer",
+        .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
+        .size = sizeof(DeferredUniform),
+      };
+      m_wgpu_deferred_uniform_buffer = m_wgpu_device.CreateBuffer(&deferred_uniform_buffer_descriptor);
+    }
+  }
+
+  void RenderManager::reinitOverlayTexture(glm::ivec2 framebuffer_size) {
+    // Overlay texture:
+    {
+      if (m_wgpu_final_overlay_texture) {
+        m_wgpu_final_overlay_texture.Destroy();
+      }
+      wgpu::TextureDescriptor overlay_texture_descriptor = {
+        .label = "Broccoli.Render.Overlay.Texture",
+        .usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::TextureBinding,
+        .size = wgpu::Extent3D {
+          .width=static_cast<uint32_t>(framebuffer_size.x),
+          .height=static_cast<uint32_t>(framebuffer_size.y)
+        },
+        .format = wgpu::TextureFormat::RGBA8Unorm,
+      };
+      m_wgpu_final_overlay_texture = m_wgpu_device.CreateTexture(&overlay_texture_descriptor);
+    }
+
+    // Overlay texture view:
+    {
+      wgpu::TextureViewDescriptor overlay_texture_view_descriptor = {
+        .label = "Broccoli.Render.Overlay.TextureView",
+      };
+      m_wgpu_final_overlay_texture_view = m_wgpu_final_overlay_texture.CreateView(&overlay_texture_view_descriptor);
+    }
+
+    // Overlay sampler:
+    {
+      wgpu::SamplerDescriptor overlay_sampler_descriptor = {
+        .label = "Broccoli.Render.Overlay.Sampler"
+      };
+      m_wgpu_final_overlay_sampler = m_wgpu_device.CreateSampler(&overlay_sampler_descriptor);
+    }
+
+    // Bind group 1:
+    {
+      auto bind_group_1_entries = std::to_array({
+        wgpu::BindGroupEntry{.binding=0, .textureView=m_wgpu_final_overlay_texture_view},
+        wgpu::BindGroupEntry{.binding=1, .sampler=m_wgpu_final_overlay_sampler},
+      });
+      wgpu::BindGroupDescriptor bind_group_1_descriptor = {
+        .label = "Broccoli.Render.Overlay.BindGroup1",
+        .layout = m_overlay_rgba_render_pipeline.textureSelectBindGroupLayout(),
+        .entryCount = bind_group_1_entries.size(),
+        .entries = bind_group_1_entries.data(),
+      };
+      m_wgpu_final_overlay_bind_group_1 = m_wgpu_device.CreateBindGroup(&bind_group_1_descriptor);
+    }
+
+    // Overlay bitmap:
+    {
+      m_final_overlay_bitmap = Bitmap{glm::i32vec3{framebuffer_size, 4}};
+    }
+  }
+}
+
+namespace broccoli {
+  void RenderManager::lazyInitDebugTakeoutBuffer(uint64_t min_byte_count) {
+#if !BROCCOLI_DEBUG
+    PANIC("Cannot initialize debug takout buffer unless in debug mode.");
+#else
+    // Shadow map sizes can change at runtime, so the buffer is re-created whenever it is too small.
+    if (m_wgpu_debug_takeout_buffer && m_wgpu_debug_takeout_buffer.GetSize() >= min_byte_count) {
+      return;
+    }
+    wgpu::BufferDescriptor desc = {
+      .label = "Broccoli.Render.Debug.TakoutBuffer",
+      .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead,
+      .size = min_byte_count,
+      .mappedAtCreation = false,
+    };
+    m_wgpu_debug_takeout_buffer = m_wgpu_device.CreateBuffer(&desc);
+#endif
+  }
+}
+
+namespace broccoli {
+  void RenderManager::helpInitFinalRenderPipeline(FinalRenderPipeline &out) {
+    // Everything but the pipeline itself, which is created asynchronously by 'requestFinalRenderPipeline'.
+    out = FinalRenderPipeline{};
+    const RenderShadowMaps &dir_light_shadow_maps = getShadowMaps(LightType::Directional);
+    bool is_cascade_filterable = dir_light_shadow_maps.representation() == ShadowMapRepresentation::Moments;
+
+    // bind group layout 0:
+    {
+      auto entries = std::to_array({
+        wgpu::BindGroupLayoutEntry {
+          .binding = 0,
+          .visibility = wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(CameraUniform),
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 1,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(LightUniform),
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 2,
+          .visibility = wgpu::ShaderStage::Vertex,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(glm::mat4x4) * R3D_INSTANCE_CAPACITY,
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 3,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(ClusterUniform),
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 4,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::ReadOnlyStorage,
+            .minBindingSize = R3D_POINT_LIGHT_CAPACITY * sizeof(PointLightData),
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 5,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::ReadOnlyStorage,
+            .minBindingSize = R3D_LIGHT_CLUSTER_BUFFER_SIZE,
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 6,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = R3D_INSTANCE_CAPACITY * sizeof(uint32_t),
+          },
+        },
+      });
+      wgpu::BindGroupLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.Final.BindGroup0Layout",
+        .entryCount = entries.size(),
+        .entries = entries.data()
+      };
+      out.bind_group_layouts[0] = m_wgpu_device.CreateBindGroupLayout(&descriptor);
+    }
+
+    // bind group layout 1:
+    {
+      auto entries = std::to_array({
+        wgpu::BindGroupLayoutEntry {
+          .binding = 0,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(VirtualShadowMapUniform),
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 1,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::ReadOnlyStorage,
+            .minBindingSize = m_virtual_shadow_map.pageTableByteCount(),
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 2,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Storage,
+            .minBindingSize = m_virtual_shadow_map.pageTableByteCount(),
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 3,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .texture = {
+            .sampleType = wgpu::TextureSampleType::Depth,
+            .viewDimension = wgpu::TextureViewDimension::e2DArray,
+          }
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 4,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .sampler = {.type = wgpu::SamplerBindingType::Comparison},
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 5,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(CascadeUniform),
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 6,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .texture = {
+            .sampleType = is_cascade_filterable ? wgpu::TextureSampleType::Float : wgpu::TextureSampleType::UnfilterableFloat,
+            .viewDimension = wgpu::TextureViewDimension::e2DArray,
+          }
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 7,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .sampler = {
+            .type = is_cascade_filterable ? wgpu::SamplerBindingType::Filtering : wgpu::SamplerBindingType::NonFiltering
+          },
+        },
+      });
+      wgpu::BindGroupLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.Final.BindGroup1Layout",
+        .entryCount = entries.size(),
+        .entries = entries.data()
+      };
+      out.bind_group_layouts[1] = m_wgpu_device.CreateBindGroupLayout(&descriptor);
+    }
+
+    // bind group layout 2:
+    {
+      auto entries = std::to_array({
+        wgpu::BindGroupLayoutEntry {
+          .binding = 0,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::ReadOnlyStorage,
+            .minBindingSize = R3D_MATERIAL_UNIFORM_CAPACITY * sizeof(MaterialUniform),
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 1,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .texture = {
+            .sampleType = wgpu::TextureSampleType::Float,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
+          }
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 2,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .texture = {
+            .sampleType = wgpu::TextureSampleType::Float,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
+          }
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 3,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .texture = {
+            .sampleType = wgpu::TextureSampleType::Float,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
+          }
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 4,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .texture = {
+            .sampleType = wgpu::TextureSampleType::Float,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
+          }
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 5,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .sampler = {.type = wgpu::SamplerBindingType::Filtering},
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 6,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .sampler = {.type = wgpu::SamplerBindingType::Filtering},
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 7,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .sampler = {.type = wgpu::SamplerBindingType::Filtering},
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 8,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .sampler = {.type = wgpu::SamplerBindingType::Filtering},
+        },
+      });
+      wgpu::BindGroupLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.Final.BindGroup2Layout",
+        .entryCount = entries.size(),
+        .entries = entries.data()
+      };
+      out.bind_group_layouts[2] = m_wgpu_device.CreateBindGroupLayout(&descriptor);
+    }
+
+    // pipeline layout:
+    {
+      wgpu::PipelineLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.Final.RenderPipelineLayout",
+        .bindGroupLayoutCount = out.bind_group_layouts.size(),
+        .bindGroupLayouts = out.bind_group_layouts.data(),
+      };
+      out.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
+    }
+
+    // bind groups 0 and 1, for each frame slot:
+    // Each slot binds its own camera, light and cascade uniforms: the current slot's are selected by 'acquireFrameSlot'.
+    wgpu::FilterMode cascade_filter = is_cascade_filterable ? wgpu::FilterMode::Linear : wgpu::FilterMode::Nearest;
+    wgpu::SamplerDescriptor cascade_sampler_descriptor = {
+      .label = "Broccoli.Render.Final.CascadeSampler",
+      .addressModeU = wgpu::AddressMode::ClampToEdge,
+      .addressModeV = wgpu::AddressMode::ClampToEdge,
+      .magFilter = cascade_filter,
+      .minFilter = cascade_filter,
+    };
+    wgpu::Sampler cascade_sampler = m_wgpu_device.CreateSampler(&cascade_sampler_descriptor);
+    out.frame_slot_bind_groups_prefix.resize(m_frame_slots.size());
+    for (size_t slot_index = 0; slot_index < m_frame_slots.size(); slot_index++) {
+      const RenderFrameSlot &slot = m_frame_slots[slot_index];
+      auto &slot_bind_groups_prefix = out.frame_slot_bind_groups_prefix[slot_index];
+
+      // bind group 0:
+      {
+        auto bind_group_entries = std::to_array({
+          wgpu::BindGroupEntry {
+            .binding = 0,
+            .buffer = slot.camera_uniform_buffer,
+            .size = sizeof(CameraUniform),
+          },
+          wgpu::BindGroupEntry {
+            .binding = 1,
+            .buffer = slot.light_uniform_buffer,
+            .size = sizeof(LightUniform),
+          },
+          wgpu::BindGroupEntry {
+            .binding = 2,
+            .buffer = m_wgpu_transform_uniform_buffer,
+            .size = sizeof(glm::mat4x4) * R3D_INSTANCE_CAPACITY,
+          },
+          wgpu::BindGroupEntry {
+            .binding = 3,
+            .buffer = m_wgpu_cluster_uniform_buffer,
+            .size = sizeof(ClusterUniform),
+          },
+          wgpu::BindGroupEntry {
+            .binding = 4,
+            .buffer = m_wgpu_point_light_storage_buffer,
+            .size = R3D_POINT_LIGHT_CAPACITY * sizeof(PointLightData),
+          },
+          wgpu::BindGroupEntry {
+            .binding = 5,
+            .buffer = m_wgpu_cluster_light_storage_buffer,
+            .size = R3D_LIGHT_CLUSTER_BUFFER_SIZE,
+          },
+          wgpu::BindGroupEntry {
+            .binding = 6,
+            .buffer = m_wgpu_instance_material_uniform_buffer,
+            .size = R3D_INSTANCE_CAPACITY * sizeof(uint32_t),
+          },
+        });
+        wgpu::BindGroupDescriptor bind_group_descriptor = {
+          .label = "Broccoli.Render.Final.BindGroup0",
+          .layout = out.bind_group_layouts[0],
+          .entryCount = bind_group_entries.size(),
+          .entries = bind_group_entries.data(),
+        };
+        slot_bind_groups_prefix[0] = m_wgpu_device.CreateBindGroup(&bind_group_descriptor);
+      }
+
+      // bind group 1:
+      {
+        auto bind_group_entries = std::to_array({
+          wgpu::BindGroupEntry {
+            .binding = 0,
+            .buffer = m_virtual_shadow_map.uniformBuffer(),
+            .size = sizeof(VirtualShadowMapUniform),
+          },
+          wgpu::BindGroupEntry {
+            .binding = 1,
+            .buffer = m_virtual_shadow_map.pageTableBuffer(),
+            .size = m_virtual_shadow_map.pageTableByteCount(),
+          },
+          wgpu::BindGroupEntry {
+            .binding = 2,
+            .buffer = m_virtual_shadow_map.pageRequestBuffer(),
+            .size = m_virtual_shadow_map.pageTableByteCount(),
+          },
+          wgpu::BindGroupEntry {
+            .binding = 3,
+            .textureView = m_virtual_shadow_map.atlasReadView(),
+          },
+          wgpu::BindGroupEntry {
+            .binding = 4,
+            .sampler = m_virtual_shadow_map.atlasSampler(),
+          },
+          wgpu::BindGroupEntry {
+            .binding = 5,
+            .buffer = slot.cascade_uniform_buffer,
+            .size = sizeof(CascadeUniform),
+          },
+          wgpu::BindGroupEntry {
+            .binding = 6,
+            .textureView = dir_light_shadow_maps.getArrayReadView(),
+          },
+          wgpu::BindGroupEntry {
+            .binding = 7,
+            .sampler = cascade_sampler,
+          },
+        });
+        wgpu::BindGroupDescriptor bind_group_descriptor = {
+          .label = "Broccoli.Render.Final.BindGroup1",
+          .layout = out.bind_group_layouts[1],
+          .entryCount = bind_group_entries.size(),
+          .entries = bind_group_entries.data(),
+        };
+        slot_bind_groups_prefix[1] = m_wgpu_device.CreateBindGroup(&bind_group_descriptor);
+      }
+    }
+    out.bind_groups_prefix = out.frame_slot_bind_groups_prefix[m_frame_slot_index];
+  }
+  void RenderManager::requestFinalRenderPipeline(uint32_t lighting_model_id, MaterialParameterSource source) {
+    FinalRenderPipeline &out = finalRenderPipelines(lighting_model_id)[source];
+    if (out.is_requested) {
+      return;
+    }
+    out.is_requested = true;
+
+    wgpu::BlendState blend_state = {
+      .color = {
+        .operation = wgpu::BlendOperation::Add,
+        .srcFactor = wgpu::BlendFactor::One,
+        .dstFactor = wgpu::BlendFactor::Zero,
+      },
+      .alpha = {
+        .operation = wgpu::BlendOperation::Add,
+        .srcFactor = wgpu::BlendFactor::One,
+        .dstFactor = wgpu::BlendFactor::Zero,
+      },
+    };
+    wgpu::ColorTargetState color_target = {
+      .format = R3D_COLOR_TEXTURE_FORMAT,
+      .blend = &blend_state,
+      .writeMask = wgpu::ColorWriteMask::All,
+    };
+    auto vertex_buffer_attrib_layout = std::to_array({
+      wgpu::VertexAttribute{wgpu::VertexFormat::Sint32x3, offsetof(Vertex, offset), 0},
+      wgpu::VertexAttribute{wgpu::VertexFormat::Unorm10_10_10_2, offsetof(Vertex, normal), 1},
+      wgpu::VertexAttribute{wgpu::VertexFormat::Unorm10_10_10_2, offsetof(Vertex, tangent), 2},
+      wgpu::VertexAttribute{wgpu::VertexFormat::Unorm16x2, offsetof(Vertex, uv), 3},
+    });
+    wgpu::VertexBufferLayout vertex_buffer_layout = {
+      .arrayStride = sizeof(Vertex),
+      .stepMode = wgpu::VertexStepMode::Vertex,
+      .attributeCount = vertex_buffer_attrib_layout.size(),
+      .attributes = vertex_buffer_attrib_layout.data(),
+    };
+    wgpu::VertexState vertex_state = {
+      .module = wgpuFinalShaderModule(),
+      .entryPoint = R3D_SHADER_VS_ENTRY_POINT_NAME,
+      .bufferCount = 1,
+      .buffers = &vertex_buffer_layout,
+    };
+    wgpu::PrimitiveState primitive_state = {
+      .topology = wgpu::PrimitiveTopology::TriangleList,
+      .stripIndexFormat = wgpu::IndexFormat::Undefined,
+      .frontFace = wgpu::FrontFace::CCW,
+      .cullMode = wgpu::CullMode::Back,
+    };
+    wgpu::DepthStencilState depth_stencil_state = {
+      .format = R3D_DEPTH_TEXTURE_FORMAT,
+      .depthWriteEnabled = true,
+      .depthCompare = wgpu::CompareFunction::LessEqual,
+    };
+    wgpu::MultisampleState multisample_state = {
+      .count = sceneSampleCount(),
+    };
+    auto fragment_constants = std::to_array({
+      wgpu::ConstantEntry {.key = "p_LIGHTING_MODEL", .value = static_cast<double>(lighting_model_id)},
+      wgpu::ConstantEntry {.key = "p_MATERIAL_SOURCE", .value = static_cast<double>(source)},
+      wgpu::ConstantEntry {.key = "p_CLUSTER_GRID_X", .value = R3D_LIGHT_CLUSTER_GRID_X},
+      wgpu::ConstantEntry {.key = "p_CLUSTER_GRID_Y", .value = R3D_LIGHT_CLUSTER_GRID_Y},
+      wgpu::ConstantEntry {.key = "p_CLUSTER_GRID_Z", .value = R3D_LIGHT_CLUSTER_GRID_Z},
+      wgpu::ConstantEntry {.key = "p_CLUSTER_LIGHT_CAPACITY", .value = R3D_LIGHT_CLUSTER_LIGHT_CAPACITY},
+    });
+    wgpu::FragmentState fragment_state = {
+      .module = wgpuFinalShaderModule(),
+      .entryPoint = R3D_SHADER_FS_ENTRY_POINT_NAME,
+      .constantCount = fragment_constants.size(),
+      .constants = fragment_constants.data(),
+      .targetCount = 1,
+      .targets = &color_target,
+    };
+    wgpu::RenderPipelineDescriptor descriptor = {
+      .label = "Broccoli.Render.Final.RenderPipeline",
+      .layout = out.pipeline_layout,
+      .vertex = vertex_state,
+      .primitive = primitive_state,
+      .depthStencil = &depth_stencil_state,
+      .multisample = multisample_state,
+      .fragment = &fragment_state,
+    };
+    createRenderPipelineAsync(descriptor, out.pipeline);
+
+    // G-buffer pipeline:
+    // Deferred frames are drawn at one sample per pixel whatever the anti-aliasing mode, and only write (never blend)
+    // material parameters. Only the overrides this entry point reads are specialized: lighting is deferred.
+    std::array<wgpu::ColorTargetState, R3D_GBUFFER_TEXTURE_FORMATS.size()> gbuffer_color_targets;
+    for (size_t i = 0; i < gbuffer_color_targets.size(); i++) {
+      gbuffer_color_targets[i] = wgpu::ColorTargetState {
+        .format = R3D_GBUFFER_TEXTURE_FORMATS[i],
+        .writeMask = wgpu::ColorWriteMask::All,
+      };
+    }
+    wgpu::MultisampleState gbuffer_multisample_state = {
+      .count = 1,
+    };
+    auto gbuffer_fragment_constants = std::to_array({
+      wgpu::ConstantEntry {.key = "p_LIGHTING_MODEL", .value = static_cast<double>(lighting_model_id)},
+      wgpu::ConstantEntry {.key = "p_MATERIAL_SOURCE", .value = static_cast<double>(source)},
+    });
+    wgpu::FragmentState gbuffer_fragment_state = {
+      .module = wgpuFinalShaderModule(),
+      .entryPoint = R3D_SHADER_GBUFFER_FS_ENTRY_POINT_NAME,
+      .constantCount = gbuffer_fragment_constants.size(),
+      .constants = gbuffer_fragment_constants.data(),
+      .targetCount = gbuffer_color_targets.size(),
+      .targets = gbuffer_color_targets.data(),
+    };
+    wgpu::RenderPipelineDescriptor gbuffer_descriptor = {
+      .label = "Broccoli.Render.Final.GBufferRenderPipeline",
+      .layout = out.pipeline_layout,
+      .vertex = vertex_state,
+      .primitive = primitive_state,
+      .depthStencil = &depth_stencil_state,
+      .multisample = gbuffer_multisample_state,
+      .fragment = &gbuffer_fragment_state,
+    };
+    createRenderPipelineAsync(gbuffer_descriptor, out.gbuffer_pipeline);
+  }
+  void RenderManager::initFinalPbrRenderPipeline() {
+    // PBR variants are created eagerly: they are the common case, and the fallback for every other variant.
+    auto lighting_model_id = static_cast<uint32_t>(MaterialLightingModel::PhysicallyBased);
+    for (auto source: {MaterialParameterSource::Constant, MaterialParameterSource::Texture}) {
+      helpInitFinalRenderPipeline(m_wgpu_pbr_final_render_pipelines[source]);
+      requestFinalRenderPipeline(lighting_model_id, source);
+    }
+  }
+  void RenderManager::initFinalBlinnPhongRenderPipeline() {
+    // Blinn-Phong variants are only created once a material uses them (see 'emplaceMaterial'), and re-created on 
+    // re-initialization only if they were already in use.
+    auto lighting_model_id = static_cast<uint32_t>(MaterialLightingModel::BlinnPhong);
+    for (auto source: {MaterialParameterSource::Constant, MaterialParameterSource::Texture}) {
+      bool was_requested = m_wgpu_blinn_phong_final_render_pipelines[source].is_requested;
+      helpInitFinalRenderPipeline(m_wgpu_blinn_phong_final_render_pipelines[source]);
+      if (was_requested) {
+        requestFinalRenderPipeline(lighting_model_id, source);
+      }
+    }
+  }
+  void RenderManager::initDeferredLightingRenderPipeline() {
+    // The lighting pass shares the final pipelines' camera, light and shadow bind groups, and binds the frame's G-buffer
+    // in place of a material: that bind group is created by each frame, whose G-buffer textures are transient.
+    m_deferred_lighting_render_pipeline = {};
+    const FinalRenderPipeline &final_render_pipeline = m_wgpu_pbr_final_render_pipelines[MaterialParameterSource::Constant];
+    m_deferred_lighting_render_pipeline.bind_group_layouts[0] = final_render_pipeline.bind_group_layouts[0];
+    m_deferred_lighting_render_pipeline.bind_group_layouts[1] = final_render_pipeline.bind_group_layouts[1];
+    m_deferred_lighting_render_pipeline.bind_groups_prefix = final_render_pipeline.bind_groups_prefix;
+
+    // bind group layout 2:
+    {
+      auto gbuffer_texture_layout_entry = [] (uint32_t binding, wgpu::TextureSampleType sample_type) {
+        return wgpu::BindGroupLayoutEntry {
+          .binding = binding,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .texture = {
+            .sampleType = sample_type,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
+          },
+        };
+      };
+      auto entries = std::to_array({
+        wgpu::BindGroupLayoutEntry {
+          .binding = 9,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(DeferredUniform),
+          },
+        },
+        gbuffer_texture_layout_entry(10, wgpu::TextureSampleType::Float),
+        gbuffer_texture_layout_entry(11, wgpu::TextureSampleType::Float),
+        gbuffer_texture_layout_entry(12, wgpu::TextureSampleType::Float),
+        gbuffer_texture_layout_entry(13, wgpu::TextureSampleType::UnfilterableFloat),
+        gbuffer_texture_layout_entry(14, wgpu::TextureSampleType::Depth),
+      });
+      wgpu::BindGroupLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.DeferredLighting.BindGroup2Layout",
+        .entryCount = entries.size(),
+        .entries = entries.data(),
+      };
+      m_deferred_lighting_render_pipeline.bind_group_layouts[2] = m_wgpu_device.CreateBindGroupLayout(&descriptor);
+    }
+
+    // pipeline layout:
+    {
+      wgpu::PipelineLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.DeferredLighting.PipelineLayout",
+        .bindGroupLayoutCount = m_deferred_lighting_render_pipeline.bind_group_layouts.size(),
+        .bindGroupLayouts = m_deferred_lighting_render_pipeline.bind_group_layouts.data(),
+      };
+      m_deferred_lighting_render_pipeline.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
+    }
+
+    // render pipeline:
+    {
+      wgpu::ColorTargetState color_target_state = {
+        .format = R3D_COLOR_TEXTURE_FORMAT,
+        .writeMask = wgpu::ColorWriteMask::All,
+      };
+      wgpu::VertexState vertex_state = {
+        .module = wgpuFinalShaderModule(),
+        .entryPoint = R3D_SHADER_DEFERRED_VS_ENTRY_POINT_NAME,
+      };
+      auto fragment_constants = std::to_array({
+        wgpu::ConstantEntry {.key = "p_CLUSTER_GRID_X", .value = R3D_LIGHT_CLUSTER_GRID_X},
+        wgpu::ConstantEntry {.key = "p_CLUSTER_GRID_Y", .value = R3D_LIGHT_CLUSTER_GRID_Y},
+        wgpu::ConstantEntry {.key = "p_CLUSTER_GRID_Z", .value = R3D_LIGHT_CLUSTER_GRID_Z},
+        wgpu::ConstantEntry {.key = "p_CLUSTER_LIGHT_CAPACITY", .value = R3D_LIGHT_CLUSTER_LIGHT_CAPACITY},
+      });
+      wgpu::FragmentState fragment_state = {
+        .module = wgpuFinalShaderModule(),
+        .entryPoint = R3D_SHADER_DEFERRED_FS_ENTRY_POINT_NAME,
+        .constantCount = fragment_constants.size(),
+        .constants = fragment_constants.data(),
+        .targetCount = 1,
+        .targets = &color_target_state,
+      };
+      wgpu::RenderPipelineDescriptor descriptor = {
+        .label = "Broccoli.Render.DeferredLighting.RenderPipeline",
+        .layout = m_deferred_lighting_render_pipeline.pipeline_layout,
+        .vertex = vertex_state,
+        .fragment = &fragment_state,
+      };
+      createRenderPipelineAsync(descriptor, m_deferred_lighting_render_pipeline.pipeline);
+    }
+  }
+  void RenderManager::initShadowRenderPipeline() {
+    // bind group layout 0:
+    {
+      auto entries = std::to_array({
+        wgpu::BindGroupLayoutEntry {
+          .binding = 0,
+          .visibility = wgpu::ShaderStage::Vertex,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(glm::mat4x4) * R3D_INSTANCE_CAPACITY,
+          },
+        },
+      });
+      wgpu::BindGroupLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.Shadow.BindGroup0Layout",
+        .entryCount = entries.size(),
+        .entries = entries.data()
+      };
+      auto bind_group_layout = m_wgpu_device.CreateBindGroupLayout(&descriptor);
+      m_shadow_render_pipeline.bind_group_layouts[0] = bind_group_layout;
+    }
+
+    // bind group layout 1:
+    {
+      auto entries = std::to_array({
+        wgpu::BindGroupLayoutEntry {
+          .binding = 0,
+          .visibility = wgpu::ShaderStage::Vertex,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(ShadowUniform),
+          },
+        },
+      });
+      wgpu::BindGroupLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.Shadow.BindGroup1Layout",
+        .entryCount = entries.size(),
+        .entries = entries.data()
+      };
+      auto bind_group_layout = m_wgpu_device.CreateBindGroupLayout(&descriptor);
+      m_shadow_render_pipeline.bind_group_layouts[1] = bind_group_layout;
+    }
+
+    // pipeline layout:
+    {
+      wgpu::PipelineLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.Shadow.RenderPipelineLayout",
+        .bindGroupLayoutCount = m_shadow_render_pipeline.bind_group_layouts.size(),
+        .bindGroupLayouts = m_shadow_render_pipeline.bind_group_layouts.data(),
+      };
+      m_shadow_render_pipeline.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
+    }
+
+    // render pipelines:
+    helpInitShadowRenderPipeline(m_shadow_render_pipeline, ShadowMapRepresentation::Depth, m_shadow_render_pipeline.pipeline);
+    m_shadow_moments_render_pipeline.bind_group_layouts = m_shadow_render_pipeline.bind_group_layouts;
+    m_shadow_moments_render_pipeline.pipeline_layout = m_shadow_render_pipeline.pipeline_layout;
+    helpInitShadowRenderPipeline(m_shadow_render_pipeline, ShadowMapRepresentation::Moments, m_shadow_moments_render_pipeline.pipeline);
+
+    // bind group 0:
+    {
+      auto bind_group_entries = std::to_array({
+        wgpu::BindGroupEntry {
+          .binding = 0,
+          .buffer = m_wgpu_transform_uniform_buffer,
+          .size = sizeof(glm::mat4x4) * R3D_INSTANCE_CAPACITY,
+        },
+      });
+      wgpu::BindGroupDescriptor descriptor = {
+        .label = "Broccoli.Render.Shadow.BindGroup0",
+        .layout = m_shadow_render_pipeline.bind_group_layouts[0],
+        .entryCount = bind_group_entries.size(),
+        .entries = bind_group_entries.data(),
+      };
+      m_shadow_render_pipeline.bind_groups_prefix[0] = m_wgpu_device.CreateBindGroup(&descriptor);
+      m_shadow_moments_render_pipeline.bind_groups_prefix[0] = m_shadow_render_pipeline.bind_groups_prefix[0];
+    }
+  }
+  void RenderManager::helpInitShadowRenderPipeline(
+    const ShadowRenderPipeline &layout_source,
+    ShadowMapRepresentation representation,
+    wgpu::RenderPipeline &out
+  ) {
+    // The depth and moments variants share bind group layouts, so shadow map UBOs work with either.
+    // TODO: must disable back-face culling for dir-lights, but can leave enabled for other types of lights.
+    bool is_moments = representation == ShadowMapRepresentation::Moments;
+    auto vertex_buffer_attrib_layout = std::to_array({
+      wgpu::VertexAttribute{wgpu::VertexFormat::Sint32x3, offsetof(Vertex, offset), 0},
+    });
+    wgpu::VertexBufferLayout vertex_buffer_layout = {
+      .arrayStride = sizeof(Vertex),
+      .stepMode = wgpu::VertexStepMode::Vertex,
+      .attributeCount = vertex_buffer_attrib_layout.size(),
+      .attributes = vertex_buffer_attrib_layout.data(),
+    };
+    wgpu::VertexState vertex_state = {
+      .module = m_wgpu_shadow_shader_module,
+      .entryPoint = R3D_SHADER_VS_ENTRY_POINT_NAME,
+      .bufferCount = 1,
+      .buffers = &vertex_buffer_layout,
+    };
+    wgpu::PrimitiveState primitive_state = {
+      .topology = wgpu::PrimitiveTopology::TriangleList,
+      .stripIndexFormat = wgpu::IndexFormat::Undefined,
+      .frontFace = wgpu::FrontFace::CCW,
+      .cullMode = wgpu::CullMode::None,
+    };
+    wgpu::DepthStencilState depth_stencil_state = {
+      .format = r3d_shadow_depth_texture_format(m_shadow_settings.depth_format),
+      .depthWriteEnabled = true,
+      .depthCompare = wgpu::CompareFunction::LessEqual,
+    };
+    wgpu::MultisampleState multisample_state = {
+      .count = 1,
+    };
+    wgpu::ColorTargetState moments_color_target = {
+      .format = R3D_CSM_MOMENTS_TEXTURE_FORMAT,
+      .writeMask = wgpu::ColorWriteMask::All,
+    };
+    auto moments_constants = std::to_array({
+      wgpu::ConstantEntry {.key = "p_EVSM_POSITIVE_EXPONENT", .value = R3D_CSM_EVSM_POSITIVE_EXPONENT},
+      wgpu::ConstantEntry {.key = "p_EVSM_NEGATIVE_EXPONENT", .value = R3D_CSM_EVSM_NEGATIVE_EXPONENT},
+    });
+    wgpu::FragmentState fragment_state = {
+      .module = m_wgpu_shadow_shader_module,
+      .entryPoint = is_moments ? R3D_SHADOW_SHADER_MOMENTS_FS_ENTRY_POINT_NAME : R3D_SHADER_FS_ENTRY_POINT_NAME,
+      .constantCount = is_moments ? moments_constants.size() : 0,
+      .constants = is_moments ? moments_constants.data() : nullptr,
+      .targetCount = is_moments ? 1U : 0U,
+      .targets = is_moments ? &moments_color_target : nullptr,
+    };
+    wgpu::RenderPipelineDescriptor descriptor = {
+      .label = is_moments ? "Broccoli.Render.Shadow.Moments.RenderPipeline" : "Broccoli.Render.Shadow.RenderPipeline",
+      .layout = layout_source.pipeline_layout,
+      .vertex = vertex_state,
+      .primitive = primitive_state,
+      .depthStencil = &depth_stencil_state,
+      .multisample = multisample_state,
+      .fragment = &fragment_state,
+    };
+    createRenderPipelineAsync(descriptor, out);
+  }
+  void RenderManager::initShadowBlurComputePipeline() {
+    // bind group layout 0:
+    {
+      auto entries = std::to_array({
+        wgpu::BindGroupLayoutEntry {
+          .binding = 0,
+          .visibility = wgpu::ShaderStage::Compute,
+          .texture = {
+            .sampleType = wgpu::TextureSampleType::UnfilterableFloat,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 1,
+          .visibility = wgpu::ShaderStage::Compute,
+          .storageTexture = {
+            .access = wgpu::StorageTextureAccess::WriteOnly,
+            .format = R3D_CSM_MOMENTS_TEXTURE_FORMAT,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
+          },
+        },
+      });
+      wgpu::BindGroupLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.ShadowBlur.BindGroup0Layout",
+        .entryCount = entries.size(),
+        .entries = entries.data()
+      };
+      auto bind_group_layout = m_wgpu_device.CreateBindGroupLayout(&descriptor);
+      m_shadow_blur_horizontal_compute_pipeline.bind_group_layouts[0] = bind_group_layout;
+      m_shadow_blur_vertical_compute_pipeline.bind_group_layouts[0] = bind_group_layout;
+    }
+
+    // pipeline layout:
+    {
+      wgpu::PipelineLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.ShadowBlur.PipelineLayout",
+        .bindGroupLayoutCount = m_shadow_blur_horizontal_compute_pipeline.bind_group_layouts.size(),
+        .bindGroupLayouts = m_shadow_blur_horizontal_compute_pipeline.bind_group_layouts.data(),
+      };
+      auto pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
+      m_shadow_blur_horizontal_compute_pipeline.pipeline_layout = pipeline_layout;
+      m_shadow_blur_vertical_compute_pipeline.pipeline_layout = pipeline_layout;
+    }
+
+    // compute pipelines:
+    {
+      auto constants = std::to_array({
+        wgpu::ConstantEntry {.key = "p_BLUR_RADIUS", .value = R3D_CSM_BLUR_RADIUS},
+        wgpu::ConstantEntry {.key = "p_WORKGROUP_SIZE", .value = R3D_CSM_BLUR_WORKGROUP_SIZE},
+      });
+      wgpu::ComputePipelineDescriptor horizontal_descriptor = {
+        .label = "Broccoli.Render.ShadowBlur.Horizontal.ComputePipeline",
+        .layout = m_shadow_blur_horizontal_compute_pipeline.pipeline_layout,
+        .compute = {
+          .module = m_wgpu_shadow_blur_shader_module,
+          .entryPoint = R3D_SHADOW_BLUR_SHADER_HORIZONTAL_ENTRY_POINT_NAME,
+          .constantCount = constants.size(),
+          .constants = constants.data(),
+        },
+      };
+      wgpu::ComputePipelineDescriptor vertical_descriptor = {
+        .label = "Broccoli.Render.ShadowBlur.Vertical.ComputePipeline",
+        .layout = m_shadow_blur_vertical_compute_pipeline.pipeline_layout,
+        .compute = {
+          .module = m_wgpu_shadow_blur_shader_module,
+          .entryPoint = R3D_SHADOW_BLUR_SHADER_VERTICAL_ENTRY_POINT_NAME,
+          .constantCount = constants.size(),
+          .constants = constants.data(),
+        },
+      };
+      createComputePipelineAsync(horizontal_descriptor, m_shadow_blur_horizontal_compute_pipeline.pipeline);
+      createComputePipelineAsync(vertical_descriptor, m_shadow_blur_vertical_compute_pipeline.pipeline);
+    }
+  }
+
+  void RenderManager::initLightClusterComputePipeline() {
+    // bind group layout 0:
+    {
+      auto entries = std::to_array({
+        wgpu::BindGroupLayoutEntry {
+          .binding = 0,
+          .visibility = wgpu::ShaderStage::Compute,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(CameraUniform),
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 1,
+          .visibility = wgpu::ShaderStage::Compute,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(ClusterUniform),
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 2,
+          .visibility = wgpu::ShaderStage::Compute,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::ReadOnlyStorage,
+            .minBindingSize = R3D_POINT_LIGHT_CAPACITY * sizeof(PointLightData),
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 3,
+          .visibility = wgpu::ShaderStage::Compute,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Storage,
+            .minBindingSize = R3D_LIGHT_CLUSTER_BUFFER_SIZE,
+          },
+        },
+      });
+      wgpu::BindGroupLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.LightCluster.BindGroup0Layout",
+        .entryCount = entries.size(),
+        .entries = entries.data()
+      };
+      m_light_cluster_compute_pipeline.bind_group_layouts[0] = m_wgpu_device.CreateBindGroupLayout(&descriptor);
+    }
+
+    // pipeline layout:
+    {
+      wgpu::PipelineLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.LightCluster.PipelineLayout",
+        .bindGroupLayoutCount = m_light_cluster_compute_pipeline.bind_group_layouts.size(),
+        .bindGroupLayouts = m_light_cluster_compute_pipeline.bind_group_layouts.data(),
+      };
+      m_light_cluster_compute_pipeline.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
+    }
+
+    // compute pipeline:
+    {
+      auto constants = std::to_array({
+        wgpu::ConstantEntry {.key = "p_CLUSTER_GRID_X", .value = R3D_LIGHT_CLUSTER_GRID_X},
+        wgpu::ConstantEntry {.key = "p_CLUSTER_GRID_Y", .value = R3D_LIGHT_CLUSTER_GRID_Y},
+        wgpu::ConstantEntry {.key = "p_CLUSTER_GRID_Z", .value = R3D_LIGHT_CLUSTER_GRID_Z},
+        wgpu::ConstantEntry {.key = "p_CLUSTER_LIGHT_CAPACITY", .value = R3D_LIGHT_CLUSTER_LIGHT_CAPACITY},
+      });
+      wgpu::ComputePipelineDescriptor descriptor = {
+        .label = "Broccoli.Render.LightCluster.ComputePipeline",
+        .layout = m_light_cluster_compute_pipeline.pipeline_layout,
+        .compute = {
+          .module = m_wgpu_light_cluster_shader_module,
+          .entryPoint = R3D_LIGHT_CLUSTER_SHADER_ENTRY_POINT_NAME,
+          .constantCount = constants.size(),
+          .constants = constants.data(),
+        },
+      };
+      createComputePipelineAsync(descriptor, m_light_cluster_compute_pipeline.pipeline);
+    }
+
+    // bind group 0, for each frame slot:
+    for (auto &slot: m_frame_slots) {
+      auto entries = std::to_array({
+        wgpu::BindGroupEntry {
+          .binding = 0,
+          .buffer = slot.camera_uniform_buffer,
+          .size = sizeof(CameraUniform),
+        },
+        wgpu::BindGroupEntry {
+          .binding = 1,
+          .buffer = m_wgpu_cluster_uniform_buffer,
+          .size = sizeof(ClusterUniform),
+        },
+        wgpu::BindGroupEntry {
+          .binding = 2,
+          .buffer = m_wgpu_point_light_storage_buffer,
+          .size = R3D_POINT_LIGHT_CAPACITY * sizeof(PointLightData),
+        },
+        wgpu::BindGroupEntry {
+          .binding = 3,
+          .buffer = m_wgpu_cluster_light_storage_buffer,
+          .size = R3D_LIGHT_CLUSTER_BUFFER_SIZE,
+        },
+      });
+      wgpu::BindGroupDescriptor descriptor = {
+        .label = "Broccoli.Render.LightCluster.BindGroup0",
+        .layout = m_light_cluster_compute_pipeline.bind_group_layouts[0],
+        .entryCount = entries.size(),
+        .entries = entries.data(),
+      };
+      slot.light_cluster_bind_group = m_wgpu_device.CreateBindGroup(&descriptor);
+    }
+  }
+  void RenderManager::initMipmapComputePipeline() {
+    // bind group layout 0:
+    {
+      auto entries = std::to_array({
+        wgpu::BindGroupLayoutEntry {
+          .binding = 0,
+          .visibility = wgpu::ShaderStage::Compute,
+          .texture = {
+            .sampleType = wgpu::TextureSampleType::Float,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 1,
+          .visibility = wgpu::ShaderStage::Compute,
+          .storageTexture = {
+            .access = wgpu::StorageTextureAccess::WriteOnly,
+            .format = wgpu::TextureFormat::RGBA8Unorm,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
+          },
+        },
+      });
+      wgpu::BindGroupLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.Mipmap.BindGroup0Layout",
+        .entryCount = entries.size(),
+        .entries = entries.data()
+      };
+      m_mipmap_compute_pipeline.bind_group_layouts[0] = m_wgpu_device.CreateBindGroupLayout(&descriptor);
+    }
+
+    // pipeline layout:
+    {
+      wgpu::PipelineLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.Mipmap.PipelineLayout",
+        .bindGroupLayoutCount = m_mipmap_compute_pipeline.bind_group_layouts.size(),
+        .bindGroupLayouts = m_mipmap_compute_pipeline.bind_group_layouts.data(),
+      };
+      m_mipmap_compute_pipeline.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
+    }
+
+    // compute pipeline:
+    {
+      auto constants = std::to_array({
+        wgpu::ConstantEntry {.key = "p_WORKGROUP_SIZE", .value = R3D_MIPMAP_WORKGROUP_SIZE},
+      });
+      wgpu::ComputePipelineDescriptor descriptor = {
+        .label = "Broccoli.Render.Mipmap.ComputePipeline",
+        .layout = m_mipmap_compute_pipeline.pipeline_layout,
+        .compute = {
+          .module = m_wgpu_mipmap_shader_module,
+          .entryPoint = R3D_MIPMAP_SHADER_ENTRY_POINT_NAME,
+          .constantCount = constants.size(),
+          .constants = constants.data(),
+        },
+      };
+      createComputePipelineAsync(descriptor, m_mipmap_compute_pipeline.pipeline);
+    }
+  }
+
+  void RenderManager::helpInitTextureAtlasRenderPipeline(RenderPipeline<1, 0> &render_pipeline, wgpu::TextureFormat format) {
+    render_pipeline = RenderPipeline<1, 0>{};
+
+    // bind group layout 0:
+    // The texture size is read in the vertex stage too, to place the gutter.
+    {
+      auto entries = std::to_array({
+        wgpu::BindGroupLayoutEntry {
+          .binding = 0,
+          .visibility = wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment,
+          .texture = {
+            .sampleType = wgpu::TextureSampleType::Float,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
+          },
+        },
+      });
+      wgpu::BindGroupLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.TextureAtlas.BindGroup0Layout",
+        .entryCount = entries.size(),
+        .entries = entries.data(),
+      };
+      render_pipeline.bind_group_layouts[0] = m_wgpu_device.CreateBindGroupLayout(&descriptor);
+    }
+
+    // pipeline layout:
+    {
+      wgpu::PipelineLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.TextureAtlas.PipelineLayout",
+        .bindGroupLayoutCount = render_pipeline.bind_group_layouts.size(),
+        .bindGroupLayouts = render_pipeline.bind_group_layouts.data(),
+      };
+      render_pipeline.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
+    }
+
+    // render pipeline:
+    // The triangle covering the viewport is generated from the vertex index, so no vertex buffers are bound.
+    {
+      wgpu::ColorTargetState color_target_state = {
+        .format = format,
+        .writeMask = wgpu::ColorWriteMask::All,
+      };
+      wgpu::VertexState vertex_state = {
+        .module = m_wgpu_texture_atlas_shader_module,
+        .entryPoint = R3D_SHADER_VS_ENTRY_POINT_NAME,
+      };
+      wgpu::FragmentState fragment_state = {
+        .module = m_wgpu_texture_atlas_shader_module,
+        .entryPoint = R3D_SHADER_FS_ENTRY_POINT_NAME,
+        .targetCount = 1,
+        .targets = &color_target_state,
+      };
+      wgpu::RenderPipelineDescriptor descriptor = {
+        .label = "Broccoli.Render.TextureAtlas.RenderPipeline",
+        .layout = render_pipeline.pipeline_layout,
+        .vertex = vertex_state,
+        .fragment = &fragment_state,
+      };
+      createRenderPipelineAsync(descriptor, render_pipeline.pipeline);
+    }
+  }
+  void RenderManager::initTextureAtlasRenderPipeline() {
+    helpInitTextureAtlasRenderPipeline(m_texture_atlas_monochrome_render_pipeline, wgpu::TextureFormat::R8Unorm);
+    helpInitTextureAtlasRenderPipeline(m_texture_atlas_rgba_render_pipeline, wgpu::TextureFormat::RGBA8Unorm);
   }
 
-  void RenderManager::reinitOverlayTexture(glm::ivec2 framebuffer_size) {
-    // Overlay texture:
+  void RenderManager::helpInitOverlayRenderPipeline(OverlayRenderPipeline &render_pipeline, uint32_t overlay_texture_type) {
+    render_pipeline = OverlayRenderPipeline{};
+
+    // bind group layout 0
     {
-      if (m_wgpu_final_overlay_texture) {
-        m_wgpu_final_overlay_texture.Destroy();
-      }
-      wgpu::TextureDescriptor overlay_texture_descriptor = {
-        .label = "Broccoli.Render.Overlay.Texture",
-        .usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::TextureBinding,
-        .size = wgpu::Extent3D {
-          .width=static_cast<uint32_t>(framebuffer_size.x),
-          .height=static_cast<uint32_t>(framebuffer_size.y)
+      auto entries = std::to_array({
+        wgpu::BindGroupLayoutEntry {
+          .binding = 0,
+          .visibility = wgpu::ShaderStage::Vertex,
+          .buffer = wgpu::BufferBindingLayout {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(OverlayUniform),
+          }
         },
-        .format = wgpu::TextureFormat::RGBA8Unorm,
+      });
+      wgpu::BindGroupLayoutDescriptor desc = {
+        .label = "Broccoli.Render.Overlay.BindGroup0Layout",
+        .entryCount = entries.size(),
+        .entries = entries.data(),
       };
-      m_wgpu_final_overlay_texture = m_wgpu_device.CreateTexture(&overlay_texture_descriptor);
+      render_pipeline.bind_group_layouts[0] = m_wgpu_device.CreateBindGroupLayout(&desc);
     }
 
-    // Overlay texture view:
+    // bind group layout 1
     {
-      wgpu::TextureViewDescriptor overlay_texture_view_descriptor = {
-        .label = "Broccoli.Render.Overlay.TextureView",
+      auto entries = std::to_array({
+        wgpu::BindGroupLayoutEntry {
+          .binding = 0,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .texture = wgpu::TextureBindingLayout {
+            .sampleType = wgpu::TextureSampleType::UnfilterableFloat,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 1,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .sampler = {.type = wgpu::SamplerBindingType::NonFiltering},
+        },
+      });
+      wgpu::BindGroupLayoutDescriptor desc = {
+        .label = "Broccoli.Render.Overlay.BindGroup1Layout",
+        .entryCount = entries.size(),
+        .entries = entries.data(),
       };
-      m_wgpu_final_overlay_texture_view = m_wgpu_final_overlay_texture.CreateView(&overlay_texture_view_descriptor);
+      render_pipeline.bind_group_layouts[1] = m_wgpu_device.CreateBindGroupLayout(&desc);
     }
 
-    // Overlay sampler:
+    // pipeline layout:
     {
-      wgpu::SamplerDescriptor overlay_sampler_descriptor = {
-        .label = "Broccoli.Render.Overlay.Sampler"
+      wgpu::PipelineLayoutDescriptor desc = {
+        .label = "Broccoli.Render.Overlay.PipelineLayout",
+        .bindGroupLayoutCount = render_pipeline.bind_group_layouts.size(),
+        .bindGroupLayouts = render_pipeline.bind_group_layouts.data(),
       };
-      m_wgpu_final_overlay_sampler = m_wgpu_device.CreateSampler(&overlay_sampler_descriptor);
+      render_pipeline.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&desc);
     }
 
-    // Bind group 1:
+    // render pipeline:
     {
-      auto bind_group_1_entries = std::to_array({
-        wgpu::BindGroupEntry{.binding=0, .textureView=m_wgpu_final_overlay_texture_view},
-        wgpu::BindGroupEntry{.binding=1, .sampler=m_wgpu_final_overlay_sampler},
+      auto vertex_attributes = std::to_array({
+        wgpu::VertexAttribute{.format=wgpu::VertexFormat::Float32x2, .offset=0, .shaderLocation=0},
       });
-      wgpu::BindGroupDescriptor bind_group_1_descriptor = {
-        .label = "Broccoli.Render.Overlay.BindGroup1",
-        .layout = m_overlay_rgba_render_pipeline.textureSelectBindGroupLayout(),
-        .entryCount = bind_group_1_entries.size(),
-        .entries = bind_group_1_entries.data(),
+      // Using premultiplied alpha 'blend over' operator:
+      // See: https://en.wikipedia.org/wiki/Alpha_compositing
+      wgpu::BlendState blend_state = {
+        .color = {
+          .operation = wgpu::BlendOperation::Add,
+          .srcFactor = wgpu::BlendFactor::One,
+          .dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha,
+        },
+        .alpha = {
+          .operation = wgpu::BlendOperation::Add,
+          .srcFactor = wgpu::BlendFactor::One,
+          .dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha,
+        },
       };
-      m_wgpu_final_overlay_bind_group_1 = m_wgpu_device.CreateBindGroup(&bind_group_1_descriptor);
+      wgpu::ColorTargetState color_target_state = {
+        .format = R3D_SWAPCHAIN_TEXTURE_FORMAT,
+        .blend = &blend_state,
+        .writeMask = wgpu::ColorWriteMask::All,
+      };
+      wgpu::VertexBufferLayout vertex_buffer_layout = {
+        .arrayStride = sizeof(glm::f32vec2),
+        .attributeCount = vertex_attributes.size(),
+        .attributes = vertex_attributes.data(),
+      };
+      wgpu::VertexState vertex_state = {
+        .module = wgpuOverlayShaderModule(),
+        .entryPoint = R3D_SHADER_VS_ENTRY_POINT_NAME,
+        .bufferCount = 1,
+        .buffers = &vertex_buffer_layout,
+      };
+      auto fragment_constants = std::to_array({
+        wgpu::ConstantEntry {.key = "p_SAMPLE_MODE", .value = static_cast<double>(overlay_texture_type)},
+      });
+      wgpu::FragmentState fragment_state = {
+        .module = wgpuOverlayShaderModule(),
+        .entryPoint = R3D_SHADER_FS_ENTRY_POINT_NAME,
+        .constantCount = fragment_constants.size(),
+        .constants = fragment_constants.data(),
+        .targetCount = 1,
+        .targets = &color_target_state
+      };
+      wgpu::RenderPipelineDescriptor desc = {
+        .label = "Broccoli.Render.Overlay.Pipeline",
+        .layout = render_pipeline.pipeline_layout,
+        .vertex = vertex_state,
+        .fragment = &fragment_state,
+      };
+      createRenderPipelineAsync(desc, render_pipeline.pipeline);
     }
 
-    // Overlay bitmap:
+    // bind group 0:
     {
-      m_final_overlay_bitmap = Bitmap{glm::i32vec3{framebuffer_size, 4}};
+      auto entries = std::to_array({
+        wgpu::BindGroupEntry{.binding=0, .buffer=m_wgpu_overlay_uniform_buffer, .offset=0, .size=sizeof(OverlayUniform)},
+      });
+      wgpu::BindGroupDescriptor desc = {
+        .label = "Broccoli.Render.Overlay.BindGroup0",
+        .layout = render_pipeline.bind_group_layouts[0],
+        .entryCount = entries.size(),
+        .entries = entries.data(),
+      };
+      render_pipeline.bind_groups_prefix[0] = m_wgpu_device.CreateBindGroup(&desc);
     }
   }
-}
-
-namespace broccoli {
-  void RenderManager::lazyInitDebugTakeoutBuffer() {
-#if !BROCCOLI_DEBUG
-    PANIC("Cannot initialize debug takout buffer unless in debug mode.");
-#else
-    if (m_wgpu_debug_takeout_buffer) {
-      return;
-    }
-    wgpu::BufferDescriptor desc = {
-      .label = "Broccoli.Render.Debug.TakoutBuffer",
-      .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::MapRead,
-      .size = R3D_DEBUG_TAKEOUT_BUFFER_SIZE,
-      .mappedAtCreation = false,
-    };
-    m_wgpu_debug_takeout_buffer = m_wgpu_device.CreateBuffer(&desc);
-#endif
+  void RenderManager::initOverlayRenderPipeline() {
+    helpInitOverlayRenderPipeline(m_overlay_monochrome_render_pipeline, 1);
+    helpInitOverlayRenderPipeline(m_overlay_rgba_render_pipeline, 4);
   }
-}
-
-namespace broccoli {
-  FinalRenderPipeline RenderManager::helpInitFinalRenderPipeline(uint32_t lighting_model_id) {
-    FinalRenderPipeline out;
 
+  void RenderManager::initTonemapRenderPipeline() {
     // bind group layout 0:
     {
       auto entries = std::to_array({
         wgpu::BindGroupLayoutEntry {
           .binding = 0,
-          .visibility = wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment,
-          .buffer = wgpu::BufferBindingLayout {
-            .type = wgpu::BufferBindingType::Uniform,
-            .minBindingSize = sizeof(CameraUniform),
+          .visibility = wgpu::ShaderStage::Fragment,
+          .texture = {
+            .sampleType = wgpu::TextureSampleType::UnfilterableFloat,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
           },
         },
         wgpu::BindGroupLayoutEntry {
           .binding = 1,
           .visibility = wgpu::ShaderStage::Fragment,
-          .buffer = wgpu::BufferBindingLayout {
+          .buffer = {
             .type = wgpu::BufferBindingType::Uniform,
-            .minBindingSize = sizeof(LightUniform),
+            .minBindingSize = sizeof(TonemapUniform),
           },
         },
         wgpu::BindGroupLayoutEntry {
           .binding = 2,
-          .visibility = wgpu::ShaderStage::Vertex,
-          .buffer = wgpu::BufferBindingLayout {
-            .type = wgpu::BufferBindingType::Uniform,
-            .minBindingSize = sizeof(glm::mat4x4) * R3D_INSTANCE_CAPACITY,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .buffer = {
+            .type = wgpu::BufferBindingType::ReadOnlyStorage,
+            .minBindingSize = R3D_EXPOSURE_STATE_SIZE,
           },
         },
       });
       wgpu::BindGroupLayoutDescriptor descriptor = {
-        .label = "Broccoli.Render.Final.BindGroup0Layout",
+        .label = "Broccoli.Render.Tonemap.BindGroup0Layout",
         .entryCount = entries.size(),
-        .entries = entries.data()
+        .entries = entries.data(),
       };
-      out.bind_group_layouts[0] = m_wgpu_device.CreateBindGroupLayout(&descriptor);
+      m_tonemap_render_pipeline.bind_group_layouts[0] = m_wgpu_device.CreateBindGroupLayout(&descriptor);
     }
 
-    // bind group layout 1:
+    // pipeline layout:
+    {
+      wgpu::PipelineLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.Tonemap.PipelineLayout",
+        .bindGroupLayoutCount = m_tonemap_render_pipeline.bind_group_layouts.size(),
+        .bindGroupLayouts = m_tonemap_render_pipeline.bind_group_layouts.data(),
+      };
+      m_tonemap_render_pipeline.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
+    }
+
+    // render pipeline:
+    // The fullscreen triangle is generated from the vertex index, so no vertex buffers are bound.
+    {
+      wgpu::ColorTargetState color_target_state = {
+        .format = R3D_SWAPCHAIN_TEXTURE_FORMAT,
+        .writeMask = wgpu::ColorWriteMask::All,
+      };
+      wgpu::VertexState vertex_state = {
+        .module = m_wgpu_tonemap_shader_module,
+        .entryPoint = R3D_SHADER_VS_ENTRY_POINT_NAME,
+      };
+      wgpu::FragmentState fragment_state = {
+        .module = m_wgpu_tonemap_shader_module,
+        .entryPoint = R3D_SHADER_FS_ENTRY_POINT_NAME,
+        .targetCount = 1,
+        .targets = &color_target_state,
+      };
+      wgpu::RenderPipelineDescriptor descriptor = {
+        .label = "Broccoli.Render.Tonemap.RenderPipeline",
+        .layout = m_tonemap_render_pipeline.pipeline_layout,
+        .vertex = vertex_state,
+        .fragment = &fragment_state,
+      };
+      createRenderPipelineAsync(descriptor, m_tonemap_render_pipeline.pipeline);
+    }
+  }
+
+  void RenderManager::initPostProcessSampler() {
+    // Post-processing passes sample between texels to filter the image, and clamp so that the screen's borders do not 
+    // wrap around.
+    wgpu::SamplerDescriptor descriptor = {
+      .label = "Broccoli.Render.PostProcess.Sampler",
+      .addressModeU = wgpu::AddressMode::ClampToEdge,
+      .addressModeV = wgpu::AddressMode::ClampToEdge,
+      .magFilter = wgpu::FilterMode::Linear,
+      .minFilter = wgpu::FilterMode::Linear,
+    };
+    m_wgpu_post_process_sampler = m_wgpu_device.CreateSampler(&descriptor);
+  }
+
+  void RenderManager::initFxaaRenderPipeline() {
+    // bind group layout 0:
     {
       auto entries = std::to_array({
         wgpu::BindGroupLayoutEntry {
           .binding = 0,
-          .visibility = wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment,
-          .buffer = wgpu::BufferBindingLayout {
-            .type = wgpu::BufferBindingType::Uniform,
-            .minBindingSize = sizeof(MaterialUniform),
-          },
-        },
-        wgpu::BindGroupLayoutEntry {
-          .binding = 1,
-          .visibility = wgpu::ShaderStage::Fragment,
-          .texture = {
-            .sampleType = wgpu::TextureSampleType::Float,
-            .viewDimension = wgpu::TextureViewDimension::e2D,
-          }
-        },
-        wgpu::BindGroupLayoutEntry {
-          .binding = 2,
-          .visibility = wgpu::ShaderStage::Fragment,
-          .texture = {
-            .sampleType = wgpu::TextureSampleType::Float,
-            .viewDimension = wgpu::TextureViewDimension::e2D,
-          }
-        },
-        wgpu::BindGroupLayoutEntry {
-          .binding = 3,
-          .visibility = wgpu::ShaderStage::Fragment,
-          .texture = {
-            .sampleType = wgpu::TextureSampleType::Float,
-            .viewDimension = wgpu::TextureViewDimension::e2D,
-          }
-        },
-        wgpu::BindGroupLayoutEntry {
-          .binding = 4,
           .visibility = wgpu::ShaderStage::Fragment,
           .texture = {
             .sampleType = wgpu::TextureSampleType::Float,
             .viewDimension = wgpu::TextureViewDimension::e2D,
-          }
-        },
-        wgpu::BindGroupLayoutEntry {
-          .binding = 5,
-          .visibility = wgpu::ShaderStage::Fragment,
-          .sampler = {.type = wgpu::SamplerBindingType::Filtering},
-        },
-        wgpu::BindGroupLayoutEntry {
-          .binding = 6,
-          .visibility = wgpu::ShaderStage::Fragment,
-          .sampler = {.type = wgpu::SamplerBindingType::Filtering},
-        },
-        wgpu::BindGroupLayoutEntry {
-          .binding = 7,
-          .visibility = wgpu::ShaderStage::Fragment,
-          .sampler = {.type = wgpu::SamplerBindingType::Filtering},
+          },
         },
         wgpu::BindGroupLayoutEntry {
-          .binding = 8,
+          .binding = 1,
           .visibility = wgpu::ShaderStage::Fragment,
           .sampler = {.type = wgpu::SamplerBindingType::Filtering},
         },
       });
       wgpu::BindGroupLayoutDescriptor descriptor = {
-        .label = "Broccoli.Render.Final.BindGroup1Layout",
+        .label = "Broccoli.Render.Fxaa.BindGroup0Layout",
         .entryCount = entries.size(),
-        .entries = entries.data()
+        .entries = entries.data(),
       };
-      out.bind_group_layouts[1] = m_wgpu_device.CreateBindGroupLayout(&descriptor);
+      m_fxaa_render_pipeline.bind_group_layouts[0] = m_wgpu_device.CreateBindGroupLayout(&descriptor);
     }
 
     // pipeline layout:
     {
       wgpu::PipelineLayoutDescriptor descriptor = {
-        .label = "Broccoli.Render.Final.RenderPipelineLayout",
-        .bindGroupLayoutCount = out.bind_group_layouts.size(),
-        .bindGroupLayouts = out.bind_group_layouts.data(),
+        .label = "Broccoli.Render.Fxaa.PipelineLayout",
+        .bindGroupLayoutCount = m_fxaa_render_pipeline.bind_group_layouts.size(),
+        .bindGroupLayouts = m_fxaa_render_pipeline.bind_group_layouts.data(),
       };
-      out.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
+      m_fxaa_render_pipeline.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
     }
 
     // render pipeline:
     {
-      wgpu::BlendState blend_state = {
-        .color = {
-          .operation = wgpu::BlendOperation::Add,
-          .srcFactor = wgpu::BlendFactor::One,
-          .dstFactor = wgpu::BlendFactor::Zero,
-        },
-        .alpha = {
-          .operation = wgpu::BlendOperation::Add,
-          .srcFactor = wgpu::BlendFactor::One,
-          .dstFactor = wgpu::BlendFactor::Zero,
-        },
-      };
-      wgpu::ColorTargetState color_target = {
+      wgpu::ColorTargetState color_target_state = {
         .format = R3D_SWAPCHAIN_TEXTURE_FORMAT,
-        .blend = &blend_state,
         .writeMask = wgpu::ColorWriteMask::All,
       };
-      auto vertex_buffer_attrib_layout = std::to_array({
-        wgpu::VertexAttribute{wgpu::VertexFormat::Sint32x3, offsetof(Vertex, offset), 0},
-        wgpu::VertexAttribute{wgpu::VertexFormat::Unorm10_10_10_2, offsetof(Vertex, normal), 1},
-        wgpu::VertexAttribute{wgpu::VertexFormat::Unorm10_10_10_2, offsetof(Vertex, tangent), 2},
-        wgpu::VertexAttribute{wgpu::VertexFormat::Unorm16x2, offsetof(Vertex, uv), 3},
-      });
-      wgpu::VertexBufferLayout vertex_buffer_layout = {
-        .arrayStride = sizeof(Vertex),
-        .stepMode = wgpu::VertexStepMode::Vertex,
-        .attributeCount = vertex_buffer_attrib_layout.size(),
-        .attributes = vertex_buffer_attrib_layout.data(),
-      };
       wgpu::VertexState vertex_state = {
-        .module = wgpuFinalShaderModule(lighting_model_id),
+        .module = m_wgpu_fxaa_shader_module,
         .entryPoint = R3D_SHADER_VS_ENTRY_POINT_NAME,
-        .bufferCount = 1,
-        .buffers = &vertex_buffer_layout,
-      };
-      wgpu::PrimitiveState primitive_state = {
-        .topology = wgpu::PrimitiveTopology::TriangleList,
-        .stripIndexFormat = wgpu::IndexFormat::Undefined,
-        .frontFace = wgpu::FrontFace::CCW,
-        .cullMode = wgpu::CullMode::Back,
-      };
-      wgpu::DepthStencilState depth_stencil_state = {
-        .format = R3D_DEPTH_TEXTURE_FORMAT,
-        .depthWriteEnabled = true,
-        .depthCompare = wgpu::CompareFunction::LessEqual,
-      };
-      wgpu::MultisampleState multisample_state = {
-        .count = R3D_MSAA_SAMPLE_COUNT,
       };
       wgpu::FragmentState fragment_state = {
-        .module = wgpuFinalShaderModule(lighting_model_id),
+        .module = m_wgpu_fxaa_shader_module,
         .entryPoint = R3D_SHADER_FS_ENTRY_POINT_NAME,
         .targetCount = 1,
-        .targets = &color_target,
+        .targets = &color_target_state,
       };
       wgpu::RenderPipelineDescriptor descriptor = {
-        .label = "Broccoli.Render.Final.RenderPipeline",
-        .layout = out.pipeline_layout,
+        .label = "Broccoli.Render.Fxaa.RenderPipeline",
+        .layout = m_fxaa_render_pipeline.pipeline_layout,
         .vertex = vertex_state,
-        .primitive = primitive_state,
-        .depthStencil = &depth_stencil_state,
-        .multisample = multisample_state,
         .fragment = &fragment_state,
       };
-      out.pipeline = m_wgpu_device.CreateRenderPipeline(&descriptor);
-    }
-
-    // bind group 0:
-    {
-      auto bind_group_entries = std::to_array({
-        wgpu::BindGroupEntry {
-          .binding = 0,
-          .buffer = m_wgpu_camera_uniform_buffer,
-          .size = sizeof(CameraUniform),
-        },
-        wgpu::BindGroupEntry {
-          .binding = 1,
-          .buffer = m_wgpu_light_uniform_buffer,
-          .size = sizeof(LightUniform),
-        },
-        wgpu::BindGroupEntry {
-          .binding = 2,
-          .buffer = m_wgpu_transform_uniform_buffer,
-          .size = sizeof(glm::mat4x4) * R3D_INSTANCE_CAPACITY,
-        },
-      });
-      wgpu::BindGroupDescriptor bind_group_descriptor = {
-        .label = "Broccoli.Render.Final.BindGroup0",
-        .layout = out.bind_group_layouts[0],
-        .entryCount = bind_group_entries.size(),
-        .entries = bind_group_entries.data(),
-      };
-      out.bind_groups_prefix[0] = m_wgpu_device.CreateBindGroup(&bind_group_descriptor);
+      createRenderPipelineAsync(descriptor, m_fxaa_render_pipeline.pipeline);
     }
-
-    // all done:
-    return out;
   }
-  void RenderManager::initFinalPbrRenderPipeline() {
-    auto render_pipeline = helpInitFinalRenderPipeline(static_cast<uint32_t>(MaterialLightingModel::PhysicallyBased));
-    m_wgpu_pbr_final_render_pipeline = render_pipeline;
-  }
-  void RenderManager::initFinalBlinnPhongRenderPipeline() {
-    auto render_pipeline = helpInitFinalRenderPipeline(static_cast<uint32_t>(MaterialLightingModel::BlinnPhong));
-    m_wgpu_blinn_phong_final_render_pipeline = render_pipeline;
-  }
-  void RenderManager::initShadowRenderPipeline() {
+
+  void RenderManager::initUpscaleRenderPipeline() {
     // bind group layout 0:
     {
       auto entries = std::to_array({
         wgpu::BindGroupLayoutEntry {
           .binding = 0,
-          .visibility = wgpu::ShaderStage::Vertex,
-          .buffer = wgpu::BufferBindingLayout {
-            .type = wgpu::BufferBindingType::Uniform,
-            .minBindingSize = sizeof(glm::mat4x4) * R3D_INSTANCE_CAPACITY,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .texture = {
+            .sampleType = wgpu::TextureSampleType::Float,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
           },
         },
-      });
-      wgpu::BindGroupLayoutDescriptor descriptor = {
-        .label = "Broccoli.Render.Shadow.BindGroup0Layout",
-        .entryCount = entries.size(),
-        .entries = entries.data()
-      };
-      auto bind_group_layout = m_wgpu_device.CreateBindGroupLayout(&descriptor);
-      m_shadow_render_pipeline.bind_group_layouts[0] = bind_group_layout;
-    }
-
-    // bind group layout 1:
-    {
-      auto entries = std::to_array({
         wgpu::BindGroupLayoutEntry {
-          .binding = 0,
-          .visibility = wgpu::ShaderStage::Vertex,
-          .buffer = wgpu::BufferBindingLayout {
-            .type = wgpu::BufferBindingType::Uniform,
-            .minBindingSize = sizeof(ShadowUniform),
-          },
+          .binding = 1,
+          .visibility = wgpu::ShaderStage::Fragment,
+          .sampler = {.type = wgpu::SamplerBindingType::Filtering},
         },
       });
       wgpu::BindGroupLayoutDescriptor descriptor = {
-        .label = "Broccoli.Render.Shadow.BindGroup1Layout",
+        .label = "Broccoli.Render.Upscale.BindGroup0Layout",
         .entryCount = entries.size(),
-        .entries = entries.data()
+        .entries = entries.data(),
       };
-      auto bind_group_layout = m_wgpu_device.CreateBindGroupLayout(&descriptor);
-      m_shadow_render_pipeline.bind_group_layouts[1] = bind_group_layout;
+      m_upscale_render_pipeline.bind_group_layouts[0] = m_wgpu_device.CreateBindGroupLayout(&descriptor);
     }
 
     // pipeline layout:
     {
       wgpu::PipelineLayoutDescriptor descriptor = {
-        .label = "Broccoli.Render.Shadow.RenderPipelineLayout",
-        .bindGroupLayoutCount = m_shadow_render_pipeline.bind_group_layouts.size(),
-        .bindGroupLayouts = m_shadow_render_pipeline.bind_group_layouts.data(),
+        .label = "Broccoli.Render.Upscale.PipelineLayout",
+        .bindGroupLayoutCount = m_upscale_render_pipeline.bind_group_layouts.size(),
+        .bindGroupLayouts = m_upscale_render_pipeline.bind_group_layouts.data(),
       };
-      m_shadow_render_pipeline.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
+      m_upscale_render_pipeline.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
     }
 
     // render pipeline:
-    // TODO: must disable back-face culling for dir-lights, but can leave enabled for other types of lights.
     {
-      auto vertex_buffer_attrib_layout = std::to_array({
-        wgpu::VertexAttribute{wgpu::VertexFormat::Sint32x3, offsetof(Vertex, offset), 0},
-      });
-      wgpu::VertexBufferLayout vertex_buffer_layout = {
-        .arrayStride = sizeof(Vertex),
-        .stepMode = wgpu::VertexStepMode::Vertex,
-        .attributeCount = vertex_buffer_attrib_layout.size(),
-        .attributes = vertex_buffer_attrib_layout.data(),
+      wgpu::ColorTargetState color_target_state = {
+        .format = R3D_SWAPCHAIN_TEXTURE_FORMAT,
+        .writeMask = wgpu::ColorWriteMask::All,
       };
       wgpu::VertexState vertex_state = {
-        .module = m_wgpu_shadow_shader_module,
+        .module = m_wgpu_upscale_shader_module,
         .entryPoint = R3D_SHADER_VS_ENTRY_POINT_NAME,
-        .bufferCount = 1,
-        .buffers = &vertex_buffer_layout,
-      };
-      wgpu::PrimitiveState primitive_state = {
-        .topology = wgpu::PrimitiveTopology::TriangleList,
-        .stripIndexFormat = wgpu::IndexFormat::Undefined,
-        .frontFace = wgpu::FrontFace::CCW,
-        .cullMode = wgpu::CullMode::None,
-      };
-      wgpu::DepthStencilState depth_stencil_state = {
-        .format = R3D_CSM_TEXTURE_FORMAT,
-        .depthWriteEnabled = true,
-        .depthCompare = wgpu::CompareFunction::LessEqual,
-      };
-      wgpu::MultisampleState multisample_state = {
-        .count = 1,
       };
       wgpu::FragmentState fragment_state = {
-        .module = m_wgpu_shadow_shader_module,
+        .module = m_wgpu_upscale_shader_module,
         .entryPoint = R3D_SHADER_FS_ENTRY_POINT_NAME,
-        .targetCount = 0,
+        .targetCount = 1,
+        .targets = &color_target_state,
       };
       wgpu::RenderPipelineDescriptor descriptor = {
-        .label = "Broccoli.Render.Shadow.RenderPipeline",
-        .layout = m_shadow_render_pipeline.pipeline_layout,
+        .label = "Broccoli.Render.Upscale.RenderPipeline",
+        .layout = m_upscale_render_pipeline.pipeline_layout,
         .vertex = vertex_state,
-        .primitive = primitive_state,
-        .depthStencil = &depth_stencil_state,
-        .multisample = multisample_state,
         .fragment = &fragment_state,
       };
-      m_shadow_render_pipeline.pipeline = m_wgpu_device.CreateRenderPipeline(&descriptor);
-    }
-
-    // bind group 0:
-    {
-      auto bind_group_entries = std::to_array({
-        wgpu::BindGroupEntry {
-          .binding = 0,
-          .buffer = m_wgpu_transform_uniform_buffer,
-          .size = sizeof(glm::mat4x4) * R3D_INSTANCE_CAPACITY,
-        },
-      });
-      wgpu::BindGroupDescriptor descriptor = {
-        .label = "Broccoli.Render.Shadow.BindGroup0",
-        .layout = m_shadow_render_pipeline.bind_group_layouts[0],
-        .entryCount = bind_group_entries.size(),
-        .entries = bind_group_entries.data(),
-      };
-      m_shadow_render_pipeline.bind_groups_prefix[0] = m_wgpu_device.CreateBindGroup(&descriptor);
+      createRenderPipelineAsync(descriptor, m_upscale_render_pipeline.pipeline);
     }
   }
 
-  OverlayRenderPipeline RenderManager::helpInitOverlayRenderPipeline(uint32_t overlay_texture_type) {
-    OverlayRenderPipeline render_pipeline;
-
-    // bind group layout 0
-    {
-      auto entries = std::to_array({
-        wgpu::BindGroupLayoutEntry {
-          .binding = 0,
-          .visibility = wgpu::ShaderStage::Vertex,
-          .buffer = wgpu::BufferBindingLayout {
-            .type = wgpu::BufferBindingType::Uniform,
-            .minBindingSize = sizeof(OverlayUniform),
-          }
-        },
-      });
-      wgpu::BindGroupLayoutDescriptor desc = {
-        .label = "Broccoli.Render.Overlay.BindGroup0Layout",
-        .entryCount = entries.size(),
-        .entries = entries.data(),
-      };
-      render_pipeline.bind_group_layouts[0] = m_wgpu_device.CreateBindGroupLayout(&desc);
-    }
-
-    // bind group layout 1
+  void RenderManager::initExposureComputePipeline() {
+    // bind group layout 0:
+    // Shared by the histogram and averaging pipelines, so that one bind group serves both dispatches.
+    wgpu::BindGroupLayout bind_group_layout = nullptr;
     {
       auto entries = std::to_array({
         wgpu::BindGroupLayoutEntry {
           .binding = 0,
-          .visibility = wgpu::ShaderStage::Fragment,
-          .texture = wgpu::TextureBindingLayout {
+          .visibility = wgpu::ShaderStage::Compute,
+          .texture = {
             .sampleType = wgpu::TextureSampleType::UnfilterableFloat,
             .viewDimension = wgpu::TextureViewDimension::e2D,
           },
         },
         wgpu::BindGroupLayoutEntry {
           .binding = 1,
-          .visibility = wgpu::ShaderStage::Fragment,
-          .sampler = {.type = wgpu::SamplerBindingType::NonFiltering},
+          .visibility = wgpu::ShaderStage::Compute,
+          .buffer = {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(ExposureUniform),
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 2,
+          .visibility = wgpu::ShaderStage::Compute,
+          .buffer = {
+            .type = wgpu::BufferBindingType::Storage,
+            .minBindingSize = sizeof(uint32_t) * R3D_LUMINANCE_HISTOGRAM_BIN_COUNT,
+          },
+        },
+        wgpu::BindGroupLayoutEntry {
+          .binding = 3,
+          .visibility = wgpu::ShaderStage::Compute,
+          .buffer = {
+            .type = wgpu::BufferBindingType::Storage,
+            .minBindingSize = R3D_EXPOSURE_STATE_SIZE,
+          },
         },
       });
-      wgpu::BindGroupLayoutDescriptor desc = {
-        .label = "Broccoli.Render.Overlay.BindGroup1Layout",
+      wgpu::BindGroupLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.Exposure.BindGroup0Layout",
         .entryCount = entries.size(),
         .entries = entries.data(),
       };
-      render_pipeline.bind_group_layouts[1] = m_wgpu_device.CreateBindGroupLayout(&desc);
+      bind_group_layout = m_wgpu_device.CreateBindGroupLayout(&descriptor);
     }
 
     // pipeline layout:
+    wgpu::PipelineLayout pipeline_layout = nullptr;
     {
-      wgpu::PipelineLayoutDescriptor desc = {
-        .label = "Broccoli.Render.Overlay.PipelineLayout",
-        .bindGroupLayoutCount = render_pipeline.bind_group_layouts.size(),
-        .bindGroupLayouts = render_pipeline.bind_group_layouts.data(),
+      wgpu::PipelineLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.Exposure.PipelineLayout",
+        .bindGroupLayoutCount = 1,
+        .bindGroupLayouts = &bind_group_layout,
       };
-      render_pipeline.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&desc);
+      pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
     }
 
-    // render pipeline:
-    {
-      auto vertex_attributes = std::to_array({
-        wgpu::VertexAttribute{.format=wgpu::VertexFormat::Float32x2, .offset=0, .shaderLocation=0},
-      });
-      // Using premultiplied alpha 'blend over' operator:
-      // See: https://en.wikipedia.org/wiki/Alpha_compositing
-      wgpu::BlendState blend_state = {
-        .color = {
-          .operation = wgpu::BlendOperation::Add,
-          .srcFactor = wgpu::BlendFactor::One,
-          .dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha,
-        },
-        .alpha = {
-          .operation = wgpu::BlendOperation::Add,
-          .srcFactor = wgpu::BlendFactor::One,
-          .dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha,
+    // compute pipelines:
+    auto constants = std::to_array({
+      wgpu::ConstantEntry {.key = "p_WORKGROUP_SIZE", .value = R3D_LUMINANCE_HISTOGRAM_WORKGROUP_SIZE},
+    });
+    auto init_pipeline = [&] (ComputePipeline<1> &out, const char *label, const char *entry_point) {
+      out.bind_group_layouts[0] = bind_group_layout;
+      out.pipeline_layout = pipeline_layout;
+      wgpu::ComputePipelineDescriptor descriptor = {
+        .label = label,
+        .layout = pipeline_layout,
+        .compute = {
+          .module = m_wgpu_exposure_shader_module,
+          .entryPoint = entry_point,
+          .constantCount = constants.size(),
+          .constants = constants.data(),
         },
       };
-      wgpu::ColorTargetState color_target_state = {
-        .format = wgpu::TextureFormat::BGRA8Unorm,
-        .blend = &blend_state,
-        .writeMask = wgpu::ColorWriteMask::All,
-      };
-      wgpu::VertexBufferLayout vertex_buffer_layout = {
-        .arrayStride = sizeof(glm::f32vec2),
-        .attributeCount = vertex_attributes.size(),
-        .attributes = vertex_attributes.data(),
-      };
-      wgpu::VertexState vertex_state = {
-        .module = wgpuOverlayShaderModule(overlay_texture_type),
-        .entryPoint = R3D_SHADER_VS_ENTRY_POINT_NAME,
-        .bufferCount = 1,
-        .buffers = &vertex_buffer_layout,
-      };
-      wgpu::FragmentState fragment_state = {
-        .module = wgpuOverlayShaderModule(overlay_texture_type),
-        .entryPoint = R3D_SHADER_FS_ENTRY_POINT_NAME,
-        .targetCount = 1,
-        .targets = &color_target_state
+      createComputePipelineAsync(descriptor, out.pipeline);
+    };
+    init_pipeline(
+      m_luminance_histogram_compute_pipeline, 
+      "Broccoli.Render.Exposure.HistogramComputePipeline", 
+      R3D_EXPOSURE_SHADER_HISTOGRAM_ENTRY_POINT_NAME
+    );
+    init_pipeline(
+      m_exposure_average_compute_pipeline, 
+      "Broccoli.Render.Exposure.AverageComputePipeline", 
+      R3D_EXPOSURE_SHADER_AVERAGE_ENTRY_POINT_NAME
+    );
+  }
+
+  void RenderManager::initHizComputePipeline() {
+    // Each pipeline reads a different kind of texture (the depth attachment, with or without multisampling, or the 
+    // previous pyramid level), so each has its own bind group layout. All write a single level of the pyramid.
+    auto constants = std::to_array({
+      wgpu::ConstantEntry {.key = "p_WORKGROUP_SIZE", .value = R3D_HIZ_WORKGROUP_SIZE},
+    });
+    auto init_pipeline = [&] (ComputePipeline<1> &out, const char *label, wgpu::TextureBindingLayout source_layout, const char *entry_point) {
+      // bind group layout 0:
+      {
+        auto entries = std::to_array({
+          wgpu::BindGroupLayoutEntry {
+            .binding = 0,
+            .visibility = wgpu::ShaderStage::Compute,
+            .texture = source_layout,
+          },
+          wgpu::BindGroupLayoutEntry {
+            .binding = 1,
+            .visibility = wgpu::ShaderStage::Compute,
+            .storageTexture = {
+              .access = wgpu::StorageTextureAccess::WriteOnly,
+              .format = R3D_HIZ_TEXTURE_FORMAT,
+              .viewDimension = wgpu::TextureViewDimension::e2D,
+            },
+          },
+        });
+        wgpu::BindGroupLayoutDescriptor descriptor = {
+          .label = "Broccoli.Render.Hiz.BindGroup0Layout",
+          .entryCount = entries.size(),
+          .entries = entries.data(),
+        };
+        out.bind_group_layouts[0] = m_wgpu_device.CreateBindGroupLayout(&descriptor);
+      }
+
+      // pipeline layout:
+      {
+        wgpu::PipelineLayoutDescriptor descriptor = {
+          .label = "Broccoli.Render.Hiz.PipelineLayout",
+          .bindGroupLayoutCount = out.bind_group_layouts.size(),
+          .bindGroupLayouts = out.bind_group_layouts.data(),
+        };
+        out.pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
+      }
+
+      // compute pipeline:
+      {
+        wgpu::ComputePipelineDescriptor descriptor = {
+          .label = label,
+          .layout = out.pipeline_layout,
+          .compute = {
+            .module = m_wgpu_hiz_shader_module,
+            .entryPoint = entry_point,
+            .constantCount = constants.size(),
+            .constants = constants.data(),
+          },
+        };
+        createComputePipelineAsync(descriptor, out.pipeline);
+      }
+    };
+    init_pipeline(
+      m_hiz_init_compute_pipeline,
+      "Broccoli.Render.Hiz.InitComputePipeline",
+      {.sampleType = wgpu::TextureSampleType::Depth, .viewDimension = wgpu::TextureViewDimension::e2D},
+      R3D_HIZ_SHADER_INIT_ENTRY_POINT_NAME
+    );
+    init_pipeline(
+      m_hiz_init_multisampled_compute_pipeline,
+      "Broccoli.Render.Hiz.InitMultisampledComputePipeline",
+      {.sampleType = wgpu::TextureSampleType::Depth, .viewDimension = wgpu::TextureViewDimension::e2D, .multisampled = true},
+      R3D_HIZ_SHADER_INIT_MULTISAMPLED_ENTRY_POINT_NAME
+    );
+    init_pipeline(
+      m_hiz_downsample_compute_pipeline,
+      "Broccoli.Render.Hiz.DownsampleComputePipeline",
+      {.sampleType = wgpu::TextureSampleType::UnfilterableFloat, .viewDimension = wgpu::TextureViewDimension::e2D},
+      R3D_HIZ_SHADER_DOWNSAMPLE_ENTRY_POINT_NAME
+    );
+  }
+
+  void RenderManager::initOcclusionCullComputePipeline() {
+    // bind group layout 0:
+    // Shared by both phases, which only differ in which instances they test.
+    wgpu::BindGroupLayout bind_group_layout = nullptr;
+    {
+      auto storage_entry = [] (uint32_t binding, wgpu::BufferBindingType type) {
+        return wgpu::BindGroupLayoutEntry {
+          .binding = binding,
+          .visibility = wgpu::ShaderStage::Compute,
+          .buffer = {.type = type},
+        };
       };
-      wgpu::RenderPipelineDescriptor desc = {
-        .label = "Broccoli.Render.Overlay.Pipeline",
-        .layout = render_pipeline.pipeline_layout,
-        .vertex = vertex_state,
-        .multisample = {.count=R3D_MSAA_SAMPLE_COUNT},
-        .fragment = &fragment_state,
+      auto entries = std::to_array({
+        wgpu::BindGroupLayoutEntry {
+          .binding = 0,
+          .visibility = wgpu::ShaderStage::Compute,
+          .buffer = {
+            .type = wgpu::BufferBindingType::Uniform,
+            .minBindingSize = sizeof(OcclusionCullUniform),
+          },
+        },
+        storage_entry(1, wgpu::BufferBindingType::ReadOnlyStorage),
+        storage_entry(2, wgpu::BufferBindingType::ReadOnlyStorage),
+        storage_entry(3, wgpu::BufferBindingType::ReadOnlyStorage),
+        storage_entry(4, wgpu::BufferBindingType::Storage),
+        storage_entry(5, wgpu::BufferBindingType::Storage),
+        storage_entry(6, wgpu::BufferBindingType::Storage),
+        storage_entry(7, wgpu::BufferBindingType::Storage),
+        wgpu::BindGroupLayoutEntry {
+          .binding = 8,
+          .visibility = wgpu::ShaderStage::Compute,
+          .texture = {
+            .sampleType = wgpu::TextureSampleType::UnfilterableFloat,
+            .viewDimension = wgpu::TextureViewDimension::e2D,
+          },
+        },
+      });
+      wgpu::BindGroupLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.OcclusionCull.BindGroup0Layout",
+        .entryCount = entries.size(),
+        .entries = entries.data(),
       };
-      render_pipeline.pipeline = m_wgpu_device.CreateRenderPipeline(&desc);
+      bind_group_layout = m_wgpu_device.CreateBindGroupLayout(&descriptor);
     }
 
-    // bind group 0:
+    // pipeline layout:
+    wgpu::PipelineLayout pipeline_layout = nullptr;
     {
-      auto entries = std::to_array({
-        wgpu::BindGroupEntry{.binding=0, .buffer=m_wgpu_overlay_uniform_buffer, .offset=0, .size=sizeof(OverlayUniform)},
-      });
-      wgpu::BindGroupDescriptor desc = {
-        .label = "Broccoli.Render.Overlay.BindGroup0",
-        .layout = render_pipeline.bind_group_layouts[0],
-        .entryCount = entries.size(),
-        .entries = entries.data(),
+      wgpu::PipelineLayoutDescriptor descriptor = {
+        .label = "Broccoli.Render.OcclusionCull.PipelineLayout",
+        .bindGroupLayoutCount = 1,
+        .bindGroupLayouts = &bind_group_layout,
       };
-      render_pipeline.bind_groups_prefix[0] = m_wgpu_device.CreateBindGroup(&desc);
+      pipeline_layout = m_wgpu_device.CreatePipelineLayout(&descriptor);
     }
 
-    // all done:
-    return render_pipeline;
-  }
-  void RenderManager::initOverlayRenderPipeline() {
-    m_overlay_monochrome_render_pipeline = helpInitOverlayRenderPipeline(1);
-    m_overlay_rgba_render_pipeline = helpInitOverlayRenderPipeline(4);
+    // compute pipelines:
+    for (uint32_t phase = 0; phase < RenderOcclusionCuller::PHASE_COUNT; phase++) {
+      auto &out = m_occlusion_cull_compute_pipelines[phase];
+      out.bind_group_layouts[0] = bind_group_layout;
+      out.pipeline_layout = pipeline_layout;
+      auto constants = std::to_array({
+        wgpu::ConstantEntry {.key = "p_WORKGROUP_SIZE", .value = R3D_OCCLUSION_CULL_WORKGROUP_SIZE},
+        wgpu::ConstantEntry {.key = "p_PHASE", .value = static_cast<double>(phase)},
+      });
+      wgpu::ComputePipelineDescriptor descriptor = {
+        .label = "Broccoli.Render.OcclusionCull.ComputePipeline",
+        .layout = pipeline_layout,
+        .compute = {
+          .module = m_wgpu_occlusion_cull_shader_module,
+          .entryPoint = R3D_OCCLUSION_CULL_SHADER_ENTRY_POINT_NAME,
+          .constantCount = constants.size(),
+          .constants = constants.data(),
+        },
+      };
+      createComputePipelineAsync(descriptor, out.pipeline);
+    }
   }
 
   void RenderManager::initShadowMaps() {
+    // Re-initializing replaces all shadow map resources, so any page readback still in flight must be cancelled first: 
+    // its callback refers to the old readback buffers.
+    wgpu::TextureFormat depth_format = r3d_shadow_depth_texture_format(m_shadow_settings.depth_format);
+    m_virtual_shadow_map.cancelPageReadbacks();
+    m_virtual_shadow_map = RenderVirtualShadowMap{};
+    getShadowMaps(LightType::Directional) = RenderShadowMaps{};
+    getShadowMaps(LightType::Point) = RenderShadowMaps{};
     getShadowMaps(LightType::Directional).init(
       m_wgpu_device, 
       m_shadow_render_pipeline,
-      static_cast<int32_t>(R3D_DIRECTIONAL_LIGHT_CAPACITY_LG2),
-      static_cast<int32_t>(R3D_DIR_LIGHT_SHADOW_CASCADE_COUNT_LG2),
-      static_cast<int32_t>(R3D_DIR_LIGHT_SHADOW_CASCADE_MAP_RESOLUTION_LG2), 
+      m_shadow_blur_horizontal_compute_pipeline,
+      m_shadow_settings.dir_light_representation,
+      depth_format,
+      m_shadow_settings.dir_light_shadow_count_lg2,
+      m_shadow_settings.dir_light_cascade_count_lg2,
+      m_shadow_settings.dir_light_cascade_map_resolution_lg2, 
       "Broccoli.Render.ShadowMaps.DirLight"
     );
     getShadowMaps(LightType::Point).init(
       m_wgpu_device, 
       m_shadow_render_pipeline,
-      static_cast<int32_t>(R3D_POINT_LIGHT_CAPACITY_LG2),
-      static_cast<int32_t>(R3D_POINT_LIGHT_SHADOW_CASCADE_COUNT_LG2),
-      static_cast<int32_t>(R3D_POINT_LIGHT_SHADOW_CASCADE_MAP_RESOLUTION_LG2), 
+      m_shadow_blur_horizontal_compute_pipeline,
+      ShadowMapRepresentation::Depth,
+      depth_format,
+      m_shadow_settings.point_light_shadow_count_lg2,
+      m_shadow_settings.point_light_cascade_count_lg2,
+      m_shadow_settings.point_light_cascade_map_resolution_lg2, 
       "Broccoli.Render.ShadowMaps.PtLight"
     );
+    m_virtual_shadow_map.init(
+      m_wgpu_device,
+      m_shadow_render_pipeline,
+      depth_format,
+      m_shadow_settings.vsm_page_table_size_lg2,
+      m_shadow_settings.vsm_page_size_lg2,
+      m_shadow_settings.vsm_physical_page_count,
+      m_shadow_settings.vsm_world_size,
+      m_shadow_settings.dir_light_shadow_radius,
+      "Broccoli.Render.VirtualShadowMap.DirLight"
+    );
   }
 
   void RenderManager::initMaterialTable() {
     m_materials.reserve(R3D_MATERIAL_TABLE_INIT_CAPACITY);
   }
+
+  void RenderManager::initMaterialStorage() {
+    // All constant materials share this bind group: their parameters are indexed out of the material storage buffer
+    // and their textures are never sampled, so draws of constant materials can cross material boundaries.
+    m_wgpu_constant_material_bind_group = acquireMaterialBindGroup(
+      std::to_array<const RenderTexture*>({
+        &m_placeholder_texture, &m_placeholder_texture, &m_placeholder_texture, &m_placeholder_texture
+      })
+    );
+  }
+
+  wgpu::BindGroup RenderManager::acquireMaterialBindGroup(std::array<wgpu::TextureView, 4> views, std::array<wgpu::Sampler, 4> samplers) {
+    // Materials binding the same textures (e.g. the same atlas pages) share a bind group, so their draws can batch.
+    // NOTE: material bind group layouts are identical across final pipeline variants, so any variant's layout will do.
+    std::array<WGPUTextureView, 4> key;
+    std::transform(views.begin(), views.end(), key.begin(), [] (const wgpu::TextureView &v) { return v.Get(); });
+    auto it = m_material_bind_group_map.find(key);
+    if (it != m_material_bind_group_map.end()) {
+      return it->second;
+    }
+    const auto &render_pipeline = getFinalRenderPipeline(
+      static_cast<uint32_t>(MaterialLightingModel::PhysicallyBased),
+      MaterialParameterSource::Constant
+    );
+    auto label = "Broccoli.Render.Material.BindGroup2." + std::to_string(m_material_bind_group_map.size());
+    auto entries = std::to_array({
+      wgpu::BindGroupEntry {
+        .binding=0,
+        .buffer=m_wgpu_material_storage_buffer,
+        .size=R3D_MATERIAL_UNIFORM_CAPACITY * sizeof(MaterialUniform)
+      },
+      wgpu::BindGroupEntry {.binding=1, .textureView=views[0]},
+      wgpu::BindGroupEntry {.binding=2, .textureView=views[1]},
+      wgpu::BindGroupEntry {.binding=3, .textureView=views[2]},
+      wgpu::BindGroupEntry {.binding=4, .textureView=views[3]},
+      wgpu::BindGroupEntry {.binding=5, .sampler=samplers[0]},
+      wgpu::BindGroupEntry {.binding=6, .sampler=samplers[1]},
+      wgpu::BindGroupEntry {.binding=7, .sampler=samplers[2]},
+      wgpu::BindGroupEntry {.binding=8, .sampler=samplers[3]},
+    });
+    wgpu::BindGroupDescriptor bind_group_desc = {
+      .label = label.c_str(),
+      .layout = render_pipeline.materialBindGroupLayout(),
+      .entryCount = entries.size(),
+      .entries = entries.data(),
+    };
+    auto bind_group = m_wgpu_device.CreateBindGroup(&bind_group_desc);
+    m_material_bind_group_map.insert({key, bind_group});
+    return bind_group;
+  }
+
+  RenderTextureView RenderManager::atlasTexture(RenderTexture const &texture) {
+    // Textures too large for the atlas, or that repeat, are bound as they are.
+    bool is_monochrome = texture.dim().z == 1;
+    auto &atlas = is_monochrome ? m_monochrome_texture_atlas : m_rgba_texture_atlas;
+    auto &blit_pipeline = is_monochrome ? m_texture_atlas_monochrome_render_pipeline : m_texture_atlas_rgba_render_pipeline;
+    auto view = atlas.insert(m_wgpu_device, texture, blit_pipeline);
+    if (view.has_value()) {
+      return view.value();
+    }
+    return {texture, glm::dvec2{0.0}, glm::dvec2{1.0}};
+  }
+
+  uint32_t RenderManager::acquireMaterialUniformSlot(const MaterialUniform &uniform) {
+    // Materials with identical parameters share a slot. Hash hits are confirmed against a CPU-side copy of each slot, so
+    // a collision merely costs a duplicate slot.
+    Fnv1aHasher hasher;
+    hasher.write(&uniform);
+    uint64_t hash = hasher.finish();
+    auto uniform_bytes = reinterpret_cast<const uint8_t*>(&uniform);
+    auto it = m_material_uniform_slot_map.find(hash);
+    if (it != m_material_uniform_slot_map.end()) {
+      auto slot_bytes = m_material_uniform_data.data() + it->second * sizeof(MaterialUniform);
+      if (std::equal(uniform_bytes, uniform_bytes + sizeof(MaterialUniform), slot_bytes)) {
+        return it->second;
+      }
+    }
+    
+    auto slot = static_cast<uint32_t>(m_material_uniform_data.size() / sizeof(MaterialUniform));
+    CHECK(slot < R3D_MATERIAL_UNIFORM_CAPACITY, "Material uniform overflow");
+    m_material_uniform_data.insert(m_material_uniform_data.end(), uniform_bytes, uniform_bytes + sizeof(MaterialUniform));
+    m_material_uniform_slot_map.insert({hash, slot});
+    m_wgpu_device.GetQueue().WriteBuffer(
+      m_wgpu_material_storage_buffer,
+      slot * sizeof(MaterialUniform),
+      &uniform,
+      sizeof(MaterialUniform)
+    );
+    return slot;
+  }
 }
 namespace broccoli {
   void RenderManager::resize(glm::i32vec2 framebuffer_size) {
     if (m_framebuffer_size == framebuffer_size) {
       return;
     }
-    reinitColorTexture(framebuffer_size);
-    reinitDepthStencilTexture(framebuffer_size);
     reinitOverlayTexture(framebuffer_size);
     m_framebuffer_size = framebuffer_size;
   }
@@ -1398,19 +4566,74 @@ namespace broccoli {
     return {*this};
   }
 }
+namespace broccoli {
+  RenderTexture RenderManager::createTexture(std::string name, Bitmap bitmap, wgpu::FilterMode filter, wgpu::AddressMode address_mode) {
+    auto lock = lockSubmission();
+    return RenderTexture::createForColorFromBitmap(
+      m_wgpu_device, 
+      std::move(name), 
+      std::move(bitmap), 
+      filter, 
+      &m_mipmap_compute_pipeline,
+      address_mode
+    );
+  }
+  StreamedTexture RenderManager::createStreamedTexture(std::string name, Bitmap bitmap, wgpu::FilterMode filter) {
+    auto lock = lockSubmission();
+    return m_texture_streamer.create(m_wgpu_device, std::move(name), std::move(bitmap), filter);
+  }
+}
+namespace broccoli {
+  void RenderManager::updateTextureStreaming() {
+    auto changed_textures = m_texture_streamer.update(m_wgpu_device);
+    if (changed_textures.empty()) {
+      return;
+    }
+
+    // Cached bind groups that hold retired views are dropped, then every material sampling a changed texture acquires a
+    // new bind group.
+    auto retired_views = m_texture_streamer.takeRetiredViews();
+    auto is_retired = [&retired_views] (WGPUTextureView view) {
+      return std::any_of(retired_views.begin(), retired_views.end(), [view] (const wgpu::TextureView &v) { return v.Get() == view; });
+    };
+    std::erase_if(m_material_bind_group_map, [&is_retired] (const auto &item) {
+      return std::any_of(item.first.begin(), item.first.end(), is_retired);
+    });
+    for (auto &material: m_materials) {
+      auto is_changed = [&material] (StreamedTexture texture) { return material.usesStreamedTexture(texture); };
+      if (std::any_of(changed_textures.begin(), changed_textures.end(), is_changed)) {
+        material.rebindStreamedTextures();
+      }
+    }
+  }
+  TextureResidency RenderManager::streamedTextureResidency(StreamedTexture texture) const {
+    return m_texture_streamer.residency(texture);
+  }
+  const RenderTexture &RenderManager::streamedTexture(StreamedTexture texture) const {
+    return m_texture_streamer.texture(texture);
+  }
+  RenderTextureStreamer &RenderManager::textureStreamer() {
+    return m_texture_streamer;
+  }
+  const RenderTextureStreamer &RenderManager::textureStreamer() const {
+    return m_texture_streamer;
+  }
+}
 namespace broccoli {
   Material RenderManager::emplaceMaterial(MaterialTableEntry material) {
     CHECK(!m_materials_locked, "Cannot create new materials while material list is locked.");
     Material material_id{m_materials.size()};
+    requestFinalRenderPipeline(material.lightingModelID(), material.parameterSource());
     m_materials.emplace_back(std::move(material));
     return material_id;
   }
   Material RenderManager::createBlinnPhongMaterial(
     std::string name,
-    std::variant<glm::dvec3, RenderTexture> albedo_map, 
-    std::variant<glm::dvec3, RenderTexture> normal_map,
+    std::variant<glm::dvec3, RenderTexture, StreamedTexture> albedo_map, 
+    std::variant<glm::dvec3, RenderTexture, StreamedTexture> normal_map,
     double shininess
   ) {
+    auto lock = lockSubmission();
     return emplaceMaterial(
       MaterialTableEntry::createBlinnPhongMaterial(
         *this,
@@ -1423,12 +4646,13 @@ namespace broccoli {
   }
   Material RenderManager::createPbrMaterial(
     std::string name,
-    std::variant<glm::dvec3, RenderTexture> albedo_map, 
-    std::variant<glm::dvec3, RenderTexture> normal_map,
-    std::variant<double, RenderTexture> metalness_map,
-    std::variant<double, RenderTexture> roughness_map,
+    std::variant<glm::dvec3, RenderTexture, StreamedTexture> albedo_map, 
+    std::variant<glm::dvec3, RenderTexture, StreamedTexture> normal_map,
+    std::variant<double, RenderTexture, StreamedTexture> metalness_map,
+    std::variant<double, RenderTexture, StreamedTexture> roughness_map,
     glm::dvec3 fresnel0
   ) {
+    auto lock = lockSubmission();
     return emplaceMaterial(
       MaterialTableEntry::createPbrMaterial(
         *this,
@@ -1449,8 +4673,119 @@ namespace broccoli {
     CHECK(m_materials_locked, "Cannot unlock materials unless materials are already locked.");
     m_materials_locked = false;
   }
+  std::unique_lock<std::mutex> RenderManager::lockSubmission() {
+    return std::unique_lock{m_submission_mutex};
+  }
+  void RenderManager::setMaterialShadowProxy(Material material, std::optional<Geometry> shadow_proxy) {
+    auto lock = lockSubmission();
+    CHECK(!m_materials_locked, "Cannot modify materials while material list is locked.");
+    CHECK(material.value < m_materials.size(), "Invalid material ID.");
+    m_materials[material.value].setShadowProxy(std::move(shadow_proxy));
+  }
+  const ShadowSettings &RenderManager::shadowSettings() const {
+    return m_shadow_settings;
+  }
+  void RenderManager::setShadowSettings(ShadowSettings shadow_settings) {
+    // The shadow pipelines depend on the depth format, and the final pipelines bind the shadow maps (with a layout that
+    // depends on their representation), so all of these are rebuilt along with the shadow maps.
+    CHECK(!m_materials_locked, "Cannot change shadow settings while a frame is being drawn.");
+    auto lock = lockSubmission();
+    // Pipelines still pending would otherwise be written over the re-initialized pipelines when they complete.
+    r3d_check_shadow_settings(shadow_settings);
+    waitForPendingPipelines();
+    m_shadow_settings = shadow_settings;
+    initShadowRenderPipeline();
+    initShadowMaps();
+    initFinalPbrRenderPipeline();
+    initFinalBlinnPhongRenderPipeline();
+    initDeferredLightingRenderPipeline();
+    waitForPendingPipelines();
+  }
+  const ToneMappingSettings &RenderManager::toneMappingSettings() const {
+    return m_tone_mapping_settings;
+  }
+  void RenderManager::setToneMappingSettings(ToneMappingSettings tone_mapping_settings) {
+    // Every tone mapping setting is uploaded per-frame, so nothing needs to be rebuilt.
+    r3d_check_tone_mapping_settings(tone_mapping_settings);
+    auto lock = lockSubmission();
+    m_tone_mapping_settings = tone_mapping_settings;
+  }
+  const DynamicResolutionSettings &RenderManager::dynamicResolutionSettings() const {
+    return m_dynamic_resolution_settings;
+  }
+  void RenderManager::setDynamicResolutionSettings(DynamicResolutionSettings dynamic_resolution_settings) {
+    r3d_check_dynamic_resolution_settings(dynamic_resolution_settings);
+    auto lock = lockSubmission();
+    m_dynamic_resolution_settings = dynamic_resolution_settings;
+    m_render_scale = dynamic_resolution_settings.max_render_scale;
+    m_render_scale_cooldown = 0;
+  }
+  double RenderManager::renderScale() const {
+    return m_render_scale;
+  }
+  bool RenderManager::isOcclusionCullingEnabled() const {
+    return m_is_occlusion_culling_enabled;
+  }
+  void RenderManager::setOcclusionCullingEnabled(bool is_enabled) {
+    // The pyramid was last built before culling was disabled, so it no longer matches the scene.
+    auto lock = lockSubmission();
+    m_is_occlusion_culling_enabled = is_enabled;
+    m_occlusion_culler.invalidate();
+  }
+  bool RenderManager::isSoftwareOcclusionCullingEnabled() const {
+    return m_is_software_occlusion_culling_enabled;
+  }
+  void RenderManager::setSoftwareOcclusionCullingEnabled(bool is_enabled) {
+    auto lock = lockSubmission();
+    m_is_software_occlusion_culling_enabled = is_enabled;
+  }
+  uint32_t RenderManager::maxFramesInFlight() const {
+    return m_max_frames_in_flight;
+  }
+  void RenderManager::setMaxFramesInFlight(uint32_t max_frames_in_flight) {
+    // Lowering the maximum takes effect when the next frame begins, which waits for enough frames to complete.
+    CHECK(
+      1 <= max_frames_in_flight && max_frames_in_flight <= R3D_FRAME_SLOT_COUNT,
+      "Invalid max frames in flight: expected 1 <= max <= frame slot count"
+    );
+    auto lock = lockSubmission();
+    m_max_frames_in_flight = max_frames_in_flight;
+  }
+  uint32_t RenderManager::framesInFlight() const {
+    return m_frames_in_flight;
+  }
+  AntiAliasingMode RenderManager::antiAliasingMode() const {
+    return m_anti_aliasing_mode;
+  }
+  void RenderManager::setAntiAliasingMode(AntiAliasingMode anti_aliasing_mode) {
+    // The final pipelines are built for the scene's sample count, so they are rebuilt whenever it changes. Post-process
+    // modes only change which passes each frame adds.
+    CHECK(!m_materials_locked, "Cannot change anti-aliasing mode while a frame is being drawn.");
+    auto lock = lockSubmission();
+    auto old_sample_count = sceneSampleCount();
+    m_anti_aliasing_mode = anti_aliasing_mode;
+    if (sceneSampleCount() == old_sample_count) {
+      return;
+    }
+    waitForPendingPipelines();
+    initFinalPbrRenderPipeline();
+    initFinalBlinnPhongRenderPipeline();
+    initDeferredLightingRenderPipeline();
+    waitForPendingPipelines();
+  }
+  ShadingPath RenderManager::shadingPath() const {
+    return m_shading_path;
+  }
+  void RenderManager::setShadingPath(ShadingPath shading_path) {
+    // Both paths' pipelines are always created, and each frame picks its path when it begins, so nothing needs to be
+    // rebuilt: the path can change every frame.
+    auto lock = lockSubmission();
+    m_shading_path = shading_path;
+  }
   const MaterialTableEntry &RenderManager::getMaterialInfo(Material material) const {
-    CHECK(m_materials_locked, "Cannot access material bind group unless materials are already locked.");
+    // Materials are read while a frame is recorded, with the table locked, or while it is submitted, with the
+    // submission lock held: the table cannot change in either case.
+    CHECK(material.value < m_materials.size(), "Invalid material ID.");
     return m_materials[material.value];
   }
 }
@@ -1462,40 +4797,84 @@ namespace broccoli {
     return m_wgpu_device;
   }
   const wgpu::Buffer &RenderManager::wgpuLightUniformBuffer() const {
-    return m_wgpu_light_uniform_buffer;
+    return m_frame_slots[m_frame_slot_index].light_uniform_buffer;
   }
   const wgpu::Buffer &RenderManager::wgpuCameraUniformBuffer() const {
-    return m_wgpu_camera_uniform_buffer;
+    return m_frame_slots[m_frame_slot_index].camera_uniform_buffer;
   }
   const wgpu::Buffer &RenderManager::wgpuTransformUniformBuffer() const {
     return m_wgpu_transform_uniform_buffer;
   }
-  wgpu::ShaderModule RenderManager::wgpuFinalShaderModule(uint32_t lighting_model_id) const {
-    switch (static_cast<MaterialLightingModel>(lighting_model_id)) {
-      case MaterialLightingModel::BlinnPhong: return m_wgpu_blinn_phong_shader_module;
-      case MaterialLightingModel::PhysicallyBased: return m_wgpu_pbr_shader_module;
-      default: PANIC("Invalid lighting model ID");
-    }
+  const wgpu::Buffer &RenderManager::wgpuCascadeUniformBuffer() const {
+    return m_frame_slots[m_frame_slot_index].cascade_uniform_buffer;
   }
-  wgpu::ShaderModule RenderManager::wgpuOverlayShaderModule(uint32_t sample_mode_id) const {
-    switch (sample_mode_id) {
-      case 1: return m_wgpu_overlay_monochrome_shader_module;
-      case 4: return m_wgpu_overlay_rgba_shader_module;
-      default: PANIC("Invalid sample mode ID");
+  const wgpu::Buffer &RenderManager::wgpuClusterUniformBuffer() const {
+    return m_wgpu_cluster_uniform_buffer;
+  }
+  const wgpu::Buffer &RenderManager::wgpuPointLightStorageBuffer() const {
+    return m_wgpu_point_light_storage_buffer;
+  }
+  const wgpu::Buffer &RenderManager::wgpuInstanceMaterialUniformBuffer() const {
+    return m_wgpu_instance_material_uniform_buffer;
+  }
+  const wgpu::Buffer &RenderManager::wgpuDeferredUniformBuffer() const {
+    return m_wgpu_deferred_uniform_buffer;
+  }
+  wgpu::BindGroup RenderManager::wgpuConstantMaterialBindGroup() const {
+    return m_wgpu_constant_material_bind_group;
+  }
+  wgpu::ShaderModule RenderManager::wgpuFinalShaderModule() const {
+    return m_wgpu_final_shader_module;
+  }
+  wgpu::ShaderModule RenderManager::wgpuOverlayShaderModule() const {
+    return m_wgpu_overlay_shader_module;
+  }
+  const FinalRenderPipeline &RenderManager::getFinalRenderPipeline(uint32_t lighting_model_id, MaterialParameterSource source) const {
+    // Variants still being created draw with the (eagerly created) PBR variant instead, rather than stalling the frame.
+    // Bind group layouts are identical across variants, so the fallback's bind groups are interchangeable.
+    const FinalRenderPipeline &render_pipeline = finalRenderPipelines(lighting_model_id)[source];
+    if (render_pipeline.pipeline == nullptr || render_pipeline.gbuffer_pipeline == nullptr) {
+      return m_wgpu_pbr_final_render_pipelines[source];
     }
+    return render_pipeline;
+  }
+  const RenderPipeline<3, 2> &RenderManager::getDeferredLightingRenderPipeline() const {
+    return m_deferred_lighting_render_pipeline;
   }
-  const FinalRenderPipeline &RenderManager::getFinalRenderPipeline(uint32_t lighting_model_id) const {
+  const EnumMap<MaterialParameterSource, FinalRenderPipeline> &RenderManager::finalRenderPipelines(uint32_t lighting_model_id) const {
     switch (static_cast<MaterialLightingModel>(lighting_model_id)) {
       case MaterialLightingModel::BlinnPhong:
-        return m_wgpu_blinn_phong_final_render_pipeline;
+        return m_wgpu_blinn_phong_final_render_pipelines;
       case MaterialLightingModel::PhysicallyBased:
-        return m_wgpu_pbr_final_render_pipeline;
+        return m_wgpu_pbr_final_render_pipelines;
       default:
         PANIC("Invalid lighting model ID");
     }
   }
-  const ShadowRenderPipeline &RenderManager::getShadowRenderPipeline() const {
-    return m_shadow_render_pipeline;
+  EnumMap<MaterialParameterSource, FinalRenderPipeline> &RenderManager::finalRenderPipelines(uint32_t lighting_model_id) {
+    return const_cast<EnumMap<MaterialParameterSource, FinalRenderPipeline>&>(std::as_const(*this).finalRenderPipelines(lighting_model_id));
+  }
+  const ShadowRenderPipeline &RenderManager::getShadowRenderPipeline(ShadowMapRepresentation representation) const {
+    switch (representation) {
+      case ShadowMapRepresentation::Depth: return m_shadow_render_pipeline;
+      case ShadowMapRepresentation::Moments: return m_shadow_moments_render_pipeline;
+      default: PANIC("unknown/invalid shadow map representation");
+    }
+  }
+  const ShadowBlurComputePipeline &RenderManager::getShadowBlurComputePipeline(bool is_vertical) const {
+    return is_vertical ? m_shadow_blur_vertical_compute_pipeline : m_shadow_blur_horizontal_compute_pipeline;
+  }
+  const ComputePipeline<1> &RenderManager::getLightClusterComputePipeline() const {
+    return m_light_cluster_compute_pipeline;
+  }
+  const ComputePipeline<1> &RenderManager::getMipmapComputePipeline() const {
+    return m_mipmap_compute_pipeline;
+  }
+  wgpu::BindGroup RenderManager::wgpuLightClusterBindGroup() const {
+    return m_frame_slots[m_frame_slot_index].light_cluster_bind_group;
+  }
+  glm::u32vec3 RenderManager::lightClusterGridSize() const {
+    return {R3D_LIGHT_CLUSTER_GRID_X, R3D_LIGHT_CLUSTER_GRID_Y, R3D_LIGHT_CLUSTER_GRID_Z};
   }
   const OverlayRenderPipeline &RenderManager::getOverlayRenderPipeline(uint32_t sample_mode_id) const {
     switch (sample_mode_id) {
@@ -1516,11 +4895,11 @@ namespace broccoli {
   wgpu::BindGroup RenderManager::wgpuOverlayBindGroup1() const {
     return m_wgpu_final_overlay_bind_group_1;
   }
-  const wgpu::TextureView &RenderManager::wgpuRenderTargetColorTextureView() const {
-    return m_wgpu_render_target_color_texture_view;
+  RenderGraphTexturePool &RenderManager::renderGraphTexturePool() {
+    return m_render_graph_texture_pool;
   }
-  const wgpu::TextureView &RenderManager::wgpuRenderTargetDepthStencilTextureView() const {
-    return m_wgpu_render_target_depth_stencil_texture_view;
+  RenderStagingBelt &RenderManager::stagingBelt() {
+    return m_staging_belt;
   }
   RenderShadowMaps &RenderManager::getShadowMaps(LightType light_type) {
     return m_light_shadow_maps[light_type];
@@ -1528,11 +4907,37 @@ namespace broccoli {
   const RenderShadowMaps &RenderManager::getShadowMaps(LightType light_type) const {
     return m_light_shadow_maps[light_type];
   }
-  const RenderTexture &RenderManager::rgbPalette() const {
-    return m_rgb_palette;
+  RenderVirtualShadowMap &RenderManager::getVirtualShadowMap() {
+    return m_virtual_shadow_map;
+  }
+  const RenderVirtualShadowMap &RenderManager::getVirtualShadowMap() const {
+    return m_virtual_shadow_map;
   }
-  const RenderTexture &RenderManager::monochromePalette() const {
-    return m_monochrome_palette;
+  RenderOcclusionCuller &RenderManager::getOcclusionCuller() {
+    return m_occlusion_culler;
+  }
+  SoftwareOcclusionCuller &RenderManager::getSoftwareOcclusionCuller() {
+    // Created on first use, so that its worker threads are only started once software culling is enabled.
+    if (!m_software_occlusion_culler) {
+      auto thread_count = std::clamp<uint32_t>(std::thread::hardware_concurrency(), 1, R3D_SOFTWARE_OCCLUSION_MAX_THREAD_COUNT);
+      m_software_occlusion_culler = std::make_unique<SoftwareOcclusionCuller>(thread_count);
+    }
+    return *m_software_occlusion_culler;
+  }
+  const ComputePipeline<1> &RenderManager::getHizInitComputePipeline(uint32_t depth_sample_count) const {
+    return depth_sample_count > 1 ? m_hiz_init_multisampled_compute_pipeline : m_hiz_init_compute_pipeline;
+  }
+  const ComputePipeline<1> &RenderManager::getHizDownsampleComputePipeline() const {
+    return m_hiz_downsample_compute_pipeline;
+  }
+  const ComputePipeline<1> &RenderManager::getOcclusionCullComputePipeline(uint32_t phase) const {
+    return m_occlusion_cull_compute_pipelines[phase];
+  }
+  ShadowTechnique RenderManager::dirLightShadowTechnique() const {
+    return m_shadow_settings.dir_light_technique;
+  }
+  const RenderTexture &RenderManager::placeholderTexture() const {
+    return m_placeholder_texture;
   }
   const std::vector<MaterialTableEntry> &RenderManager::materials() const {
     return m_materials;
@@ -1540,7 +4945,16 @@ namespace broccoli {
 }
 namespace broccoli {
   void RenderManager::debug_takeoutShadowMap(LightType light_type, int32_t light_index, int32_t cascade_index, std::function<void(FloatBitmap)> cb) {
-    lazyInitDebugTakeoutBuffer();
+    // Depth maps are dumped as a single float channel (converted from unorm16 if needed), moment maps as four 
+    // (converted from f16).
+    const RenderShadowMaps &shadow_maps = getShadowMaps(light_type);
+    bool is_moments = shadow_maps.representation() == ShadowMapRepresentation::Moments;
+    bool is_unorm16 = shadow_maps.format() == wgpu::TextureFormat::Depth16Unorm;
+    int32_t channel_count = is_moments ? 4 : 1;
+    size_t texel_size = is_moments ? 4 * sizeof(uint16_t) : is_unorm16 ? sizeof(uint16_t) : sizeof(float);
+    uint32_t resolution = 1U << shadow_maps.sizeLg2();
+    size_t byte_count = static_cast<size_t>(resolution) * resolution * texel_size;
+    lazyInitDebugTakeoutBuffer(byte_count);
 
     wgpu::CommandEncoderDescriptor command_encoder_descriptor = {
       .label = "Broccoli.Render.Debug.ShadowMapTakeoutCommandEncoder",
@@ -1548,23 +4962,23 @@ namespace broccoli {
     wgpu::CommandEncoder command_encoder = m_wgpu_device.CreateCommandEncoder(&command_encoder_descriptor);
     {
       const wgpu::ImageCopyTexture source = {
-        .texture = getShadowMaps(light_type).texture(),
+        .texture = shadow_maps.texture(),
         .origin = wgpu::Origin3D {
           .x = 0,
           .y = 0,
-          .z = static_cast<uint32_t>((light_index << r3d_shadow_cascade_map_count_lg2(light_type)) + cascade_index),
+          .z = static_cast<uint32_t>(light_index * shadow_maps.cascadesPerLight() + cascade_index),
         },
       };
       const wgpu::ImageCopyBuffer destination = {
         .layout = {
-          .bytesPerRow = static_cast<size_t>((1U << r3d_shadow_cascade_map_resolution_lg2(light_type)) * sizeof(float)),
-          .rowsPerImage = static_cast<size_t>((1U << r3d_shadow_cascade_map_resolution_lg2(light_type))),
+          .bytesPerRow = static_cast<uint32_t>(resolution * texel_size),
+          .rowsPerImage = resolution,
         },
         .buffer = m_wgpu_debug_takeout_buffer,
       };
       const wgpu::Extent3D copy_size = {
-        .width = 1U << r3d_shadow_cascade_map_resolution_lg2(light_type),
-        .height = 1U << r3d_shadow_cascade_map_resolution_lg2(light_type),
+        .width = resolution,
+        .height = resolution,
         .depthOrArrayLayers = 1,
       };
       command_encoder.CopyTextureToBuffer(&source, &destination, &copy_size);
@@ -1573,43 +4987,62 @@ namespace broccoli {
     m_wgpu_device.GetQueue().Submit(1, &command_buffer);
 
     struct MapUserData {
-      LightType light_type;
+      glm::i32vec3 output_dimension;
+      bool is_moments;
+      bool is_unorm16;
       wgpu::Buffer mapped_buffer;
       std::function<void(FloatBitmap)> cb;
     };
     m_wgpu_debug_takeout_buffer.MapAsync(
       wgpu::MapMode::Read,
       0,
-      static_cast<size_t>(1U << (2 * r3d_shadow_cascade_map_resolution_lg2(light_type))) * sizeof(float),
+      byte_count,
       [] (WGPUBufferMapAsyncStatus status, void *userdata) {
         CHECK(status == WGPUBufferMapAsyncStatus_Success, "Mapping takeout buffer failed when fetching shadow map.");
         MapUserData *data = reinterpret_cast<MapUserData*>(userdata);
-        
-        glm::i32vec3 output_dimension = {
-          1 << r3d_shadow_cascade_map_resolution_lg2(data->light_type),
-          1 << r3d_shadow_cascade_map_resolution_lg2(data->light_type),
-          1,
-        };
-        FloatBitmap output{output_dimension};
+        FloatBitmap output{data->output_dimension};
 
         CHECK(data->mapped_buffer.GetMapState() == wgpu::BufferMapState::Mapped, "Expected buffer to be mapped.");
         const void *src = data->mapped_buffer.GetConstMappedRange();
         CHECK(src, "Expected mapped buffer range to be valid");
-        memcpy(output.data(), src, output.dataSize());
+        if (data->is_moments) {
+          const uint16_t *src_half = reinterpret_cast<const uint16_t*>(src);
+          float *dst = reinterpret_cast<float*>(output.data());
+          for (size_t i = 0; i < static_cast<size_t>(output.dataSize()) / sizeof(float); i++) {
+            dst[i] = glm::unpackHalf1x16(src_half[i]);
+          }
+        } else if (data->is_unorm16) {
+          const uint16_t *src_unorm = reinterpret_cast<const uint16_t*>(src);
+          float *dst = reinterpret_cast<float*>(output.data());
+          for (size_t i = 0; i < static_cast<size_t>(output.dataSize()) / sizeof(float); i++) {
+            dst[i] = static_cast<float>(src_unorm[i]) / 65535.0f;
+          }
+        } else {
+          memcpy(output.data(), src, output.dataSize());
+        }
 
         data->cb(std::move(output));
 
         data->mapped_buffer.Unmap();
         delete data;
       },
-      new MapUserData{light_type, m_wgpu_debug_takeout_buffer, std::move(cb)}
+      new MapUserData{
+        glm::i32vec3{static_cast<int32_t>(resolution), static_cast<int32_t>(resolution), channel_count},
+        is_moments,
+        is_unorm16,
+        m_wgpu_debug_takeout_buffer,
+        std::move(cb)
+      }
     );
   }
 }
 namespace broccoli {
-  RenderFrame RenderManager::frame(RenderTarget target) {
+  std::unique_ptr<RenderFrame> RenderManager::frame(RenderTarget target) {
+    acquireFrameSlot();
+    m_staging_belt.beginFrame();
     resize(target.size);
-    return {*this, target, m_final_overlay_bitmap};
+    updateRenderScale();
+    return std::make_unique<RenderFrame>(*this, target, m_final_overlay_bitmap);
   }
 }
 
@@ -1617,70 +5050,457 @@ namespace broccoli {
 // Interface: RenderFrame:
 //
 
+namespace broccoli {
+  void RenderManager::addExposurePass(RenderGraph &graph, RenderGraphTexture scene_texture) {
+    if (!m_tone_mapping_settings.is_auto_exposure_enabled) {
+      return;
+    }
+
+    // Adaptation is framerate-independent: the fraction of the remaining distance covered each frame depends on how long
+    // the frame took. Long stalls (e.g. while loading) are capped so that they do not snap exposure to a new value.
+    auto now = std::chrono::steady_clock::now();
+    auto dt = std::min(std::chrono::duration<double>(now - m_exposure_timestamp).count(), 1.0);
+    m_exposure_timestamp = now;
+    ExposureUniform uniform = {
+      .min_log2_luminance = m_tone_mapping_settings.auto_exposure_min_log2_luminance,
+      .log2_luminance_range = 
+        m_tone_mapping_settings.auto_exposure_max_log2_luminance - 
+        m_tone_mapping_settings.auto_exposure_min_log2_luminance,
+      .adaptation_rate = static_cast<float>(1.0 - std::exp(-dt * m_tone_mapping_settings.auto_exposure_adaptation_speed)),
+    };
+    graph.addEncoderPass(
+      RenderGraphPassInfo {
+        .name = "Broccoli.Render.Exposure",
+        .reads = {scene_texture},
+        .has_side_effects = true,
+      },
+      [this, scene_texture, uniform] (wgpu::CommandEncoder &encoder, const RenderGraph &graph) {
+        m_wgpu_device.GetQueue().WriteBuffer(m_wgpu_exposure_uniform_buffer, 0, &uniform, sizeof(uniform));
+        auto entries = std::to_array({
+          wgpu::BindGroupEntry {.binding = 0, .textureView = graph.textureView(scene_texture)},
+          wgpu::BindGroupEntry {.binding = 1, .buffer = m_wgpu_exposure_uniform_buffer, .size = sizeof(ExposureUniform)},
+          wgpu::BindGroupEntry {
+            .binding = 2, 
+            .buffer = m_wgpu_luminance_histogram_storage_buffer, 
+            .size = sizeof(uint32_t) * R3D_LUMINANCE_HISTOGRAM_BIN_COUNT
+          },
+          wgpu::BindGroupEntry {.binding = 3, .buffer = m_wgpu_exposure_storage_buffer, .size = R3D_EXPOSURE_STATE_SIZE},
+        });
+        wgpu::BindGroupDescriptor bind_group_descriptor = {
+          .label = "Broccoli.Render.Exposure.BindGroup0",
+          .layout = m_luminance_histogram_compute_pipeline.bind_group_layouts[0],
+          .entryCount = entries.size(),
+          .entries = entries.data(),
+        };
+        auto bind_group = m_wgpu_device.CreateBindGroup(&bind_group_descriptor);
+
+        // Both dispatches share one compute pass: the average only starts once every histogram workgroup is done.
+        auto scene_size = graph.textureSize(scene_texture);
+        wgpu::ComputePassDescriptor compute_pass_descriptor = {.label = "Broccoli.Render.Exposure.ComputePass"};
+        auto compute_pass = encoder.BeginComputePass(&compute_pass_descriptor);
+        compute_pass.SetBindGroup(0, bind_group);
+        compute_pass.SetPipeline(m_luminance_histogram_compute_pipeline.pipeline);
+        compute_pass.DispatchWorkgroups(
+          (static_cast<uint32_t>(scene_size.x) + R3D_LUMINANCE_HISTOGRAM_WORKGROUP_SIZE - 1) / R3D_LUMINANCE_HISTOGRAM_WORKGROUP_SIZE,
+          (static_cast<uint32_t>(scene_size.y) + R3D_LUMINANCE_HISTOGRAM_WORKGROUP_SIZE - 1) / R3D_LUMINANCE_HISTOGRAM_WORKGROUP_SIZE
+        );
+        compute_pass.SetPipeline(m_exposure_average_compute_pipeline.pipeline);
+        compute_pass.DispatchWorkgroups(1);
+        compute_pass.End();
+      }
+    );
+  }
+  void RenderManager::addTonemapPass(
+    RenderGraph &graph, 
+    RenderGraphTexture scene_texture, 
+    RenderGraphTexture target_texture, 
+    glm::dvec3 clear_color, 
+    float exposure_bias
+  ) {
+    TonemapUniform uniform = {
+      .clear_color = glm::fvec4{clear_color, 1.0},
+      .exposure_bias = exposure_bias,
+      .tonemap_operator = static_cast<uint32_t>(m_tone_mapping_settings.tonemap_operator),
+      .is_auto_exposure_enabled = m_tone_mapping_settings.is_auto_exposure_enabled ? 1u : 0u,
+    };
+    graph.addRasterPass(
+      RenderGraphPassInfo {
+        .name = "Broccoli.Render.Tonemap",
+        .reads = {scene_texture},
+        .color_attachment = RenderGraphColorAttachment {
+          .texture = target_texture,
+          .load_op = wgpu::LoadOp::Clear,
+        },
+      },
+      [this, scene_texture, uniform] (wgpu::RenderPassEncoder &rp_encoder, const RenderGraph &graph) {
+        m_wgpu_device.GetQueue().WriteBuffer(m_wgpu_tonemap_uniform_buffer, 0, &uniform, sizeof(uniform));
+        auto entries = std::to_array({
+          wgpu::BindGroupEntry {.binding = 0, .textureView = graph.textureView(scene_texture)},
+          wgpu::BindGroupEntry {.binding = 1, .buffer = m_wgpu_tonemap_uniform_buffer, .size = sizeof(TonemapUniform)},
+          wgpu::BindGroupEntry {.binding = 2, .buffer = m_wgpu_exposure_storage_buffer, .size = R3D_EXPOSURE_STATE_SIZE},
+        });
+        wgpu::BindGroupDescriptor bind_group_descriptor = {
+          .label = "Broccoli.Render.Tonemap.BindGroup0",
+          .layout = m_tonemap_render_pipeline.bind_group_layouts[0],
+          .entryCount = entries.size(),
+          .entries = entries.data(),
+        };
+        auto bind_group = m_wgpu_device.CreateBindGroup(&bind_group_descriptor);
+        rp_encoder.SetPipeline(m_tonemap_render_pipeline.pipeline);
+        m_tonemap_render_pipeline.setBindGroups(rp_encoder, std::array{bind_group});
+        rp_encoder.Draw(3);
+      }
+    );
+  }
+}
+namespace broccoli {
+  void RenderManager::addFxaaPass(RenderGraph &graph, RenderGraphTexture source_texture, RenderGraphTexture target_texture) {
+    graph.addRasterPass(
+      RenderGraphPassInfo {
+        .name = "Broccoli.Render.Fxaa",
+        .reads = {source_texture},
+        .color_attachment = RenderGraphColorAttachment {
+          .texture = target_texture,
+          .load_op = wgpu::LoadOp::Clear,
+        },
+      },
+      [this, source_texture] (wgpu::RenderPassEncoder &rp_encoder, const RenderGraph &graph) {
+        auto entries = std::to_array({
+          wgpu::BindGroupEntry {.binding = 0, .textureView = graph.textureView(source_texture)},
+          wgpu::BindGroupEntry {.binding = 1, .sampler = m_wgpu_post_process_sampler},
+        });
+        wgpu::BindGroupDescriptor bind_group_descriptor = {
+          .label = "Broccoli.Render.Fxaa.BindGroup0",
+          .layout = m_fxaa_render_pipeline.bind_group_layouts[0],
+          .entryCount = entries.size(),
+          .entries = entries.data(),
+        };
+        auto bind_group = m_wgpu_device.CreateBindGroup(&bind_group_descriptor);
+        rp_encoder.SetPipeline(m_fxaa_render_pipeline.pipeline);
+        m_fxaa_render_pipeline.setBindGroups(rp_encoder, std::array{bind_group});
+        rp_encoder.Draw(3);
+      }
+    );
+  }
+  void RenderManager::addUpscalePass(RenderGraph &graph, RenderGraphTexture source_texture, RenderGraphTexture target_texture) {
+    graph.addRasterPass(
+      RenderGraphPassInfo {
+        .name = "Broccoli.Render.Upscale",
+        .reads = {source_texture},
+        .color_attachment = RenderGraphColorAttachment {
+          .texture = target_texture,
+          .load_op = wgpu::LoadOp::Clear,
+        },
+      },
+      [this, source_texture] (wgpu::RenderPassEncoder &rp_encoder, const RenderGraph &graph) {
+        auto entries = std::to_array({
+          wgpu::BindGroupEntry {.binding = 0, .textureView = graph.textureView(source_texture)},
+          wgpu::BindGroupEntry {.binding = 1, .sampler = m_wgpu_post_process_sampler},
+        });
+        wgpu::BindGroupDescriptor bind_group_descriptor = {
+          .label = "Broccoli.Render.Upscale.BindGroup0",
+          .layout = m_upscale_render_pipeline.bind_group_layouts[0],
+          .entryCount = entries.size(),
+          .entries = entries.data(),
+        };
+        auto bind_group = m_wgpu_device.CreateBindGroup(&bind_group_descriptor);
+        rp_encoder.SetPipeline(m_upscale_render_pipeline.pipeline);
+        m_upscale_render_pipeline.setBindGroups(rp_encoder, std::array{bind_group});
+        rp_encoder.Draw(3);
+      }
+    );
+  }
+  uint32_t RenderManager::sceneSampleCount() const {
+    return m_anti_aliasing_mode == AntiAliasingMode::Msaa4x ? R3D_MSAA_SAMPLE_COUNT : 1;
+  }
+  glm::ivec2 RenderManager::sceneSize(glm::ivec2 target_size) const {
+    return glm::max(glm::ivec2{glm::round(glm::dvec2{target_size} * m_render_scale)}, glm::ivec2{1});
+  }
+}
+namespace broccoli {
+  void RenderManager::recordFrameTime(double frame_time_ms) {
+    if (m_smoothed_frame_time_ms <= 0.0) {
+      m_smoothed_frame_time_ms = frame_time_ms;
+    } else {
+      m_smoothed_frame_time_ms = glm::mix(m_smoothed_frame_time_ms, frame_time_ms, R3D_FRAME_TIME_SMOOTHING);
+    }
+  }
+  void RenderManager::updateRenderScale() {
+    const auto &settings = m_dynamic_resolution_settings;
+    if (!settings.is_enabled) {
+      m_render_scale = settings.max_render_scale;
+      return;
+    }
+    if (m_smoothed_frame_time_ms <= 0.0) {
+      return;
+    }
+    if (m_render_scale_cooldown > 0) {
+      m_render_scale_cooldown--;
+      return;
+    }
+
+    // Frame time is assumed to grow with the number of pixels drawn, i.e. with the square of the render scale. Rounding
+    // the ideal scale down to a step keeps a margin under the budget, so that the scale does not oscillate between two
+    // steps. The scale only grows one step at a time, since overestimating the headroom costs dropped frames while
+    // underestimating it only costs sharpness.
+    double budget_ms = R3D_FRAME_TIME_BUDGET_HEADROOM * settings.frame_time_budget_ms;
+    double ideal_scale = m_render_scale * std::sqrt(budget_ms / m_smoothed_frame_time_ms);
+    double new_scale = std::floor(ideal_scale / R3D_RENDER_SCALE_STEP) * R3D_RENDER_SCALE_STEP;
+    new_scale = std::min(new_scale, m_render_scale + R3D_RENDER_SCALE_STEP);
+    new_scale = std::clamp(new_scale, settings.min_render_scale, settings.max_render_scale);
+    if (std::abs(new_scale - m_render_scale) < 0.5 * R3D_RENDER_SCALE_STEP) {
+      return;
+    }
+    m_render_scale = new_scale;
+    m_render_scale_cooldown = R3D_RENDER_SCALE_COOLDOWN_FRAMES;
+  }
+}
 namespace broccoli {
   RenderFrame::RenderFrame(RenderManager &manager, RenderTarget target, Bitmap &overlay_bitmap)
   : m_manager(manager),
     m_target(target),
     m_overlay_bitmap(overlay_bitmap),
-    m_state(0)
-  {}
+    m_state(0),
+    m_graph(manager.wgpuDevice(), manager.renderGraphTexturePool()),
+    m_anti_aliasing_mode(manager.antiAliasingMode()),
+    m_shading_path(manager.shadingPath()),
+    m_scene_size(manager.sceneSize(target.size)),
+    m_target_texture(m_graph.importTexture("Broccoli.Render.Target", target.texture_view, target.size)),
+    m_scene_texture(
+      m_graph.createTexture(
+        "Broccoli.Render.SceneTexture",
+        {
+          .size = m_scene_size,
+          .format = R3D_COLOR_TEXTURE_FORMAT,
+          .usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding,
+        }
+      )
+    ),
+    m_color_texture(
+      sceneSampleCount() == 1 ?
+      m_scene_texture :
+      m_graph.createTexture(
+        "Broccoli.Render.ColorTexture",
+        {
+          .size = m_scene_size,
+          .format = R3D_COLOR_TEXTURE_FORMAT,
+          .usage = wgpu::TextureUsage::RenderAttachment,
+          .sample_count = sceneSampleCount(),
+        }
+      )
+    ),
+    m_depth_stencil_texture(
+      m_graph.createTexture(
+        "Broccoli.Render.DepthStencilTexture",
+        {
+          .size = m_scene_size,
+          .format = R3D_DEPTH_TEXTURE_FORMAT,
+          // Also bound to build the occlusion culling pyramid.
+          .usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding,
+          .sample_count = sceneSampleCount(),
+        }
+      )
+    ),
+    m_gbuffer_textures(),
+    m_clear_color(0.0),
+    m_exposure_bias(1.0f),
+    m_is_tonemapped(false),
+    m_is_submitted(false)
+  {
+    if (m_shading_path == ShadingPath::Deferred) {
+      for (size_t i = 0; i < m_gbuffer_textures.size(); i++) {
+        m_gbuffer_textures[i] = m_graph.createTexture(
+          "Broccoli.Render.GBufferTexture" + std::to_string(i),
+          {
+            .size = m_scene_size,
+            .format = R3D_GBUFFER_TEXTURE_FORMATS[i],
+            .usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding,
+          }
+        );
+      }
+    }
+  }
+  RenderFrame::~RenderFrame() {
+    submit();
+  }
+  void RenderFrame::submit() {
+    if (m_is_submitted) {
+      return;
+    }
+    m_is_submitted = true;
+    tonemap();
+
+    // The frame's GPU time is measured between timestamps written before and after its work, and its slot is released
+    // once that work is done (see 'endFrameTimer').
+    m_manager.beginFrameTimer();
+    m_graph.execute();
+    m_manager.endFrameTimer();
+  }
 }
 namespace broccoli {
   void RenderFrame::clear(glm::dvec3 cc) {
+    CHECK(!m_is_submitted, "Clear cannot be called after submit.");
     CHECK((m_state & static_cast<uint32_t>(State::CLEAR_COMPLETE)) == 0, "Clear can only be called once per-frame.");
     CHECK((m_state & static_cast<uint32_t>(State::DRAW_COMPLETE)) == 0, "Clear cannot be called after draw.");
     CHECK((m_state & static_cast<uint32_t>(State::OVERLAY_COMPLETE)) == 0, "Clear cannot be called after overlay.");
-    drawClear(cc);
+    m_graph.addRasterPass(
+      RenderGraphPassInfo {
+        .name = "Broccoli.Render.Clear",
+        .color_attachment = RenderGraphColorAttachment {
+          .texture = m_color_texture,
+          .resolve_target = sceneResolveTarget(),
+          .load_op = wgpu::LoadOp::Clear,
+          .clear_value = wgpu::Color{.r=0.0, .g=0.0, .b=0.0, .a=0.0},
+        },
+        .depth_stencil_attachment = RenderGraphDepthStencilAttachment {
+          .texture = m_depth_stencil_texture,
+          .load_op = wgpu::LoadOp::Clear,
+          .clear_value = 1.0f,
+        },
+      },
+      [] (wgpu::RenderPassEncoder &, const RenderGraph &) {}
+    );
+    // The scene is cleared to transparent black so that its alpha measures coverage, and the clear color is composited
+    // under it after tonemapping instead.
+    m_clear_color = cc;
     m_state |= static_cast<uint32_t>(State::CLEAR_COMPLETE);
   }
   void RenderFrame::draw(RenderCamera camera, std::function<void(Renderer &)> draw_cb) {
+    CHECK(!m_is_submitted, "Draw cannot be called after submit.");
     CHECK((m_state & static_cast<uint32_t>(State::DRAW_COMPLETE)) == 0, "Draw can only be called once per-frame.");
     CHECK((m_state & static_cast<uint32_t>(State::OVERLAY_COMPLETE)) == 0, "Draw cannot be called after overlay.");
-    {
-      Renderer renderer = {m_manager, m_target, camera};
-      draw_cb(renderer);
-      // allow Renderer::~Renderer to run, thereby applying all drawing.
+    RenderTarget scene_target{m_target.texture_view, m_scene_size};
+    std::shared_ptr<Renderer> renderer{new Renderer{m_manager, scene_target, camera}};
+    draw_cb(*renderer);
+    m_exposure_bias = camera.exposureBias();
+
+    // Recording is over: the materials table is unlocked, and the residency requests made while recording are acted on,
+    // still on the recording thread. The renderer only reads materials from here on (see RenderManager).
+    m_manager.unlockMaterialsTable();
+    m_manager.updateTextureStreaming();
+
+    // The scene still encodes and submits its own commands, since each mesh batch re-uploads the instance buffers
+    // between submits.
+    RenderGraphPassInfo scene_pass_info = {
+      .name = "Broccoli.Render.Scene",
+      .reads = {m_color_texture, m_depth_stencil_texture},
+      .writes = {m_color_texture, m_depth_stencil_texture},
+    };
+    if (isMultisampled()) {
+      scene_pass_info.writes.push_back(m_scene_texture);
+    }
+    if (m_shading_path == ShadingPath::Deferred) {
+      // Every G-buffer texel read by the lighting pass is written first, so the G-buffer is never cleared.
+      scene_pass_info.writes.insert(scene_pass_info.writes.end(), m_gbuffer_textures.begin(), m_gbuffer_textures.end());
     }
+    m_graph.addExternalPass(
+      std::move(scene_pass_info),
+      [this, renderer] (const RenderGraph &) {
+        renderer->render(attachments());
+      }
+    );
     m_state |= static_cast<uint32_t>(State::DRAW_COMPLETE);
   }
   void RenderFrame::overlay(std::function<void(OverlayRenderer&)> draw_cb) {
+    CHECK(!m_is_submitted, "Overlay cannot be called after submit.");
     m_overlay_bitmap.clear();
-    {
-      OverlayRenderer overlay_renderer{m_manager, m_target, m_overlay_bitmap};
-      draw_cb(overlay_renderer);
-      // allow OverlayRenderer::~OverlayRenderer to run, thereby applying all drawing.
-    }
+    std::shared_ptr<OverlayRenderer> overlay_renderer{new OverlayRenderer{m_manager, m_overlay_bitmap}};
+    draw_cb(*overlay_renderer);
+
+    // Copies cannot be recorded within a render pass, so the overlay bitmap is staged in a submission of its own:
+    m_graph.addExternalPass(
+      RenderGraphPassInfo {
+        .name = "Broccoli.Render.OverlayUpload",
+        .has_side_effects = true,
+      },
+      [overlay_renderer] (const RenderGraph &) {
+        overlay_renderer->uploadOverlayBitmap();
+      }
+    );
+
+    // The overlay is display-referred, so it is drawn straight into the target once the scene has been tonemapped.
+    tonemap();
+    m_graph.addRasterPass(
+      RenderGraphPassInfo {
+        .name = "Broccoli.Render.Overlay",
+        .color_attachment = RenderGraphColorAttachment {
+          .texture = m_target_texture,
+        },
+      },
+      [overlay_renderer] (wgpu::RenderPassEncoder &rp_encoder, const RenderGraph &) {
+        overlay_renderer->draw(rp_encoder);
+      }
+    );
     m_state |= static_cast<uint32_t>(State::OVERLAY_COMPLETE);
   }
 }
 namespace broccoli {
-  void RenderFrame::drawClear(glm::dvec3 cc) {
-    wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label = "Broccoli.Render.Clear.CommandEncoder"};
-    wgpu::CommandEncoder command_encoder = m_manager.wgpuDevice().CreateCommandEncoder(&command_encoder_descriptor);
-    wgpu::RenderPassColorAttachment rp_color_attachment = {
-      .view = m_manager.wgpuRenderTargetColorTextureView(),
-      .resolveTarget = m_target.texture_view,
-      .loadOp = wgpu::LoadOp::Clear,
-      .storeOp = wgpu::StoreOp::Store,
-      .clearValue = wgpu::Color{.r=cc.x, .g=cc.y, .b=cc.z, .a=1.0},
-    };
-    wgpu::RenderPassDepthStencilAttachment rp_depth_attachment = {
-      .view = m_manager.wgpuRenderTargetDepthStencilTextureView(),
-      .depthLoadOp = wgpu::LoadOp::Clear,
-      .depthStoreOp = wgpu::StoreOp::Store,
-      .depthClearValue = 1.0f,
+  void RenderFrame::tonemap() {
+    // A frame that was neither cleared nor drawn has no scene to tonemap, and leaves the target as it was.
+    auto scene_mask = static_cast<uint32_t>(State::CLEAR_COMPLETE) | static_cast<uint32_t>(State::DRAW_COMPLETE);
+    if (m_is_tonemapped || (m_state & scene_mask) == 0) {
+      return;
+    }
+    m_manager.addExposurePass(m_graph, m_scene_texture);
+
+    // Each post-processing pass writes straight into the target if it is the last one, or else into an LDR texture at
+    // the scene's resolution that the next pass reads.
+    bool is_fxaa_enabled = m_anti_aliasing_mode == AntiAliasingMode::Fxaa;
+    bool is_upscaled = m_scene_size != m_target.size;
+    auto create_ldr_texture = [this] (std::string name) {
+      return m_graph.createTexture(
+        std::move(name),
+        {
+          .size = m_scene_size,
+          .format = R3D_SWAPCHAIN_TEXTURE_FORMAT,
+          .usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding,
+        }
+      );
     };
-    wgpu::RenderPassDescriptor rp_descriptor = {
-      .nextInChain = nullptr,
-      .label = "Broccoli.Render.Clear.RenderPassEncoder",
-      .colorAttachmentCount = 1,
-      .colorAttachments = &rp_color_attachment,
-      .depthStencilAttachment = &rp_depth_attachment,
+    auto output_texture = m_target_texture;
+    if (is_fxaa_enabled || is_upscaled) {
+      output_texture = create_ldr_texture("Broccoli.Render.TonemappedTexture");
+    }
+    m_manager.addTonemapPass(m_graph, m_scene_texture, output_texture, m_clear_color, m_exposure_bias);
+    if (is_fxaa_enabled) {
+      auto input_texture = output_texture;
+      output_texture = is_upscaled ? create_ldr_texture("Broccoli.Render.AntiAliasedTexture") : m_target_texture;
+      m_manager.addFxaaPass(m_graph, input_texture, output_texture);
+    }
+    if (is_upscaled) {
+      m_manager.addUpscalePass(m_graph, output_texture, m_target_texture);
+    }
+    m_is_tonemapped = true;
+  }
+  uint32_t RenderFrame::sceneSampleCount() const {
+    // Deferred shading always draws the scene at one sample per pixel.
+    return m_shading_path == ShadingPath::Deferred ? 1 : m_manager.sceneSampleCount();
+  }
+  bool RenderFrame::isMultisampled() const {
+    return m_color_texture.value != m_scene_texture.value;
+  }
+  std::optional<RenderGraphTexture> RenderFrame::sceneResolveTarget() const {
+    if (isMultisampled()) {
+      return m_scene_texture;
+    } else {
+      return std::nullopt;
+    }
+  }
+  RenderAttachments RenderFrame::attachments() const {
+    RenderAttachments attachments = {
+      .color_texture_view = m_graph.textureView(m_color_texture),
+      .resolve_texture_view = isMultisampled() ? m_graph.textureView(m_scene_texture) : wgpu::TextureView{},
+      .depth_stencil_texture_view = m_graph.textureView(m_depth_stencil_texture),
+      .sample_count = isMultisampled() ? R3D_MSAA_SAMPLE_COUNT : 1,
+      .shading_path = m_shading_path,
+      .gbuffer_texture_views = {},
     };
-    wgpu::RenderPassEncoder rp = command_encoder.BeginRenderPass(&rp_descriptor);
-    rp.End();
-    wgpu::CommandBuffer command_buffer = command_encoder.Finish();
-    m_manager.wgpuDevice().GetQueue().Submit(1, &command_buffer);
+    if (m_shading_path == ShadingPath::Deferred) {
+      for (size_t i = 0; i < m_gbuffer_textures.size(); i++) {
+        attachments.gbuffer_texture_views[i] = m_graph.textureView(m_gbuffer_textures[i]);
+      }
+    }
+    return attachments;
   }
 }
 
@@ -1689,34 +5509,27 @@ namespace broccoli {
 //
 
 namespace broccoli {
-  OverlayRenderer::OverlayRenderer(RenderManager &manager, RenderTarget &target, Bitmap &bitmap)
+  OverlayRenderer::OverlayRenderer(RenderManager &manager, Bitmap &bitmap)
   : m_manager(manager),
-    m_target(target),
     m_bitmap(bitmap),
     m_texture_draw_requests()
   {
-    initAllShadowMapViewResources();
-  }
-  OverlayRenderer::~OverlayRenderer() {
-    // NOTE: requests to draw a texture from the GPU directly are processed AFTER drawing the bitmap overlay.
-    // It is the user's responsibility to ensure anything in the bitmap obscured by a texture overlay can be safely 
-    // ignored.
-    drawOverlayBitmap();
-    drawOverlayTextures();
+    initAllShadowMapViewResources();
   }
 }
 namespace broccoli {
   void OverlayRenderer::initAllShadowMapViewResources() {
     for (uint32_t i_light_type = 0; i_light_type < static_cast<uint32_t>(LightType::Metadata_Count); i_light_type++) {
       LightType light_type = static_cast<LightType>(i_light_type);
-      size_t capacity = 1 << (r3d_light_capacity_lg2(light_type) + r3d_shadow_cascade_map_count_lg2(light_type));
+      const RenderShadowMaps &shadow_maps = m_manager.getShadowMaps(light_type);
+      size_t capacity = shadow_maps.lightCount() * shadow_maps.cascadesPerLight();
       m_shadow_map_view_resources[light_type].reserve(capacity);
-      for (int32_t i_light = 0; i_light < r3d_light_capacity(light_type); i_light++) {
-        for (int32_t i_cascade = 0; i_cascade < r3d_shadow_cascade_map_count(light_type); i_cascade++) {
+      for (int32_t i_light = 0; i_light < shadow_maps.lightCount(); i_light++) {
+        for (int32_t i_cascade = 0; i_cascade < shadow_maps.cascadesPerLight(); i_cascade++) {
           wgpu::SamplerDescriptor sampler_desc = {
             .label = "Broccoli.Render.Overlay.ShadowViz.Sampler",
           };
-          const wgpu::TextureView &view = m_manager.getShadowMaps(light_type).getReadView(i_light, i_cascade);
+          const wgpu::TextureView &view = shadow_maps.getReadView(i_light, i_cascade);
           wgpu::Sampler sampler = m_manager.wgpuDevice().CreateSampler(&sampler_desc);
           auto bind_group_entries = std::to_array({
             wgpu::BindGroupEntry{.binding=0, .textureView=view},
@@ -1758,30 +5571,33 @@ namespace broccoli {
   }
 }
 namespace broccoli {
-  void OverlayRenderer::drawOverlayBitmap() const {
-    // copy overlay bitmap to texture
-    {
-      wgpu::ImageCopyTexture dst_desc = {
-        .texture = m_manager.wgpuOverlayTexture(),
-        .origin = wgpu::Origin3D{},
-      };
-      wgpu::TextureDataLayout dst_data_layout = {
-        .bytesPerRow = static_cast<uint32_t>(m_bitmap.pitch()),
-        .rowsPerImage = static_cast<uint32_t>(m_bitmap.rows()),
-      };
-      wgpu::Extent3D write_size = {
-        .width = static_cast<uint32_t>(m_bitmap.dim().x),
-        .height = static_cast<uint32_t>(m_bitmap.dim().y),
-      };
-      m_manager.wgpuDevice().GetQueue().WriteTexture(
-        &dst_desc,
-        m_bitmap.data(),
-        m_bitmap.dataSize(),
-        &dst_data_layout,
-        &write_size
-      );
-    }
-
+  void OverlayRenderer::draw(wgpu::RenderPassEncoder &rp_encoder) const {
+    // NOTE: requests to draw a texture from the GPU directly are processed AFTER drawing the bitmap overlay.
+    // It is the user's responsibility to ensure anything in the bitmap obscured by a texture overlay can be safely 
+    // ignored.
+    drawOverlayBitmap(rp_encoder);
+    drawOverlayTextures(rp_encoder);
+  }
+  void OverlayRenderer::uploadOverlayBitmap() const {
+    wgpu::ImageCopyTexture dst_desc = {
+      .texture = m_manager.wgpuOverlayTexture(),
+      .origin = wgpu::Origin3D{},
+    };
+    wgpu::TextureDataLayout dst_data_layout = {
+      .bytesPerRow = static_cast<uint32_t>(m_bitmap.pitch()),
+      .rowsPerImage = static_cast<uint32_t>(m_bitmap.rows()),
+    };
+    wgpu::Extent3D write_size = {
+      .width = static_cast<uint32_t>(m_bitmap.dim().x),
+      .height = static_cast<uint32_t>(m_bitmap.dim().y),
+    };
+    auto &staging_belt = m_manager.stagingBelt();
+    wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.Overlay.Upload.CommandEncoder"};
+    wgpu::CommandEncoder command_encoder = m_manager.wgpuDevice().CreateCommandEncoder(&command_encoder_descriptor);
+    staging_belt.writeTexture(command_encoder, dst_desc, m_bitmap.data(), dst_data_layout, write_size, static_cast<uint32_t>(m_bitmap.pitch() / m_bitmap.dim().x));
+    staging_belt.submit(command_encoder);
+  }
+  void OverlayRenderer::drawOverlayBitmap(wgpu::RenderPassEncoder &rp_encoder) const {
     // write screen size into uniform buffer:
     {
       OverlayUniform overlay_uniform_buffer = {
@@ -1799,87 +5615,44 @@ namespace broccoli {
 
     // draw overlay texture using a loaded render pipeline
     {
-      wgpu::CommandEncoderDescriptor ce_desc = {
-        .label = "Broccoli.Render.Overlay.CommandEncoder",
-      };
-      wgpu::CommandEncoder command_encoder = m_manager.wgpuDevice().CreateCommandEncoder(&ce_desc);
-      
-      wgpu::RenderPassColorAttachment rp_color_attachment = {
-        .view = m_manager.wgpuRenderTargetColorTextureView(),
-        .resolveTarget = m_target.texture_view,
-        .loadOp = wgpu::LoadOp::Load,
-        .storeOp = wgpu::StoreOp::Store,
-      };
-      wgpu::RenderPassDescriptor rp_desc = {
-        .label = "Broccoli.Render.Overlay.RenderPass",
-        .colorAttachmentCount = 1,
-        .colorAttachments = &rp_color_attachment,
-      };
-      wgpu::RenderPassEncoder rp_encoder = command_encoder.BeginRenderPass(&rp_desc);
-      {
-        rp_encoder.SetPipeline(m_manager.getOverlayRenderPipeline(4).pipeline);
-        rp_encoder.SetVertexBuffer(0, m_manager.wgpuOverlayVertexBuffer());
-        m_manager.getOverlayRenderPipeline(4).setBindGroups(rp_encoder, std::to_array({m_manager.wgpuOverlayBindGroup1()}));
-        rp_encoder.Draw(6);
-      }
-      rp_encoder.End();
-      wgpu::CommandBuffer command_buffer = command_encoder.Finish();
-      m_manager.wgpuDevice().GetQueue().Submit(1, &command_buffer);
+      rp_encoder.SetPipeline(m_manager.getOverlayRenderPipeline(4).pipeline);
+      rp_encoder.SetVertexBuffer(0, m_manager.wgpuOverlayVertexBuffer());
+      m_manager.getOverlayRenderPipeline(4).setBindGroups(rp_encoder, std::to_array({m_manager.wgpuOverlayBindGroup1()}));
+      rp_encoder.Draw(6);
     }
   }
-  void OverlayRenderer::drawOverlayTextures() const {
+  void OverlayRenderer::drawOverlayTextures(wgpu::RenderPassEncoder &rp_encoder) const {
     for (const auto &request: m_texture_draw_requests) {
       switch (request.type) {
         case OverlayTextureDrawRequestType::ShadowMap: {
           const auto &more = request.more.shadow_map;
-          drawShadowMapOverlayTexture(request.viewport_center, request.viewport_size, more.light_type, more.light_idx, more.cascade_idx);
+          drawShadowMapOverlayTexture(rp_encoder, request.viewport_center, request.viewport_size, more.light_type, more.light_idx, more.cascade_idx);
         }
       }
     }
   }
-  void OverlayRenderer::drawShadowMapOverlayTexture(glm::i32vec2 vp_center, glm::i32vec2 vp_size, LightType light_type, int32_t light_idx, int32_t cascade_idx) const {
+  void OverlayRenderer::drawShadowMapOverlayTexture(wgpu::RenderPassEncoder &rp_encoder, glm::i32vec2 vp_center, glm::i32vec2 vp_size, LightType light_type, int32_t light_idx, int32_t cascade_idx) const {
     helpDrawOverlayTexture(
+      rp_encoder,
       vp_center,
       vp_size,
       1,
       [this, light_type, light_idx, cascade_idx] (wgpu::RenderPassEncoder &encoder, const OverlayRenderPipeline &rp) {
-        const size_t offset = (light_idx << r3d_light_capacity_lg2(light_type)) + cascade_idx;
+        const size_t offset = light_idx * m_manager.getShadowMaps(light_type).cascadesPerLight() + cascade_idx;
         const WgpuShadowMapTextureOverlayResource &res = m_shadow_map_view_resources[light_type][offset];
         rp.setBindGroups(encoder, std::to_array({res.bind_group}));
       }
     );
   }
-  void OverlayRenderer::helpDrawOverlayTexture(glm::i32vec2 vp_center, glm::i32vec2 vp_size, uint32_t sample_mode_id, std::function<void(wgpu::RenderPassEncoder&, OverlayRenderPipeline const&)> cb) const {
-    wgpu::CommandEncoderDescriptor ce_desc = {
-      .label = "Broccoli.Render.Overlay.CommandEncoder",
-    };
-    wgpu::CommandEncoder command_encoder = m_manager.wgpuDevice().CreateCommandEncoder(&ce_desc);
-    
-    wgpu::RenderPassColorAttachment rp_color_attachment = {
-      .view = m_manager.wgpuRenderTargetColorTextureView(),
-      .resolveTarget = m_target.texture_view,
-      .loadOp = wgpu::LoadOp::Load,
-      .storeOp = wgpu::StoreOp::Store,
-    };
-    wgpu::RenderPassDescriptor rp_desc = {
-      .label = "Broccoli.Render.Overlay.RenderPass",
-      .colorAttachmentCount = 1,
-      .colorAttachments = &rp_color_attachment,
-    };
-    wgpu::RenderPassEncoder rp_encoder = command_encoder.BeginRenderPass(&rp_desc);
-    {
-      const OverlayRenderPipeline &rp = m_manager.getOverlayRenderPipeline(sample_mode_id);
-      glm::i32vec2 min_vp_xy = vp_center - vp_size / 2;
-      rp_encoder.SetViewport(min_vp_xy.x, min_vp_xy.y, vp_size.x, vp_size.y, 0.0, 1.0);
-      rp_encoder.SetPipeline(rp.pipeline);
-      rp_encoder.SetVertexBuffer(0, m_manager.wgpuOverlayVertexBuffer());
-      cb(rp_encoder, rp);
-      rp_encoder.Draw(6);
-    }
-    rp_encoder.End();
-    wgpu::CommandBuffer command_buffer = command_encoder.Finish();
-
-    m_manager.wgpuDevice().GetQueue().Submit(1, &command_buffer);
+  void OverlayRenderer::helpDrawOverlayTexture(wgpu::RenderPassEncoder &rp_encoder, glm::i32vec2 vp_center, glm::i32vec2 vp_size, uint32_t sample_mode_id, std::function<void(wgpu::RenderPassEncoder&, OverlayRenderPipeline const&)> cb) const {
+    // Every overlay texture shares the overlay's render pass, so each sets its own viewport.
+    const OverlayRenderPipeline &rp = m_manager.getOverlayRenderPipeline(sample_mode_id);
+    glm::i32vec2 min_vp_xy = vp_center - vp_size / 2;
+    rp_encoder.SetViewport(min_vp_xy.x, min_vp_xy.y, vp_size.x, vp_size.y, 0.0, 1.0);
+    rp_encoder.SetPipeline(rp.pipeline);
+    rp_encoder.SetVertexBuffer(0, m_manager.wgpuOverlayVertexBuffer());
+    cb(rp_encoder, rp);
+    rp_encoder.Draw(6);
   }
 }
 
@@ -1892,6 +5665,7 @@ namespace broccoli {
   : m_manager(manager),
     m_target(target),
     m_camera(camera),
+    m_attachments(),
     m_mesh_instance_lists(),
     m_directional_light_vec(),
     m_point_light_vec()
@@ -1901,12 +5675,23 @@ namespace broccoli {
     m_point_light_vec.reserve(R3D_POINT_LIGHT_CAPACITY);
     m_mesh_instance_lists.resize(manager.materials().size());
   }
-  Renderer::~Renderer() {
-    sendCameraData(m_camera, m_target);
-    sendLightData(m_directional_light_vec, m_point_light_vec);
+  void Renderer::render(RenderAttachments attachments) {
+    m_attachments = std::move(attachments);
+    {
+      // The camera and lights are staged in the same submission that clusters them:
+      wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.LightCluster.CommandEncoder"};
+      wgpu::CommandEncoder command_encoder = m_manager.wgpuDevice().CreateCommandEncoder(&command_encoder_descriptor);
+      sendCameraData(command_encoder, m_camera, m_target);
+      sendLightData(command_encoder, m_target, m_directional_light_vec, m_point_light_vec);
+      buildLightClusters(command_encoder);
+      m_manager.stagingBelt().submit(command_encoder);
+    }
     drawShadowMaps(m_camera, m_target, m_directional_light_vec, m_mesh_instance_lists);
     drawMeshInstanceListVec(std::move(m_mesh_instance_lists));
-    m_manager.unlockMaterialsTable();
+    if (m_attachments.shading_path == ShadingPath::Deferred) {
+      drawDeferredLighting();
+    }
+    m_manager.getVirtualShadowMap().requestPageReadback(m_manager.wgpuDevice());
   }
 }
 namespace broccoli {
@@ -1921,7 +5706,14 @@ namespace broccoli {
     addMesh(material_id, std::move(geometry), std::move(transforms));
   }
   void Renderer::addMesh(Material material_id, const Geometry &geometry, std::vector<glm::mat4x4> transforms) {
-    MeshInstanceList mil = {geometry, std::move(transforms)};
+    // Absent an explicit proxy, the material's shadow proxy takes precedence over the geometry's own.
+    const Geometry *material_shadow_proxy = m_manager.getMaterialInfo(material_id).shadowProxy();
+    const Geometry &shadow_mesh = material_shadow_proxy ? *material_shadow_proxy : geometry.shadowGeometry();
+    addMesh(material_id, geometry, shadow_mesh, std::move(transforms));
+  }
+  void Renderer::addMesh(Material material_id, const Geometry &geometry, const Geometry &shadow_proxy, std::vector<glm::mat4x4> transforms) {
+    requestMaterialTextureResolution(material_id, transforms);
+    MeshInstanceList mil = {geometry, shadow_proxy, std::move(transforms)};
     m_mesh_instance_lists[material_id.value].emplace_back(std::move(mil));
   }
   void Renderer::addDirectionalLight(glm::vec3 direction, float intensity, glm::vec3 color) {
@@ -1931,13 +5723,43 @@ namespace broccoli {
     m_directional_light_vec.emplace_back(directional_list);
   }
   void Renderer::addPointLight(glm::vec3 position, float intensity, glm::vec3 color) {
+    // By default, a light's range ends where its inverse-square falloff drops below 1/256 of its intensity.
+    addPointLight(position, intensity, color, 16.0f * std::sqrt(intensity));
+  }
+  void Renderer::addPointLight(glm::vec3 position, float intensity, glm::vec3 color, float range) {
+    CHECK(range > 0.0f, "Expected a positive point light range");
     color = glm::normalize(color) * intensity;
-    PointLight point_light{position, color};
+    PointLight point_light{position, color, range};
     m_point_light_vec.emplace_back(point_light);
   }
 }
 namespace broccoli {
-  void Renderer::sendCameraData(RenderCamera camera, RenderTarget target) {
+  void Renderer::requestTextureResolution(StreamedTexture texture, glm::vec3 world_center, float world_radius) {
+    // The projected diameter of a bounding sphere, in pixels, is the on-screen extent a texture mapped onto it needs.
+    const float fovy_rad = (m_camera.fovyDeg() / 360.0f) * (2.0f * static_cast<float>(M_PI));
+    const float distance = glm::max(glm::length(world_center - m_camera.position()), world_radius);
+    const double screen_extent = m_target.size.y * world_radius / (distance * glm::tan(0.5f * fovy_rad));
+    m_manager.textureStreamer().request(texture, screen_extent);
+  }
+  void Renderer::requestMaterialTextureResolution(Material material, std::span<const glm::mat4x4> transforms) {
+    // Absent mesh bounds, each instance is taken to fill a unit sphere scaled by its transform: pass tighter bounds to 
+    // 'requestTextureResolution' directly where they are known.
+    for (const auto &streamed_texture: m_manager.getMaterialInfo(material).streamedTextures()) {
+      if (!streamed_texture.has_value()) {
+        continue;
+      }
+      for (const auto &transform: transforms) {
+        float scale = glm::max(
+          glm::length(glm::vec3{transform[0]}), 
+          glm::max(glm::length(glm::vec3{transform[1]}), glm::length(glm::vec3{transform[2]}))
+        );
+        requestTextureResolution(streamed_texture.value(), glm::vec3{transform[3]}, scale);
+      }
+    }
+  }
+}
+namespace broccoli {
+  void Renderer::sendCameraData(wgpu::CommandEncoder &command_encoder, RenderCamera camera, RenderTarget target) {
     const float fovy_rad = (camera.fovyDeg() / 360.0f) * (2.0f * static_cast<float>(M_PI));
     const float aspect = target.size.x / static_cast<float>(target.size.y);
     const CameraUniform buf = {
@@ -1945,15 +5767,16 @@ namespace broccoli {
       .world_position = glm::vec4{camera.position(), 1.0f},
       .camera_cot_half_fovy = 1.0f / std::tanf(fovy_rad / 2.0f),
       .camera_aspect_inv = 1.0f / aspect,
-      .camera_zmin = 000.050f,
-      .camera_zmax = 100.000f,
-      .camera_logarithmic_z_scale = 1.0,
+      .camera_zmin = R3D_CAMERA_ZMIN,
+      .camera_zmax = R3D_CAMERA_ZMAX,
+      .camera_logarithmic_z_scale = R3D_CAMERA_LOGARITHMIC_Z_SCALE,
       .hdr_exposure_bias = camera.exposureBias(),
     };
-    auto queue = m_manager.wgpuDevice().GetQueue();
-    queue.WriteBuffer(m_manager.wgpuCameraUniformBuffer(), 0, &buf, sizeof(CameraUniform));
+    m_manager.stagingBelt().writeBuffer(command_encoder, m_manager.wgpuCameraUniformBuffer(), 0, &buf, sizeof(CameraUniform));
   }
   void Renderer::sendLightData(
+    wgpu::CommandEncoder &command_encoder,
+    RenderTarget target,
     std::vector<DirectionalLight> const &directional_light_vec, 
     std::vector<PointLight> const &point_light_vec
   ) {
@@ -1970,14 +5793,177 @@ namespace broccoli {
       buf.directional_light_color_array[i] = glm::vec4{directional_light_vec[i].color, 0.0f};
       buf.directional_light_dir_array[i] = glm::vec4{directional_light_vec[i].direction, 0.0f};
     }
-    for (size_t i = 0; i < point_light_vec.size(); i++) {
-      buf.point_light_color_array[i] = glm::vec4{point_light_vec[i].color, 0.0f};
-      buf.point_light_pos_array[i] = glm::vec4{point_light_vec[i].position, 0.0f};
+    auto &staging_belt = m_manager.stagingBelt();
+    staging_belt.writeBuffer(command_encoder, m_manager.wgpuLightUniformBuffer(), 0, &buf, sizeof(LightUniform));
+
+    // Uploading point lights for clustering:
+    std::vector<PointLightData> point_light_data;
+    point_light_data.reserve(point_light_vec.size());
+    for (const auto &point_light: point_light_vec) {
+      point_light_data.push_back(PointLightData {
+        .position_range = glm::vec4{point_light.position, point_light.range},
+        .color = glm::vec4{point_light.color, 0.0f},
+      });
     }
-    auto queue = m_manager.wgpuDevice().GetQueue();
-    queue.WriteBuffer(m_manager.wgpuLightUniformBuffer(), 0, &buf, sizeof(LightUniform));
+    staging_belt.writeBuffer(
+      command_encoder, m_manager.wgpuPointLightStorageBuffer(), 0, 
+      point_light_data.data(), point_light_data.size() * sizeof(PointLightData)
+    );
+    const ClusterUniform cluster_buf = {
+      .screen_size = glm::fvec2{target.size},
+      .point_light_count = static_cast<uint32_t>(point_light_vec.size()),
+    };
+    staging_belt.writeBuffer(command_encoder, m_manager.wgpuClusterUniformBuffer(), 0, &cluster_buf, sizeof(ClusterUniform));
+  }
+  void Renderer::buildLightClusters(wgpu::CommandEncoder &command_encoder) {
+    const auto &compute_pipeline = m_manager.getLightClusterComputePipeline();
+    const glm::u32vec3 grid_size = m_manager.lightClusterGridSize();
+
+    // Each workgroup builds one row of clusters; see 'light_cluster.wgsl'.
+    wgpu::ComputePassDescriptor compute_pass_descriptor = {.label="Broccoli.Render.LightCluster.ComputePass"};
+    wgpu::ComputePassEncoder cp_encoder = command_encoder.BeginComputePass(&compute_pass_descriptor);
+    cp_encoder.SetPipeline(compute_pipeline.pipeline);
+    cp_encoder.SetBindGroup(0, m_manager.wgpuLightClusterBindGroup());
+    cp_encoder.DispatchWorkgroups(1, grid_size.y, grid_size.z);
+    cp_encoder.End();
   }
   void Renderer::drawShadowMaps(RenderCamera camera, RenderTarget target, std::vector<DirectionalLight> const &light_vec, const std::vector<std::vector<MeshInstanceList>> &mesh_instance_lists) {
+    switch (m_manager.dirLightShadowTechnique()) {
+      case ShadowTechnique::CascadedShadowMap: {
+        m_manager.getVirtualShadowMap().disable(m_manager.wgpuDevice().GetQueue());
+        drawCascadedShadowMaps(camera, target, light_vec, mesh_instance_lists);
+      } break;
+      case ShadowTechnique::VirtualShadowMap: {
+        sendCascadeData({}, false);
+        drawVirtualShadowMap(camera, light_vec, mesh_instance_lists);
+      } break;
+      default: {
+        PANIC("unknown/invalid shadow technique");
+      }
+    }
+  }
+  void Renderer::drawVirtualShadowMap(RenderCamera camera, std::vector<DirectionalLight> const &light_vec, const std::vector<std::vector<MeshInstanceList>> &mesh_instance_lists) {
+    auto &vsm = m_manager.getVirtualShadowMap();
+    auto queue = m_manager.wgpuDevice().GetQueue();
+    if (light_vec.empty()) {
+      vsm.disable(queue);
+      return;
+    }
+
+    // Every caster's world-space bounds are passed to the virtual shadow map, which re-renders the cached pages of 
+    // casters that changed since the last frame.
+    std::vector<const MeshInstanceList*> caster_lists;
+    std::vector<RenderVirtualShadowMap::CasterBounds> caster_bounds;
+    for (size_t material_idx = 0; material_idx < mesh_instance_lists.size(); material_idx++) {
+      Material material{material_idx};
+      if (m_manager.getMaterialInfo(material).isShadowCasting()) {
+        for (auto const &mesh_instance_list: mesh_instance_lists[material_idx]) {
+          if (!mesh_instance_list.instance_list.empty()) {
+            caster_lists.push_back(&mesh_instance_list);
+          }
+          const auto &mesh = mesh_instance_list.shadow_mesh;
+          for (const auto &transform: mesh_instance_list.instance_list) {
+            auto bounds_min = glm::vec3{std::numeric_limits<float>::max()};
+            auto bounds_max = glm::vec3{std::numeric_limits<float>::lowest()};
+            for (int32_t corner_idx = 0; corner_idx < 8; corner_idx++) {
+              glm::vec4 corner = {
+                (corner_idx & 1) ? mesh.bounds_max.x : mesh.bounds_min.x,
+                (corner_idx & 2) ? mesh.bounds_max.y : mesh.bounds_min.y,
+                (corner_idx & 4) ? mesh.bounds_max.z : mesh.bounds_min.z,
+                1.0f
+              };
+              auto world_corner = glm::vec3{transform * corner};
+              bounds_min = glm::min(bounds_min, world_corner);
+              bounds_max = glm::max(bounds_max, world_corner);
+            }
+            caster_bounds.push_back({bounds_min, bounds_max});
+          }
+        }
+      }
+    }
+
+    // Only the first directional light gets a virtual shadow map. Its page table and transforms are staged into the
+    // same submit that draws its dirty pages.
+    wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.VirtualShadowMap.CommandEncoder"};
+    wgpu::CommandEncoder command_encoder = m_manager.wgpuDevice().CreateCommandEncoder(&command_encoder_descriptor);
+    glm::dmat3 light_view_matrix_m3 = glm::inverse(computeDirLightTransform(light_vec[0].direction));
+    auto dirty_pages = vsm.beginFrame(
+      command_encoder, 
+      m_manager.stagingBelt(), 
+      light_view_matrix_m3, 
+      glm::dvec3{camera.position()}, 
+      std::move(caster_bounds)
+    );
+    if (dirty_pages.empty()) {
+      m_manager.stagingBelt().submit(command_encoder);
+      return;
+    }
+
+    // Caster transforms are packed into batches of up to R3D_INSTANCE_CAPACITY, and each list is drawn from its offset
+    // within the batch via 'firstInstance'. Every batch is uploaded once, then drawn into each dirty page with a single
+    // render pass per page, all within one submit. The first batch clears each page.
+    struct CasterDraw {
+      const MeshInstanceList *mesh_instance_list;
+      uint32_t first_instance;
+      uint32_t instance_count;
+    };
+    struct CasterBatch {
+      std::vector<glm::mat4x4> transforms;
+      std::vector<CasterDraw> draws;
+    };
+    std::vector<CasterBatch> caster_batches(1);
+    for (auto mesh_instance_list: caster_lists) {
+      const auto &transform_list = mesh_instance_list->instance_list;
+      for (size_t offset = 0; offset < transform_list.size(); ) {
+        if (caster_batches.back().transforms.size() == R3D_INSTANCE_CAPACITY) {
+          caster_batches.emplace_back();
+        }
+        auto &batch = caster_batches.back();
+        size_t count = std::min<size_t>(R3D_INSTANCE_CAPACITY - batch.transforms.size(), transform_list.size() - offset);
+        batch.draws.push_back(CasterDraw {
+          .mesh_instance_list = mesh_instance_list,
+          .first_instance = static_cast<uint32_t>(batch.transforms.size()),
+          .instance_count = static_cast<uint32_t>(count),
+        });
+        batch.transforms.insert(batch.transforms.end(), transform_list.begin() + offset, transform_list.begin() + offset + count);
+        offset += count;
+      }
+    }
+
+    const auto &render_pipeline = m_manager.getShadowRenderPipeline();
+    for (size_t batch_idx = 0; batch_idx < caster_batches.size(); batch_idx++) {
+      const auto &batch = caster_batches[batch_idx];
+      auto uniform_buffer_size = batch.transforms.size() * sizeof(glm::mat4x4);
+      m_manager.stagingBelt().writeBuffer(command_encoder, m_manager.wgpuTransformUniformBuffer(), 0, batch.transforms.data(), uniform_buffer_size);
+      for (auto physical_page_idx: dirty_pages) {
+        auto render_pass_depth_stencil_attachment = wgpu::RenderPassDepthStencilAttachment {
+          .view = vsm.getPageWriteView(physical_page_idx),
+          .depthLoadOp = batch_idx == 0 ? wgpu::LoadOp::Clear : wgpu::LoadOp::Load,
+          .depthStoreOp = wgpu::StoreOp::Store,
+          .depthClearValue = 1.0,
+        };
+        auto render_pass_encoder_descriptor = wgpu::RenderPassDescriptor {
+          .label = "Broccoli.Render.VirtualShadowMap.RenderPass",
+          .colorAttachmentCount = 0,
+          .depthStencilAttachment = &render_pass_depth_stencil_attachment,
+        };
+        wgpu::RenderPassEncoder rp_encoder = command_encoder.BeginRenderPass(&render_pass_encoder_descriptor);
+        if (!batch.draws.empty()) {
+          rp_encoder.SetPipeline(render_pipeline.pipeline);
+          render_pipeline.setBindGroups(rp_encoder, std::to_array({vsm.getPageUbo(physical_page_idx).bind_group}));
+        }
+        for (const auto &draw: batch.draws) {
+          const auto &mesh = draw.mesh_instance_list->shadow_mesh;
+          rp_encoder.SetIndexBuffer(mesh.idx_buffer, wgpu::IndexFormat::Uint32);
+          rp_encoder.SetVertexBuffer(0, mesh.vtx_buffer);
+          rp_encoder.DrawIndexed(mesh.idx_count, draw.instance_count, 0, 0, draw.first_instance);
+        }
+        rp_encoder.End();
+      }
+    }
+    m_manager.stagingBelt().submit(command_encoder);
+  }
+  void Renderer::drawCascadedShadowMaps(RenderCamera camera, RenderTarget target, std::vector<DirectionalLight> const &light_vec, const std::vector<std::vector<MeshInstanceList>> &mesh_instance_lists) {
     // Resources on cascaded shadow maps:
     // - https://ogldev.org/www/tutorial49/tutorial49.html
     // - https://www.youtube.com/watch?v=u0pk1LyLKYQ
@@ -1986,7 +5972,12 @@ namespace broccoli {
     CHECK(glm::abs(camera_position_v4.w - 1.0) <= 1e-9, "Invalid camera transform matrix");
     glm::dvec4 camera_position = camera_position_v4;
 
-    for (int32_t light_idx = 0; light_idx < light_vec.size(); light_idx++) {
+    // Lights past the shadowed light count are drawn unshadowed.
+    const RenderShadowMaps &shadow_maps = m_manager.getShadowMaps(LightType::Directional);
+    int32_t light_count = std::min<int32_t>(static_cast<int32_t>(light_vec.size()), shadow_maps.lightCount());
+    std::vector<glm::mat4x4> proj_view_matrices;
+    proj_view_matrices.reserve(light_count * shadow_maps.cascadesPerLight());
+    for (int32_t light_idx = 0; light_idx < light_count; light_idx++) {
       const auto &light = light_vec[light_idx];
 
       glm::dmat3 light_transform_matrix_m3 = computeDirLightTransform(light.direction);
@@ -2004,34 +5995,76 @@ namespace broccoli {
       // In past renderers, I have used a large uniform buffer containing all transform matrices coupled with a layer of
       // indirection and dynamic offsets to circumvent this.
       // Consider a similar solution.
-      for (int32_t i = 0; i < R3D_DIR_LIGHT_SHADOW_CASCADE_COUNT; i++) {
-        glm::dmat4x4 cascade_projection_matrix = computeDirLightCascadeProjectionMatrix(camera, target, light_view_matrix, i);
+      for (int32_t i = 0; i < shadow_maps.cascadesPerLight(); i++) {
+        glm::dmat4x4 cascade_projection_matrix = computeDirLightCascadeProjectionMatrix(m_manager.shadowSettings(), camera, target, light_view_matrix, i);
         glm::dmat4x4 proj_view_matrix = cascade_projection_matrix * light_view_matrix;
-        const RenderShadowMaps &shadow_maps = m_manager.getShadowMaps(LightType::Directional);
         drawShadowMap(proj_view_matrix, shadow_maps, light_idx, i, mesh_instance_lists);
+        proj_view_matrices.push_back(glm::mat4x4{proj_view_matrix});
       }
     }
+    sendCascadeData(proj_view_matrices, true);
+  }
+  void Renderer::sendCascadeData(std::span<const glm::mat4x4> proj_view_matrices, bool is_enabled) {
+    const RenderShadowMaps &shadow_maps = m_manager.getShadowMaps(LightType::Directional);
+    CascadeUniform buf = {
+      .proj_view_matrices = {},
+      .cascade_max_distances = {},
+      .cascade_count = static_cast<uint32_t>(shadow_maps.cascadesPerLight()),
+      .representation = static_cast<uint32_t>(shadow_maps.representation()),
+      .depth_bias = R3D_CSM_DEPTH_BIAS,
+      .is_enabled = is_enabled ? 1U : 0U,
+      .evsm_exponents = glm::fvec2{R3D_CSM_EVSM_POSITIVE_EXPONENT, R3D_CSM_EVSM_NEGATIVE_EXPONENT},
+      .evsm_light_bleed_reduction = R3D_CSM_EVSM_LIGHT_BLEED_REDUCTION,
+      .light_count = static_cast<uint32_t>(shadow_maps.lightCount()),
+    };
+    CHECK(proj_view_matrices.size() <= buf.proj_view_matrices.size(), "Cascade overflow");
+    std::copy(proj_view_matrices.begin(), proj_view_matrices.end(), buf.proj_view_matrices.begin());
+    for (int32_t i = 0; i < shadow_maps.cascadesPerLight(); i++) {
+      double max_distance = maxDirLightCascadeDistance(m_manager.shadowSettings(), i);
+      buf.cascade_max_distances[i] = glm::vec4{static_cast<float>(max_distance), 0.0f, 0.0f, 0.0f};
+    }
+    auto queue = m_manager.wgpuDevice().GetQueue();
+    queue.WriteBuffer(m_manager.wgpuCascadeUniformBuffer(), 0, &buf, sizeof(CascadeUniform));
   }
   void Renderer::drawShadowMap(glm::mat4x4 proj_view_matrix, const RenderShadowMaps &shadow_maps, int32_t light_idx, int32_t cascade_idx, const std::vector<std::vector<MeshInstanceList>> &mesh_instance_list_vec) {
     const wgpu::Queue queue = m_manager.wgpuDevice().GetQueue();
     clearShadowMap(shadow_maps, light_idx, cascade_idx);
     drawShadowMapMeshInstanceListVec(proj_view_matrix, shadow_maps, light_idx, cascade_idx, mesh_instance_list_vec);
+    if (shadow_maps.representation() == ShadowMapRepresentation::Moments) {
+      blurShadowMap(shadow_maps, light_idx, cascade_idx);
+    }
   }
   void Renderer::clearShadowMap(const RenderShadowMaps &shadow_maps, int32_t light_idx, int32_t cascade_idx) {
     const auto &view = shadow_maps.getWriteView(light_idx, cascade_idx);
+    bool is_moments = shadow_maps.representation() == ShadowMapRepresentation::Moments;
     auto queue = m_manager.wgpuDevice().GetQueue();
     
     wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.ShadowMap.CommandEncoder"};
     wgpu::CommandEncoder command_encoder = m_manager.wgpuDevice().CreateCommandEncoder(&command_encoder_descriptor);
     auto render_pass_depth_stencil_attachment = wgpu::RenderPassDepthStencilAttachment {
-      .view = view,
+      .view = is_moments ? shadow_maps.getDepthScratchView() : view,
       .depthLoadOp = wgpu::LoadOp::Clear,
       .depthStoreOp = wgpu::StoreOp::Store,
       .depthClearValue = 1.0,
     };
+    // Moments are cleared to the warped moments of the far plane (depth 1, i.e. warped depth +1).
+    double max_positive_moment = std::exp(R3D_CSM_EVSM_POSITIVE_EXPONENT);
+    double max_negative_moment = -std::exp(-R3D_CSM_EVSM_NEGATIVE_EXPONENT);
+    auto render_pass_color_attachment = wgpu::RenderPassColorAttachment {
+      .view = view,
+      .loadOp = wgpu::LoadOp::Clear,
+      .storeOp = wgpu::StoreOp::Store,
+      .clearValue = wgpu::Color {
+        .r = max_positive_moment,
+        .g = max_positive_moment * max_positive_moment,
+        .b = max_negative_moment,
+        .a = max_negative_moment * max_negative_moment,
+      },
+    };
     auto render_pass_encoder_descriptor = wgpu::RenderPassDescriptor {
       .label = "Broccoli.Render.ShadowMap.RenderPass",
-      .colorAttachmentCount = 0,
+      .colorAttachmentCount = is_moments ? 1U : 0U,
+      .colorAttachments = is_moments ? &render_pass_color_attachment : nullptr,
       .depthStencilAttachment = &render_pass_depth_stencil_attachment,
     };
     wgpu::RenderPassEncoder rp_encoder = command_encoder.BeginRenderPass(&render_pass_encoder_descriptor);
@@ -2040,6 +6073,25 @@ namespace broccoli {
     wgpu::CommandBuffer command_buffer = command_encoder.Finish();
     queue.Submit(1, &command_buffer);
   }
+  void Renderer::blurShadowMap(const RenderShadowMaps &shadow_maps, int32_t light_idx, int32_t cascade_idx) {
+    const auto &bind_groups = shadow_maps.getBlurBindGroups(light_idx, cascade_idx);
+    uint32_t workgroup_count = ((1U << shadow_maps.sizeLg2()) + R3D_CSM_BLUR_WORKGROUP_SIZE - 1) / R3D_CSM_BLUR_WORKGROUP_SIZE;
+    auto queue = m_manager.wgpuDevice().GetQueue();
+
+    wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.ShadowMap.Blur.CommandEncoder"};
+    wgpu::CommandEncoder command_encoder = m_manager.wgpuDevice().CreateCommandEncoder(&command_encoder_descriptor);
+    for (bool is_vertical: {false, true}) {
+      const auto &compute_pipeline = m_manager.getShadowBlurComputePipeline(is_vertical);
+      wgpu::ComputePassDescriptor compute_pass_descriptor = {.label="Broccoli.Render.ShadowMap.Blur.ComputePass"};
+      wgpu::ComputePassEncoder cp_encoder = command_encoder.BeginComputePass(&compute_pass_descriptor);
+      cp_encoder.SetPipeline(compute_pipeline.pipeline);
+      cp_encoder.SetBindGroup(0, is_vertical ? bind_groups.vertical : bind_groups.horizontal);
+      cp_encoder.DispatchWorkgroups(workgroup_count, workgroup_count);
+      cp_encoder.End();
+    }
+    wgpu::CommandBuffer command_buffer = command_encoder.Finish();
+    queue.Submit(1, &command_buffer);
+  }
   void Renderer::drawShadowMapMeshInstanceListVec(glm::mat4x4 proj_view_matrix, const RenderShadowMaps &shadow_maps, int32_t light_idx, int32_t cascade_idx, const std::vector<std::vector<MeshInstanceList>> &mesh_instance_list_vec) {
     for (size_t material_idx = 0; material_idx < mesh_instance_list_vec.size(); material_idx++) {
       Material material{material_idx};
@@ -2055,33 +6107,35 @@ namespace broccoli {
       return;
     }
   
-    const auto &render_pipeline = m_manager.getShadowRenderPipeline();
-    const auto &mesh = mesh_instance_list.mesh;
+    const auto &render_pipeline = m_manager.getShadowRenderPipeline(shadow_maps.representation());
+    bool is_moments = shadow_maps.representation() == ShadowMapRepresentation::Moments;
+    const auto &mesh = mesh_instance_list.shadow_mesh;
     const auto &transform_list = mesh_instance_list.instance_list;
     const auto &ubo = shadow_maps.getShadowMapUbo(light_idx, cascade_idx);
     const auto &view = shadow_maps.getWriteView(light_idx, cascade_idx);
-    auto queue = m_manager.wgpuDevice().GetQueue();
-    
-    if (true) {
-      auto uniform_buffer_size = transform_list.size() * sizeof(glm::mat4x4);
-      queue.WriteBuffer(m_manager.wgpuTransformUniformBuffer(), 0, transform_list.data(), uniform_buffer_size);
-    }
-    
-    ShadowUniform freshest_ubo = {.proj_view_matrix=proj_view_matrix};
-    if (freshest_ubo != ubo.state) {
-      queue.WriteBuffer(ubo.buffer, 0, &freshest_ubo, sizeof(freshest_ubo));
-    }
 
+    // The shadow UBO is shared by all frame slots: it is copied into place by the very submit that reads it (see 
+    // RenderFrameSlot).
     wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.ShadowMap.CommandEncoder"};
     wgpu::CommandEncoder command_encoder = m_manager.wgpuDevice().CreateCommandEncoder(&command_encoder_descriptor);
+    ShadowUniform shadow_uniform = {.proj_view_matrix=proj_view_matrix};
+    m_manager.stagingBelt().writeBuffer(command_encoder, ubo.buffer, 0, &shadow_uniform, sizeof(shadow_uniform));
+    auto uniform_buffer_size = transform_list.size() * sizeof(glm::mat4x4);
+    m_manager.stagingBelt().writeBuffer(command_encoder, m_manager.wgpuTransformUniformBuffer(), 0, transform_list.data(), uniform_buffer_size);
     auto render_pass_depth_stencil_attachment = wgpu::RenderPassDepthStencilAttachment {
-      .view = view,
+      .view = is_moments ? shadow_maps.getDepthScratchView() : view,
       .depthLoadOp = wgpu::LoadOp::Load,
       .depthStoreOp = wgpu::StoreOp::Store,
     };
+    auto render_pass_color_attachment = wgpu::RenderPassColorAttachment {
+      .view = view,
+      .loadOp = wgpu::LoadOp::Load,
+      .storeOp = wgpu::StoreOp::Store,
+    };
     auto render_pass_encoder_descriptor = wgpu::RenderPassDescriptor {
       .label = "Broccoli.Render.ShadowMap.RenderPass",
-      .colorAttachmentCount = 0,
+      .colorAttachmentCount = is_moments ? 1U : 0U,
+      .colorAttachments = is_moments ? &render_pass_color_attachment : nullptr,
       .depthStencilAttachment = &render_pass_depth_stencil_attachment,
     };
     wgpu::RenderPassEncoder rp_encoder = command_encoder.BeginRenderPass(&render_pass_encoder_descriptor);
@@ -2094,68 +6148,300 @@ namespace broccoli {
     }
     rp_encoder.End();
 
-    wgpu::CommandBuffer command_buffer = command_encoder.Finish();
-    queue.Submit(1, &command_buffer);
+    m_manager.stagingBelt().submit(command_encoder);
   }
   void Renderer::drawMeshInstanceListVec(std::vector<std::vector<MeshInstanceList>> mesh_instance_list_vec) {
+    if (m_manager.isSoftwareOcclusionCullingEnabled()) {
+      cullSoftwareOccludedMeshInstances(mesh_instance_list_vec);
+    }
+    using MeshDrawBatchKey = std::tuple<const void*, const void*, const void*>;
+    std::vector<MeshDrawBatch> batches;
+    std::map<MeshDrawBatchKey, size_t> batch_index_map;
     for (size_t material_idx = 0; material_idx < mesh_instance_list_vec.size(); material_idx++) {
       Material material{material_idx};
-      for (auto const &mesh_instance_list: mesh_instance_list_vec[material_idx]) {
-        drawMeshInstanceList(material, mesh_instance_list);
+      auto const &material_info = m_manager.getMaterialInfo(material);
+      const auto &render_pipeline = m_manager.getFinalRenderPipeline(material_info.lightingModelID(), material_info.parameterSource());
+      for (auto &mesh_instance_list: mesh_instance_list_vec[material_idx]) {
+        if (mesh_instance_list.instance_list.empty()) {
+          continue;
+        }
+        const auto &mesh = mesh_instance_list.mesh;
+        MeshDrawBatchKey key = {&render_pipeline, material_info.wgpuMaterialBindGroup().Get(), mesh.vtx_buffer.Get()};
+        auto [it, is_new_batch] = batch_index_map.insert({key, batches.size()});
+        if (is_new_batch) {
+          batches.push_back({&render_pipeline, material_info.wgpuMaterialBindGroup(), &mesh, {}, {}});
+        }
+        auto &batch = batches[it->second];
+        auto &transforms = mesh_instance_list.instance_list;
+        batch.transforms.insert(batch.transforms.end(), transforms.begin(), transforms.end());
+        batch.material_indices.insert(batch.material_indices.end(), transforms.size(), material_info.materialUniformIndex());
+      }
+    }
+    if (m_manager.isOcclusionCullingEnabled()) {
+      if (!batches.empty()) {
+        drawOcclusionCulledMeshBatches(batches);
+      }
+      return;
+    }
+    for (const auto &batch: batches) {
+      for (size_t offset = 0; offset < batch.transforms.size(); offset += R3D_INSTANCE_CAPACITY) {
+        size_t count = std::min<size_t>(R3D_INSTANCE_CAPACITY, batch.transforms.size() - offset);
+        drawMeshBatch(
+          *batch.render_pipeline,
+          batch.material_bind_group,
+          *batch.mesh,
+          std::span{batch.transforms}.subspan(offset, count),
+          std::span{batch.material_indices}.subspan(offset, count)
+        );
       }
     }
   }
-  void Renderer::drawMeshInstanceList(Material material, const MeshInstanceList &mesh_instance_list) {
-    if (mesh_instance_list.instance_list.empty()) {
+  void Renderer::cullSoftwareOccludedMeshInstances(std::vector<std::vector<MeshInstanceList>> &mesh_instance_list_vec) {
+    // Occluders are drawn first, then every instance's bounding box is tested against them, all before any instance is
+    // batched or uploaded (see SoftwareOcclusionCuller).
+    // NOTE: shadow maps are drawn from the unculled lists, since casters hidden from the camera may still cast visible
+    // shadows.
+    std::vector<SoftwareOccluderInstance> occluders;
+    for (const auto &mesh_instance_lists: mesh_instance_list_vec) {
+      for (const auto &mesh_instance_list: mesh_instance_lists) {
+        if (!mesh_instance_list.mesh.occluder) {
+          continue;
+        }
+        for (const auto &transform: mesh_instance_list.instance_list) {
+          occluders.push_back({.geometry = mesh_instance_list.mesh.occluder.get(), .transform = transform});
+        }
+      }
+    }
+    if (occluders.empty()) {
       return;
     }
-    auto const &mesh = mesh_instance_list.mesh;
-    auto const &transform_list = mesh_instance_list.instance_list;
-    auto const &material_info = m_manager.getMaterialInfo(material);
-    auto queue = m_manager.wgpuDevice().GetQueue();
-    auto uniform_buffer_size = transform_list.size() * sizeof(glm::mat4x4);
-    queue.WriteBuffer(m_manager.wgpuTransformUniformBuffer(), 0, transform_list.data(), uniform_buffer_size);
+
+    const float fovy_rad = (m_camera.fovyDeg() / 360.0f) * (2.0f * static_cast<float>(M_PI));
+    const float aspect = m_target.size.x / static_cast<float>(m_target.size.y);
+    const SoftwareOcclusionCamera camera = {
+      .view_matrix = m_camera.viewMatrix(),
+      .cot_half_fovy = 1.0f / std::tanf(fovy_rad / 2.0f),
+      .aspect_inv = 1.0f / aspect,
+      .zmin = R3D_CAMERA_ZMIN,
+      .zmax = R3D_CAMERA_ZMAX,
+    };
+    const int32_t tile_height = SoftwareOcclusionCuller::TILE_HEIGHT;
+    const auto buffer_height = static_cast<int32_t>(std::ceil(R3D_SOFTWARE_OCCLUSION_BUFFER_WIDTH / aspect / tile_height));
+    const glm::ivec2 buffer_size = {R3D_SOFTWARE_OCCLUSION_BUFFER_WIDTH, std::max(buffer_height, 1) * tile_height};
+    auto &culler = m_manager.getSoftwareOcclusionCuller();
+    culler.beginFrame(camera, buffer_size);
+    culler.rasterizeOccluders(occluders);
+    for (auto &mesh_instance_lists: mesh_instance_list_vec) {
+      for (auto &mesh_instance_list: mesh_instance_lists) {
+        const auto &mesh = mesh_instance_list.mesh;
+        culler.cullInstances(mesh.bounds_min, mesh.bounds_max, mesh_instance_list.instance_list);
+      }
+    }
+  }
+  void Renderer::drawMeshBatch(
+    const FinalRenderPipeline &render_pipeline,
+    wgpu::BindGroup material_bind_group,
+    const Geometry &mesh,
+    std::span<const glm::mat4x4> transform_list,
+    std::span<const uint32_t> material_index_list
+  ) {
+    auto &staging_belt = m_manager.stagingBelt();
     wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.Draw.CommandEncoder"};
     wgpu::CommandEncoder command_encoder = m_manager.wgpuDevice().CreateCommandEncoder(&command_encoder_descriptor);
-    wgpu::RenderPassColorAttachment rp_color_attachment = {
-      .view = m_manager.wgpuRenderTargetColorTextureView(),
-      .resolveTarget = m_target.texture_view,
-      .loadOp = wgpu::LoadOp::Load,
-      .storeOp = wgpu::StoreOp::Store,
+    staging_belt.writeBuffer(command_encoder, m_manager.wgpuTransformUniformBuffer(), 0, transform_list.data(), transform_list.size_bytes());
+    staging_belt.writeBuffer(command_encoder, m_manager.wgpuInstanceMaterialUniformBuffer(), 0, material_index_list.data(), material_index_list.size_bytes());
+    wgpu::RenderPassEncoder rp_encoder = beginFinalRenderPass(command_encoder);
+    {
+      rp_encoder.SetPipeline(meshRenderPipeline(render_pipeline));
+      render_pipeline.setBindGroups(rp_encoder, std::to_array({material_bind_group}));
+      rp_encoder.SetIndexBuffer(mesh.idx_buffer, wgpu::IndexFormat::Uint32);
+      rp_encoder.SetVertexBuffer(0, mesh.vtx_buffer);
+      rp_encoder.DrawIndexed(mesh.idx_count, static_cast<uint32_t>(transform_list.size()));
+    }
+    rp_encoder.End();
+    staging_belt.submit(command_encoder);
+  }
+  void Renderer::drawOcclusionCulledMeshBatches(const std::vector<MeshDrawBatch> &batches) {
+    // Every batch is split into chunks that fit the instance uniforms, as when drawing without culling, and all chunks
+    // are culled and drawn in a single submission (see RenderOcclusionCuller).
+    // NOTE: shadow maps are not culled against the pyramid, since casters hidden from the camera may still cast visible
+    // shadows.
+    std::vector<OcclusionCullChunk> chunks;
+    std::vector<const MeshDrawBatch*> chunk_batches;
+    std::vector<glm::mat4x4> transforms;
+    std::vector<uint32_t> material_indices;
+    for (const auto &batch: batches) {
+      for (size_t offset = 0; offset < batch.transforms.size(); offset += R3D_INSTANCE_CAPACITY) {
+        size_t count = std::min<size_t>(R3D_INSTANCE_CAPACITY, batch.transforms.size() - offset);
+        chunks.push_back({
+          .bounds_min = batch.mesh->bounds_min,
+          .instance_offset = static_cast<uint32_t>(transforms.size()),
+          .bounds_max = batch.mesh->bounds_max,
+          .instance_count = static_cast<uint32_t>(count),
+          .index_count = batch.mesh->idx_count,
+        });
+        chunk_batches.push_back(&batch);
+        transforms.insert(transforms.end(), batch.transforms.begin() + offset, batch.transforms.begin() + offset + count);
+        material_indices.insert(material_indices.end(), batch.material_indices.begin() + offset, batch.material_indices.begin() + offset + count);
+      }
+    }
+
+    const float fovy_rad = (m_camera.fovyDeg() / 360.0f) * (2.0f * static_cast<float>(M_PI));
+    const float aspect = m_target.size.x / static_cast<float>(m_target.size.y);
+    const OcclusionCullUniform uniform = {
+      .view_matrix = m_camera.viewMatrix(),
+      .camera_cot_half_fovy = 1.0f / std::tanf(fovy_rad / 2.0f),
+      .camera_aspect_inv = 1.0f / aspect,
+      .camera_zmin = R3D_CAMERA_ZMIN,
+      .camera_zmax = R3D_CAMERA_ZMAX,
+      .camera_logarithmic_z_scale = R3D_CAMERA_LOGARITHMIC_Z_SCALE,
     };
+    wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.OcclusionCulledDraw.CommandEncoder"};
+    wgpu::CommandEncoder command_encoder = m_manager.wgpuDevice().CreateCommandEncoder(&command_encoder_descriptor);
+    auto &culler = m_manager.getOcclusionCuller();
+    culler.beginFrame(
+      m_manager.wgpuDevice(),
+      command_encoder,
+      m_manager.stagingBelt(),
+      m_manager.getOcclusionCullComputePipeline(0),
+      m_manager.getHizDownsampleComputePipeline(),
+      m_target.size,
+      uniform,
+      std::move(chunks),
+      transforms,
+      material_indices
+    );
+    for (uint32_t phase = 0; phase < RenderOcclusionCuller::PHASE_COUNT; phase++) {
+      if (phase > 0) {
+        culler.buildPyramid(
+          m_manager.wgpuDevice(),
+          command_encoder,
+          m_manager.getHizInitComputePipeline(m_attachments.sample_count),
+          m_manager.getHizDownsampleComputePipeline(),
+          m_attachments.depth_stencil_texture_view
+        );
+      }
+      culler.cull(command_encoder, m_manager.getOcclusionCullComputePipeline(phase), phase);
+
+      // The instance uniforms are shared by every chunk, so each chunk's visible instances are copied in just before
+      // its draw:
+      for (size_t chunk_index = 0; chunk_index < culler.chunkCount(); chunk_index++) {
+        const auto &batch = *chunk_batches[chunk_index];
+        culler.copyVisibleInstances(
+          command_encoder, 
+          chunk_index, 
+          m_manager.wgpuTransformUniformBuffer(), 
+          m_manager.wgpuInstanceMaterialUniformBuffer()
+        );
+        wgpu::RenderPassEncoder rp_encoder = beginFinalRenderPass(command_encoder);
+        {
+          rp_encoder.SetPipeline(meshRenderPipeline(*batch.render_pipeline));
+          batch.render_pipeline->setBindGroups(rp_encoder, std::to_array({batch.material_bind_group}));
+          rp_encoder.SetIndexBuffer(batch.mesh->idx_buffer, wgpu::IndexFormat::Uint32);
+          rp_encoder.SetVertexBuffer(0, batch.mesh->vtx_buffer);
+          rp_encoder.DrawIndexedIndirect(culler.drawArgsBuffer(), culler.drawArgsOffset(chunk_index, phase));
+        }
+        rp_encoder.End();
+      }
+    }
+    m_manager.stagingBelt().submit(command_encoder);
+  }
+  wgpu::RenderPassEncoder Renderer::beginFinalRenderPass(wgpu::CommandEncoder &command_encoder) const {
+    // When deferred shading, meshes are drawn into the G-buffer instead of the color attachment, which is only written
+    // by the lighting pass (see 'drawDeferredLighting').
+    bool is_deferred = m_attachments.shading_path == ShadingPath::Deferred;
+    std::array<wgpu::RenderPassColorAttachment, R3D_GBUFFER_TEXTURE_FORMATS.size()> rp_color_attachments;
+    if (is_deferred) {
+      for (size_t i = 0; i < rp_color_attachments.size(); i++) {
+        rp_color_attachments[i] = wgpu::RenderPassColorAttachment {
+          .view = m_attachments.gbuffer_texture_views[i],
+          .loadOp = wgpu::LoadOp::Load,
+          .storeOp = wgpu::StoreOp::Store,
+        };
+      }
+    } else {
+      rp_color_attachments[0] = wgpu::RenderPassColorAttachment {
+        .view = m_attachments.color_texture_view,
+        .resolveTarget = m_attachments.resolve_texture_view,
+        .loadOp = wgpu::LoadOp::Load,
+        .storeOp = wgpu::StoreOp::Store,
+      };
+    }
     wgpu::RenderPassDepthStencilAttachment rp_depth_attachment = {
-      .view = m_manager.wgpuRenderTargetDepthStencilTextureView(),
+      .view = m_attachments.depth_stencil_texture_view,
       .depthLoadOp = wgpu::LoadOp::Load,
       .depthStoreOp = wgpu::StoreOp::Store,
     };
     wgpu::RenderPassDescriptor rp_descriptor = {
       .nextInChain = nullptr,
-      .label = "Broccoli.Render.Final.RenderPassEncoder",
+      .label = is_deferred ? "Broccoli.Render.GBuffer.RenderPassEncoder" : "Broccoli.Render.Final.RenderPassEncoder",
+      .colorAttachmentCount = is_deferred ? rp_color_attachments.size() : 1,
+      .colorAttachments = rp_color_attachments.data(),
+      .depthStencilAttachment = &rp_depth_attachment,
+    };
+    return command_encoder.BeginRenderPass(&rp_descriptor);
+  }
+  const wgpu::RenderPipeline &Renderer::meshRenderPipeline(const FinalRenderPipeline &render_pipeline) const {
+    if (m_attachments.shading_path == ShadingPath::Deferred) {
+      return render_pipeline.gbuffer_pipeline;
+    } else {
+      return render_pipeline.pipeline;
+    }
+  }
+  void Renderer::drawDeferredLighting() {
+    // Shades every pixel covered by the G-buffer exactly once, with the same clustered point lights and shadows as 
+    // forward shading. The G-buffer is transient, so its bind group is created for each frame.
+    const auto &render_pipeline = m_manager.getDeferredLightingRenderPipeline();
+    const DeferredUniform uniform = {
+      .camera_transform_matrix = m_camera.transformMatrix(),
+    };
+    wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Render.DeferredLighting.CommandEncoder"};
+    wgpu::CommandEncoder command_encoder = m_manager.wgpuDevice().CreateCommandEncoder(&command_encoder_descriptor);
+    m_manager.stagingBelt().writeBuffer(command_encoder, m_manager.wgpuDeferredUniformBuffer(), 0, &uniform, sizeof(uniform));
+    auto bind_group_entries = std::to_array({
+      wgpu::BindGroupEntry {.binding = 9, .buffer = m_manager.wgpuDeferredUniformBuffer(), .size = sizeof(DeferredUniform)},
+      wgpu::BindGroupEntry {.binding = 10, .textureView = m_attachments.gbuffer_texture_views[0]},
+      wgpu::BindGroupEntry {.binding = 11, .textureView = m_attachments.gbuffer_texture_views[1]},
+      wgpu::BindGroupEntry {.binding = 12, .textureView = m_attachments.gbuffer_texture_views[2]},
+      wgpu::BindGroupEntry {.binding = 13, .textureView = m_attachments.gbuffer_texture_views[3]},
+      wgpu::BindGroupEntry {.binding = 14, .textureView = m_attachments.depth_stencil_texture_view},
+    });
+    wgpu::BindGroupDescriptor bind_group_descriptor = {
+      .label = "Broccoli.Render.DeferredLighting.BindGroup2",
+      .layout = render_pipeline.bind_group_layouts[2],
+      .entryCount = bind_group_entries.size(),
+      .entries = bind_group_entries.data(),
+    };
+    wgpu::BindGroup bind_group = m_manager.wgpuDevice().CreateBindGroup(&bind_group_descriptor);
+
+    wgpu::RenderPassColorAttachment rp_color_attachment = {
+      .view = m_attachments.color_texture_view,
+      .loadOp = wgpu::LoadOp::Load,
+      .storeOp = wgpu::StoreOp::Store,
+    };
+    wgpu::RenderPassDescriptor rp_descriptor = {
+      .label = "Broccoli.Render.DeferredLighting.RenderPassEncoder",
       .colorAttachmentCount = 1,
       .colorAttachments = &rp_color_attachment,
-      .depthStencilAttachment = &rp_depth_attachment,
     };
     wgpu::RenderPassEncoder rp_encoder = command_encoder.BeginRenderPass(&rp_descriptor);
     {
-      const auto &render_pipeline = m_manager.getFinalRenderPipeline(material_info.lightingModelID());
       rp_encoder.SetPipeline(render_pipeline.pipeline);
-      render_pipeline.setBindGroups(rp_encoder, std::to_array({material_info.wgpuMaterialBindGroup()}));
-      rp_encoder.SetIndexBuffer(mesh.idx_buffer, wgpu::IndexFormat::Uint32);
-      rp_encoder.SetVertexBuffer(0, mesh.vtx_buffer);
-      rp_encoder.DrawIndexed(mesh.idx_count, static_cast<uint32_t>(transform_list.size()));
+      render_pipeline.setBindGroups(rp_encoder, std::to_array({bind_group}));
+      rp_encoder.Draw(3);
     }
     rp_encoder.End();
-    wgpu::CommandBuffer command_buffer = command_encoder.Finish();
-    queue.Submit(1, &command_buffer);
+    m_manager.stagingBelt().submit(command_encoder);
   }
   glm::mat4x4 Renderer::computeDirLightCascadeProjectionMatrix(
+    const ShadowSettings &settings,
     RenderCamera camera,
     RenderTarget target,
     glm::dmat4x4 inv_light_transform,
     size_t cascade_index
   ) {
-    double min_distance = minDirLightCascadeDistance(cascade_index);
-    double max_distance = maxDirLightCascadeDistance(cascade_index);
+    double min_distance = minDirLightCascadeDistance(settings, cascade_index);
+    double max_distance = maxDirLightCascadeDistance(settings, cascade_index);
     glm::dmat4x3 min_world_section = computeFrustumSection(camera, target, min_distance);
     glm::dmat4x3 max_world_section = computeFrustumSection(camera, target, max_distance);
     glm::dmat4x2 min_light_section = projectFrustumSection(min_world_section, inv_light_transform);
@@ -2183,7 +6469,8 @@ namespace broccoli {
     glm::dvec2 max_xy = max_proj_xy + glm::dvec2{padding};
     // CHECK(proj_cascade_size.x <= max_cascade_size.x && proj_cascade_size.y <= max_cascade_size.y, "Bad max cascade size.");
     // CHECK(max_xy - min_xy == max_cascade_size, "Expected orthographic projection to be fixed size.");
-    return glm::ortho(min_xy.x, max_xy.x, min_xy.y, max_xy.y, -R3D_DIR_LIGHT_SHADOW_RADIUS, +R3D_DIR_LIGHT_SHADOW_RADIUS);
+    double radius = settings.dir_light_shadow_radius;
+    return glm::orthoRH_ZO(min_xy.x, max_xy.x, min_xy.y, max_xy.y, -radius, +radius);
   }
   glm::dmat4x3 Renderer::computeFrustumSection(RenderCamera camera, RenderTarget target, double distance) {
     double aspect = target.size.x / static_cast<double>(target.size.y);
@@ -2243,8 +6530,9 @@ namespace broccoli {
   {}
 }
 namespace broccoli {
-  Geometry GeometryFactory::createCuboid(glm::dvec3 dimensions) {
+  Geometry GeometryFactory::createCuboid(glm::dvec3 dimensions, bool is_occluder) {
     GeometryBuilder mb = m_manager.createGeometryBuilder();
+    mb.setIsOccluder(is_occluder);
     
     auto hd = dimensions * 0.5;
 
@@ -2303,12 +6591,16 @@ namespace broccoli {
   : m_manager(manager),
     m_vtx_compression_map(),
     m_vtx_buf(),
-    m_idx_buf()
+    m_idx_buf(),
+    m_is_occluder(false)
   {
     m_vtx_compression_map.reserve(R3D_VERTEX_BUFFER_CAPACITY);
     m_vtx_buf.reserve(R3D_VERTEX_BUFFER_CAPACITY);
     m_idx_buf.reserve(R3D_INDEX_BUFFER_CAPACITY);
   }
+  void GeometryBuilder::setIsOccluder(bool is_occluder) {
+    m_is_occluder = is_occluder;
+  }
   void GeometryBuilder::triangle(Vtx v1, Vtx v2, Vtx v3, bool double_faced) {
     singleFaceTriangle(v1, v2, v3);
     if (double_faced) {
@@ -2345,33 +6637,147 @@ namespace broccoli {
     m_idx_buf.push_back(iv2);
     m_idx_buf.push_back(iv3);
   }
+  const Geometry &Geometry::shadowGeometry() const {
+    return shadow_proxy ? *shadow_proxy : *this;
+  }
+}
+namespace broccoli {
   Geometry GeometryBuilder::finish(GeometryBuilder &&mb) {
+    auto mesh = upload(mb.m_manager, mb.m_vtx_buf, mb.m_idx_buf);
+    if (mb.m_is_occluder) {
+      mesh.occluder = createOccluder(mb.m_vtx_buf, mb.m_idx_buf);
+    }
+    return mesh;
+  }
+  Geometry GeometryBuilder::finishWithShadowProxy(GeometryBuilder &&mb, double proxy_cell_size) {
+    auto mesh = upload(mb.m_manager, mb.m_vtx_buf, mb.m_idx_buf);
+    if (mb.m_is_occluder) {
+      mesh.occluder = createOccluder(mb.m_vtx_buf, mb.m_idx_buf);
+    }
+    auto proxy = createDecimatedShadowProxy(mb.m_manager, mb.m_vtx_buf, mb.m_idx_buf, proxy_cell_size);
+    if (proxy.has_value()) {
+      mesh.shadow_proxy = std::make_shared<const Geometry>(std::move(proxy.value()));
+    }
+    return mesh;
+  }
+  Geometry GeometryBuilder::upload(RenderManager &manager, std::span<const Vertex> vtx_buf, std::span<const uint32_t> idx_buf) {
+    auto lock = manager.lockSubmission();
     wgpu::BufferDescriptor vtx_buf_descriptor = {
       .nextInChain = nullptr,
       .label = "Broccoli.Mesh.VertexBuffer",
       .usage = wgpu::BufferUsage::Vertex | wgpu::BufferUsage::CopyDst,
-      .size = mb.m_vtx_buf.size() * sizeof(Vertex),
+      .size = vtx_buf.size() * sizeof(Vertex),
     };
     wgpu::BufferDescriptor idx_buf_descriptor = {
       .nextInChain = nullptr,
       .label = "Broccoli.Mesh.IndexBuffer",
       .usage = wgpu::BufferUsage::Index | wgpu::BufferUsage::CopyDst,
-      .size = mb.m_idx_buf.size() * sizeof(uint32_t),
+      .size = idx_buf.size() * sizeof(uint32_t),
     };
     Geometry mesh = {
       .mesh_type = GeometryType::Static,
-      .vtx_buffer = mb.m_manager.wgpuDevice().CreateBuffer(&vtx_buf_descriptor),
-      .idx_buffer = mb.m_manager.wgpuDevice().CreateBuffer(&idx_buf_descriptor),
-      .vtx_count = static_cast<uint32_t>(mb.m_vtx_buf.size()),
-      .idx_count = static_cast<uint32_t>(mb.m_idx_buf.size()),
-    };
-    wgpu::Queue queue = mb.m_manager.wgpuDevice().GetQueue();
-    auto vtx_buf_size = mb.m_vtx_buf.size() * sizeof(Vertex);
-    auto idx_buf_size = mb.m_idx_buf.size() * sizeof(uint32_t);
-    queue.WriteBuffer(mesh.vtx_buffer, 0, mb.m_vtx_buf.data(), vtx_buf_size);
-    queue.WriteBuffer(mesh.idx_buffer, 0, mb.m_idx_buf.data(), idx_buf_size);
+      .vtx_buffer = manager.wgpuDevice().CreateBuffer(&vtx_buf_descriptor),
+      .idx_buffer = manager.wgpuDevice().CreateBuffer(&idx_buf_descriptor),
+      .vtx_count = static_cast<uint32_t>(vtx_buf.size()),
+      .idx_count = static_cast<uint32_t>(idx_buf.size()),
+    };
+    if (!vtx_buf.empty()) {
+      glm::ivec3 bounds_min = vtx_buf[0].offset;
+      glm::ivec3 bounds_max = vtx_buf[0].offset;
+      for (const auto &vtx: vtx_buf) {
+        bounds_min = glm::min(bounds_min, vtx.offset);
+        bounds_max = glm::max(bounds_max, vtx.offset);
+      }
+      mesh.bounds_min = glm::vec3{glm::dvec3{bounds_min} / 1048576.0};
+      mesh.bounds_max = glm::vec3{glm::dvec3{bounds_max} / 1048576.0};
+    }
+    auto vtx_buf_size = vtx_buf.size() * sizeof(Vertex);
+    auto idx_buf_size = idx_buf.size() * sizeof(uint32_t);
+    wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label="Broccoli.Mesh.Upload.CommandEncoder"};
+    wgpu::CommandEncoder command_encoder = manager.wgpuDevice().CreateCommandEncoder(&command_encoder_descriptor);
+    manager.stagingBelt().writeBuffer(command_encoder, mesh.vtx_buffer, 0, vtx_buf.data(), vtx_buf_size);
+    manager.stagingBelt().writeBuffer(command_encoder, mesh.idx_buffer, 0, idx_buf.data(), idx_buf_size);
+    manager.stagingBelt().submit(command_encoder);
     return mesh;
   }
+  std::shared_ptr<const OccluderGeometry> GeometryBuilder::createOccluder(std::span<const Vertex> vtx_buf, std::span<const uint32_t> idx_buf) {
+    auto occluder = std::make_shared<OccluderGeometry>();
+    occluder->positions.reserve(vtx_buf.size());
+    for (const auto &vtx: vtx_buf) {
+      occluder->positions.push_back(glm::vec3{glm::dvec3{vtx.offset} / 1048576.0});
+    }
+    occluder->indices.assign(idx_buf.begin(), idx_buf.end());
+    return occluder;
+  }
+  std::optional<Geometry> GeometryBuilder::createDecimatedShadowProxy(RenderManager &manager, std::span<const Vertex> vtx_buf, std::span<const uint32_t> idx_buf, double cell_size) {
+    // Vertex-clustering decimation: every vertex is snapped to the centroid of the grid cell it falls in, and triangles
+    // that collapse as a result are dropped.
+    // Shadow passes only read positions, so normals, tangents, and UVs are discarded.
+    CHECK(cell_size > 0.0, "Expected shadow proxy cell size to be positive.");
+    const auto cell_size_fixpt = cell_size * 1048576.0;
+    
+    struct Cluster {
+      glm::i64vec3 offset_sum;
+      int64_t vertex_count;
+    };
+    struct PodHash {
+      size_t operator() (glm::i64vec3 v) const { Fnv1aHasher hasher; hasher.write(&v); return hasher.finish(); }
+      size_t operator() (glm::u32vec3 v) const { Fnv1aHasher hasher; hasher.write(&v); return hasher.finish(); }
+    };
+    std::vector<Cluster> clusters;
+    std::vector<uint32_t> vtx_cluster_map(vtx_buf.size());
+    robin_hood::unordered_map<glm::i64vec3, uint32_t, PodHash> cell_cluster_map;
+    for (size_t vtx_idx = 0; vtx_idx < vtx_buf.size(); vtx_idx++) {
+      auto offset = glm::i64vec3{vtx_buf[vtx_idx].offset};
+      auto cell = glm::i64vec3{glm::floor(glm::dvec3{offset} / cell_size_fixpt)};
+      auto [it, is_new_cell] = cell_cluster_map.insert({cell, static_cast<uint32_t>(clusters.size())});
+      if (is_new_cell) {
+        clusters.push_back({.offset_sum = glm::i64vec3{0}, .vertex_count = 0});
+      }
+      auto &cluster = clusters[it->second];
+      cluster.offset_sum += offset;
+      cluster.vertex_count++;
+      vtx_cluster_map[vtx_idx] = it->second;
+    }
+
+    std::vector<uint32_t> proxy_idx_buf;
+    robin_hood::unordered_set<glm::u32vec3, PodHash> proxy_triangle_set;
+    for (size_t i = 0; i + 2 < idx_buf.size(); i += 3) {
+      auto a = vtx_cluster_map[idx_buf[i + 0]];
+      auto b = vtx_cluster_map[idx_buf[i + 1]];
+      auto c = vtx_cluster_map[idx_buf[i + 2]];
+      if (a == b || b == c || c == a) {
+        continue;
+      }
+      // Rotate so the smallest index leads: this identifies a triangle irrespective of its starting vertex while
+      // preserving winding.
+      glm::u32vec3 triangle = a < b && a < c ? glm::u32vec3{a, b, c} : b < c ? glm::u32vec3{b, c, a} : glm::u32vec3{c, a, b};
+      if (!proxy_triangle_set.insert(triangle).second) {
+        continue;
+      }
+      proxy_idx_buf.push_back(triangle.x);
+      proxy_idx_buf.push_back(triangle.y);
+      proxy_idx_buf.push_back(triangle.z);
+    }
+    
+    // A proxy that barely simplifies the source is not worth the extra buffers.
+    if (proxy_idx_buf.empty() || 4 * proxy_idx_buf.size() > 3 * idx_buf.size()) {
+      return std::nullopt;
+    }
+    
+    std::vector<Vertex> proxy_vtx_buf;
+    proxy_vtx_buf.reserve(clusters.size());
+    for (auto const &cluster: clusters) {
+      auto centroid = cluster.offset_sum / cluster.vertex_count;
+      proxy_vtx_buf.push_back({
+        .offset = glm::ivec3{centroid},
+        .normal = 0,
+        .tangent = 0,
+        .uv = glm::tvec2<uint16_t>{0},
+      });
+    }
+    return upload(manager, proxy_vtx_buf, proxy_idx_buf);
+  }
   uint32_t GeometryBuilder::vertex(glm::dvec3 offset, glm::dvec2 uv, uint32_t packed_normal, uint32_t packed_tangent) {
     auto packed_offset = packOffset(offset);
     auto packed_uv = packUv(uv);
@@ -2440,22 +6846,22 @@ namespace broccoli {
   MaterialTableEntry::MaterialTableEntry(
     RenderManager &render_manager, 
     std::string name,
-    std::variant<glm::dvec3, RenderTexture> albedo_map, 
-    std::variant<glm::dvec3, RenderTexture> normal_map,
-    std::variant<double, RenderTexture> metalness_map,
-    std::variant<double, RenderTexture> roughness_map,
+    std::variant<glm::dvec3, RenderTexture, StreamedTexture> albedo_map, 
+    std::variant<glm::dvec3, RenderTexture, StreamedTexture> normal_map,
+    std::variant<double, RenderTexture, StreamedTexture> metalness_map,
+    std::variant<double, RenderTexture, StreamedTexture> roughness_map,
     glm::dvec3 pbr_fresnel0,
     double blinn_phong_shininess,
     MaterialLightingModel lighting_model,
-    bool is_shadow_casting
+    bool is_shadow_casting,
+    std::optional<Geometry> shadow_proxy
   )
   : m_render_manager(render_manager),
-    m_wgpu_material_buffer(nullptr),
     m_wgpu_material_bind_group(nullptr),
+    m_material_uniform_index(0),
     m_name("Broccoli.Material." + name),
-    m_wgpu_material_buffer_label(m_name + ".MaterialUbo"),
-    m_wgpu_material_bind_group_label(m_name + ".BindGroup1"),
-    m_is_shadow_casting(is_shadow_casting)
+    m_is_shadow_casting(is_shadow_casting),
+    m_shadow_proxy(std::move(shadow_proxy))
   {
     init(
       std::move(albedo_map),
@@ -2470,26 +6876,56 @@ namespace broccoli {
   uint32_t MaterialTableEntry::lightingModelID() const {
     return static_cast<uint32_t>(m_lighting_model);
   }
+  MaterialParameterSource MaterialTableEntry::parameterSource() const {
+    return m_parameter_source;
+  }
   const wgpu::BindGroup &MaterialTableEntry::wgpuMaterialBindGroup() const {
     return m_wgpu_material_bind_group;
   }
+  uint32_t MaterialTableEntry::materialUniformIndex() const {
+    return m_material_uniform_index;
+  }
   bool MaterialTableEntry::isShadowCasting() const {
     return m_is_shadow_casting;
   }
+  const Geometry *MaterialTableEntry::shadowProxy() const {
+    return m_shadow_proxy.has_value() ? &m_shadow_proxy.value() : nullptr;
+  }
+  void MaterialTableEntry::setShadowProxy(std::optional<Geometry> shadow_proxy) {
+    m_shadow_proxy = std::move(shadow_proxy);
+  }
+  const std::array<std::optional<StreamedTexture>, 4> &MaterialTableEntry::streamedTextures() const {
+    return m_streamed_textures;
+  }
+  bool MaterialTableEntry::usesStreamedTexture(StreamedTexture texture) const {
+    return std::any_of(
+      m_streamed_textures.begin(), 
+      m_streamed_textures.end(), 
+      [texture] (const auto &streamed_texture) { return streamed_texture.has_value() && streamed_texture->value == texture.value; }
+    );
+  }
+  void MaterialTableEntry::rebindStreamedTextures() {
+    for (size_t i = 0; i < m_streamed_textures.size(); i++) {
+      if (m_streamed_textures[i].has_value()) {
+        const auto &texture = m_render_manager.streamedTexture(m_streamed_textures[i].value());
+        m_texture_views[i] = texture.view();
+        m_texture_samplers[i] = texture.sampler();
+      }
+    }
+    m_wgpu_material_bind_group = m_render_manager.acquireMaterialBindGroup(m_texture_views, m_texture_samplers);
+  }
 }
 namespace broccoli {
   void MaterialTableEntry::init(
-    std::variant<glm::dvec3, RenderTexture> const &albedo_map, 
-    std::variant<glm::dvec3, RenderTexture> const &normal_map,
-    std::variant<double, RenderTexture> const &metalness_map,
-    std::variant<double, RenderTexture> const &roughness_map,
+    std::variant<glm::dvec3, RenderTexture, StreamedTexture> const &albedo_map, 
+    std::variant<glm::dvec3, RenderTexture, StreamedTexture> const &normal_map,
+    std::variant<double, RenderTexture, StreamedTexture> const &metalness_map,
+    std::variant<double, RenderTexture, StreamedTexture> const &roughness_map,
     glm::dvec3 pbr_fresnel0,
     double blinn_phong_shininess,
     MaterialLightingModel lighting_model
   ) {
     auto &manager = m_render_manager;
-    auto &device = manager.wgpuDevice();
-    auto lighting_model_id = static_cast<uint32_t>(lighting_model);
     
     bool all_constants = 
       std::holds_alternative<glm::dvec3>(albedo_map) &&
@@ -2497,16 +6933,17 @@ namespace broccoli {
       std::holds_alternative<double>(metalness_map) &&
       std::holds_alternative<double>(roughness_map);
     bool all_textures =
-      std::holds_alternative<RenderTexture>(albedo_map) &&
-      std::holds_alternative<RenderTexture>(normal_map) &&
-      std::holds_alternative<RenderTexture>(metalness_map) &&
-      std::holds_alternative<RenderTexture>(roughness_map);;
+      !std::holds_alternative<glm::dvec3>(albedo_map) &&
+      !std::holds_alternative<glm::dvec3>(normal_map) &&
+      !std::holds_alternative<double>(metalness_map) &&
+      !std::holds_alternative<double>(roughness_map);
     CHECK(all_constants || all_textures, "Invalid material: mixed textures and constants.");
 
+    auto source = all_constants ? MaterialParameterSource::Constant : MaterialParameterSource::Texture;
     auto albedo = getColorOrTexture(manager, albedo_map);
     auto normal = getColorOrTexture(manager, normal_map);
-    auto roughness = getColorOrTexture(manager, metalness_map);
-    auto metalness = getColorOrTexture(manager, roughness_map);
+    auto metalness = getColorOrTexture(manager, metalness_map);
+    auto roughness = getColorOrTexture(manager, roughness_map);
     
     MaterialUniform uniform = {
       .albedo_uv_offset = albedo.uv_offset(),
@@ -2520,68 +6957,72 @@ namespace broccoli {
       .pbr_fresnel0 = glm::dvec4{pbr_fresnel0, 1.0f},
       .blinn_phong_shininess = static_cast<float>(blinn_phong_shininess),
     };
-    wgpu::BufferDescriptor buffer_desc = {
-      .label = m_wgpu_material_buffer_label.c_str(),
-      .usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst,
-      .size = sizeof(MaterialUniform),
-      .mappedAtCreation = false,
-    };
-    m_wgpu_material_buffer = device.CreateBuffer(&buffer_desc);
-    device.GetQueue().WriteBuffer(m_wgpu_material_buffer, 0, &uniform, sizeof(uniform));
+    if (source == MaterialParameterSource::Constant) {
+      uniform.albedo_constant = glm::dvec4{std::get<glm::dvec3>(albedo_map), 1.0};
+      uniform.normal_constant = glm::dvec4{std::get<glm::dvec3>(normal_map), 0.0};
+      uniform.metalness_constant = static_cast<float>(std::get<double>(metalness_map));
+      uniform.roughness_constant = static_cast<float>(std::get<double>(roughness_map));
+    }
+    m_material_uniform_index = manager.acquireMaterialUniformSlot(uniform);
 
-    auto const &render_pipeline = m_render_manager.getFinalRenderPipeline(lighting_model_id);
-    auto entries = std::to_array({
-      wgpu::BindGroupEntry {.binding=0, .buffer=m_wgpu_material_buffer, .size=sizeof(MaterialUniform)},
-      wgpu::BindGroupEntry {.binding=1, .textureView=albedo.render_texture().view()},
-      wgpu::BindGroupEntry {.binding=2, .textureView=normal.render_texture().view()},
-      wgpu::BindGroupEntry {.binding=3, .textureView=metalness.render_texture().view()},
-      wgpu::BindGroupEntry {.binding=4, .textureView=roughness.render_texture().view()},
-      wgpu::BindGroupEntry {.binding=5, .sampler=albedo.render_texture().sampler()},
-      wgpu::BindGroupEntry {.binding=6, .sampler=normal.render_texture().sampler()},
-      wgpu::BindGroupEntry {.binding=7, .sampler=metalness.render_texture().sampler()},
-      wgpu::BindGroupEntry {.binding=8, .sampler=roughness.render_texture().sampler()},
-    });
-    wgpu::BindGroupDescriptor bind_group_desc = {
-      .label = m_wgpu_material_bind_group_label.c_str(),
-      .layout = render_pipeline.materialBindGroupLayout(),
-      .entryCount = entries.size(),
-      .entries = entries.data(),
+    // Views and samplers are kept so that the bind group can be rebuilt whenever a streamed texture changes residency.
+    auto streamed = [] (const auto &map) -> std::optional<StreamedTexture> {
+      if (std::holds_alternative<StreamedTexture>(map)) {
+        return std::get<StreamedTexture>(map);
+      }
+      return std::nullopt;
     };
-    m_wgpu_material_bind_group = device.CreateBindGroup(&bind_group_desc);
+    m_streamed_textures = {streamed(albedo_map), streamed(normal_map), streamed(metalness_map), streamed(roughness_map)};
+    m_texture_views = {
+      albedo.render_texture().view(), 
+      normal.render_texture().view(), 
+      metalness.render_texture().view(), 
+      roughness.render_texture().view()
+    };
+    m_texture_samplers = {
+      albedo.render_texture().sampler(), 
+      normal.render_texture().sampler(), 
+      metalness.render_texture().sampler(), 
+      roughness.render_texture().sampler()
+    };
+    if (source == MaterialParameterSource::Constant) {
+      m_wgpu_material_bind_group = manager.wgpuConstantMaterialBindGroup();
+    } else {
+      m_wgpu_material_bind_group = manager.acquireMaterialBindGroup(m_texture_views, m_texture_samplers);
+    }
 
     m_lighting_model = lighting_model;
+    m_parameter_source = source;
   }
 }
 namespace broccoli {
-  RenderTextureView MaterialTableEntry::getColorOrTexture(RenderManager &rm, std::variant<glm::dvec3, RenderTexture> const &map) {
+  RenderTextureView MaterialTableEntry::getColorOrTexture(RenderManager &rm, std::variant<glm::dvec3, RenderTexture, StreamedTexture> const &map) {
     if (std::holds_alternative<glm::dvec3>(map)) {
-      glm::u8vec3 val{glm::round(glm::clamp(std::get<glm::dvec3>(map), 0.0, 1.0) * 255.0)};
-      int64_t idx = (val.r << 0) | (val.g << 8) | (val.b << 16);
-      glm::u16vec2 uv_fixpt{(idx & 0x000FFF) >> 0, (idx & 0xFFF000) >> 12};
-      glm::dvec2 uv{(uv_fixpt.x + 0.5) / 4096.0, (uv_fixpt.y + 0.5) / 4096.0};
-      return {rm.rgbPalette(), uv, glm::dvec2{0.0}};
+      return {rm.placeholderTexture(), glm::dvec2{0.0}, glm::dvec2{0.0}};
     } else if (std::holds_alternative<RenderTexture>(map)) {
       RenderTexture const &tex = std::get<RenderTexture>(map);
-      glm::i64vec3 isize = tex.dim();
-      CHECK(isize.z == 4, "Expected RGBA texture.");
-      glm::dvec2 size{isize.x, isize.y};
-      return {rm.rgbPalette(), glm::dvec2{0.0}, size};
+      CHECK(tex.dim().z == 4, "Expected RGBA texture.");
+      return rm.atlasTexture(tex);
+    } else if (std::holds_alternative<StreamedTexture>(map)) {
+      // Streamed textures change size with residency, so they are never atlased.
+      RenderTexture const &tex = rm.streamedTexture(std::get<StreamedTexture>(map));
+      CHECK(tex.dim().z == 4, "Expected RGBA texture.");
+      return {tex, glm::dvec2{0.0}, glm::dvec2{1.0}};
     } else {
       PANIC("Invalid map contents.");
     }
   }
-  RenderTextureView MaterialTableEntry::getColorOrTexture(RenderManager &rm, std::variant<double, RenderTexture> const &map) {
+  RenderTextureView MaterialTableEntry::getColorOrTexture(RenderManager &rm, std::variant<double, RenderTexture, StreamedTexture> const &map) {
     if (std::holds_alternative<double>(map)) {
-      uint8_t val = static_cast<uint8_t>(glm::round(glm::clamp(std::get<double>(map), 0.0, 1.0) * 255.0));
-      glm::u16vec2 uv_fixpt{(val & 0x0F) >> 0, (val & 0xF0) >> 4};
-      glm::dvec2 uv{uv_fixpt.x / 16.0, uv_fixpt.y / 16.0};
-      return {rm.monochromePalette(), uv + glm::dvec2{0.5}, glm::dvec2{0.0}};
+      return {rm.placeholderTexture(), glm::dvec2{0.0}, glm::dvec2{0.0}};
     } else if (std::holds_alternative<RenderTexture>(map)) {
       RenderTexture const &tex = std::get<RenderTexture>(map);
-      glm::i64vec3 isize = tex.dim();
-      CHECK(isize.z == 1, "Expected monochrome texture.");
-      glm::dvec2 size{isize.x, isize.y};
-      return {rm.monochromePalette(), glm::dvec2{0.0}, size};
+      CHECK(tex.dim().z == 1, "Expected monochrome texture.");
+      return rm.atlasTexture(tex);
+    } else if (std::holds_alternative<StreamedTexture>(map)) {
+      RenderTexture const &tex = rm.streamedTexture(std::get<StreamedTexture>(map));
+      CHECK(tex.dim().z == 1, "Expected monochrome texture.");
+      return {tex, glm::dvec2{0.0}, glm::dvec2{1.0}};
     } else {
       PANIC("Invalid map contents.");
     }
@@ -2591,8 +7032,8 @@ namespace broccoli {
   MaterialTableEntry MaterialTableEntry::createBlinnPhongMaterial(
     RenderManager &render_manager,
     std::string name,
-    std::variant<glm::dvec3, RenderTexture> albedo_map, 
-    std::variant<glm::dvec3, RenderTexture> normal_map,
+    std::variant<glm::dvec3, RenderTexture, StreamedTexture> albedo_map, 
+    std::variant<glm::dvec3, RenderTexture, StreamedTexture> normal_map,
     double shininess
   ) {
     return {
@@ -2612,10 +7053,10 @@ namespace broccoli {
   MaterialTableEntry MaterialTableEntry::createPbrMaterial(
     RenderManager &render_manager,
     std::string name,
-    std::variant<glm::dvec3, RenderTexture> albedo_map, 
-    std::variant<glm::dvec3, RenderTexture> normal_map,
-    std::variant<double, RenderTexture> metalness_map,
-    std::variant<double, RenderTexture> roughness_map,
+    std::variant<glm::dvec3, RenderTexture, StreamedTexture> albedo_map, 
+    std::variant<glm::dvec3, RenderTexture, StreamedTexture> normal_map,
+    std::variant<double, RenderTexture, StreamedTexture> metalness_map,
+    std::variant<double, RenderTexture, StreamedTexture> roughness_map,
     glm::dvec3 fresnel0
   ) {
     return {
@@ -0,0 +1,371 @@
+#include "broccoli/engine/render_graph.hh"
+
+#include <algorithm>
+#include <utility>
+
+//
+// RenderGraph resources:
+//
+
+namespace broccoli {
+  bool operator==(const RenderGraphTextureInfo &lt, const RenderGraphTextureInfo &rt) {
+    return (
+      lt.size == rt.size &&
+      lt.format == rt.format &&
+      lt.usage == rt.usage &&
+      lt.sample_count == rt.sample_count
+    );
+  }
+}
+
+//
+// RenderGraphTexturePool:
+//
+
+namespace broccoli {
+  RenderGraphTexturePool::RenderGraphTexturePool(wgpu::Device device)
+  : m_device(std::move(device)),
+    m_entries(),
+    m_frame_index(0)
+  {}
+}
+namespace broccoli {
+  void RenderGraphTexturePool::beginFrame() {
+    // Entries are only ever erased here, while none are acquired, so that entry indices stay stable within a frame.
+    m_frame_index++;
+    std::erase_if(m_entries, [this] (Entry &entry) {
+      CHECK(!entry.is_acquired, "Transient textures must all be released before the next frame begins.");
+      bool is_idle = m_frame_index - entry.last_used_frame > MAX_IDLE_FRAMES;
+      if (is_idle) {
+        entry.texture.Destroy();
+      }
+      return is_idle;
+    });
+  }
+  size_t RenderGraphTexturePool::acquire(const RenderGraphTextureInfo &info) {
+    for (size_t i = 0; i < m_entries.size(); i++) {
+      auto &entry = m_entries[i];
+      if (!entry.is_acquired && entry.info == info) {
+        entry.is_acquired = true;
+        entry.last_used_frame = m_frame_index;
+        return i;
+      }
+    }
+    wgpu::TextureDescriptor texture_descriptor = {
+      .label = "Broccoli.Render.Graph.TransientTexture",
+      .usage = info.usage,
+      .dimension = wgpu::TextureDimension::e2D,
+      .size = wgpu::Extent3D {
+        .width = static_cast<uint32_t>(info.size.x),
+        .height = static_cast<uint32_t>(info.size.y),
+      },
+      .format = info.format,
+      .mipLevelCount = 1,
+      .sampleCount = info.sample_count,
+    };
+    wgpu::Texture texture = m_device.CreateTexture(&texture_descriptor);
+    wgpu::TextureViewDescriptor texture_view_descriptor = {
+      .label = "Broccoli.Render.Graph.TransientTextureView",
+    };
+    wgpu::TextureView texture_view = texture.CreateView(&texture_view_descriptor);
+    m_entries.push_back({info, std::move(texture), std::move(texture_view), m_frame_index, true});
+    return m_entries.size() - 1;
+  }
+  void RenderGraphTexturePool::release(size_t entry_index) {
+    CHECK(m_entries[entry_index].is_acquired, "Cannot release a transient texture that was not acquired.");
+    m_entries[entry_index].is_acquired = false;
+  }
+}
+namespace broccoli {
+  const wgpu::Texture &RenderGraphTexturePool::texture(size_t entry_index) const {
+    return m_entries[entry_index].texture;
+  }
+  const wgpu::TextureView &RenderGraphTexturePool::textureView(size_t entry_index) const {
+    return m_entries[entry_index].texture_view;
+  }
+  size_t RenderGraphTexturePool::size() const {
+    return m_entries.size();
+  }
+}
+
+//
+// RenderGraph:
+//
+
+namespace broccoli {
+  RenderGraph::RenderGraph(wgpu::Device device, RenderGraphTexturePool &pool)
+  : m_device(std::move(device)),
+    m_pool(pool),
+    m_textures(),
+    m_passes(),
+    m_is_executed(false)
+  {}
+}
+namespace broccoli {
+  RenderGraphTexture RenderGraph::importTexture(std::string name, wgpu::TextureView texture_view, glm::ivec2 size) {
+    RenderGraphTextureInfo info = {.size = size, .format = wgpu::TextureFormat::Undefined, .usage = wgpu::TextureUsage::None};
+    m_textures.push_back({std::move(name), info, true, std::move(texture_view), NO_POOL_ENTRY});
+    return {static_cast<uint32_t>(m_textures.size() - 1)};
+  }
+  RenderGraphTexture RenderGraph::createTexture(std::string name, RenderGraphTextureInfo info) {
+    m_textures.push_back({std::move(name), info, false, nullptr, NO_POOL_ENTRY});
+    return {static_cast<uint32_t>(m_textures.size() - 1)};
+  }
+  void RenderGraph::addRasterPass(RenderGraphPassInfo info, RasterCallback cb) {
+    CHECK(info.color_attachment.has_value() || info.depth_stencil_attachment.has_value(), "Raster passes need at least one attachment.");
+    addPass(RenderGraphPassType::Raster, std::move(info), std::move(cb), nullptr, nullptr);
+  }
+  void RenderGraph::addEncoderPass(RenderGraphPassInfo info, EncoderCallback cb) {
+    addPass(RenderGraphPassType::Encoder, std::move(info), nullptr, std::move(cb), nullptr);
+  }
+  void RenderGraph::addExternalPass(RenderGraphPassInfo info, ExternalCallback cb) {
+    addPass(RenderGraphPassType::External, std::move(info), nullptr, nullptr, std::move(cb));
+  }
+  void RenderGraph::addPass(RenderGraphPassType type, RenderGraphPassInfo info, RasterCallback raster_cb, EncoderCallback encoder_cb, ExternalCallback external_cb) {
+    CHECK(!m_is_executed, "Cannot add passes to a render graph that was already executed.");
+
+    // Attachments are folded into the pass' reads and writes, so that culling and lifetimes need not special-case them:
+    if (info.color_attachment.has_value()) {
+      const auto &attachment = info.color_attachment.value();
+      info.writes.push_back(attachment.texture);
+      if (attachment.load_op == wgpu::LoadOp::Load) {
+        info.reads.push_back(attachment.texture);
+      }
+      if (attachment.resolve_target.has_value()) {
+        info.writes.push_back(attachment.resolve_target.value());
+      }
+    }
+    if (info.depth_stencil_attachment.has_value()) {
+      const auto &attachment = info.depth_stencil_attachment.value();
+      info.writes.push_back(attachment.texture);
+      if (attachment.load_op == wgpu::LoadOp::Load) {
+        info.reads.push_back(attachment.texture);
+      }
+    }
+    for (auto texture: info.reads) {
+      CHECK(texture.value < m_textures.size(), "Render graph pass reads an undeclared texture.");
+    }
+    for (auto texture: info.writes) {
+      CHECK(texture.value < m_textures.size(), "Render graph pass writes an undeclared texture.");
+    }
+    m_passes.push_back({type, std::move(info), std::move(raster_cb), std::move(encoder_cb), std::move(external_cb)});
+  }
+}
+namespace broccoli {
+  void RenderGraph::execute() {
+    CHECK(!m_is_executed, "A render graph can only be executed once.");
+    m_is_executed = true;
+    m_pool.beginFrame();
+
+    auto groups = mergePasses(cullPasses());
+
+    // Computing the groups between which each texture is live:
+    static constexpr uint32_t UNUSED = UINT32_MAX;
+    std::vector<uint32_t> first_use_group(m_textures.size(), UNUSED);
+    std::vector<uint32_t> last_use_group(m_textures.size(), UNUSED);
+    for (uint32_t group_index = 0; group_index < groups.size(); group_index++) {
+      for (auto pass_index: groups[group_index].pass_indices) {
+        const auto &info = m_passes[pass_index].info;
+        for (const auto &textures: {std::cref(info.reads), std::cref(info.writes)}) {
+          for (auto texture: textures.get()) {
+            first_use_group[texture.value] = std::min(first_use_group[texture.value], group_index);
+            last_use_group[texture.value] = group_index;
+          }
+        }
+      }
+    }
+
+    // Recording and submitting:
+    wgpu::CommandEncoderDescriptor command_encoder_descriptor = {.label = "Broccoli.Render.Graph.CommandEncoder"};
+    wgpu::CommandEncoder command_encoder = m_device.CreateCommandEncoder(&command_encoder_descriptor);
+    bool is_command_encoder_empty = true;
+    auto flush = [&] () {
+      if (!is_command_encoder_empty) {
+        wgpu::CommandBuffer command_buffer = command_encoder.Finish();
+        m_device.GetQueue().Submit(1, &command_buffer);
+        command_encoder = m_device.CreateCommandEncoder(&command_encoder_descriptor);
+        is_command_encoder_empty = true;
+      }
+    };
+    for (uint32_t group_index = 0; group_index < groups.size(); group_index++) {
+      const auto &group = groups[group_index];
+      for (size_t i = 0; i < m_textures.size(); i++) {
+        auto &texture = m_textures[i];
+        if (!texture.is_imported && first_use_group[i] == group_index) {
+          texture.pool_entry = m_pool.acquire(texture.info);
+        }
+      }
+      switch (group.type) {
+        case RenderGraphPassType::Raster: {
+          wgpu::RenderPassEncoder rp_encoder = nullptr;
+          beginRenderPass(command_encoder, group, last_use_group, group_index, rp_encoder);
+          for (size_t i = 0; i < group.pass_indices.size(); i++) {
+            const auto &pass = m_passes[group.pass_indices[i]];
+            if (i > 0) {
+              // Merged passes each start from the full attachment, as they would in a render pass of their own.
+              const auto &attachment = pass.info.color_attachment.has_value() ? pass.info.color_attachment->texture : pass.info.depth_stencil_attachment->texture;
+              auto size = textureSize(attachment);
+              rp_encoder.SetViewport(0.0f, 0.0f, static_cast<float>(size.x), static_cast<float>(size.y), 0.0f, 1.0f);
+              rp_encoder.SetScissorRect(0, 0, static_cast<uint32_t>(size.x), static_cast<uint32_t>(size.y));
+            }
+            pass.raster_cb(rp_encoder, *this);
+          }
+          rp_encoder.End();
+          is_command_encoder_empty = false;
+        } break;
+        case RenderGraphPassType::Encoder: {
+          m_passes[group.pass_indices[0]].encoder_cb(command_encoder, *this);
+          is_command_encoder_empty = false;
+        } break;
+        case RenderGraphPassType::External: {
+          flush();
+          m_passes[group.pass_indices[0]].external_cb(*this);
+        } break;
+      }
+      for (size_t i = 0; i < m_textures.size(); i++) {
+        auto &texture = m_textures[i];
+        if (!texture.is_imported && last_use_group[i] == group_index) {
+          m_pool.release(texture.pool_entry);
+          texture.pool_entry = NO_POOL_ENTRY;
+        }
+      }
+    }
+    flush();
+  }
+}
+namespace broccoli {
+  const wgpu::TextureView &RenderGraph::textureView(RenderGraphTexture texture) const {
+    const auto &t = m_textures[texture.value];
+    if (t.is_imported) {
+      return t.imported_texture_view;
+    }
+    CHECK(t.pool_entry != NO_POOL_ENTRY, [&t] () { return "Render graph texture is not live: " + t.name; });
+    return m_pool.textureView(t.pool_entry);
+  }
+  wgpu::Texture RenderGraph::texture(RenderGraphTexture texture) const {
+    const auto &t = m_textures[texture.value];
+    CHECK(!t.is_imported, [&t] () { return "Imported render graph textures have no texture: " + t.name; });
+    CHECK(t.pool_entry != NO_POOL_ENTRY, [&t] () { return "Render graph texture is not live: " + t.name; });
+    return m_pool.texture(t.pool_entry);
+  }
+  glm::ivec2 RenderGraph::textureSize(RenderGraphTexture texture) const {
+    return m_textures[texture.value].info.size;
+  }
+}
+namespace broccoli {
+  std::vector<size_t> RenderGraph::cullPasses() const {
+    // Walking passes backwards from the imported textures, which outlive the frame: a pass is live if it has side
+    // effects or writes a texture still needed by a later live pass. A live pass that clears an attachment hides every
+    // earlier write to it.
+    std::vector<bool> is_needed(m_textures.size(), false);
+    for (size_t i = 0; i < m_textures.size(); i++) {
+      is_needed[i] = m_textures[i].is_imported;
+    }
+    std::vector<size_t> live_pass_indices;
+    for (size_t pass_index = m_passes.size(); pass_index-- > 0;) {
+      const auto &info = m_passes[pass_index].info;
+      bool is_live = info.has_side_effects || std::any_of(
+        info.writes.begin(), info.writes.end(),
+        [&is_needed] (RenderGraphTexture texture) { return is_needed[texture.value]; }
+      );
+      if (!is_live) {
+        continue;
+      }
+      live_pass_indices.push_back(pass_index);
+      if (info.color_attachment.has_value() && info.color_attachment->load_op == wgpu::LoadOp::Clear) {
+        auto texture = info.color_attachment->texture;
+        is_needed[texture.value] = m_textures[texture.value].is_imported;
+      }
+      if (info.depth_stencil_attachment.has_value() && info.depth_stencil_attachment->load_op == wgpu::LoadOp::Clear) {
+        auto texture = info.depth_stencil_attachment->texture;
+        is_needed[texture.value] = m_textures[texture.value].is_imported;
+      }
+      for (auto texture: info.reads) {
+        is_needed[texture.value] = true;
+      }
+    }
+    std::reverse(live_pass_indices.begin(), live_pass_indices.end());
+    return live_pass_indices;
+  }
+  std::vector<RenderGraph::PassGroup> RenderGraph::mergePasses(const std::vector<size_t> &live_pass_indices) const {
+    std::vector<PassGroup> groups;
+    for (auto pass_index: live_pass_indices) {
+      const auto &pass = m_passes[pass_index];
+      bool is_mergeable = (
+        !groups.empty() &&
+        groups.back().type == RenderGraphPassType::Raster &&
+        pass.type == RenderGraphPassType::Raster &&
+        canMergeRasterPasses(m_passes[groups.back().pass_indices.back()], pass)
+      );
+      if (is_mergeable) {
+        groups.back().pass_indices.push_back(pass_index);
+      } else {
+        groups.push_back({pass.type, {pass_index}});
+      }
+    }
+    return groups;
+  }
+  bool RenderGraph::canMergeRasterPasses(const Pass &prev, const Pass &next) {
+    // The next pass may only continue the previous one's render pass if it renders to exactly the same attachments
+    // and would have loaded them anyway.
+    const auto &prev_color = prev.info.color_attachment;
+    const auto &next_color = next.info.color_attachment;
+    const auto &prev_depth = prev.info.depth_stencil_attachment;
+    const auto &next_depth = next.info.depth_stencil_attachment;
+    if (prev_color.has_value() != next_color.has_value() || prev_depth.has_value() != next_depth.has_value()) {
+      return false;
+    }
+    if (next_color.has_value()) {
+      bool is_same_resolve_target = (
+        prev_color->resolve_target.has_value() == next_color->resolve_target.has_value() &&
+        (!next_color->resolve_target.has_value() || prev_color->resolve_target->value == next_color->resolve_target->value)
+      );
+      if (prev_color->texture.value != next_color->texture.value || !is_same_resolve_target || next_color->load_op != wgpu::LoadOp::Load) {
+        return false;
+      }
+    }
+    if (next_depth.has_value()) {
+      if (prev_depth->texture.value != next_depth->texture.value || next_depth->load_op != wgpu::LoadOp::Load) {
+        return false;
+      }
+    }
+    return true;
+  }
+  void RenderGraph::beginRenderPass(wgpu::CommandEncoder &encoder, const PassGroup &group, const std::vector<uint32_t> &last_use_group, size_t group_index, wgpu::RenderPassEncoder &out) const {
+    // Load operations come from the group's first pass. Transient attachments that nothing reads after this group are
+    // discarded rather than stored, which saves their bandwidth, e.g. a multisampled target once it is resolved.
+    const auto &first = m_passes[group.pass_indices.front()].info;
+    auto store_op = [this, &last_use_group, group_index] (RenderGraphTexture texture) {
+      bool is_read_later = m_textures[texture.value].is_imported || last_use_group[texture.value] > group_index;
+      return is_read_later ? wgpu::StoreOp::Store : wgpu::StoreOp::Discard;
+    };
+    wgpu::RenderPassColorAttachment rp_color_attachment = {};
+    wgpu::RenderPassDepthStencilAttachment rp_depth_attachment = {};
+    if (first.color_attachment.has_value()) {
+      const auto &attachment = first.color_attachment.value();
+      rp_color_attachment = {
+        .view = textureView(attachment.texture),
+        .resolveTarget = attachment.resolve_target.has_value() ? textureView(attachment.resolve_target.value()) : nullptr,
+        .loadOp = attachment.load_op,
+        .storeOp = store_op(attachment.texture),
+        .clearValue = attachment.clear_value,
+      };
+    }
+    if (first.depth_stencil_attachment.has_value()) {
+      const auto &attachment = first.depth_stencil_attachment.value();
+      rp_depth_attachment = {
+        .view = textureView(attachment.texture),
+        .depthLoadOp = attachment.load_op,
+        .depthStoreOp = store_op(attachment.texture),
+        .depthClearValue = attachment.clear_value,
+      };
+    }
+    wgpu::RenderPassDescriptor rp_descriptor = {
+      .label = first.name.c_str(),
+      .colorAttachmentCount = first.color_attachment.has_value() ? 1u : 0u,
+      .colorAttachments = first.color_attachment.has_value() ? &rp_color_attachment : nullptr,
+      .depthStencilAttachment = first.depth_stencil_attachment.has_value() ? &rp_depth_attachment : nullptr,
+    };
+    out = encoder.BeginRenderPass(&rp_descriptor);
+  }
+}
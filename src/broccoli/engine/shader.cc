@@ -0,0 +1,299 @@
+#include "broccoli/engine/shader.hh"
+
+#include <filesystem>
+#include <algorithm>
+#include <utility>
+
+//
+// Helpers:
+//
+
+namespace broccoli {
+  static bool isIdentifierStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+  }
+  static bool isIdentifierContinue(char c) {
+    return isIdentifierStart(c) || (c >= '0' && c <= '9');
+  }
+  static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+  }
+  static std::string_view trim(std::string_view s) {
+    auto begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos) {
+      return {};
+    }
+    auto end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+  }
+  static std::string_view takeIdentifier(std::string_view &s) {
+    size_t length = 0;
+    while (length < s.size() && isIdentifierContinue(s[length])) {
+      length++;
+    }
+    auto identifier = s.substr(0, length);
+    s.remove_prefix(length);
+    return identifier;
+  }
+}
+
+//
+// Condition expressions:
+//
+
+namespace broccoli {
+  /// A recursive descent parser over '#if' expressions, evaluating as it parses.
+  class ShaderConditionParser {
+  private:
+    const ShaderPreprocessor::Defines &m_defines;
+    std::string_view m_rest;
+    int32_t m_depth;
+  public:
+    ShaderConditionParser(const ShaderPreprocessor::Defines &defines, std::string_view expression, int32_t depth)
+    : m_defines(defines),
+      m_rest(expression),
+      m_depth(depth)
+    {}
+  public:
+    int64_t parseAll() {
+      int64_t value = parseOr();
+      skipSpace();
+      CHECK(m_rest.empty(), [this] () { return "Unexpected trailing text in shader '#if': " + std::string(m_rest); });
+      return value;
+    }
+  private:
+    void skipSpace() {
+      m_rest = m_rest.substr(std::min(m_rest.size(), m_rest.find_first_not_of(" \t\r")));
+    }
+    bool accept(std::string_view op) {
+      skipSpace();
+      if (m_rest.starts_with(op)) {
+        m_rest.remove_prefix(op.size());
+        return true;
+      }
+      return false;
+    }
+    int64_t parseOr() {
+      int64_t value = parseAnd();
+      while (accept("||")) {
+        int64_t rhs = parseAnd();
+        value = value || rhs;
+      }
+      return value;
+    }
+    int64_t parseAnd() {
+      int64_t value = parseComparison();
+      while (accept("&&")) {
+        int64_t rhs = parseComparison();
+        value = value && rhs;
+      }
+      return value;
+    }
+    int64_t parseComparison() {
+      int64_t value = parseSum();
+      for (;;) {
+        if (accept("==")) { value = value == parseSum(); }
+        else if (accept("!=")) { value = value != parseSum(); }
+        else if (accept("<=")) { value = value <= parseSum(); }
+        else if (accept(">=")) { value = value >= parseSum(); }
+        else if (accept("<")) { value = value < parseSum(); }
+        else if (accept(">")) { value = value > parseSum(); }
+        else { return value; }
+      }
+    }
+    int64_t parseSum() {
+      int64_t value = parseProduct();
+      for (;;) {
+        if (accept("+")) { value += parseProduct(); }
+        else if (accept("-")) { value -= parseProduct(); }
+        else { return value; }
+      }
+    }
+    int64_t parseProduct() {
+      int64_t value = parseUnary();
+      for (;;) {
+        if (accept("*")) {
+          value *= parseUnary();
+        } else if (accept("/")) {
+          int64_t rhs = parseUnary();
+          CHECK(rhs != 0, "Division by zero in shader '#if'");
+          value /= rhs;
+        } else if (accept("%")) {
+          int64_t rhs = parseUnary();
+          CHECK(rhs != 0, "Division by zero in shader '#if'");
+          value %= rhs;
+        } else {
+          return value;
+        }
+      }
+    }
+    int64_t parseUnary() {
+      if (accept("!")) {
+        return !parseUnary();
+      }
+      if (accept("-")) {
+        return -parseUnary();
+      }
+      return parsePrimary();
+    }
+    int64_t parsePrimary() {
+      skipSpace();
+      CHECK(!m_rest.empty(), "Unexpected end of shader '#if' expression");
+      if (accept("(")) {
+        int64_t value = parseOr();
+        CHECK(accept(")"), "Expected ')' in shader '#if' expression");
+        return value;
+      }
+      if (isDigit(m_rest[0])) {
+        size_t length = 0;
+        int64_t value = std::stoll(std::string(m_rest), &length, 0);
+        m_rest.remove_prefix(length);
+        // WGSL literal suffixes carry no meaning here.
+        if (!m_rest.empty() && (m_rest[0] == 'u' || m_rest[0] == 'i')) {
+          m_rest.remove_prefix(1);
+        }
+        return value;
+      }
+      CHECK(isIdentifierStart(m_rest[0]), [this] () { return "Unexpected text in shader '#if': " + std::string(m_rest); });
+      auto identifier = takeIdentifier(m_rest);
+      if (identifier == "defined") {
+        bool is_parenthesized = accept("(");
+        skipSpace();
+        auto name = takeIdentifier(m_rest);
+        CHECK(!is_parenthesized || accept(")"), "Expected ')' after 'defined(' in shader '#if'");
+        return m_defines.contains(std::string(name));
+      }
+
+      // Macros evaluate as expressions in their own right, and undefined names as 0 (as in C).
+      auto it = m_defines.find(std::string(identifier));
+      if (it == m_defines.end()) {
+        return 0;
+      }
+      CHECK(m_depth < 64, "Recursive macro in shader '#if'");
+      return ShaderConditionParser{m_defines, it->second, m_depth + 1}.parseAll();
+    }
+  };
+}
+
+//
+// ShaderPreprocessor:
+//
+
+namespace broccoli {
+  std::string ShaderPreprocessor::preprocess(const char *filepath, const std::string &text, const Defines &defines) const {
+    State state = {.defines = defines, .included_paths = {}, .conditions = {}};
+    state.included_paths.insert(std::filesystem::path(filepath).lexically_normal().string());
+    std::string output;
+    output.reserve(text.size() + text.size() / 2);
+    expand(state, filepath, text, output);
+    CHECK(state.conditions.empty(), [filepath] () { return std::string("Unterminated '#if' in shader: ") + filepath; });
+    return output;
+  }
+}
+namespace broccoli {
+  void ShaderPreprocessor::expand(State &state, const std::string &filepath, std::string_view text, std::string &output) {
+    size_t line_begin = 0;
+    while (line_begin < text.size()) {
+      size_t line_end = std::min(text.size(), text.find('\n', line_begin));
+      auto line = text.substr(line_begin, line_end - line_begin);
+      auto directive_begin = line.find_first_not_of(" \t");
+      if (directive_begin != std::string_view::npos && line[directive_begin] == '#') {
+        expandDirective(state, filepath, line.substr(directive_begin + 1), output);
+      } else if (isActive(state)) {
+        expandLine(state, line, output);
+      }
+      output += '\n';
+      line_begin = line_end + 1;
+    }
+  }
+  void ShaderPreprocessor::expandDirective(State &state, const std::string &filepath, std::string_view directive, std::string &output) {
+    directive = trim(directive);
+    auto name = takeIdentifier(directive);
+    auto argument = trim(directive);
+    bool is_parent_active = isActive(state);
+
+    // Conditionals are tracked even within inactive blocks, so that nesting stays balanced:
+    if (name == "if" || name == "ifdef" || name == "ifndef") {
+      bool is_active = false;
+      if (is_parent_active) {
+        if (name == "if") {
+          is_active = evaluateCondition(state, argument) != 0;
+        } else {
+          is_active = state.defines.contains(std::string(argument)) == (name == "ifdef");
+        }
+      }
+      state.conditions.push_back({is_active, is_active, is_parent_active});
+      return;
+    }
+    if (name == "elif" || name == "else" || name == "endif") {
+      CHECK(!state.conditions.empty(), [&] () { return "Unmatched '#" + std::string(name) + "' in shader: " + filepath; });
+      auto &condition = state.conditions.back();
+      if (name == "endif") {
+        state.conditions.pop_back();
+      } else {
+        bool is_candidate = condition.is_parent_active && !condition.was_taken;
+        condition.is_active = is_candidate && (name == "else" || evaluateCondition(state, argument) != 0);
+        condition.was_taken = condition.was_taken || condition.is_active;
+      }
+      return;
+    }
+    if (!is_parent_active) {
+      return;
+    }
+
+    // Other directives only apply in active blocks:
+    if (name == "define") {
+      auto macro_name = takeIdentifier(argument);
+      CHECK(!macro_name.empty(), [&] () { return "Expected a macro name after '#define' in shader: " + filepath; });
+      std::string value;
+      expandLine(state, trim(argument), value);
+      state.defines.insert_or_assign(std::string(macro_name), std::move(value));
+    } else if (name == "undef") {
+      state.defines.erase(std::string(argument));
+    } else if (name == "include") {
+      CHECK(
+        argument.size() >= 2 && argument.front() == '"' && argument.back() == '"',
+        [&] () { return "Expected a quoted path after '#include' in shader: " + filepath; }
+      );
+      auto include_path = std::filesystem::path(filepath).parent_path() / argument.substr(1, argument.size() - 2);
+      auto include_filepath = include_path.lexically_normal().string();
+      if (state.included_paths.insert(include_filepath).second) {
+        std::string include_text = readTextFile(include_filepath.c_str());
+        expand(state, include_filepath, include_text, output);
+      }
+    } else {
+      PANIC("Unknown shader directive '#{}' in shader: {}", name, filepath);
+    }
+  }
+  void ShaderPreprocessor::expandLine(const State &state, std::string_view line, std::string &output) {
+    // Numbers are copied whole, so that e.g. the 'xFF' in '0xFF' is never mistaken for an identifier.
+    size_t i = 0;
+    while (i < line.size()) {
+      char c = line[i];
+      if (isIdentifierStart(c)) {
+        size_t begin = i;
+        while (i < line.size() && isIdentifierContinue(line[i])) {
+          i++;
+        }
+        auto identifier = line.substr(begin, i - begin);
+        auto it = state.defines.find(std::string(identifier));
+        output += it != state.defines.end() ? std::string_view{it->second} : identifier;
+      } else if (isDigit(c)) {
+        size_t begin = i;
+        while (i < line.size() && (isIdentifierContinue(line[i]) || line[i] == '.')) {
+          i++;
+        }
+        output += line.substr(begin, i - begin);
+      } else {
+        output += c;
+        i++;
+      }
+    }
+  }
+  int64_t ShaderPreprocessor::evaluateCondition(const State &state, std::string_view expression) {
+    return ShaderConditionParser{state.defines, expression, 0}.parseAll();
+  }
+  bool ShaderPreprocessor::isActive(const State &state) {
+    return state.conditions.empty() || state.conditions.back().is_active;
+  }
+}
@@ -0,0 +1,462 @@
+#include "broccoli/engine/software_occlusion.hh"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BROCCOLI_SOFTWARE_OCCLUSION_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define BROCCOLI_SOFTWARE_OCCLUSION_NEON 1
+#endif
+
+//
+// Constants:
+//
+
+namespace broccoli {
+  /// Occluder depths are pulled back by this fraction, so that rounding in a triangle's depth plane never places it in
+  /// front of the surface it was drawn from.
+  static constexpr float SOFTWARE_OCCLUSION_DEPTH_BIAS = 1.0f / 4096.0f;
+}
+
+//
+// SIMD:
+//
+
+namespace broccoli {
+  /// 4 lanes of floats, on SSE2 or NEON where available and in scalar code everywhere else: pixels are tested against
+  /// a triangle's edges 4 at a time.
+  struct Float4 {
+#if BROCCOLI_SOFTWARE_OCCLUSION_SSE2
+    __m128 v;
+    static Float4 broadcast(float x) { return {_mm_set1_ps(x)}; }
+    static Float4 make(float x0, float x1, float x2, float x3) { return {_mm_setr_ps(x0, x1, x2, x3)}; }
+    friend Float4 operator+(Float4 lt, Float4 rt) { return {_mm_add_ps(lt.v, rt.v)}; }
+    friend Float4 operator*(Float4 lt, Float4 rt) { return {_mm_mul_ps(lt.v, rt.v)}; }
+    /// The bits of the lanes where every one of 'e0', 'e1' and 'e2' is non-negative.
+    static uint32_t allNonNegativeMask(Float4 e0, Float4 e1, Float4 e2) {
+      auto zero = _mm_setzero_ps();
+      auto inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0.v, zero), _mm_cmpge_ps(e1.v, zero)), _mm_cmpge_ps(e2.v, zero));
+      return static_cast<uint32_t>(_mm_movemask_ps(inside));
+    }
+#elif BROCCOLI_SOFTWARE_OCCLUSION_NEON
+    float32x4_t v;
+    static Float4 broadcast(float x) { return {vdupq_n_f32(x)}; }
+    static Float4 make(float x0, float x1, float x2, float x3) { float xs[4] = {x0, x1, x2, x3}; return {vld1q_f32(xs)}; }
+    friend Float4 operator+(Float4 lt, Float4 rt) { return {vaddq_f32(lt.v, rt.v)}; }
+    friend Float4 operator*(Float4 lt, Float4 rt) { return {vmulq_f32(lt.v, rt.v)}; }
+    static uint32_t allNonNegativeMask(Float4 e0, Float4 e1, Float4 e2) {
+      auto zero = vdupq_n_f32(0.0f);
+      auto inside = vandq_u32(vandq_u32(vcgeq_f32(e0.v, zero), vcgeq_f32(e1.v, zero)), vcgeq_f32(e2.v, zero));
+      const uint32_t lane_bits[4] = {1, 2, 4, 8};
+      auto bits = vandq_u32(inside, vld1q_u32(lane_bits));
+#if defined(__aarch64__) || defined(_M_ARM64)
+      return vaddvq_u32(bits);
+#else
+      // 32-bit ARM has no across-vector add, so pairwise-add the halves instead:
+      auto sums = vpadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+      return vget_lane_u32(vpadd_u32(sums, sums), 0);
+#endif
+    }
+#else
+    float v[4];
+    static Float4 broadcast(float x) { return {{x, x, x, x}}; }
+    static Float4 make(float x0, float x1, float x2, float x3) { return {{x0, x1, x2, x3}}; }
+    friend Float4 operator+(Float4 lt, Float4 rt) { return {{lt.v[0] + rt.v[0], lt.v[1] + rt.v[1], lt.v[2] + rt.v[2], lt.v[3] + rt.v[3]}}; }
+    friend Float4 operator*(Float4 lt, Float4 rt) { return {{lt.v[0] * rt.v[0], lt.v[1] * rt.v[1], lt.v[2] * rt.v[2], lt.v[3] * rt.v[3]}}; }
+    static uint32_t allNonNegativeMask(Float4 e0, Float4 e1, Float4 e2) {
+      uint32_t mask = 0;
+      for (uint32_t i = 0; i < 4; i++) {
+        mask |= static_cast<uint32_t>(e0.v[i] >= 0.0f && e1.v[i] >= 0.0f && e2.v[i] >= 0.0f) << i;
+      }
+      return mask;
+    }
+#endif
+  };
+}
+
+//
+// SoftwareOcclusionWorkerPool:
+//
+
+namespace broccoli {
+  SoftwareOcclusionWorkerPool::SoftwareOcclusionWorkerPool(uint32_t thread_count)
+  : m_workers(),
+    m_mutex(),
+    m_task_cv(),
+    m_done_cv(),
+    m_task(nullptr),
+    m_task_count(0),
+    m_next_task_index(0),
+    m_done_task_count(0),
+    m_generation(0),
+    m_is_stopping(false)
+  {
+    CHECK(thread_count > 0, "Expected at least one software occlusion thread.");
+    m_workers.reserve(thread_count - 1);
+    for (uint32_t i = 1; i < thread_count; i++) {
+      m_workers.emplace_back([this] () { workerMain(); });
+    }
+  }
+  SoftwareOcclusionWorkerPool::~SoftwareOcclusionWorkerPool() {
+    {
+      std::lock_guard lock{m_mutex};
+      m_is_stopping = true;
+    }
+    m_task_cv.notify_all();
+    for (auto &worker: m_workers) {
+      worker.join();
+    }
+  }
+  uint32_t SoftwareOcclusionWorkerPool::threadCount() const {
+    return static_cast<uint32_t>(m_workers.size() + 1);
+  }
+  void SoftwareOcclusionWorkerPool::parallelFor(uint32_t task_count, const std::function<void(uint32_t)> &task) {
+    if (m_workers.empty() || task_count <= 1) {
+      for (uint32_t i = 0; i < task_count; i++) {
+        task(i);
+      }
+      return;
+    }
+    std::unique_lock lock{m_mutex};
+    m_task = &task;
+    m_task_count = task_count;
+    m_next_task_index = 0;
+    m_done_task_count = 0;
+    m_generation++;
+    m_task_cv.notify_all();
+    runTasks(lock);
+    m_done_cv.wait(lock, [this] () { return m_done_task_count == m_task_count; });
+    m_task = nullptr;
+    m_task_count = 0;
+  }
+  void SoftwareOcclusionWorkerPool::workerMain() {
+    uint64_t generation = 0;
+    std::unique_lock lock{m_mutex};
+    for (;;) {
+      m_task_cv.wait(lock, [this, generation] () { return m_is_stopping || m_generation != generation; });
+      if (m_is_stopping) {
+        return;
+      }
+      generation = m_generation;
+      runTasks(lock);
+    }
+  }
+  void SoftwareOcclusionWorkerPool::runTasks(std::unique_lock<std::mutex> &lock) {
+    while (m_next_task_index < m_task_count) {
+      uint32_t task_index = m_next_task_index++;
+      const auto &task = *m_task;
+      lock.unlock();
+      task(task_index);
+      lock.lock();
+      if (++m_done_task_count == m_task_count) {
+        m_done_cv.notify_all();
+      }
+    }
+  }
+}
+
+//
+// SoftwareOcclusionCuller:
+//
+
+namespace broccoli {
+  SoftwareOcclusionCuller::SoftwareOcclusionCuller(uint32_t thread_count)
+  : m_workers(thread_count),
+    m_size(0),
+    m_tile_count(0),
+    m_tiles(),
+    m_thread_triangles(thread_count),
+    m_camera(),
+    m_stats()
+  {}
+  void SoftwareOcclusionCuller::beginFrame(const SoftwareOcclusionCamera &camera, glm::ivec2 size) {
+    CHECK(size.x > 0 && size.y > 0, "Expected a non-empty software occlusion buffer.");
+    CHECK(size.x % TILE_WIDTH == 0 && size.y % TILE_HEIGHT == 0, "Expected software occlusion buffer size to be a multiple of the tile size.");
+    m_camera = camera;
+    m_size = size;
+    m_tile_count = size / glm::ivec2{TILE_WIDTH, TILE_HEIGHT};
+    m_tiles.assign(m_tile_count.x * m_tile_count.y, {
+      .coverage_mask = 0,
+      .reference_depth = 0.0f,
+      .working_depth = std::numeric_limits<float>::max(),
+    });
+    m_stats = {};
+  }
+  void SoftwareOcclusionCuller::rasterizeOccluders(std::span<const SoftwareOccluderInstance> occluders) {
+    for (const auto &occluder: occluders) {
+      m_stats.occluder_triangle_count += occluder.geometry->indices.size() / 3;
+    }
+    if (m_stats.occluder_triangle_count == 0) {
+      return;
+    }
+
+    // Setting up triangles, split evenly across threads:
+    const uint32_t thread_count = m_workers.threadCount();
+    m_workers.parallelFor(thread_count, [this, occluders, thread_count] (uint32_t task_index) {
+      setupTriangles(occluders, task_index, thread_count);
+    });
+    for (const auto &triangles: m_thread_triangles) {
+      m_stats.rasterized_triangle_count += triangles.size();
+    }
+
+    // Rasterizing triangles in submission order, split into horizontal strips of tiles so that each tile is only ever
+    // written by one thread:
+    const auto strip_count = static_cast<uint32_t>(std::min<int32_t>(m_tile_count.y, 2 * thread_count));
+    m_workers.parallelFor(strip_count, [this, strip_count] (uint32_t strip_index) {
+      const auto tile_row_count = static_cast<uint32_t>(m_tile_count.y);
+      const auto tile_row_min = static_cast<int32_t>(tile_row_count * strip_index / strip_count);
+      const auto tile_row_max = static_cast<int32_t>(tile_row_count * (strip_index + 1) / strip_count) - 1;
+      for (const auto &triangles: m_thread_triangles) {
+        for (const auto &triangle: triangles) {
+          rasterizeTriangle(triangle, tile_row_min, tile_row_max);
+        }
+      }
+    });
+  }
+  bool SoftwareOcclusionCuller::isVisible(glm::vec3 bounds_min, glm::vec3 bounds_max, const glm::mat4x4 &transform) const {
+    // Projecting the bounding box's corners: a box reaching the near plane is always visible, since its projection is
+    // unbounded.
+    const glm::mat4x4 view_transform = m_camera.view_matrix * transform;
+    glm::vec2 ndc_min{std::numeric_limits<float>::max()};
+    glm::vec2 ndc_max{-std::numeric_limits<float>::max()};
+    float nearest_depth = std::numeric_limits<float>::max();
+    for (uint32_t i = 0; i < 8; i++) {
+      glm::vec3 corner = {
+        (i & 1) ? bounds_max.x : bounds_min.x,
+        (i & 2) ? bounds_max.y : bounds_min.y,
+        (i & 4) ? bounds_max.z : bounds_min.z,
+      };
+      glm::vec4 view_position = view_transform * glm::vec4{corner, 1.0f};
+      float depth = -view_position.z;
+      if (depth <= m_camera.zmin) {
+        return true;
+      }
+      glm::vec2 ndc = glm::vec2{
+        view_position.x * m_camera.cot_half_fovy * m_camera.aspect_inv,
+        view_position.y * m_camera.cot_half_fovy
+      } / depth;
+      ndc_min = glm::min(ndc_min, ndc);
+      ndc_max = glm::max(ndc_max, ndc);
+      nearest_depth = std::min(nearest_depth, depth);
+    }
+
+    // Frustum culling:
+    if (ndc_max.x < -1.0f || ndc_max.y < -1.0f || ndc_min.x > 1.0f || ndc_min.y > 1.0f || nearest_depth > m_camera.zmax) {
+      return false;
+    }
+    if (m_tiles.empty()) {
+      return true;
+    }
+
+    // Occlusion culling: every pixel the box's screen rectangle touches must lie in front of the box's nearest depth.
+    // Pixels covered by a tile's mask lie in front of both of its depths, and the rest only in front of its reference
+    // depth.
+    const glm::vec2 screen_min = glm::vec2{0.5f * ndc_min.x + 0.5f, 0.5f - 0.5f * ndc_max.y} * glm::vec2{m_size};
+    const glm::vec2 screen_max = glm::vec2{0.5f * ndc_max.x + 0.5f, 0.5f - 0.5f * ndc_min.y} * glm::vec2{m_size};
+    const glm::vec2 screen_limit = glm::vec2{m_size - 1};
+    const glm::ivec2 pixel_min = glm::ivec2{glm::floor(glm::clamp(screen_min, glm::vec2{0.0f}, screen_limit))};
+    const glm::ivec2 pixel_max = glm::ivec2{glm::floor(glm::clamp(screen_max, glm::vec2{0.0f}, screen_limit))};
+    const glm::ivec2 tile_min = pixel_min / glm::ivec2{TILE_WIDTH, TILE_HEIGHT};
+    const glm::ivec2 tile_max = pixel_max / glm::ivec2{TILE_WIDTH, TILE_HEIGHT};
+    const float object_depth = 1.0f / nearest_depth;
+    for (int32_t tile_y = tile_min.y; tile_y <= tile_max.y; tile_y++) {
+      int32_t row_min = std::max(pixel_min.y - tile_y * TILE_HEIGHT, 0);
+      int32_t row_max = std::min(pixel_max.y - tile_y * TILE_HEIGHT, TILE_HEIGHT - 1);
+      for (int32_t tile_x = tile_min.x; tile_x <= tile_max.x; tile_x++) {
+        int32_t column_min = std::max(pixel_min.x - tile_x * TILE_WIDTH, 0);
+        int32_t column_max = std::min(pixel_max.x - tile_x * TILE_WIDTH, TILE_WIDTH - 1);
+        uint32_t row_mask = ((2u << column_max) - 1u) & ~((1u << column_min) - 1u);
+        uint32_t rect_mask = 0;
+        for (int32_t row = row_min; row <= row_max; row++) {
+          rect_mask |= row_mask << (row * TILE_WIDTH);
+        }
+        const auto &tile = m_tiles[tile_y * m_tile_count.x + tile_x];
+        bool is_rect_covered = (rect_mask & ~tile.coverage_mask) == 0;
+        float occluder_depth = is_rect_covered ? std::max(tile.reference_depth, tile.working_depth) : tile.reference_depth;
+        if (object_depth >= occluder_depth) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+  size_t SoftwareOcclusionCuller::cullInstances(glm::vec3 bounds_min, glm::vec3 bounds_max, std::vector<glm::mat4x4> &transforms) {
+    // Instances are tested in parallel in fixed-size groups, then compacted in order:
+    constexpr size_t GROUP_SIZE = 256;
+    std::vector<uint8_t> is_visible(transforms.size());
+    const auto group_count = static_cast<uint32_t>((transforms.size() + GROUP_SIZE - 1) / GROUP_SIZE);
+    m_workers.parallelFor(group_count, [&] (uint32_t group_index) {
+      size_t end = std::min(transforms.size(), (group_index + 1) * GROUP_SIZE);
+      for (size_t i = group_index * GROUP_SIZE; i < end; i++) {
+        is_visible[i] = isVisible(bounds_min, bounds_max, transforms[i]);
+      }
+    });
+    size_t visible_count = 0;
+    for (size_t i = 0; i < transforms.size(); i++) {
+      if (is_visible[i]) {
+        transforms[visible_count++] = transforms[i];
+      }
+    }
+    size_t culled_count = transforms.size() - visible_count;
+    transforms.resize(visible_count);
+    m_stats.tested_instance_count += is_visible.size();
+    m_stats.culled_instance_count += culled_count;
+    return culled_count;
+  }
+  glm::ivec2 SoftwareOcclusionCuller::size() const {
+    return m_size;
+  }
+  const SoftwareOcclusionStats &SoftwareOcclusionCuller::stats() const {
+    return m_stats;
+  }
+  void SoftwareOcclusionCuller::setupTriangles(std::span<const SoftwareOccluderInstance> occluders, uint32_t task_index, uint32_t task_count) {
+    auto &triangles = m_thread_triangles[task_index];
+    triangles.clear();
+    const uint64_t triangle_begin = m_stats.occluder_triangle_count * task_index / task_count;
+    const uint64_t triangle_end = m_stats.occluder_triangle_count * (task_index + 1) / task_count;
+    const glm::vec2 size = glm::vec2{m_size};
+    uint64_t occluder_triangle_offset = 0;
+    for (const auto &occluder: occluders) {
+      const auto &indices = occluder.geometry->indices;
+      const auto &positions = occluder.geometry->positions;
+      const uint64_t occluder_triangle_count = indices.size() / 3;
+      const uint64_t begin = std::max(triangle_begin, occluder_triangle_offset);
+      const uint64_t end = std::min(triangle_end, occluder_triangle_offset + occluder_triangle_count);
+      const glm::mat4x4 view_transform = m_camera.view_matrix * occluder.transform;
+      for (uint64_t triangle_index = begin; triangle_index < end; triangle_index++) {
+        // Projecting vertices into pixels: triangles reaching the near plane are skipped rather than clipped, which
+        // only ever leaves the buffer less covered than it could be.
+        std::array<glm::vec2, 3> p;
+        std::array<float, 3> w;
+        bool is_clipped = false;
+        for (uint32_t i = 0; i < 3; i++) {
+          auto position = positions[indices[3 * (triangle_index - occluder_triangle_offset) + i]];
+          glm::vec4 view_position = view_transform * glm::vec4{position, 1.0f};
+          float depth = -view_position.z;
+          if (depth <= m_camera.zmin) {
+            is_clipped = true;
+            break;
+          }
+          glm::vec2 ndc = glm::vec2{
+            view_position.x * m_camera.cot_half_fovy * m_camera.aspect_inv,
+            view_position.y * m_camera.cot_half_fovy
+          } / depth;
+          p[i] = glm::vec2{0.5f * ndc.x + 0.5f, 0.5f - 0.5f * ndc.y} * size;
+          w[i] = 1.0f / depth;
+        }
+        if (is_clipped) {
+          continue;
+        }
+
+        // Finding the tiles whose pixel centers the triangle may cover:
+        glm::vec2 p_min = glm::min(p[0], glm::min(p[1], p[2]));
+        glm::vec2 p_max = glm::max(p[0], glm::max(p[1], p[2]));
+        glm::ivec2 pixel_min = glm::ivec2{glm::ceil(glm::clamp(p_min - 0.5f, glm::vec2{0.0f}, size))};
+        glm::ivec2 pixel_max = glm::ivec2{glm::floor(glm::clamp(p_max - 0.5f, glm::vec2{-1.0f}, size - 1.0f))};
+        if (pixel_min.x > pixel_max.x || pixel_min.y > pixel_max.y) {
+          continue;
+        }
+
+        // Both windings are accepted, since occluders need not be closed: clockwise triangles are flipped.
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+        if (std::abs(area) < 1e-6f) {
+          continue;
+        }
+        if (area < 0.0f) {
+          std::swap(p[1], p[2]);
+          std::swap(w[1], w[2]);
+          area = -area;
+        }
+        Triangle triangle;
+        for (uint32_t i = 0; i < 3; i++) {
+          // The edge opposite vertex 'i', which is zero on that edge and 'area' at vertex 'i':
+          const auto &a = p[(i + 1) % 3];
+          const auto &b = p[(i + 2) % 3];
+          triangle.edges[i] = glm::vec3{-(b.y - a.y), b.x - a.x, (b.y - a.y) * a.x - (b.x - a.x) * a.y};
+        }
+        triangle.depth_plane = (triangle.edges[0] * w[0] + triangle.edges[1] * w[1] + triangle.edges[2] * w[2]) / area;
+        triangle.depth_min = std::min(w[0], std::min(w[1], w[2]));
+        triangle.tile_min = pixel_min / glm::ivec2{TILE_WIDTH, TILE_HEIGHT};
+        triangle.tile_max = pixel_max / glm::ivec2{TILE_WIDTH, TILE_HEIGHT};
+        triangles.push_back(triangle);
+      }
+      occluder_triangle_offset += occluder_triangle_count;
+    }
+  }
+  void SoftwareOcclusionCuller::rasterizeTriangle(const Triangle &triangle, int32_t tile_row_min, int32_t tile_row_max) {
+    const int32_t tile_y_min = std::max(triangle.tile_min.y, tile_row_min);
+    const int32_t tile_y_max = std::min(triangle.tile_max.y, tile_row_max);
+    const Float4 lane_offsets_lo = Float4::make(0.5f, 1.5f, 2.5f, 3.5f);
+    const Float4 lane_offsets_hi = Float4::make(4.5f, 5.5f, 6.5f, 7.5f);
+    for (int32_t tile_y = tile_y_min; tile_y <= tile_y_max; tile_y++) {
+      for (int32_t tile_x = triangle.tile_min.x; tile_x <= triangle.tile_max.x; tile_x++) {
+        // Testing the tile's pixel centers against each edge, 8 pixels per row in 2 sets of 4 lanes, stepping down a
+        // row at a time:
+        const float x0 = static_cast<float>(tile_x * TILE_WIDTH);
+        const float y0 = static_cast<float>(tile_y * TILE_HEIGHT) + 0.5f;
+        std::array<Float4, 3> e_lo;
+        std::array<Float4, 3> e_hi;
+        std::array<Float4, 3> e_step;
+        for (uint32_t i = 0; i < 3; i++) {
+          const auto &edge = triangle.edges[i];
+          Float4 a = Float4::broadcast(edge.x);
+          Float4 row_start = Float4::broadcast(edge.x * x0 + edge.y * y0 + edge.z);
+          e_lo[i] = row_start + a * lane_offsets_lo;
+          e_hi[i] = row_start + a * lane_offsets_hi;
+          e_step[i] = Float4::broadcast(edge.y);
+        }
+        uint32_t coverage_mask = 0;
+        for (int32_t row = 0; row < TILE_HEIGHT; row++) {
+          uint32_t row_mask = (
+            Float4::allNonNegativeMask(e_lo[0], e_lo[1], e_lo[2]) |
+            Float4::allNonNegativeMask(e_hi[0], e_hi[1], e_hi[2]) << 4
+          );
+          coverage_mask |= row_mask << (row * TILE_WIDTH);
+          for (uint32_t i = 0; i < 3; i++) {
+            e_lo[i] = e_lo[i] + e_step[i];
+            e_hi[i] = e_hi[i] + e_step[i];
+          }
+        }
+        if (coverage_mask == 0) {
+          continue;
+        }
+
+        // The triangle's farthest depth over the tile: the depth plane's minimum over the tile's corners, which never
+        // lies beyond the triangle's farthest vertex.
+        const auto &plane = triangle.depth_plane;
+        float depth = (
+          plane.x * x0 + plane.y * (y0 - 0.5f) + plane.z +
+          std::min(0.0f, plane.x * TILE_WIDTH) +
+          std::min(0.0f, plane.y * TILE_HEIGHT)
+        );
+        depth = std::max(depth, triangle.depth_min) * (1.0f - SOFTWARE_OCCLUSION_DEPTH_BIAS);
+        updateTile(m_tiles[tile_y * m_tile_count.x + tile_x], coverage_mask, depth);
+      }
+    }
+  }
+  void SoftwareOcclusionCuller::updateTile(Tile &tile, uint32_t coverage_mask, float depth) {
+    // A triangle behind the reference depth cannot tighten it.
+    if (depth <= tile.reference_depth) {
+      return;
+    }
+    // The working layer is discarded if the triangle lies further in front of it than it lies in front of the
+    // reference layer, since merging them would lose more than starting over from the triangle.
+    const float distance_to_working = depth - tile.working_depth;
+    const float distance_to_reference = tile.working_depth - tile.reference_depth;
+    if (distance_to_working > distance_to_reference) {
+      tile.coverage_mask = 0;
+      tile.working_depth = std::numeric_limits<float>::max();
+    }
+    tile.coverage_mask |= coverage_mask;
+    tile.working_depth = std::min(tile.working_depth, depth);
+    if (tile.coverage_mask == ~0u) {
+      tile.reference_depth = tile.working_depth;
+      tile.coverage_mask = 0;
+      tile.working_depth = std::numeric_limits<float>::max();
+    }
+  }
+}
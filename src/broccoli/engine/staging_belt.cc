@@ -0,0 +1,202 @@
+#include "broccoli/engine/staging_belt.hh"
+
+#include <algorithm>
+#include <utility>
+#include <cstring>
+
+//
+// RenderStagingBelt:
+//
+
+namespace broccoli {
+  static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+}
+namespace broccoli {
+  RenderStagingBelt::RenderStagingBelt(wgpu::Device device)
+  : m_device(std::move(device)),
+    m_open_chunks(),
+    m_in_flight_chunks(),
+    m_free_chunks(),
+    m_frame_index(0),
+    m_stats()
+  {}
+  RenderStagingBelt::~RenderStagingBelt() {
+    // The map callbacks of in-flight chunks point at this belt, so none may run after it is destroyed. This relies on
+    // Dawn firing a pending map's callback (with a failure status) from within 'Unmap', before it returns, rather than 
+    // on a later 'Tick': by the time the loop below is done, every callback has run, and found no chunk left to recycle
+    // since every in-flight chunk was moved out first.
+    auto in_flight_chunks = std::move(m_in_flight_chunks);
+    m_in_flight_chunks.clear();
+    for (auto &chunk: in_flight_chunks) {
+      chunk.buffer.Unmap();
+    }
+  }
+}
+namespace broccoli {
+  void RenderStagingBelt::beginFrame() {
+    m_frame_index++;
+    m_stats.frame_saved_copy_byte_count = 0;
+    std::erase_if(m_free_chunks, [this] (Chunk &chunk) {
+      bool is_idle = m_frame_index - chunk.last_used_frame > MAX_IDLE_FRAMES;
+      if (is_idle) {
+        chunk.buffer.Destroy();
+        m_stats.chunk_count--;
+        m_stats.chunk_byte_count -= chunk.size;
+      }
+      return is_idle;
+    });
+  }
+  void RenderStagingBelt::writeBuffer(wgpu::CommandEncoder &encoder, const wgpu::Buffer &buffer, uint64_t offset, const void *data, size_t size) {
+    if (size == 0) {
+      return;
+    }
+    CHECK(offset % 4 == 0 && size % 4 == 0, "Staged buffer writes must be aligned to 4 bytes.");
+    auto allocation = allocate(encoder, size, 4);
+    memcpy(allocation.data, data, size);
+    encoder.CopyBufferToBuffer(allocation.buffer, allocation.offset, buffer, offset, size);
+    m_stats.frame_saved_copy_byte_count += size;
+    m_stats.saved_copy_byte_count += size;
+    m_stats.upload_count++;
+  }
+  void RenderStagingBelt::writeTexture(wgpu::CommandEncoder &encoder, const wgpu::ImageCopyTexture &destination, const void *data, const wgpu::TextureDataLayout &data_layout, const wgpu::Extent3D &write_size, uint32_t texel_size) {
+    CHECK(write_size.depthOrArrayLayers == 1, "Staged texture writes must be 2D.");
+    if (write_size.width == 0 || write_size.height == 0) {
+      return;
+    }
+
+    // Buffer-to-texture copies need rows aligned to 256 bytes, so rows are repacked as they are staged:
+    uint64_t row_size = static_cast<uint64_t>(write_size.width) * texel_size;
+    uint64_t staged_bytes_per_row = alignUp(row_size, 256);
+    auto allocation = allocate(encoder, staged_bytes_per_row * write_size.height, 256);
+    auto src = reinterpret_cast<const uint8_t*>(data) + data_layout.offset;
+    for (uint32_t y = 0; y < write_size.height; y++) {
+      memcpy(allocation.data + y * staged_bytes_per_row, src + y * data_layout.bytesPerRow, row_size);
+    }
+    wgpu::ImageCopyBuffer source = {
+      .layout = wgpu::TextureDataLayout {
+        .offset = allocation.offset,
+        .bytesPerRow = static_cast<uint32_t>(staged_bytes_per_row),
+        .rowsPerImage = write_size.height,
+      },
+      .buffer = allocation.buffer,
+    };
+    encoder.CopyBufferToTexture(&source, &destination, &write_size);
+    m_stats.frame_saved_copy_byte_count += row_size * write_size.height;
+    m_stats.saved_copy_byte_count += row_size * write_size.height;
+    m_stats.upload_count++;
+  }
+  void RenderStagingBelt::submit(wgpu::CommandEncoder &encoder) {
+    // Only the chunks written through this encoder are unmapped: chunks open for other encoders stay mapped, since
+    // they are still being written.
+    std::vector<Chunk> submitted_chunks;
+    std::erase_if(m_open_chunks, [&encoder, &submitted_chunks] (Chunk &chunk) {
+      bool is_submitted = chunk.encoder == encoder.Get();
+      if (is_submitted) {
+        chunk.buffer.Unmap();
+        submitted_chunks.push_back(std::move(chunk));
+      }
+      return is_submitted;
+    });
+    wgpu::CommandBuffer command_buffer = encoder.Finish();
+    m_device.GetQueue().Submit(1, &command_buffer);
+
+    // Mapping only completes once the queue is done with every command submitted before it, including the copies:
+    for (auto &chunk: submitted_chunks) {
+      recall(std::move(chunk));
+    }
+  }
+}
+namespace broccoli {
+  const RenderStagingBeltStats &RenderStagingBelt::stats() const {
+    return m_stats;
+  }
+}
+namespace broccoli {
+  RenderStagingBelt::Allocation RenderStagingBelt::allocate(wgpu::CommandEncoder &encoder, uint64_t size, uint64_t alignment) {
+    auto fits = [size, alignment] (const Chunk &chunk) {
+      return alignUp(chunk.offset, alignment) + size <= chunk.size;
+    };
+    auto it = std::find_if(m_open_chunks.begin(), m_open_chunks.end(), [&encoder, &fits] (const Chunk &chunk) {
+      return chunk.encoder == encoder.Get() && fits(chunk);
+    });
+    if (it == m_open_chunks.end()) {
+      // Opening the smallest free chunk that fits, so that small uploads leave large chunks for large ones:
+      auto free_it = m_free_chunks.end();
+      for (auto candidate_it = m_free_chunks.begin(); candidate_it != m_free_chunks.end(); candidate_it++) {
+        if (fits(*candidate_it) && (free_it == m_free_chunks.end() || candidate_it->size < free_it->size)) {
+          free_it = candidate_it;
+        }
+      }
+      if (free_it != m_free_chunks.end()) {
+        m_open_chunks.push_back(std::move(*free_it));
+        m_free_chunks.erase(free_it);
+      } else {
+        m_open_chunks.push_back(createChunk(std::max(CHUNK_SIZE, alignUp(size, CHUNK_SIZE))));
+      }
+      it = m_open_chunks.end() - 1;
+      it->encoder = encoder.Get();
+    }
+    auto &chunk = *it;
+    uint64_t offset = alignUp(chunk.offset, alignment);
+    chunk.offset = offset + size;
+    chunk.last_used_frame = m_frame_index;
+    return {chunk.buffer, offset, chunk.data + offset};
+  }
+  RenderStagingBelt::Chunk RenderStagingBelt::createChunk(uint64_t size) {
+    wgpu::BufferDescriptor buffer_descriptor = {
+      .label = "Broccoli.Render.StagingBelt.Chunk",
+      .usage = wgpu::BufferUsage::MapWrite | wgpu::BufferUsage::CopySrc,
+      .size = size,
+      .mappedAtCreation = true,
+    };
+    wgpu::Buffer buffer = m_device.CreateBuffer(&buffer_descriptor);
+    auto data = reinterpret_cast<uint8_t*>(buffer.GetMappedRange(0, size));
+    CHECK(data != nullptr, "Failed to map a new staging belt chunk.");
+    m_stats.chunk_count++;
+    m_stats.chunk_byte_count += size;
+    return {buffer, size, 0, data, m_frame_index, nullptr};
+  }
+  void RenderStagingBelt::recall(Chunk chunk) {
+    struct MapUserData {
+      RenderStagingBelt *self;
+      wgpu::Buffer buffer;
+    };
+    chunk.offset = 0;
+    chunk.data = nullptr;
+    chunk.encoder = nullptr;
+    wgpu::Buffer buffer = chunk.buffer;
+    uint64_t size = chunk.size;
+    m_in_flight_chunks.push_back(std::move(chunk));
+    buffer.MapAsync(
+      wgpu::MapMode::Write,
+      0,
+      size,
+      [] (WGPUBufferMapAsyncStatus status, void *userdata) {
+        MapUserData *data = reinterpret_cast<MapUserData*>(userdata);
+        auto self = data->self;
+        auto buffer = std::move(data->buffer);
+        delete data;
+        auto &in_flight_chunks = self->m_in_flight_chunks;
+        auto it = std::find_if(in_flight_chunks.begin(), in_flight_chunks.end(), [&buffer] (const Chunk &chunk) {
+          return chunk.buffer.Get() == buffer.Get();
+        });
+        if (it == in_flight_chunks.end()) {
+          return;
+        }
+        Chunk chunk = std::move(*it);
+        in_flight_chunks.erase(it);
+        if (status != WGPUBufferMapAsyncStatus_Success) {
+          // The chunk is dropped, e.g. when the device is lost.
+          self->m_stats.chunk_count--;
+          self->m_stats.chunk_byte_count -= chunk.size;
+          return;
+        }
+        chunk.data = reinterpret_cast<uint8_t*>(chunk.buffer.GetMappedRange(0, chunk.size));
+        self->m_free_chunks.push_back(std::move(chunk));
+      },
+      new MapUserData{this, buffer}
+    );
+  }
+}
@@ -0,0 +1,81 @@
+#include "broccoli/engine/timeline.hh"
+
+#include <algorithm>
+#include <map>
+
+//
+// StartupTimeline:
+//
+
+namespace broccoli {
+  StartupTimeline::StartupTimeline()
+  : m_origin(Clock::now()),
+    m_main_thread(std::this_thread::get_id()),
+    m_mutex(),
+    m_phases()
+  {}
+}
+namespace broccoli {
+  StartupTimeline::Scope StartupTimeline::scope(std::string name) {
+    return Scope{this, std::move(name)};
+  }
+  void StartupTimeline::record(std::string name, Clock::time_point begin, Clock::time_point end) {
+    std::lock_guard lock{m_mutex};
+    m_phases.push_back({std::move(name), begin, end, std::this_thread::get_id()});
+  }
+}
+namespace broccoli {
+  StartupTimeline::Clock::time_point StartupTimeline::origin() const {
+    return m_origin;
+  }
+  double StartupTimeline::elapsedMs() const {
+    return toMs(Clock::now());
+  }
+  void StartupTimeline::report(std::ostream &out) const {
+    std::vector<Phase> phases;
+    {
+      std::lock_guard lock{m_mutex};
+      phases = m_phases;
+    }
+    std::stable_sort(phases.begin(), phases.end(), [] (const Phase &lt, const Phase &rt) { return lt.begin < rt.begin; });
+
+    // Threads are numbered in order of their first phase, with the main thread always first:
+    std::map<std::thread::id, size_t> thread_indices = {{m_main_thread, 0}};
+    for (const auto &phase: phases) {
+      thread_indices.insert({phase.thread, thread_indices.size()});
+    }
+    out << "Startup timeline (ms since startup):" << std::endl;
+    for (const auto &phase: phases) {
+      auto thread_index = thread_indices[phase.thread];
+      out
+        << fmt::format(
+          "  {:>9.2f} .. {:>9.2f} ({:>8.2f})  {:<8}  {}",
+          toMs(phase.begin), toMs(phase.end), toMs(phase.end) - toMs(phase.begin),
+          thread_index == 0 ? std::string("main") : fmt::format("worker{}", thread_index),
+          phase.name
+        )
+        << std::endl;
+    }
+    out << fmt::format("  total: {:.2f} ms", elapsedMs()) << std::endl;
+  }
+  double StartupTimeline::toMs(Clock::time_point t) const {
+    return std::chrono::duration<double, std::milli>(t - m_origin).count();
+  }
+}
+
+//
+// StartupTimeline::Scope:
+//
+
+namespace broccoli {
+  StartupTimeline::Scope::Scope(StartupTimeline *timeline, std::string name)
+  : m_timeline(timeline),
+    m_name(std::move(name)),
+    m_begin(Clock::now())
+  {}
+  StartupTimeline::Scope::~Scope() {
+    if (m_timeline != nullptr) {
+      m_timeline->record(std::move(m_name), m_begin, Clock::now());
+    }
+  }
+}
@@ -8,7 +8,12 @@ namespace broccoli {
   : broccoli::Activity(engine),
     m_cube_geometry(buildCubeGeometry(engine)),
     m_cube_material(buildCubeMaterial(engine))
-  {}
+  {
+    // The overlay shows the cascades of the first directional light, so this sample uses cascaded shadow maps.
+    ShadowSettings shadow_settings = engine.renderManager().shadowSettings();
+    shadow_settings.dir_light_technique = ShadowTechnique::CascadedShadowMap;
+    engine.renderManager().setShadowSettings(shadow_settings);
+  }
   Geometry SampleActivity1::buildCubeGeometry(broccoli::Engine &engine) {
     return engine.renderManager().createGeometryFactory().createCuboid(glm::dvec3{1.0});
   }
@@ -18,7 +18,12 @@ namespace broccoli {
     m_floor_material(buildFloorMaterial(engine)),
     m_tree_trunk_material(buildTreeTrunkMaterial(engine)),
     m_tree_leaves_material(buildTreeLeavesMaterial(engine))
-  {}
+  {
+    // The overlay below draws cascades 0-3, which are only rendered with cascaded shadow maps.
+    ShadowSettings shadow_settings = engine.renderManager().shadowSettings();
+    shadow_settings.dir_light_technique = ShadowTechnique::CascadedShadowMap;
+    engine.renderManager().setShadowSettings(shadow_settings);
+  }
   Geometry SampleActivity2::buildFloorGeometry(broccoli::Engine &engine) {
     return engine.renderManager().createGeometryFactory().createCuboid(glm::dvec3{64.0, 1.0, 64.0});
   }